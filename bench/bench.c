@@ -0,0 +1,502 @@
+// Benchmarks the stages of the frontend in isolation. Each stage is run on
+// the output of the previous stages, which is created again for every run
+// without being timed.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/FileContents.h"
+#include "util/mem.h"
+#include "util/timing.h"
+
+#include "frontend/preproc/preproc.h"
+
+#include "frontend/ast/ast_dumper.h"
+#include "frontend/ast/ast_serializer.h"
+
+#include "tokenizer.h"
+
+#include "corpus.h"
+
+typedef struct {
+    const Corpus* corpus;
+    CStr path;
+    const ArchTypeInfo* type_info;
+} BenchCtx;
+
+typedef struct {
+    // Time taken by the stage itself, without the setup
+    double duration_ms;
+    uint32_t num_tokens;
+    size_t num_bytes;
+} StageRun;
+
+/**
+ * @brief Runs a stage once
+ *
+ * @return false if an error occurred, which was already printed
+ */
+typedef bool (*StageFunc)(const BenchCtx* ctx, StageRun* run);
+
+static double get_duration_ms(const struct timespec* start) {
+    const struct timespec end = mycc_current_time();
+    const struct timespec diff = mycc_time_diff(&end, start);
+    return mycc_get_msecs_double(&diff);
+}
+
+static bool run_tokenizer(const BenchCtx* ctx, StageRun* run) {
+    File f = File_open(ctx->path, FILE_READ | FILE_BINARY);
+    if (!File_valid(f)) {
+        File_printf(mycc_stderr,
+                    "Failed to open {Str}\n",
+                    CStr_as_str(ctx->path));
+        return false;
+    }
+    const FileContents contents = FileContents_read(f);
+    if (contents.data == NULL) {
+        return false;
+    }
+    PreprocTokenArr arr = PreprocTokenArr_create_empty();
+    PreprocTokenValList vals = PreprocTokenValList_create();
+    PreprocErr err = PreprocErr_create();
+    // The whole file is tokenized at once, as the tokenizer handles newlines
+    LineInfo info = {
+        .line = StrBuf_null(),
+        .next = {(uint32_t)contents.len, contents.data},
+        .curr_loc = {0, {1, 1}},
+        .is_in_comment = false,
+    };
+
+    const struct timespec start = mycc_current_time();
+    const bool success = tokenize_line(&arr, &vals, &err, &info);
+    run->duration_ms = get_duration_ms(&start);
+
+    run->num_tokens = arr.len;
+    run->num_bytes = contents.len;
+    if (!success) {
+        File_printf(mycc_stderr,
+                    "Failed to tokenize {Str}\n",
+                    CStr_as_str(ctx->path));
+        PreprocErr_free(&err);
+    }
+    PreprocTokenArr_free(&arr);
+    PreprocTokenValList_free(&vals);
+    FileContents_free(&contents);
+    return success;
+}
+
+static bool preprocess(const BenchCtx* ctx, PreprocRes* res) {
+    PreprocErr err = PreprocErr_create();
+    *res = preproc(ctx->path,
+                   NULL,
+                   0,
+                   NULL,
+                   NULL,
+                   ctx->type_info,
+                   &err);
+    if (err.kind != PREPROC_ERR_NONE) {
+        PreprocErr_print(mycc_stderr, &res->file_info, &res->vals, &err);
+        PreprocErr_free(&err);
+        PreprocRes_free_preproc_tokens(res);
+        return false;
+    }
+    return true;
+}
+
+static bool convert(const BenchCtx* ctx, PreprocRes* res, TokenArr* toks) {
+    PreprocErr err = PreprocErr_create();
+    *toks = convert_preproc_tokens(&res->toks,
+                                   &res->vals,
+                                   ctx->type_info,
+                                   &err);
+    if (err.kind != PREPROC_ERR_NONE) {
+        PreprocErr_print(mycc_stderr, &res->file_info, &res->vals, &err);
+        PreprocErr_free(&err);
+        PreprocRes_free_preproc_tokens(res);
+        return false;
+    }
+    return true;
+}
+
+static bool parse(PreprocRes* res, TokenArr* toks, AST* ast) {
+    ParserErrArr errs = ParserErrArr_create();
+    *ast = parse_ast(toks, &errs);
+    if (errs.len != 0) {
+        ParserErrArr_print(mycc_stderr, &res->file_info, &ast->toks, &errs);
+        ParserErrArr_free(&errs);
+        AST_free(ast);
+        PreprocRes_free(res);
+        return false;
+    }
+    return true;
+}
+
+static bool create_ast(const BenchCtx* ctx, PreprocRes* res, AST* ast) {
+    TokenArr toks;
+    return preprocess(ctx, res) && convert(ctx, res, &toks)
+           && parse(res, &toks, ast);
+}
+
+static bool run_preproc(const BenchCtx* ctx, StageRun* run) {
+    const struct timespec start = mycc_current_time();
+    PreprocRes res;
+    const bool success = preprocess(ctx, &res);
+    run->duration_ms = get_duration_ms(&start);
+    if (!success) {
+        return false;
+    }
+    run->num_tokens = res.toks.len;
+    PreprocRes_free_preproc_tokens(&res);
+    return true;
+}
+
+static bool run_convert(const BenchCtx* ctx, StageRun* run) {
+    PreprocRes res;
+    if (!preprocess(ctx, &res)) {
+        return false;
+    }
+    const struct timespec start = mycc_current_time();
+    TokenArr toks;
+    const bool success = convert(ctx, &res, &toks);
+    run->duration_ms = get_duration_ms(&start);
+    if (!success) {
+        return false;
+    }
+    run->num_tokens = toks.len;
+    TokenArr_free(&toks);
+    PreprocRes_free(&res);
+    return true;
+}
+
+static bool run_parser(const BenchCtx* ctx, StageRun* run) {
+    PreprocRes res;
+    TokenArr toks;
+    if (!preprocess(ctx, &res) || !convert(ctx, &res, &toks)) {
+        return false;
+    }
+    const struct timespec start = mycc_current_time();
+    AST ast;
+    const bool success = parse(&res, &toks, &ast);
+    run->duration_ms = get_duration_ms(&start);
+    if (!success) {
+        return false;
+    }
+    run->num_tokens = ast.toks.len;
+    AST_free(&ast);
+    PreprocRes_free(&res);
+    return true;
+}
+
+// Runs the function that writes the AST to a temporary file
+static bool run_writer(const BenchCtx* ctx,
+                       StageRun* run,
+                       bool (*write_ast)(const AST*,
+                                         const FileInfo*,
+                                         File,
+                                         PreprocErr*)) {
+    PreprocRes res;
+    AST ast;
+    if (!create_ast(ctx, &res, &ast)) {
+        return false;
+    }
+    File out = File_open_tmp();
+    if (!File_valid(out)) {
+        File_put_str("Failed to open temporary file\n", mycc_stderr);
+        AST_free(&ast);
+        PreprocRes_free(&res);
+        return false;
+    }
+    PreprocErr err = PreprocErr_create();
+    const struct timespec start = mycc_current_time();
+    const bool success = write_ast(&ast, &res.file_info, out, &err)
+                         && File_flush(out);
+    run->duration_ms = get_duration_ms(&start);
+    if (!success) {
+        File_printf(mycc_stderr,
+                    "Failed to write ast of {Str}\n",
+                    CStr_as_str(ctx->path));
+        PreprocErr_free(&err);
+    }
+    run->num_tokens = ast.toks.len;
+    File_close(out);
+    AST_free(&ast);
+    PreprocRes_free(&res);
+    return success;
+}
+
+static bool run_serializer(const BenchCtx* ctx, StageRun* run) {
+    return run_writer(ctx, run, serialize_ast);
+}
+
+static bool run_dumper(const BenchCtx* ctx, StageRun* run) {
+    return run_writer(ctx, run, dump_ast);
+}
+
+static bool run_deserializer(const BenchCtx* ctx, StageRun* run) {
+    PreprocRes res;
+    AST ast;
+    if (!create_ast(ctx, &res, &ast)) {
+        return false;
+    }
+    File f = File_open_tmp();
+    PreprocErr err = PreprocErr_create();
+    if (!File_valid(f) || !serialize_ast(&ast, &res.file_info, f, &err)) {
+        File_printf(mycc_stderr,
+                    "Failed to serialize ast of {Str}\n",
+                    CStr_as_str(ctx->path));
+        PreprocErr_free(&err);
+        if (File_valid(f)) {
+            File_close(f);
+        }
+        AST_free(&ast);
+        PreprocRes_free(&res);
+        return false;
+    }
+    AST_free(&ast);
+    PreprocRes_free(&res);
+    File_seek(f, 0, FILE_SEEK_START);
+
+    const struct timespec start = mycc_current_time();
+    DeserializeASTRes deserialized = deserialize_ast(f);
+    run->duration_ms = get_duration_ms(&start);
+
+    File_close(f);
+    if (deserialized.ast.len == 0) {
+        File_printf(mycc_stderr,
+                    "Failed to deserialize ast of {Str}\n",
+                    CStr_as_str(ctx->path));
+        return false;
+    }
+    run->num_tokens = deserialized.ast.toks.len;
+    AST_free(&deserialized.ast);
+    FileInfo_free(&deserialized.file_info);
+    return true;
+}
+
+typedef struct {
+    const char* name;
+    StageFunc func;
+} Stage;
+
+static const Stage g_stages[] = {
+    {"tokenizer", run_tokenizer},
+    {"preproc", run_preproc},
+    {"convert", run_convert},
+    {"parser", run_parser},
+    {"serialize", run_serializer},
+    {"deserialize", run_deserializer},
+    {"dump", run_dumper},
+};
+
+enum {
+    NUM_STAGES = sizeof g_stages / sizeof *g_stages,
+    DEFAULT_RUNS = 10,
+    STAGE_NAME_WIDTH = 12,
+};
+
+static int compare_doubles(const void* lhs, const void* rhs) {
+    const double l = *(const double*)lhs;
+    const double r = *(const double*)rhs;
+    return (l > r) - (l < r);
+}
+
+// The number of tokens and bytes are the same for every run
+static void print_stats(const Stage* stage,
+                        const StageRun* last_run,
+                        double* durations,
+                        uint32_t runs) {
+    qsort(durations, runs, sizeof *durations, compare_doubles);
+    double sum = 0;
+    for (uint32_t i = 0; i != runs; ++i) {
+        sum += durations[i];
+    }
+    const double mean = sum / runs;
+    double sq_diff_sum = 0;
+    for (uint32_t i = 0; i != runs; ++i) {
+        sq_diff_sum += (durations[i] - mean) * (durations[i] - mean);
+    }
+    const double stddev = sqrt(sq_diff_sum / runs);
+    const double median = runs % 2 == 0
+                              ? (durations[runs / 2 - 1] + durations[runs / 2])
+                                    / 2
+                              : durations[runs / 2];
+    // Throughput is based on the median, as it is not skewed by outliers
+    const double secs = median / 1000;
+    const double mb_per_sec = secs == 0 ? 0
+                                        : last_run->num_bytes / 1e6 / secs;
+    const double mtoks_per_sec = secs == 0 ? 0
+                                           : last_run->num_tokens / 1e6 / secs;
+
+    File_printf(mycc_stdout, "    {c_str}", stage->name);
+    for (size_t i = strlen(stage->name); i < STAGE_NAME_WIDTH; ++i) {
+        File_putc(' ', mycc_stdout);
+    }
+    File_printf(mycc_stdout,
+                "min {float.3}ms, median {float.3}ms, mean {float.3}ms, "
+                "stddev {float.3}ms, {float.2} MB/s, {float.2} Mtokens/s\n",
+                durations[0],
+                median,
+                mean,
+                stddev,
+                mb_per_sec,
+                mtoks_per_sec);
+}
+
+static bool run_stage(const Stage* stage,
+                      const BenchCtx* ctx,
+                      double* durations,
+                      uint32_t runs) {
+    StageRun run = {
+        .duration_ms = 0,
+        .num_tokens = 0,
+        .num_bytes = ctx->corpus->bytes,
+    };
+    // Warm up caches and lazily initialized state
+    if (!stage->func(ctx, &run)) {
+        return false;
+    }
+    for (uint32_t i = 0; i != runs; ++i) {
+        if (!stage->func(ctx, &run)) {
+            return false;
+        }
+        durations[i] = run.duration_ms;
+    }
+    print_stats(stage, &run, durations, runs);
+    return true;
+}
+
+static void print_usage(const char* name) {
+    File_printf(mycc_stderr,
+                "Usage: {c_str} [-r <runs>] [-s <stage>] [files...]\n"
+                "Without files, the test files and generated macro and "
+                "include heavy files are used\n"
+                "Stages:",
+                name);
+    for (uint32_t i = 0; i != NUM_STAGES; ++i) {
+        File_printf(mycc_stderr, " {c_str}", g_stages[i].name);
+    }
+    File_putc('\n', mycc_stderr);
+}
+
+static const Stage* find_stage(const char* name) {
+    for (uint32_t i = 0; i != NUM_STAGES; ++i) {
+        if (strcmp(g_stages[i].name, name) == 0) {
+            return &g_stages[i];
+        }
+    }
+    return NULL;
+}
+
+static bool get_default_corpora(Corpus* corpora, uint32_t* num_corpora) {
+    const CStr files[] = {
+        CSTR_LIT(MYCC_BENCH_FILES_DIR "/huge_testfile.c"),
+        CSTR_LIT(MYCC_BENCH_FILES_DIR "/large_testfile.c"),
+    };
+    *num_corpora = 0;
+    for (uint32_t i = 0; i != sizeof files / sizeof *files; ++i) {
+        if (!Corpus_from_file(&corpora[*num_corpora], files[i])) {
+            return false;
+        }
+        ++*num_corpora;
+    }
+    const Str gen_dir = STR_LIT(MYCC_BENCH_CORPUS_DIR);
+    if (!Corpus_gen_macro_heavy(&corpora[*num_corpora], gen_dir)) {
+        return false;
+    }
+    ++*num_corpora;
+    if (!Corpus_gen_include_heavy(&corpora[*num_corpora], gen_dir)) {
+        return false;
+    }
+    ++*num_corpora;
+    return true;
+}
+
+enum {
+    NUM_DEFAULT_CORPORA = 4,
+};
+
+int main(int argc, char** argv) {
+    uint32_t runs = DEFAULT_RUNS;
+    const Stage* only_stage = NULL;
+    int first_file = argc;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            const long val = strtol(argv[i + 1], NULL, 10);
+            if (val <= 0) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            runs = (uint32_t)val;
+            ++i;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            only_stage = find_stage(argv[i + 1]);
+            if (only_stage == NULL) {
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            ++i;
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+
+    const uint32_t num_files = (uint32_t)(argc - first_file);
+    uint32_t num_corpora = 0;
+    Corpus* corpora = mycc_alloc(
+        sizeof *corpora
+        * (num_files == 0 ? NUM_DEFAULT_CORPORA : num_files));
+    bool success = true;
+    if (num_files == 0) {
+        success = get_default_corpora(corpora, &num_corpora);
+    } else {
+        for (; num_corpora != num_files; ++num_corpora) {
+            const char* path = argv[first_file + num_corpora];
+            const CStr path_str = {(uint32_t)strlen(path), path};
+            if (!Corpus_from_file(&corpora[num_corpora], path_str)) {
+                success = false;
+                break;
+            }
+        }
+    }
+
+    const bool is_windows =
+#ifdef _WIN32
+        true;
+#else
+        false;
+#endif
+    const ArchTypeInfo type_info = get_arch_type_info(ARCH_X86_64, is_windows);
+    double* durations = mycc_alloc(sizeof *durations * runs);
+    for (uint32_t i = 0; success && i != num_corpora; ++i) {
+        Corpus* corpus = &corpora[i];
+        File_printf(mycc_stdout,
+                    "{Str} ({size_t} bytes, {u32} runs):\n",
+                    StrBuf_as_str(&corpus->path),
+                    corpus->bytes,
+                    runs);
+        const BenchCtx ctx = {
+            .corpus = corpus,
+            .path = StrBuf_c_str(&corpus->path),
+            .type_info = &type_info,
+        };
+        if (only_stage != NULL) {
+            success = run_stage(only_stage, &ctx, durations, runs);
+            continue;
+        }
+        for (uint32_t j = 0; success && j != NUM_STAGES; ++j) {
+            success = run_stage(&g_stages[j], &ctx, durations, runs);
+        }
+    }
+
+    mycc_free(durations);
+    for (uint32_t i = 0; i != num_corpora; ++i) {
+        Corpus_free(&corpora[i]);
+    }
+    mycc_free(corpora);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
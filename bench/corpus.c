@@ -0,0 +1,151 @@
+#include "corpus.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "util/File.h"
+
+enum {
+    NUM_MACRO_FUNCS = 1000,
+    NUM_HEADERS = 300,
+};
+
+static StrBuf get_path(Str dir, Str filename) {
+    StrBuf res = StrBuf_create(dir);
+    StrBuf_push_back(&res, '/');
+    StrBuf_append(&res, filename);
+    return res;
+}
+
+static File open_for_writing(StrBuf* path) {
+    File res = File_open(StrBuf_c_str(path), FILE_WRITE | FILE_BINARY);
+    if (!File_valid(res)) {
+        File_printf(mycc_stderr,
+                    "Failed to open {Str} for writing\n",
+                    StrBuf_as_str(path));
+    }
+    return res;
+}
+
+// Closes f and adds its size to bytes
+static bool finish_file(File f, size_t* bytes) {
+    const long size = File_tell(f);
+    if (!File_close(f) || size < 0) {
+        return false;
+    }
+    *bytes += (size_t)size;
+    return true;
+}
+
+bool Corpus_from_file(Corpus* res, CStr path) {
+    File f = File_open(path, FILE_READ | FILE_BINARY);
+    if (!File_valid(f)) {
+        File_printf(mycc_stderr, "Failed to open {Str}\n", CStr_as_str(path));
+        return false;
+    }
+    File_seek(f, 0, FILE_SEEK_END);
+    const long size = File_tell(f);
+    File_close(f);
+    if (size < 0) {
+        return false;
+    }
+    res->path = StrBuf_create(CStr_as_str(path));
+    res->bytes = (size_t)size;
+    return true;
+}
+
+bool Corpus_gen_macro_heavy(Corpus* res, Str dir) {
+    res->path = get_path(dir, STR_LIT("macro_heavy.c"));
+    res->bytes = 0;
+    File f = open_for_writing(&res->path);
+    if (!File_valid(f)) {
+        StrBuf_free(&res->path);
+        return false;
+    }
+    File_put_str("#define ADD(a, b) ((a) + (b))\n"
+                 "#define MUL(a, b) ((a) * (b))\n"
+                 "#define SQ(x) MUL(x, x)\n"
+                 "#define POLY(x) ADD(SQ(x), ADD(MUL(3, x), 7))\n"
+                 "#define NESTED(x) POLY(POLY(x))\n"
+                 "#define SELECT(c, a, b) ((c) ? (a) : (b))\n\n",
+                 f);
+    for (uint32_t i = 0; i != NUM_MACRO_FUNCS; ++i) {
+        File_printf(f, "#define CONST_{u32} {u32}\n", i, i);
+        // File_printf() has no way to escape braces
+        File_printf(f, "int f_{u32}(int x) ", i);
+        File_put_str("{\n", f);
+        File_printf(f,
+                    "    return SELECT(x > CONST_{u32}, NESTED(x), "
+                    "POLY(CONST_{u32}));\n",
+                    i,
+                    i);
+        File_put_str("}\n\n", f);
+    }
+    if (!finish_file(f, &res->bytes)) {
+        StrBuf_free(&res->path);
+        return false;
+    }
+    return true;
+}
+
+static bool gen_header(Str dir, uint32_t idx, size_t* bytes) {
+    char filename[64];
+    const int len = snprintf(filename,
+                             sizeof filename,
+                             "header_%" PRIu32 ".h",
+                             idx);
+    StrBuf path = get_path(dir, (Str){(uint32_t)len, filename});
+    File f = open_for_writing(&path);
+    StrBuf_free(&path);
+    if (!File_valid(f)) {
+        return false;
+    }
+    File_printf(f,
+                "#ifndef HEADER_{u32}_H\n#define HEADER_{u32}_H\n\n",
+                idx,
+                idx);
+    if (idx != 0) {
+        File_printf(f, "#include \"header_{u32}.h\"\n\n", idx - 1);
+    }
+    File_printf(f, "struct s_{u32} ", idx);
+    File_put_str("{\n    int a;\n", f);
+    if (idx != 0) {
+        File_printf(f, "    struct s_{u32}* prev;\n", idx - 1);
+    }
+    File_put_str("};\n\n", f);
+    File_printf(f, "int get_{u32}(const struct s_{u32}* s);\n\n", idx, idx);
+    File_put_str("#endif\n", f);
+    return finish_file(f, bytes);
+}
+
+bool Corpus_gen_include_heavy(Corpus* res, Str dir) {
+    res->bytes = 0;
+    for (uint32_t i = 0; i != NUM_HEADERS; ++i) {
+        if (!gen_header(dir, i, &res->bytes)) {
+            return false;
+        }
+    }
+    res->path = get_path(dir, STR_LIT("include_heavy.c"));
+    File f = open_for_writing(&res->path);
+    if (!File_valid(f)) {
+        StrBuf_free(&res->path);
+        return false;
+    }
+    // Every header is included directly and by each of the headers after it
+    for (uint32_t i = 0; i != NUM_HEADERS; ++i) {
+        File_printf(f, "#include \"header_{u32}.h\"\n", NUM_HEADERS - i - 1);
+    }
+    for (uint32_t i = 0; i != NUM_HEADERS; ++i) {
+        File_printf(f, "#include \"header_{u32}.h\"\n", i);
+    }
+    File_put_str("\nint main(void) {\n    return 0;\n}\n", f);
+    if (!finish_file(f, &res->bytes)) {
+        StrBuf_free(&res->path);
+        return false;
+    }
+    return true;
+}
+
+void Corpus_free(const Corpus* c) {
+    StrBuf_free(&c->path);
+}
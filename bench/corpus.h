@@ -0,0 +1,39 @@
+#ifndef MYCC_BENCH_CORPUS_H
+#define MYCC_BENCH_CORPUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "util/StrBuf.h"
+
+typedef struct {
+    // Path of the file that is compiled
+    StrBuf path;
+    // Size of all files of the corpus, including headers
+    size_t bytes;
+} Corpus;
+
+/**
+ * @brief Creates a corpus from an existing file, without counting the size
+ *        of the headers it includes
+ *
+ * @return false if the file could not be opened
+ */
+bool Corpus_from_file(Corpus* res, CStr path);
+
+/**
+ * @brief Writes a file to dir that expands a large number of nested
+ *        object-like and function-like macros
+ */
+bool Corpus_gen_macro_heavy(Corpus* res, Str dir);
+
+/**
+ * @brief Writes a file to dir that includes a large number of headers, which
+ *        include each other and are guarded against multiple inclusion
+ */
+bool Corpus_gen_include_heavy(Corpus* res, Str dir);
+
+void Corpus_free(const Corpus* c);
+
+#endif
+
@@ -4,7 +4,9 @@
 #include <stdbool.h>
 
 #include "util/StrBuf.h"
+#include "util/StringPool.h"
 
+#include "ArchTypeInfo.h"
 #include "StrLit.h"
 #include "Value.h"
 
@@ -29,25 +31,240 @@ typedef struct SourceLoc {
     FileLoc file_loc;
 } SourceLoc;
 
-typedef struct TokenArr {
+// File index of the SourceLoc of a token that came out of a macro expansion.
+// Its line is the index of the expansion in the SourceLocTable of the
+// preprocessor and its index is the index of the token in the expanded macro.
+#define SOURCE_LOC_EXPANSION_FILE_IDX (UINT32_MAX - 1)
+
+// Set in the compact locations of tokens that came out of a macro expansion
+#define SOURCE_LOC_EXPANDED_BIT ((uint32_t)1 << 31)
+
+// Compact location of tokens whose offset does not fit into 31 bits, which
+// maps to line 0 of the first file
+#define SOURCE_LOC_UNKNOWN (SOURCE_LOC_EXPANDED_BIT - 1)
+
+/**
+ * @brief Maps compact 32-bit token locations back to SourceLocs
+ *
+ * Every line that contains tokens gets its own range of offsets, so the
+ * location of a token is the start of the range of its line plus its index.
+ * This only stores file and line once for every line, instead of once for
+ * every token.
+ *
+ * Likewise every macro expansion gets a range of offsets with
+ * SOURCE_LOC_EXPANDED_BIT set, so all tokens of an expansion share the
+ * location of the macro invocation, while the spelling locations of the
+ * tokens are stored once for every macro definition.
+ */
+typedef struct SourceLocTable {
     uint32_t len, cap;
-    uint8_t* kinds;
-    uint32_t* val_indices;
-    SourceLoc* locs;
-    StrBuf* identifiers;
+    // First offset of the range of each line, in ascending order
+    uint32_t* starts;
+    uint32_t* file_indices;
+    uint32_t* lines;
+    // First offset after all ranges
+    uint32_t end;
+
+    uint32_t exps_len, exps_cap;
+    // First offset of the range of each expansion, in ascending order
+    uint32_t* exp_starts;
+    // Location of the macro name of each expansion, which may be in another
+    // expansion if the macro was invoked by one
+    SourceLoc* exp_locs;
+    // Index of the spelling location of the first token of the expanded macro
+    uint32_t* exp_spellings;
+    uint32_t exp_end;
+
+    uint32_t spellings_len, spellings_cap;
+    // Locations of the tokens of all macro definitions
+    SourceLoc* spellings;
+} SourceLocTable;
+
+SourceLocTable SourceLocTable_create(void);
+
+void SourceLocTable_free(const SourceLocTable* t);
+
+SourceLocTable SourceLocTable_copy(const SourceLocTable* t);
+
+/**
+ * @brief Gets the compact location of loc, adding a range for its line if it
+ *        is not the last line that was added
+ *
+ * @return SOURCE_LOC_UNKNOWN if the table has run out of offsets
+ */
+uint32_t SourceLocTable_add(SourceLocTable* t, SourceLoc loc);
+
+/**
+ * @brief Stores the locations of the tokens of a macro definition
+ *
+ * @return The index of the first location, which is used to add expansions
+ *         of the macro
+ */
+uint32_t SourceLocTable_add_macro(SourceLocTable* t,
+                                  const SourceLoc* locs,
+                                  uint32_t len);
+
+/**
+ * @brief Adds an expansion of the macro with the given spellings, invoked at
+ *        loc
+ *
+ * @return The index of the expansion, to be used as line in the SourceLocs of
+ *         the expanded tokens
+ */
+uint32_t SourceLocTable_add_expansion(SourceLocTable* t,
+                                      SourceLoc loc,
+                                      uint32_t spellings_idx,
+                                      uint32_t len);
+
+/**
+ * @brief Gets the location of the token at the given compact location, which
+ *        is the outermost macro invocation for expanded tokens
+ */
+SourceLoc SourceLocTable_get(const SourceLocTable* t, uint32_t loc);
+
+/**
+ * @brief Gets the location of the outermost macro invocation of loc, if it
+ *        came out of an expansion
+ */
+SourceLoc SourceLocTable_resolve(const SourceLocTable* t, SourceLoc loc);
+
+/**
+ * @brief Gets the location where the token at the given compact location was
+ *        spelled, which is in a macro definition for expanded tokens
+ */
+SourceLoc SourceLocTable_spelling_loc(const SourceLocTable* t, uint32_t loc);
+
+typedef enum {
+    TOKEN_LITERAL_UNCONVERTED,
+    TOKEN_LITERAL_CONVERTED,
+    TOKEN_LITERAL_INVALID,
+} TokenLiteralState;
+
+/**
+ * @brief Values of the constants and string literals of a TokenArr
+ *
+ * Values are converted from their spelling when they are first accessed and
+ * cached afterwards, so literals that are never looked at, like the ones in
+ * macros that are never expanded, are not converted at all.
+ */
+typedef struct TokenLiterals {
+    // Needed to convert integer and character constants
+    ArchTypeInfo info;
+    uint32_t int_consts_len, float_consts_len, str_lits_len;
+    // Spelling of every value, at the same index as the value. A pool is
+    // empty if its values were all added already converted.
+    StringPool int_spellings;
+    StringPool float_spellings;
+    StringPool str_spellings;
+    // TokenLiteralState of every value
+    uint8_t* int_states;
+    uint8_t* float_states;
+    uint8_t* str_states;
     IntVal* int_consts;
     FloatVal* float_consts;
     StrLit* str_lits;
-    uint32_t identifiers_len;
-    uint32_t int_consts_len;
-    uint32_t float_consts_len;
-    uint32_t str_lits_len;
+} TokenLiterals;
+
+/**
+ * @brief Creates literals that are converted from the given spellings when
+ *        they are accessed, taking ownership of the pools
+ */
+TokenLiterals TokenLiterals_create(const ArchTypeInfo* info,
+                                   StringPool int_spellings,
+                                   StringPool float_spellings,
+                                   StringPool str_spellings);
+
+/**
+ * @brief Creates literals without spellings, whose values are all added with
+ *        TokenLiterals_add_*()
+ */
+TokenLiterals TokenLiterals_create_empty(void);
+
+uint32_t TokenLiterals_add_int_const(TokenLiterals* l, IntVal val);
+uint32_t TokenLiterals_add_float_const(TokenLiterals* l, FloatVal val);
+uint32_t TokenLiterals_add_str_lit(TokenLiterals* l, StrLit lit);
+
+void TokenLiterals_free(const TokenLiterals* l);
+
+typedef struct PreprocErr PreprocErr;
+
+/**
+ * @brief Gets the value of the integer or character constant at idx,
+ *        converting it if this is the first access
+ *
+ * @param loc The location reported if the constant is invalid
+ * @param err May be NULL if the constant is known to be valid
+ *
+ * @return NULL if the constant is invalid, in which case err is set
+ */
+const IntVal* TokenLiterals_int_const(const TokenLiterals* l,
+                                      uint32_t idx,
+                                      SourceLoc loc,
+                                      PreprocErr* err);
+
+const FloatVal* TokenLiterals_float_const(const TokenLiterals* l,
+                                          uint32_t idx,
+                                          SourceLoc loc,
+                                          PreprocErr* err);
+
+const StrLit* TokenLiterals_str_lit(const TokenLiterals* l,
+                                    uint32_t idx,
+                                    SourceLoc loc,
+                                    PreprocErr* err);
+
+typedef struct TokenArr {
+    uint32_t len, cap;
+    uint8_t* kinds;
+    uint32_t* val_indices;
+    // Compact locations of the tokens in loc_table
+    uint32_t* locs;
+    SourceLocTable loc_table;
+    StringPool identifiers;
+    TokenLiterals literals;
 } TokenArr;
 
 TokenArr TokenArr_create_empty(void);
 
 void TokenArr_free(const TokenArr* arr);
 
+/**
+ * @brief Makes sure num more tokens fit into arr without reallocating
+ */
+void TokenArr_reserve(TokenArr* arr, uint32_t num);
+
+/**
+ * @brief Estimates how many tokens a source file of the given size contains
+ *
+ * Most C code in the test files and the benchmark corpora has between 5.5
+ * and 7 bytes per token, so token arrays sized with this usually do not need
+ * to grow. Macro expansions are not accounted for.
+ */
+uint32_t estimate_num_tokens(size_t num_bytes);
+
+SourceLoc TokenArr_loc(const TokenArr* arr, uint32_t token_idx);
+
+bool TokenArr_is_expanded(const TokenArr* arr, uint32_t token_idx);
+
+SourceLoc TokenArr_spelling_loc(const TokenArr* arr, uint32_t token_idx);
+
+/**
+ * @brief Gets the value of the integer or character constant token at
+ *        token_idx, converting it if this is the first access
+ *
+ * @return NULL if the constant is invalid, in which case err is set
+ */
+const IntVal* TokenArr_int_const(const TokenArr* arr,
+                                 uint32_t token_idx,
+                                 PreprocErr* err);
+
+const FloatVal* TokenArr_float_const(const TokenArr* arr,
+                                     uint32_t token_idx,
+                                     PreprocErr* err);
+
+const StrLit* TokenArr_str_lit(const TokenArr* arr,
+                               uint32_t token_idx,
+                               PreprocErr* err);
+
 /**
  * @brief Gets a spelling for the given token_kind
  *
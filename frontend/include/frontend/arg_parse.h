@@ -9,6 +9,7 @@ typedef enum {
     ARG_ACTION_OUTPUT_TEXT,
     ARG_ACTION_OUTPUT_BIN,
     ARG_ACTION_CONVERT_BIN_TO_TEXT,
+    ARG_ACTION_OUTPUT_PCH,
 } ArgAction;
 
 typedef struct CmdArgs {
@@ -17,7 +18,14 @@ typedef struct CmdArgs {
     CStr* files;
     Str* include_dirs;
     CStr output_file;
+    // Precompiled header applied before each file, data is NULL if not given
+    CStr pch_file;
+    // AST of a previous version of the file, whose unchanged declarations
+    // are reused. data is NULL if not given
+    CStr prev_ast_file;
     ArgAction action;
+    // Number of files that are compiled in parallel
+    uint32_t num_threads;
 } CmdArgs;
 
 CmdArgs parse_cmd_args(int argc, char** argv);
@@ -224,7 +224,9 @@ typedef enum {
     AST_DESIGNATOR,
     // cond_expr (might be removeable)
     AST_CONST_EXPR,
-    // lhs assign_expr ',' rhs ?assign_expr
+    // Nodes for expressions are only created if their operator is present, so
+    // a lone operand like an identifier is not wrapped in any of them
+    // lhs assign_expr ',' rhs (expr | assign_expr)
     AST_EXPR,
     // assign_expr:
     // lhs cond_expr '=' rhs (assign_expr | cond_expr)
@@ -295,7 +297,7 @@ typedef enum {
     AST_DIV_EXPR,
     // lhs cast_expr '%' rhs (mul_expr | cast_expr)
     AST_MOD_EXPR,
-    // '('lhs ?type_name')' (rhs cast_expr | unary_expr) 
+    // '(' lhs type_name ')' rhs (cast_expr | unary_expr)
     AST_CAST_EXPR,
     // lhs spec_qual_list rhs ?abs_declartor
     AST_TYPE_NAME,
@@ -329,7 +331,7 @@ typedef enum {
     AST_UNARY_EXPR_BNOT,
     // '!' lhs cast_expr
     AST_UNARY_EXPR_NOT,
-    // lhs primary_expr | compound_literal rhs ?postfix_op
+    // lhs primary_expr | compound_literal rhs postfix_op
     AST_POSTFIX_EXPR,
     // postfix_op:
     // '['lhs expr']' rhs ?postfix_op
@@ -345,7 +347,7 @@ typedef enum {
     AST_POSTFIX_OP_DEC,
     // subrange assign_expr[lhs...rhs]
     AST_ARG_EXPR_LIST,
-    // constant | string_constant | identifier | bracket_expr | generic_sel
+    // '(' lhs expr ')'
     AST_PRIMARY_EXPR,
     // '_Generic' '(' lhs assign_expr ',' rhs generic_assoc_list ')'
     AST_GENERIC_SEL,
@@ -370,9 +372,12 @@ typedef enum {
     AST_STORAGE_CLASS_SPECS,
     // main token is identifier
     AST_IDENTIFIER,
+    // Replaces a declaration or block item that could not be parsed
+    // main token is the first token of the item
+    AST_ERROR,
 } ASTNodeKind;
 
-_Static_assert(AST_IDENTIFIER < 256, "ASTNodeKind does not fit into a byte");
+_Static_assert(AST_ERROR < 256, "ASTNodeKind does not fit into a byte");
 
 typedef struct ASTNodeData {
     uint32_t main_token;
@@ -395,7 +400,42 @@ typedef struct AST {
     TokenArr toks;
 } AST;
 
-AST parse_ast(TokenArr* tokens, ParserErr* err);
+/**
+ * @brief Parses tokens, recovering from errors at the end of declarations and
+ *        statements
+ *
+ * All errors are added to errs. If there were any, the declarations and
+ * statements that could not be parsed are replaced by AST_ERROR nodes.
+ */
+AST parse_ast(TokenArr* tokens, ParserErrArr* errs);
+
+/**
+ * @brief Parses tokens like parse_ast(), but copies the nodes of top-level
+ *        declarations of prev whose tokens did not change
+ *
+ * The result is the same as with parse_ast(). Declarations are looked up by
+ * the kinds of their tokens, and only reused if the same identifiers are
+ * typedef names and enum constants as in prev. Declarations that define
+ * typedef names or enum constants or that contain errors are always parsed
+ * again.
+ *
+ * @param prev AST of a previous version of the same file, e.g. read with
+ *        deserialize_ast()
+ */
+AST parse_ast_incremental(TokenArr* tokens,
+                          const AST* prev,
+                          ParserErrArr* errs);
+
+typedef struct PreprocStream PreprocStream;
+
+/**
+ * @brief Parses the tokens of stream while they are being preprocessed
+ *
+ * If the stream produced an error, the tokens of the result do not contain
+ * identifiers or literals and the parser errors should be ignored, as the
+ * parser only saw the tokens before the error
+ */
+AST parse_ast_stream(PreprocStream* stream, ParserErrArr* errs);
 
 void AST_free(AST* ast);
 
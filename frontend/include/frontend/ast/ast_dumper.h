@@ -1,9 +1,20 @@
 #ifndef MYCC_FRONTEND_AST_AST_DUMPER_2_H
 #define MYCC_FRONTEND_AST_AST_DUMPER_2_H
 
+#include "frontend/preproc/PreprocErr.h"
+
 #include "ast.h"
 
-bool dump_ast(const AST* ast, const FileInfo* file_info, File f);
+/**
+ * @brief Writes a textual representation of ast to f
+ *
+ * Values of literals are converted as they are dumped, so if one is invalid,
+ * false is returned and err is set.
+ */
+bool dump_ast(const AST* ast,
+              const FileInfo* file_info,
+              File f,
+              PreprocErr* err);
 
 #endif
 
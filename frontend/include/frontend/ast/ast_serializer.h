@@ -1,6 +1,8 @@
 #ifndef FRONTEND_AST_AST_SERIALIZER_2_H
 #define FRONTEND_AST_AST_SERIALIZER_2_H
 
+#include "frontend/preproc/PreprocErr.h"
+
 #include "ast.h"
 
 typedef struct {
@@ -10,6 +12,15 @@ typedef struct {
 
 DeserializeASTRes deserialize_ast(File f);
 
-bool serialize_ast(const AST* ast, const FileInfo* file_info, File f);
+/**
+ * @brief Writes ast to f in a format that can be read by deserialize_ast()
+ *
+ * Only the literals referenced by a token are written. If one of them is
+ * invalid, false is returned and err is set to the location of its token.
+ */
+bool serialize_ast(const AST* ast,
+                   const FileInfo* file_info,
+                   File f,
+                   PreprocErr* err);
 
 #endif
@@ -25,6 +25,7 @@ typedef enum {
     PARSER_ERR_EXPECTED_TYPEDEF_NAME,
     PARSER_ERR_EMPTY_DIRECT_ABS_DECL,
     PARSER_ERR_TYPEDEF_WITHOUT_DECLARATOR,
+    PARSER_ERR_EXPECTED_DECLARATION_SPECS,
 } ParserErrKind;
 
 typedef struct ParserErr {
@@ -50,5 +51,22 @@ void ParserErr_set(ParserErr* err, ParserErrKind kind, uint32_t loc);
 
 void ParserErr_print(File out, const FileInfo* file_info, const TokenArr* tokens, const ParserErr* err);
 
+// Errors of a translation unit, in the order they were found
+typedef struct ParserErrArr {
+    uint32_t len, cap;
+    ParserErr* errs;
+} ParserErrArr;
+
+ParserErrArr ParserErrArr_create(void);
+
+void ParserErrArr_push(ParserErrArr* arr, const ParserErr* err);
+
+void ParserErrArr_print(File out,
+                        const FileInfo* file_info,
+                        const TokenArr* tokens,
+                        const ParserErrArr* arr);
+
+void ParserErrArr_free(const ParserErrArr* arr);
+
 #endif
 
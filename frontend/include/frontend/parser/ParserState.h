@@ -7,19 +7,60 @@
 
 #include "ParserErr.h"
 
-typedef struct ParserIdentifierMap ParserIdentifierMap;
+typedef struct ParserBinding ParserBinding;
+typedef struct PreprocStream PreprocStream;
+
+enum {
+    // Number of tokens the parser may look at from the current one
+    PARSER_STATE_LOOKAHEAD = 2,
+    // Number of tokens read from a stream beyond the lookahead, so the
+    // stream is not called for every token
+    PARSER_STATE_STREAM_CHUNK_LEN = 1024,
+};
 
 typedef struct ParserState {
     TokenArr _arr;
     uint32_t it;
+    // Bindings of typedef names and enum constants of all open scopes, in the
+    // order they were registered. Each scope owns the bindings from its entry
+    // in _scope_starts to the start of the next scope.
+    ParserBinding* _bindings;
+    uint32_t _num_bindings, _bindings_cap;
+    // Number of open scopes, including the file scope
     uint32_t _len, _cap;
-    ParserIdentifierMap* _scope_maps;
+    uint32_t* _scope_starts;
+    // Maps each identifier index to its innermost binding + 1, or 0 if the
+    // identifier has no binding
+    uint32_t* _innermost;
+    uint32_t _innermost_len;
+    // If this is not NULL, _arr only contains the tokens read so far
+    PreprocStream* _stream;
+    // Error that is currently being reported
     ParserErr* err;
+    // Errors the parser already recovered from. After an error, the parser
+    // moves err here and continues at the next point it can synchronize at.
+    ParserErrArr* _errs;
 } ParserState;
 
 ParserState ParserState_create(TokenArr* tokens, ParserErr* err);
+
+/**
+ * @brief Creates a parser state that reads its tokens from stream while
+ *        parsing
+ *
+ * The tokens are only moved out of the stream by ParserState_finish_stream()
+ */
+ParserState ParserState_create_stream(PreprocStream* stream, ParserErr* err);
 void ParserState_free(ParserState* s);
 
+void ParserState_finish_stream(ParserState* s);
+
+/**
+ * @brief Reads tokens from the stream so the current token and the ones after
+ *        it that may be looked at are available
+ */
+void ParserState_read_tokens(ParserState* s);
+
 void expected_token_error(ParserState* s, TokenKind expected);
 
 void expected_tokens_error(ParserState* s,
@@ -32,6 +73,7 @@ inline TokenKind ParserState_curr_kind(const ParserState* s);
 inline TokenKind ParserState_next_token_kind(const ParserState* s);
 inline uint32_t ParserState_next_token_id_idx(const ParserState* s);
 
+inline void ParserState_advance(ParserState* s);
 inline bool ParserState_accept(ParserState* s, TokenKind expected);
 inline void ParserState_accept_it(ParserState* s);
 
@@ -48,6 +90,11 @@ bool ParserState_register_typedef(ParserState* s,
 bool ParserState_is_enum_constant(const ParserState* s, uint32_t identifier_idx);
 bool ParserState_is_typedef(const ParserState* s, uint32_t identifier_idx);
 
+/**
+ * @brief Whether the identifier is either a typedef name or an enum constant
+ */
+bool ParserState_is_bound(const ParserState* s, uint32_t identifier_idx);
+
 void ParserState_set_redefinition_err(ParserState* s,
                                       uint32_t identifier_idx,
                                       uint32_t redef_token_idx);
@@ -0,0 +1,56 @@
+#ifndef MYCC_FRONTEND_PREPROC_HIDE_SET_TABLE_H
+#define MYCC_FRONTEND_PREPROC_HIDE_SET_TABLE_H
+
+#include "util/IndexedStringSet.h"
+
+/**
+ * @brief Interned sets of identifier indices of the macros a token may not be
+ *        expanded by anymore, as in Prosser's expansion algorithm
+ *
+ * Every distinct set is stored once and referred to by its index, so tokens
+ * only carry a single index and equal sets compare equal by index. The empty
+ * set always has the index HIDE_SET_EMPTY.
+ */
+typedef struct HideSetTable {
+    // The sorted elements of every set, stored as bytes
+    IndexedStringSet _sets;
+    uint32_t _masks_cap;
+    // One bit for every element modulo 64 for each set, so most failing
+    // lookups do not need to look at the elements
+    uint64_t* _masks;
+    // Elements of the set that is being built
+    uint32_t _tmp_cap;
+    uint32_t* _tmp;
+} HideSetTable;
+
+enum {
+    HIDE_SET_EMPTY = 0,
+};
+
+HideSetTable HideSetTable_create(void);
+
+void HideSetTable_free(const HideSetTable* t);
+
+/**
+ * @brief Checks whether macro_id is in the set with the index set
+ *
+ * This takes constant time, unless the set contains another element that
+ * collides with macro_id in the mask of the set.
+ */
+bool HideSetTable_contains(const HideSetTable* t,
+                           uint32_t set,
+                           uint32_t macro_id);
+
+/**
+ * @brief Returns the index of the set containing the elements of set and
+ *        macro_id
+ */
+uint32_t HideSetTable_add(HideSetTable* t, uint32_t set, uint32_t macro_id);
+
+uint32_t HideSetTable_union(HideSetTable* t, uint32_t s1, uint32_t s2);
+
+uint32_t HideSetTable_intersection(HideSetTable* t, uint32_t s1, uint32_t s2);
+
+uint32_t HideSetTable_len(const HideSetTable* t);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MYCC_FRONTEND_PREPROC_INCLUDE_CACHE_H
+#define MYCC_FRONTEND_PREPROC_INCLUDE_CACHE_H
+
+#include "util/StrBuf.h"
+
+/**
+ * @brief Results of include path resolution
+ *
+ * Maps the directory of the including file and the spelled name of the
+ * included file to the path it resolved to, or to the fact that it could not
+ * be found. Additionally, the entries of every searched directory are listed
+ * once, so names that do not exist there are rejected without trying to open
+ * them.
+ *
+ * All functions are thread safe, so one cache can be shared by all
+ * translation units that are compiled with the same include directories.
+ */
+typedef struct IncludeCache IncludeCache;
+
+IncludeCache* IncludeCache_create(void);
+
+void IncludeCache_free(IncludeCache* c);
+
+typedef enum {
+    INCLUDE_CACHE_UNKNOWN,
+    INCLUDE_CACHE_FOUND,
+    INCLUDE_CACHE_NOT_FOUND,
+} IncludeCacheRes;
+
+/**
+ * @brief Looks up the result of resolving name from the including directory
+ *        dir
+ *
+ * @param path Set to a copy of the resolved path if INCLUDE_CACHE_FOUND is
+ *        returned
+ */
+IncludeCacheRes IncludeCache_find(IncludeCache* c,
+                                  Str dir,
+                                  Str name,
+                                  StrBuf* path);
+
+/**
+ * @brief Stores the result of resolving name from the including directory
+ *        dir, where path is NULL if the file was not found
+ */
+void IncludeCache_insert(IncludeCache* c, Str dir, Str name, const StrBuf* path);
+
+/**
+ * @brief Checks whether dir may contain the path name, using the entries of
+ *        dir, which are only listed the first time it is searched
+ */
+bool IncludeCache_may_exist(IncludeCache* c, Str dir, Str name);
+
+#endif
+
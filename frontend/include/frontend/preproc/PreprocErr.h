@@ -36,6 +36,7 @@ typedef enum {
     PREPROC_ERR_INCLUDE_NUM_ARGS,
     PREPROC_ERR_INCLUDE_NOT_STRING_LITERAL,
     PREPROC_ERR_INCOMPLETE_EXPR,
+    PREPROC_ERR_INCLUDE_STR_LIT,
 } PreprocErrKind;
 
 typedef enum {
@@ -19,16 +19,22 @@ typedef struct PreprocMacro {
     // if kinds[i] is TOKEN_INVALID, current is an argument
     uint8_t* kinds;
     TokenValOrArg* vals;
+    // Index of the locations of the expansion in the SourceLocTable of the
+    // preprocessor
+    uint32_t spellings_idx;
 } PreprocMacro;
 
 bool expand_all_macros(PreprocState* state, PreprocTokenArr* res,
                        uint32_t start, const ArchTypeInfo* info);
 
 // TODO: change to accept the val idx instead of the name len
+/**
+ * @brief Parses the macro defined in arr, allocating its expansion in arena
+ */
 PreprocMacro parse_preproc_macro(PreprocTokenArr* arr,
-                                 uint32_t name_len, PreprocErr* err);
-
-void PreprocMacro_free(const PreprocMacro* m);
+                                 uint32_t name_len,
+                                 MemArena* arena,
+                                 PreprocErr* err);
 
 #endif
 
@@ -0,0 +1,50 @@
+#ifndef MYCC_FRONTEND_PREPROC_PREPROC_PCH_H
+#define MYCC_FRONTEND_PREPROC_PREPROC_PCH_H
+
+#include "util/File.h"
+#include "util/MemArena.h"
+
+#include "frontend/FileInfo.h"
+
+#include "PreprocState.h"
+#include "PreprocTokenArr.h"
+
+typedef struct PreprocPCHFile {
+    bool is_once;
+    // Identifier index of the include guard macro, UINT32_MAX if there is none
+    uint32_t guard_id;
+} PreprocPCHFile;
+
+/**
+ * @brief Precompiled header: the state of the preprocessor after it has
+ *        processed a header
+ *
+ * Applying it at the start of a translation unit has the same effect as
+ * including the header there, without reading or tokenizing it again.
+ */
+typedef struct PreprocPCH {
+    PreprocTokenArr toks;
+    PreprocTokenValList vals;
+    PreprocMacroMap macro_map;
+    // Holds the expansions of all macros in macro_map
+    MemArena _macro_arena;
+    FileInfo file_info;
+    // Include guard state of every file in file_info, so files that were
+    // already included by the header are skipped after it is applied
+    PreprocPCHFile* files;
+} PreprocPCH;
+
+bool PreprocPCH_write(const PreprocPCH* pch, File f);
+
+/**
+ * @brief Reads a precompiled header written by PreprocPCH_write()
+ *
+ * @return false if f does not contain a precompiled header that was written
+ *         by a compatible build, in which case res does not need to be freed
+ */
+bool PreprocPCH_read(PreprocPCH* res, File f);
+
+void PreprocPCH_free(const PreprocPCH* pch);
+
+#endif
+
@@ -3,8 +3,12 @@
 
 #include <stddef.h>
 
+#include "util/MemArena.h"
+
 #include "frontend/FileInfo.h"
 
+#include "HideSetTable.h"
+#include "IncludeCache.h"
 #include "PreprocTokenArr.h"
 #include "PreprocErr.h"
 
@@ -22,12 +26,22 @@ typedef struct PreprocCond {
 } PreprocCond;
 
 typedef struct OpenedFileInfo OpenedFileInfo;
+typedef struct IncludedFileInfo IncludedFileInfo;
 
 typedef struct FileManager {
     uint32_t opened_info_len, opened_info_cap;
     OpenedFileInfo* opened_info;
     uint32_t prefixes_len, prefixes_cap;
     StrBuf* prefixes;
+    // Resolved paths of all files that were opened, with the index of their
+    // file in included_info for every path
+    IndexedStringSet included_paths;
+    uint32_t path_files_cap;
+    uint32_t* path_files;
+    // What is known about the include guards of every distinct file, which is
+    // shared by all paths that lead to the same file
+    uint32_t included_info_len, included_info_cap;
+    IncludedFileInfo* included_info;
 } FileManager;
 
 typedef struct PreprocMacro PreprocMacro;
@@ -39,6 +53,32 @@ typedef struct PreprocMacroMap {
     PreprocMacro* _macros;
 } PreprocMacroMap;
 
+typedef struct PreprocExpansionCtx PreprocExpansionCtx;
+
+/**
+ * @brief Tokens that are being expanded, with the hide set of each token
+ */
+typedef struct PreprocExpansionTokens {
+    PreprocTokenArr arr;
+    // Index in PreprocExpansionBufs.hide_sets for every token, with the same
+    // capacity as arr
+    uint32_t* hide_sets;
+} PreprocExpansionTokens;
+
+/**
+ * @brief Buffers for macro expansion, which are kept for the whole translation
+ *        unit, so expanding a line does not allocate once they are large enough
+ */
+typedef struct PreprocExpansionBufs {
+    // Tokens of the macro expansions that are being rescanned
+    PreprocExpansionTokens toks;
+    // Arguments of function-like macro calls and their expansions
+    PreprocExpansionTokens args;
+    uint32_t ctxs_len, ctxs_cap;
+    PreprocExpansionCtx* ctxs;
+    HideSetTable hide_sets;
+} PreprocExpansionBufs;
+
 typedef struct PreprocState {
     PreprocTokenArr toks;
     PreprocTokenValList vals;
@@ -51,15 +91,25 @@ typedef struct PreprocState {
     PreprocCond* conds;
 
     PreprocMacroMap _macro_map;
+    // Holds the expansions of all macros, which live until the end of the
+    // translation unit
+    MemArena _macro_arena;
+    // Temporary allocations, which are released when the macro expansion
+    // they belong to is done
+    MemArena _scratch_arena;
+    PreprocExpansionBufs _expansion;
     FileInfo file_info;
     uint32_t num_include_dirs;
     const Str* include_dirs;
+    // Not owned by the state, as it may be shared with other states
+    IncludeCache* include_cache;
     PreprocErr* err;
 } PreprocState;
 
 PreprocState PreprocState_create(CStr start_file,
                                  uint32_t num_include_dirs,
                                  const Str* include_dirs,
+                                 IncludeCache* include_cache,
                                  PreprocErr* err);
 
 PreprocState PreprocState_create_string(Str code,
@@ -68,18 +118,72 @@ PreprocState PreprocState_create_string(Str code,
                                         const Str* include_dirs,
                                         PreprocErr* err);
 
+typedef struct PreprocPCH PreprocPCH;
+
+/**
+ * @brief Makes the state continue from where pch left off, as if the header
+ *        it was created from was included at the start of the file
+ *
+ * Must be called before the first line is read. The macros of the state
+ * refer to the expansions in pch, so pch has to outlive the state.
+ */
+void PreprocState_apply_pch(PreprocState* state, const PreprocPCH* pch);
+
+/**
+ * @brief Moves everything a precompiled header needs out of the state, which
+ *        still needs to be freed afterwards
+ */
+PreprocPCH PreprocState_take_pch(PreprocState* state);
+
 void PreprocState_read_line(PreprocState* state);
+
+/**
+ * @brief Estimates the number of tokens of the start file, which has to be
+ *        called before any line is read
+ */
+uint32_t PreprocState_estimate_num_tokens(const PreprocState* state);
+
 bool PreprocState_over(const PreprocState* state);
 
+/**
+ * @brief Moves past the lines of an inactive conditional region in the
+ *        current file without reading them
+ *
+ * Stops at the start of the next line that begins with a '#' outside of
+ * comments, or at the end of the file. Lines that are skipped are still
+ * counted. Files that cannot be scanned directly are left unchanged, so the
+ * following lines have to be checked anyway.
+ */
+void PreprocState_skip_inactive_lines(PreprocState* state);
+
 typedef struct PreprocMacro PreprocMacro;
 
 const PreprocMacro* find_preproc_macro(const PreprocState* state,
                                        uint32_t identifier_idx);
 
+/**
+ * @brief Opens the included file, unless it was already included and has
+ *        #pragma once or an include guard whose macro is still defined
+ */
 bool PreprocState_open_file(PreprocState* s,
                             const StrBuf* filename_str,
                             const SourceLoc* include_loc);
 
+/**
+ * @brief Updates the include guard detection of the current file with the
+ *        directive in arr, before it is executed
+ */
+void PreprocState_guard_directive(PreprocState* state,
+                                  const PreprocTokenArr* arr);
+
+/**
+ * @brief Tells the include guard detection that the current file produced
+ *        tokens outside of a directive
+ */
+void PreprocState_guard_tokens(PreprocState* state);
+
+void PreprocState_pragma_once(PreprocState* state);
+
 void PreprocState_register_macro(PreprocState* state,
                                  uint32_t identifier_idx,
                                  const PreprocMacro* macro);
@@ -60,16 +60,28 @@ typedef struct PreprocTokenValList {
     IndexedStringSet int_consts;
     IndexedStringSet float_consts;
     IndexedStringSet str_lits;
+    // Holds the macro definitions and expansions the locations of expanded
+    // tokens refer to
+    SourceLocTable loc_table;
 } PreprocTokenValList;
 
 PreprocTokenValList PreprocTokenValList_create(void);
 
 void PreprocTokenValList_free(const PreprocTokenValList* vals);
 
+PreprocTokenValList PreprocTokenValList_copy(const PreprocTokenValList* vals);
+
 PreprocTokenArr PreprocTokenArr_create_empty(void);
 
 void PreprocTokenArr_free(const PreprocTokenArr* arr);
 
+/**
+ * @brief Makes sure num more tokens fit into arr without reallocating
+ */
+void PreprocTokenArr_reserve(PreprocTokenArr* arr, uint32_t num);
+
+PreprocTokenArr PreprocTokenArr_copy(const PreprocTokenArr* arr);
+
 uint32_t PreprocTokenValList_add_identifier(PreprocTokenValList* vals, Str str);
 uint32_t PreprocTokenValList_add_int_const(PreprocTokenValList* vals, Str str);
 uint32_t PreprocTokenValList_add_float_const(PreprocTokenValList* vals, Str str);
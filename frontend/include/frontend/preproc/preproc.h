@@ -4,7 +4,10 @@
 #include "frontend/FileInfo.h"
 #include "frontend/Token.h"
 
+#include "IncludeCache.h"
 #include "PreprocErr.h"
+#include "PreprocPCH.h"
+#include "PreprocState.h"
 #include "PreprocTokenArr.h"
 
 typedef struct PreprocRes {
@@ -15,16 +18,39 @@ typedef struct PreprocRes {
 
 /**
  * @param path path to file
+ * @param pch precompiled header to apply before the file, may be NULL
+ * @param include_cache cache of include path resolution, which may be shared
+ *        between calls with the same include_dirs. If it is NULL, a cache is
+ *        only used for this file
  *
  * @return preprocessed tokens from this file, or NULL if an error occurred
  *         note that these tokens still need to be converted
  */
 PreprocRes preproc(CStr path,
+                   const PreprocPCH* pch,
                    uint32_t num_include_dirs,
                    const Str* include_dirs,
+                   IncludeCache* include_cache,
                    const ArchTypeInfo* info,
                    PreprocErr* err);
 
+/**
+ * @brief Preprocesses the header at path and stores the resulting state
+ *
+ * @param pch precompiled header to apply before the header, may be NULL
+ * @param include_cache see preproc()
+ *
+ * @return the precompiled header. If an error occurred, only vals and
+ *         file_info are set, so the error can be printed
+ */
+PreprocPCH preproc_create_pch(CStr path,
+                              const PreprocPCH* pch,
+                              uint32_t num_include_dirs,
+                              const Str* include_dirs,
+                              IncludeCache* include_cache,
+                              const ArchTypeInfo* info,
+                              PreprocErr* err);
+
 #ifdef MYCC_TEST_FUNCTIONALITY
 
 /**
@@ -44,8 +70,76 @@ PreprocRes preproc_string(Str str,
 
 #endif
 
+/**
+ * @brief Preprocessor that produces converted tokens on demand, so they can
+ *        be consumed while the rest of the file is still being preprocessed
+ */
+typedef struct PreprocStream {
+    PreprocState _state;
+    const ArchTypeInfo* _info;
+    // Whether _state was fully created, otherwise it only holds the file info
+    bool _state_valid;
+} PreprocStream;
+
+/**
+ * @param include_cache see preproc(), but it may not be NULL and must outlive
+ *        the stream
+ *
+ * If an error occurred, the stream must still be closed to get the file info
+ * needed to print it
+ */
+PreprocStream PreprocStream_create(CStr path,
+                                   const PreprocPCH* pch,
+                                   uint32_t num_include_dirs,
+                                   const Str* include_dirs,
+                                   IncludeCache* include_cache,
+                                   const ArchTypeInfo* info,
+                                   PreprocErr* err);
+
+/**
+ * @brief Preprocesses lines until there are at least min_len tokens, or the
+ *        file is over
+ *
+ * The new tokens are appended to tokens, with their final kinds. Only the
+ * token arrays and the location table are set, as identifiers and literals
+ * are only moved into it by PreprocStream_finish()
+ *
+ * @return false if an error occurred now or in an earlier call, in which case
+ *         no further tokens are read
+ */
+bool PreprocStream_read(PreprocStream* s, TokenArr* tokens, uint32_t min_len);
+
+bool PreprocStream_over(const PreprocStream* s);
+
+/**
+ * @brief Estimates how many tokens the stream produces, including the ones
+ *        of the precompiled header, but not the ones of included files
+ *
+ * Has to be called before the first PreprocStream_read()
+ */
+uint32_t PreprocStream_estimate_num_tokens(const PreprocStream* s);
+
+/**
+ * @brief Moves the identifiers and literals of the tokens read so far into
+ *        tokens
+ *
+ * This is only done if no error occurred, as they may be needed to print it
+ */
+void PreprocStream_finish(PreprocStream* s, TokenArr* tokens);
+
+/**
+ * @brief Frees the stream
+ *
+ * @return the file info and the remaining values, which are needed to print
+ *         errors. The tokens of the result are empty
+ */
+PreprocRes PreprocStream_close(PreprocStream* s);
+
 /**
  * Converts the given preprocessor tokens to parser tokens
+ *
+ * The values of constants and string literals are not converted here, but
+ * when they are first accessed through the returned TokenArr
  */
 TokenArr convert_preproc_tokens(PreprocTokenArr* tokens,
                                 PreprocTokenValList* vals,
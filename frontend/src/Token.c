@@ -1,14 +1,462 @@
 #include "frontend/Token.h"
 
+#include <string.h>
+#include <assert.h>
+
 #include "util/mem.h"
 #include "util/macro_util.h"
 
+#include "frontend/preproc/PreprocErr.h"
+#include "frontend/preproc/num_parse.h"
+
+SourceLocTable SourceLocTable_create(void) {
+    return (SourceLocTable){
+        .len = 0,
+        .cap = 0,
+        .starts = NULL,
+        .file_indices = NULL,
+        .lines = NULL,
+        .end = 0,
+        .exps_len = 0,
+        .exps_cap = 0,
+        .exp_starts = NULL,
+        .exp_locs = NULL,
+        .exp_spellings = NULL,
+        .exp_end = 0,
+        .spellings_len = 0,
+        .spellings_cap = 0,
+        .spellings = NULL,
+    };
+}
+
+void SourceLocTable_free(const SourceLocTable* t) {
+    mycc_free(t->starts);
+    mycc_free(t->file_indices);
+    mycc_free(t->lines);
+    mycc_free(t->exp_starts);
+    mycc_free(t->exp_locs);
+    mycc_free(t->exp_spellings);
+    mycc_free(t->spellings);
+}
+
+static void* copy_arr(const void* arr, size_t elem_size, uint32_t len) {
+    if (len == 0) {
+        return NULL;
+    }
+    void* res = mycc_alloc(elem_size * len);
+    memcpy(res, arr, elem_size * len);
+    return res;
+}
+
+SourceLocTable SourceLocTable_copy(const SourceLocTable* t) {
+    return (SourceLocTable){
+        .len = t->len,
+        .cap = t->len,
+        .starts = copy_arr(t->starts, sizeof *t->starts, t->len),
+        .file_indices = copy_arr(t->file_indices,
+                                 sizeof *t->file_indices,
+                                 t->len),
+        .lines = copy_arr(t->lines, sizeof *t->lines, t->len),
+        .end = t->end,
+        .exps_len = t->exps_len,
+        .exps_cap = t->exps_len,
+        .exp_starts = copy_arr(t->exp_starts,
+                               sizeof *t->exp_starts,
+                               t->exps_len),
+        .exp_locs = copy_arr(t->exp_locs, sizeof *t->exp_locs, t->exps_len),
+        .exp_spellings = copy_arr(t->exp_spellings,
+                                  sizeof *t->exp_spellings,
+                                  t->exps_len),
+        .exp_end = t->exp_end,
+        .spellings_len = t->spellings_len,
+        .spellings_cap = t->spellings_len,
+        .spellings = copy_arr(t->spellings,
+                              sizeof *t->spellings,
+                              t->spellings_len),
+    };
+}
+
+uint32_t SourceLocTable_add(SourceLocTable* t, SourceLoc loc) {
+    if (loc.file_idx == SOURCE_LOC_EXPANSION_FILE_IDX) {
+        assert(loc.file_loc.line < t->exps_len);
+        const uint32_t start = t->exp_starts[loc.file_loc.line];
+        if (start == SOURCE_LOC_UNKNOWN) {
+            return SOURCE_LOC_UNKNOWN;
+        }
+        return (start + loc.file_loc.index) | SOURCE_LOC_EXPANDED_BIT;
+    }
+    const bool is_new_line = t->len == 0
+                             || t->file_indices[t->len - 1] != loc.file_idx
+                             || t->lines[t->len - 1] != loc.file_loc.line;
+    const uint32_t start = is_new_line ? t->end : t->starts[t->len - 1];
+    if (loc.file_loc.index >= SOURCE_LOC_UNKNOWN - start) {
+        return SOURCE_LOC_UNKNOWN;
+    }
+    if (is_new_line) {
+        if (t->len == t->cap) {
+            mycc_grow_alloc((void**)&t->starts, &t->cap, sizeof *t->starts);
+            t->file_indices = mycc_realloc(t->file_indices,
+                                           sizeof *t->file_indices * t->cap);
+            t->lines = mycc_realloc(t->lines, sizeof *t->lines * t->cap);
+        }
+        t->starts[t->len] = start;
+        t->file_indices[t->len] = loc.file_idx;
+        t->lines[t->len] = loc.file_loc.line;
+        ++t->len;
+    }
+    const uint32_t res = start + loc.file_loc.index;
+    if (res >= t->end) {
+        t->end = res + 1;
+    }
+    return res;
+}
+
+uint32_t SourceLocTable_add_macro(SourceLocTable* t,
+                                  const SourceLoc* locs,
+                                  uint32_t len) {
+    const uint32_t res = t->spellings_len;
+    if (t->spellings_len + len > t->spellings_cap) {
+        const uint32_t grown = t->spellings_cap + t->spellings_cap / 2 + 1;
+        const uint32_t needed = t->spellings_len + len;
+        t->spellings_cap = grown > needed ? grown : needed;
+        t->spellings = mycc_realloc(t->spellings,
+                                    sizeof *t->spellings * t->spellings_cap);
+    }
+    if (len != 0) {
+        memcpy(t->spellings + t->spellings_len,
+               locs,
+               sizeof *t->spellings * len);
+    }
+    t->spellings_len += len;
+    return res;
+}
+
+uint32_t SourceLocTable_add_expansion(SourceLocTable* t,
+                                      SourceLoc loc,
+                                      uint32_t spellings_idx,
+                                      uint32_t len) {
+    // Empty ranges would share their start with the next expansion
+    assert(len != 0);
+    assert(spellings_idx + len <= t->spellings_len);
+    if (t->exps_len == t->exps_cap) {
+        mycc_grow_alloc((void**)&t->exp_starts,
+                        &t->exps_cap,
+                        sizeof *t->exp_starts);
+        t->exp_locs = mycc_realloc(t->exp_locs,
+                                   sizeof *t->exp_locs * t->exps_cap);
+        t->exp_spellings = mycc_realloc(t->exp_spellings,
+                                        sizeof *t->exp_spellings
+                                            * t->exps_cap);
+    }
+    // Once the offsets run out, the expansion is still recorded so its
+    // invocation can be resolved, but its tokens get SOURCE_LOC_UNKNOWN. The
+    // starts stay ascending because every later expansion gets it as well,
+    // while exp_end stays the end of the last expansion that fit.
+    const bool is_full = (t->exps_len != 0
+                          && t->exp_starts[t->exps_len - 1]
+                                 == SOURCE_LOC_UNKNOWN)
+                         || len >= SOURCE_LOC_UNKNOWN - t->exp_end;
+    if (is_full) {
+        t->exp_starts[t->exps_len] = SOURCE_LOC_UNKNOWN;
+    } else {
+        t->exp_starts[t->exps_len] = t->exp_end;
+        t->exp_end += len;
+    }
+    t->exp_locs[t->exps_len] = loc;
+    t->exp_spellings[t->exps_len] = spellings_idx;
+    return t->exps_len++;
+}
+
+// Finds the last range in starts that starts before or at loc
+static uint32_t find_range(const uint32_t* starts, uint32_t len, uint32_t loc) {
+    assert(len != 0);
+    uint32_t low = 0, high = len;
+    while (high - low > 1) {
+        const uint32_t mid = low + (high - low) / 2;
+        if (starts[mid] <= loc) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+SourceLoc SourceLocTable_get(const SourceLocTable* t, uint32_t loc) {
+    if (loc == SOURCE_LOC_UNKNOWN) {
+        return (SourceLoc){
+            .file_idx = 0,
+            .file_loc = {0, 0},
+        };
+    }
+    if ((loc & SOURCE_LOC_EXPANDED_BIT) != 0) {
+        loc &= ~SOURCE_LOC_EXPANDED_BIT;
+        assert(loc < t->exp_end);
+        const uint32_t exp = find_range(t->exp_starts, t->exps_len, loc);
+        return SourceLocTable_resolve(t, t->exp_locs[exp]);
+    }
+    assert(loc < t->end);
+    const uint32_t range = find_range(t->starts, t->len, loc);
+    return (SourceLoc){
+        .file_idx = t->file_indices[range],
+        .file_loc = {t->lines[range], loc - t->starts[range]},
+    };
+}
+
+SourceLoc SourceLocTable_resolve(const SourceLocTable* t, SourceLoc loc) {
+    while (loc.file_idx == SOURCE_LOC_EXPANSION_FILE_IDX) {
+        assert(loc.file_loc.line < t->exps_len);
+        loc = t->exp_locs[loc.file_loc.line];
+    }
+    return loc;
+}
+
+SourceLoc SourceLocTable_spelling_loc(const SourceLocTable* t, uint32_t loc) {
+    if ((loc & SOURCE_LOC_EXPANDED_BIT) == 0) {
+        return SourceLocTable_get(t, loc);
+    }
+    loc &= ~SOURCE_LOC_EXPANDED_BIT;
+    assert(loc < t->exp_end);
+    const uint32_t exp = find_range(t->exp_starts, t->exps_len, loc);
+    const uint32_t idx = t->exp_spellings[exp] + (loc - t->exp_starts[exp]);
+    assert(idx < t->spellings_len);
+    return t->spellings[idx];
+}
+
+static uint8_t* create_states(uint32_t len) {
+    uint8_t* res = mycc_alloc_or_null(sizeof *res * len);
+    if (len != 0) {
+        memset(res, TOKEN_LITERAL_UNCONVERTED, sizeof *res * len);
+    }
+    return res;
+}
+
+TokenLiterals TokenLiterals_create(const ArchTypeInfo* info,
+                                   StringPool int_spellings,
+                                   StringPool float_spellings,
+                                   StringPool str_spellings) {
+    assert(info);
+    const uint32_t int_consts_len = int_spellings.len;
+    const uint32_t float_consts_len = float_spellings.len;
+    const uint32_t str_lits_len = str_spellings.len;
+    return (TokenLiterals){
+        .info = *info,
+        .int_consts_len = int_consts_len,
+        .float_consts_len = float_consts_len,
+        .str_lits_len = str_lits_len,
+        .int_spellings = int_spellings,
+        .float_spellings = float_spellings,
+        .str_spellings = str_spellings,
+        .int_states = create_states(int_consts_len),
+        .float_states = create_states(float_consts_len),
+        .str_states = create_states(str_lits_len),
+        .int_consts = mycc_alloc_or_null(sizeof(IntVal) * int_consts_len),
+        .float_consts = mycc_alloc_or_null(sizeof(FloatVal)
+                                           * float_consts_len),
+        .str_lits = mycc_alloc_or_null(sizeof(StrLit) * str_lits_len),
+    };
+}
+
+TokenLiterals TokenLiterals_create_empty(void) {
+    return (TokenLiterals){
+        .info = {0},
+        .int_consts_len = 0,
+        .float_consts_len = 0,
+        .str_lits_len = 0,
+        .int_spellings = StringPool_create(0),
+        .float_spellings = StringPool_create(0),
+        .str_spellings = StringPool_create(0),
+        .int_states = NULL,
+        .float_states = NULL,
+        .str_states = NULL,
+        .int_consts = NULL,
+        .float_consts = NULL,
+        .str_lits = NULL,
+    };
+}
+
+// Appends a converted value, returning its index
+static uint32_t add_value(void** vals,
+                          uint8_t** states,
+                          uint32_t* len,
+                          size_t val_size) {
+    const uint32_t idx = *len;
+    ++*len;
+    *vals = mycc_realloc(*vals, val_size * *len);
+    *states = mycc_realloc(*states, sizeof **states * *len);
+    (*states)[idx] = TOKEN_LITERAL_CONVERTED;
+    return idx;
+}
+
+uint32_t TokenLiterals_add_int_const(TokenLiterals* l, IntVal val) {
+    const uint32_t idx = add_value((void**)&l->int_consts,
+                                   &l->int_states,
+                                   &l->int_consts_len,
+                                   sizeof *l->int_consts);
+    l->int_consts[idx] = val;
+    return idx;
+}
+
+uint32_t TokenLiterals_add_float_const(TokenLiterals* l, FloatVal val) {
+    const uint32_t idx = add_value((void**)&l->float_consts,
+                                   &l->float_states,
+                                   &l->float_consts_len,
+                                   sizeof *l->float_consts);
+    l->float_consts[idx] = val;
+    return idx;
+}
+
+uint32_t TokenLiterals_add_str_lit(TokenLiterals* l, StrLit lit) {
+    const uint32_t idx = add_value((void**)&l->str_lits,
+                                   &l->str_states,
+                                   &l->str_lits_len,
+                                   sizeof *l->str_lits);
+    l->str_lits[idx] = lit;
+    return idx;
+}
+
+void TokenLiterals_free(const TokenLiterals* l) {
+    StringPool_free(&l->int_spellings);
+    StringPool_free(&l->float_spellings);
+    StringPool_free(&l->str_spellings);
+    mycc_free(l->int_states);
+    mycc_free(l->float_states);
+    for (uint32_t i = 0; i < l->str_lits_len; ++i) {
+        if (l->str_states[i] == TOKEN_LITERAL_CONVERTED) {
+            StrLit_free(&l->str_lits[i]);
+        }
+    }
+    mycc_free(l->str_states);
+    mycc_free(l->int_consts);
+    mycc_free(l->float_consts);
+    mycc_free(l->str_lits);
+}
+
+// Values are cached on the first access, so the value arrays are written even
+// though the literals are const
+
+const IntVal* TokenLiterals_int_const(const TokenLiterals* l,
+                                      uint32_t idx,
+                                      SourceLoc loc,
+                                      PreprocErr* err) {
+    assert(idx < l->int_consts_len);
+    switch (l->int_states[idx]) {
+        case TOKEN_LITERAL_CONVERTED:
+            return &l->int_consts[idx];
+        case TOKEN_LITERAL_INVALID:
+            break;
+        case TOKEN_LITERAL_UNCONVERTED: {
+            const Str spelling = StringPool_get(&l->int_spellings, idx);
+            if (Str_at(spelling, 0) == '\'') {
+                const ParseCharConstRes res = parse_char_const(spelling,
+                                                               &l->info);
+                if (res.err.kind == CHAR_CONST_ERR_NONE) {
+                    l->int_consts[idx] = res.res;
+                    l->int_states[idx] = TOKEN_LITERAL_CONVERTED;
+                    return &l->int_consts[idx];
+                }
+            } else {
+                const ParseIntConstRes res = parse_int_const(spelling,
+                                                             &l->info);
+                if (res.err.kind == INT_CONST_ERR_NONE) {
+                    l->int_consts[idx] = res.res;
+                    l->int_states[idx] = TOKEN_LITERAL_CONVERTED;
+                    return &l->int_consts[idx];
+                }
+            }
+            l->int_states[idx] = TOKEN_LITERAL_INVALID;
+            break;
+        }
+        default:
+            UNREACHABLE();
+    }
+    if (err != NULL) {
+        // Converted again, so the error does not need to be stored
+        const Str spelling = StringPool_get(&l->int_spellings, idx);
+        if (Str_at(spelling, 0) == '\'') {
+            PreprocErr_set(err, PREPROC_ERR_CHAR_CONST, loc);
+            err->char_const_err = parse_char_const(spelling, &l->info).err;
+        } else {
+            PreprocErr_set(err, PREPROC_ERR_INT_CONST, loc);
+            err->int_const_err = parse_int_const(spelling, &l->info).err;
+        }
+        err->constant_spell = spelling;
+    }
+    return NULL;
+}
+
+const FloatVal* TokenLiterals_float_const(const TokenLiterals* l,
+                                          uint32_t idx,
+                                          SourceLoc loc,
+                                          PreprocErr* err) {
+    assert(idx < l->float_consts_len);
+    switch (l->float_states[idx]) {
+        case TOKEN_LITERAL_CONVERTED:
+            return &l->float_consts[idx];
+        case TOKEN_LITERAL_INVALID:
+            break;
+        case TOKEN_LITERAL_UNCONVERTED: {
+            const Str spelling = StringPool_get(&l->float_spellings, idx);
+            const ParseFloatConstRes res = parse_float_const(spelling);
+            if (res.err.kind == FLOAT_CONST_ERR_NONE) {
+                l->float_consts[idx] = res.res;
+                l->float_states[idx] = TOKEN_LITERAL_CONVERTED;
+                return &l->float_consts[idx];
+            }
+            l->float_states[idx] = TOKEN_LITERAL_INVALID;
+            break;
+        }
+        default:
+            UNREACHABLE();
+    }
+    if (err != NULL) {
+        const Str spelling = StringPool_get(&l->float_spellings, idx);
+        PreprocErr_set(err, PREPROC_ERR_FLOAT_CONST, loc);
+        err->float_const_err = parse_float_const(spelling).err;
+        err->constant_spell = spelling;
+    }
+    return NULL;
+}
+
+const StrLit* TokenLiterals_str_lit(const TokenLiterals* l,
+                                    uint32_t idx,
+                                    SourceLoc loc,
+                                    PreprocErr* err) {
+    assert(idx < l->str_lits_len);
+    switch (l->str_states[idx]) {
+        case TOKEN_LITERAL_CONVERTED:
+            return &l->str_lits[idx];
+        case TOKEN_LITERAL_INVALID:
+            break;
+        case TOKEN_LITERAL_UNCONVERTED: {
+            const Str spelling = StringPool_get(&l->str_spellings, idx);
+            StrLit lit = convert_to_str_lit(spelling);
+            if (lit.kind != STR_LIT_INCLUDE) {
+                l->str_lits[idx] = lit;
+                l->str_states[idx] = TOKEN_LITERAL_CONVERTED;
+                return &l->str_lits[idx];
+            }
+            StrLit_free(&lit);
+            l->str_states[idx] = TOKEN_LITERAL_INVALID;
+            break;
+        }
+        default:
+            UNREACHABLE();
+    }
+    if (err != NULL) {
+        PreprocErr_set(err, PREPROC_ERR_INCLUDE_STR_LIT, loc);
+    }
+    return NULL;
+}
+
 TokenArr TokenArr_create_empty(void) {
     return (TokenArr){
         .len = 0,
         .cap = 0,
         .kinds = NULL,
         .locs = NULL,
+        .loc_table = SourceLocTable_create(),
+        .literals = TokenLiterals_create_empty(),
     };
 }
 
@@ -16,16 +464,75 @@ void TokenArr_free(const TokenArr* arr) {
     mycc_free(arr->kinds);
     mycc_free(arr->val_indices);
     mycc_free(arr->locs);
-    for (uint32_t i = 0; i < arr->identifiers_len; ++i) {
-        StrBuf_free(&arr->identifiers[i]);
-    }
-    mycc_free(arr->identifiers);
-    mycc_free(arr->int_consts);
-    mycc_free(arr->float_consts);
-    for (uint32_t i = 0; i < arr->str_lits_len; ++i) {
-        StrLit_free(&arr->str_lits[i]);
+    SourceLocTable_free(&arr->loc_table);
+    StringPool_free(&arr->identifiers);
+    TokenLiterals_free(&arr->literals);
+}
+
+void TokenArr_reserve(TokenArr* arr, uint32_t num) {
+    const uint32_t needed = arr->len + num;
+    if (needed <= arr->cap) {
+        return;
     }
-    mycc_free(arr->str_lits);
+    const uint32_t grown = arr->cap + arr->cap / 2 + 1;
+    arr->cap = grown > needed ? grown : needed;
+    arr->kinds = mycc_realloc(arr->kinds, sizeof *arr->kinds * arr->cap);
+    arr->val_indices = mycc_realloc(arr->val_indices,
+                                    sizeof *arr->val_indices * arr->cap);
+    arr->locs = mycc_realloc(arr->locs, sizeof *arr->locs * arr->cap);
+}
+
+uint32_t estimate_num_tokens(size_t num_bytes) {
+    enum {
+        BYTES_PER_TOKEN = 5,
+    };
+    const size_t res = num_bytes / BYTES_PER_TOKEN + 1;
+    return res > UINT32_MAX ? UINT32_MAX : (uint32_t)res;
+}
+
+SourceLoc TokenArr_loc(const TokenArr* arr, uint32_t token_idx) {
+    assert(token_idx < arr->len);
+    return SourceLocTable_get(&arr->loc_table, arr->locs[token_idx]);
+}
+
+bool TokenArr_is_expanded(const TokenArr* arr, uint32_t token_idx) {
+    assert(token_idx < arr->len);
+    return (arr->locs[token_idx] & SOURCE_LOC_EXPANDED_BIT) != 0;
+}
+
+SourceLoc TokenArr_spelling_loc(const TokenArr* arr, uint32_t token_idx) {
+    assert(token_idx < arr->len);
+    return SourceLocTable_spelling_loc(&arr->loc_table, arr->locs[token_idx]);
+}
+
+const IntVal* TokenArr_int_const(const TokenArr* arr,
+                                 uint32_t token_idx,
+                                 PreprocErr* err) {
+    assert(arr->kinds[token_idx] == TOKEN_I_CONSTANT);
+    return TokenLiterals_int_const(&arr->literals,
+                                   arr->val_indices[token_idx],
+                                   TokenArr_loc(arr, token_idx),
+                                   err);
+}
+
+const FloatVal* TokenArr_float_const(const TokenArr* arr,
+                                     uint32_t token_idx,
+                                     PreprocErr* err) {
+    assert(arr->kinds[token_idx] == TOKEN_F_CONSTANT);
+    return TokenLiterals_float_const(&arr->literals,
+                                     arr->val_indices[token_idx],
+                                     TokenArr_loc(arr, token_idx),
+                                     err);
+}
+
+const StrLit* TokenArr_str_lit(const TokenArr* arr,
+                               uint32_t token_idx,
+                               PreprocErr* err) {
+    assert(arr->kinds[token_idx] == TOKEN_STRING_LITERAL);
+    return TokenLiterals_str_lit(&arr->literals,
+                                 arr->val_indices[token_idx],
+                                 TokenArr_loc(arr, token_idx),
+                                 err);
 }
 
 #ifdef _WIN32
@@ -33,7 +33,10 @@ CmdArgs parse_cmd_args(int argc, char** argv) {
         .files = NULL,
         .include_dirs = NULL,
         .output_file = {0, NULL},
+        .pch_file = {0, NULL},
+        .prev_ast_file = {0, NULL},
         .action = ARG_ACTION_OUTPUT_TEXT,
+        .num_threads = 1,
     };
     for (int i = 1; i < argc; ++i) {
         const char* item = argv[i];
@@ -58,6 +61,35 @@ CmdArgs parse_cmd_args(int argc, char** argv) {
                 case 'c':
                     res.action = ARG_ACTION_CONVERT_BIN_TO_TEXT;
                     break;
+                case 'H':
+                    res.action = ARG_ACTION_OUTPUT_PCH;
+                    break;
+                case 'p': {
+                    if (i == argc - 1) {
+                        CmdArgs_free(&res);
+                        exit_with_err(
+                            "-p Option without precompiled header argument\n");
+                    }
+                    const size_t sz_len = strlen(argv[i + 1]);
+                    const uint32_t len = (uint32_t)sz_len;
+                    assert((size_t)len == sz_len);
+                    res.pch_file = (CStr){len, argv[i + 1]};
+                    ++i;
+                    break;
+                }
+                case 'r': {
+                    if (i == argc - 1) {
+                        CmdArgs_free(&res);
+                        exit_with_err("-r Option without previous AST "
+                                      "argument\n");
+                    }
+                    const size_t sz_len = strlen(argv[i + 1]);
+                    const uint32_t len = (uint32_t)sz_len;
+                    assert((size_t)len == sz_len);
+                    res.prev_ast_file = (CStr){len, argv[i + 1]};
+                    ++i;
+                    break;
+                }
                 case 'I': {
                     if (i == argc - 1) {
                         CmdArgs_free(&res);
@@ -78,6 +110,25 @@ CmdArgs parse_cmd_args(int argc, char** argv) {
                     ++i;
                     break;
                 }
+                case 'j': {
+                    if (i == argc - 1) {
+                        CmdArgs_free(&res);
+                        exit_with_err("-j Option without number of jobs\n");
+                    }
+                    const char* num_str = argv[i + 1];
+                    char* end;
+                    const unsigned long num = strtoul(num_str, &end, 10);
+                    if (*num_str == '\0' || *end != '\0' || num == 0
+                        || num > UINT32_MAX) {
+                        CmdArgs_free(&res);
+                        exit_with_err_fmt(
+                            "Invalid number of jobs \"{c_str}\"\n",
+                            num_str);
+                    }
+                    res.num_threads = (uint32_t)num;
+                    ++i;
+                    break;
+                }
                 default:
                     CmdArgs_free(&res);
                     exit_with_err_fmt(
@@ -105,6 +156,9 @@ CmdArgs parse_cmd_args(int argc, char** argv) {
     } else if (res.output_file.data != NULL && res.num_files > 1) {
         CmdArgs_free(&res);
         exit_with_err("Cannot write output of multiple sources in one file\n");
+    } else if (res.prev_ast_file.data != NULL && res.num_files > 1) {
+        CmdArgs_free(&res);
+        exit_with_err("Cannot reuse a previous AST for multiple sources\n");
     }
     return res;
 }
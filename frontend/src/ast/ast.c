@@ -1,6 +1,9 @@
 #include "frontend/ast/ast.h"
 
+#include <string.h>
+
 #include "frontend/parser/ParserState.h"
+#include "frontend/preproc/preproc.h"
 #include "util/mem.h"
 #include "util/macro_util.h"
 #include "util/log.h"
@@ -48,6 +51,44 @@ static uint32_t add_node_with_type(AST* ast,
     return idx;
 }
 
+// Inserts a node at idx, which makes the subtree starting at idx its lhs. This
+// way, nodes for operators are only created when the operator is actually
+// found after its first operand
+static void insert_node_with_type(AST* ast,
+                                  uint32_t idx,
+                                  ASTNodeKind kind,
+                                  uint32_t main_token) {
+    assert(idx != 0 && idx <= ast->len);
+    AST_ensure_capacity(ast);
+
+    const uint32_t num_moved = ast->len - idx;
+    memmove(ast->kinds + idx + 1,
+            ast->kinds + idx,
+            sizeof *ast->kinds * num_moved);
+    memmove(ast->datas + idx + 1,
+            ast->datas + idx,
+            sizeof *ast->datas * num_moved);
+    ++ast->len;
+    // All rhs indices in the moved subtree point to nodes inside of it or to
+    // the node after it
+    for (uint32_t i = idx + 1; i != ast->len; ++i) {
+        const ASTNodeKind moved_kind = ast->kinds[i];
+        if (ast->datas[i].rhs != 0 && moved_kind != AST_TYPE_QUAL_LIST
+            && moved_kind != AST_STORAGE_CLASS_SPECS) {
+            ++ast->datas[i].rhs;
+        }
+    }
+
+    const uint32_t type_data_idx = ast->type_data_len;
+    ++ast->type_data_len;
+    ast->kinds[idx] = kind;
+    ast->datas[idx] = (ASTNodeData){
+        .main_token = main_token,
+        .rhs = 0,
+        .type_data_idx = type_data_idx,
+    };
+}
+
 #define CHECK_ERR(expr)                                                        \
     do {                                                                       \
         if (UNLIKELY(!(expr))) {                                               \
@@ -55,53 +96,74 @@ static uint32_t add_node_with_type(AST* ast,
         }                                                                      \
     } while (0)
 
-static bool parse_translation_unit(ParserState* s, AST* ast);
+typedef struct PrevDecls PrevDecls;
 
-// frees whole AST but leaves tokens, as they are needed for errors
-static void AST_free_error(AST* ast) {
-    mycc_free(ast->kinds);
-    mycc_free(ast->datas);
-    mycc_free(ast->type_data);
+static void parse_translation_unit(ParserState* s, AST* ast, PrevDecls* prev);
 
-    ast->len = 0;
-    ast->cap = 0;
-    ast->kinds = NULL;
-    ast->datas = NULL;
-    ast->type_data = NULL;
+// The parser creates between 1.4 and 1.6 nodes per token for the test files
+// and the benchmark corpora, and fewer for code with many macro expansions
+static uint32_t estimate_num_nodes(uint32_t num_tokens) {
+    const uint64_t res = (uint64_t)num_tokens + num_tokens / 2 + 1;
+    return res > UINT32_MAX ? UINT32_MAX : (uint32_t)res;
 }
 
-AST parse_ast(TokenArr* tokens, ParserErr* err) {
-    assert(tokens);
-    assert(err);
-
-    MYCC_TIMER_BEGIN();
-
-    ParserState s = ParserState_create(tokens, err);
-
-    // TODO: allocate appropriate size for AST
+// Parses the tokens of s, but leaves setting the tokens of the result to the
+// caller. If prev is not NULL, its declarations are reused where possible.
+static AST parse_ast_impl(ParserState* s,
+                          uint32_t num_tokens,
+                          PrevDecls* prev,
+                          ParserErrArr* errs) {
+    const uint32_t cap = estimate_num_nodes(num_tokens);
     AST res = {
         .len = 0,
-        .cap = 0,
-        .kinds = NULL,
-        .datas = NULL,
+        .cap = cap,
+        .kinds = mycc_alloc(sizeof *res.kinds * cap),
+        .datas = mycc_alloc(sizeof *res.datas * cap),
         .type_data_len = 0,
         .type_data_cap = 0,
         .type_data = NULL,
     };
 
-    if (!parse_translation_unit(&s, &res)) {
-        ParserState_free(&s);
-        AST_free_error(&res);
-        assert(err->kind != PARSER_ERR_NONE);
-        res.toks = s._arr;
-        res.len = 0;
-        res.cap = 0;
-        return res;
-    }
+    s->_errs = errs;
+    parse_translation_unit(s, &res, prev);
+    assert(s->err->kind == PARSER_ERR_NONE);
+    return res;
+}
+
+AST parse_ast(TokenArr* tokens, ParserErrArr* errs) {
+    assert(tokens);
+    assert(errs);
+
+    MYCC_TIMER_BEGIN();
+
+    const uint32_t num_tokens = tokens->len;
+    ParserErr err = ParserErr_create();
+    ParserState s = ParserState_create(tokens, &err);
+    AST res = parse_ast_impl(&s, num_tokens, NULL, errs);
     res.toks = s._arr;
+    ParserState_free(&s);
+    if (errs->len == 0) {
+        MYCC_TIMER_END("parser");
+    }
+    return res;
+}
+
+AST parse_ast_stream(PreprocStream* stream, ParserErrArr* errs) {
+    assert(stream);
+    assert(errs);
+
+    MYCC_TIMER_BEGIN();
 
+    const uint32_t num_tokens = PreprocStream_estimate_num_tokens(stream);
+    ParserErr err = ParserErr_create();
+    ParserState s = ParserState_create_stream(stream, &err);
+    AST res = parse_ast_impl(&s, num_tokens, NULL, errs);
+    ParserState_finish_stream(&s);
+    res.toks = s._arr;
     ParserState_free(&s);
-    MYCC_TIMER_END("parser");
+    if (errs->len == 0) {
+        MYCC_TIMER_END("preprocessor and parser");
+    }
     return res;
 }
 
@@ -112,19 +174,478 @@ void AST_free(AST* ast) {
     TokenArr_free(&ast->toks);
 }
 
+// Whether the tokens after the closing brace of a struct, union or enum body
+// may still belong to the same declaration
+static bool continues_declaration(const ParserState* s) {
+    switch (ParserState_curr_kind(s)) {
+        case TOKEN_IDENTIFIER:
+            return !ParserState_is_typedef(s, ParserState_curr_id_idx(s));
+        case TOKEN_ASTERISK:
+        case TOKEN_LBRACKET:
+        case TOKEN_COMMA:
+        case TOKEN_ASSIGN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Skips the rest of the item starting at start_it, in which an error was
+// found. This stops after the next ';' or after the '}' closing a brace
+// opened by the item, or before a '}' closing the enclosing block.
+static void skip_to_sync_point(ParserState* s, uint32_t start_it) {
+    uint32_t depth = 0;
+    for (uint32_t i = start_it; i != s->it; ++i) {
+        if (s->_arr.kinds[i] == TOKEN_LBRACE) {
+            ++depth;
+        } else if (s->_arr.kinds[i] == TOKEN_RBRACE && depth != 0) {
+            --depth;
+        }
+    }
+
+    while (true) {
+        switch (ParserState_curr_kind(s)) {
+            case TOKEN_INVALID:
+                return;
+            case TOKEN_SEMICOLON:
+                ParserState_accept_it(s);
+                if (depth == 0) {
+                    return;
+                }
+                break;
+            case TOKEN_LBRACE:
+                ParserState_accept_it(s);
+                ++depth;
+                break;
+            case TOKEN_RBRACE:
+                if (depth == 0) {
+                    return;
+                }
+                ParserState_accept_it(s);
+                --depth;
+                if (depth == 0 && !continues_declaration(s)) {
+                    if (ParserState_curr_kind(s) == TOKEN_SEMICOLON) {
+                        ParserState_accept_it(s);
+                    }
+                    return;
+                }
+                break;
+            default:
+                ParserState_accept_it(s);
+                break;
+        }
+    }
+}
+
+// Records the error of s and replaces the nodes of the item starting at node
+// idx and token start_it with an AST_ERROR node, so parsing can continue after
+// the item
+static void recover_from_error(ParserState* s,
+                               AST* ast,
+                               uint32_t idx,
+                               uint32_t start_it,
+                               uint32_t num_scopes) {
+    assert(s->err->kind != PARSER_ERR_NONE);
+    // An error at the same token as the previous one is usually caused by the
+    // same problem, e.g. each unclosed block reporting the end of the file
+    const ParserErrArr* errs = s->_errs;
+    if (errs->len == 0
+        || errs->errs[errs->len - 1].err_token_idx != s->err->err_token_idx) {
+        ParserErrArr_push(s->_errs, s->err);
+    }
+    *s->err = ParserErr_create();
+
+    while (s->_len > num_scopes) {
+        ParserState_pop_scope(s);
+    }
+    skip_to_sync_point(s, start_it);
+    // A '}' outside of any block is skipped as well
+    if (s->it == start_it && ParserState_curr_kind(s) != TOKEN_INVALID) {
+        ParserState_accept_it(s);
+    }
+
+    ast->len = idx;
+    add_node(ast, AST_ERROR, start_it);
+}
+
+enum {
+    // Shorter declarations are parsed again, as that is about as fast as
+    // finding and checking them
+    PREV_DECL_MIN_TOKENS = 16,
+    // Number of token kinds at the start of a declaration that are hashed
+    PREV_DECL_KEY_LEN = PREV_DECL_MIN_TOKENS,
+    // Limits the declarations checked at one position, in case many of them
+    // start with the same token kinds
+    PREV_DECL_MAX_CANDIDATES = 8,
+};
+
+// Top-level declaration of a previous AST
+typedef struct {
+    uint32_t first_token, num_tokens;
+    uint32_t first_node, num_nodes;
+    // Index of the next declaration in the same bucket, or UINT32_MAX
+    uint32_t next;
+} PrevDecl;
+
+// Top-level declarations of a previous AST, hashed by the kinds of their first
+// PREV_DECL_KEY_LEN tokens
+struct PrevDecls {
+    const AST* ast;
+    uint32_t len, cap;
+    PrevDecl* decls;
+    // The number of buckets is a power of two, so this is used as a mask
+    uint32_t bucket_mask;
+    uint32_t* buckets;
+    // Declaration after the one that was reused last. Unchanged declarations
+    // usually stay in the same order, so this is checked first.
+    uint32_t expected;
+};
+
+static uint32_t hash_token_kinds(const uint8_t* kinds) {
+    // FNV-1a
+    uint32_t res = 2166136261u;
+    for (uint32_t i = 0; i != PREV_DECL_KEY_LEN; ++i) {
+        res = (res ^ kinds[i]) * 16777619u;
+    }
+    return res;
+}
+
+// Gets the index of the node after the external declaration at idx, or 0 if
+// it cannot be determined from the nodes
+static uint32_t get_external_declaration_end(const AST* ast, uint32_t idx) {
+    const ASTNodeData* datas = ast->datas;
+    switch (ast->kinds[idx]) {
+        case AST_FUNC_DEF: {
+            // The compound statement is the last part of a function definition
+            const uint32_t impl = datas[idx].rhs;
+            const uint32_t sub_impl = datas[impl].rhs;
+            const uint32_t body = datas[sub_impl].rhs;
+            if (ast->kinds[impl] != AST_FUNC_DEF_IMPL
+                || ast->kinds[sub_impl] != AST_FUNC_DEF_SUB_IMPL
+                || ast->kinds[body] != AST_COMPOUND_STATEMENT) {
+                return 0;
+            }
+            return datas[body].rhs;
+        }
+        case AST_DECLARATION: {
+            const uint32_t specs_and_list = datas[idx].rhs;
+            if (ast->kinds[specs_and_list]
+                != AST_DECLARATION_SPECS_AND_INIT_DECLARATOR_LIST) {
+                return 0;
+            }
+            const uint32_t list = datas[specs_and_list].rhs;
+            if (list != 0) {
+                return ast->kinds[list] == AST_INIT_DECLARATOR_LIST
+                           ? datas[list].rhs
+                           : 0;
+            }
+            // Declaration without declarators, which ends with the
+            // declaration specifiers and their attributes
+            if (ast->kinds[specs_and_list + 1] != AST_DECLARATION_SPECS) {
+                return 0;
+            }
+            const uint32_t specs_end = datas[specs_and_list + 1].rhs;
+            if (specs_end != ast->len
+                && ast->kinds[specs_end] == AST_ATTRIBUTE_SPEC_SEQUENCE) {
+                return datas[specs_end].rhs;
+            }
+            return specs_end;
+        }
+        case AST_ATTRIBUTE_DECLARATION:
+            return ast->kinds[idx + 1] == AST_ATTRIBUTE_SPEC_SEQUENCE
+                       ? datas[idx + 1].rhs
+                       : 0;
+        case AST_STATIC_ASSERT_DECLARATION:
+            // Without the message, the end of the expression is not known
+            return datas[idx].rhs == 0 ? 0 : datas[idx].rhs + 1;
+        case AST_ERROR:
+            return idx + 1;
+        default:
+            return 0;
+    }
+}
+
+// Splits the previous AST into its top-level declarations. If its shape is
+// not as expected, nothing is reused.
+static bool PrevDecls_split(PrevDecls* prev) {
+    const AST* ast = prev->ast;
+    if (ast->len == 0 || ast->kinds[0] != AST_TRANSLATION_UNIT
+        || ast->datas[0].rhs != ast->len) {
+        return false;
+    }
+    uint32_t idx = 1;
+    while (idx != ast->len) {
+        const uint32_t end = get_external_declaration_end(ast, idx);
+        if (end <= idx || end > ast->len) {
+            return false;
+        }
+        if (prev->len == prev->cap) {
+            mycc_grow_alloc((void**)&prev->decls,
+                            &prev->cap,
+                            sizeof *prev->decls);
+        }
+        prev->decls[prev->len] = (PrevDecl){
+            .first_token = ast->datas[idx].main_token,
+            .first_node = idx,
+            .num_nodes = end - idx,
+        };
+        ++prev->len;
+        idx = end;
+    }
+    // Each declaration takes the tokens up to the start of the next one
+    for (uint32_t i = 0; i != prev->len; ++i) {
+        const uint32_t next_token = i == prev->len - 1
+                                        ? ast->toks.len
+                                        : prev->decls[i + 1].first_token;
+        if (next_token <= prev->decls[i].first_token) {
+            return false;
+        }
+        prev->decls[i].num_tokens = next_token - prev->decls[i].first_token;
+    }
+    return true;
+}
+
+static PrevDecls PrevDecls_create(const AST* ast) {
+    PrevDecls res = {
+        .ast = ast,
+        .len = 0,
+        .cap = 0,
+        .decls = NULL,
+        .bucket_mask = 0,
+        .buckets = NULL,
+        .expected = 0,
+    };
+    if (!PrevDecls_split(&res)) {
+        res.len = 0;
+        return res;
+    }
+
+    // Shorter declarations are left out
+    uint32_t num_long = 0;
+    for (uint32_t i = 0; i != res.len; ++i) {
+        if (res.decls[i].num_tokens >= PREV_DECL_MIN_TOKENS) {
+            res.decls[num_long] = res.decls[i];
+            ++num_long;
+        }
+    }
+    res.len = num_long;
+    if (res.len == 0) {
+        return res;
+    }
+
+    uint32_t num_buckets = 1;
+    while (num_buckets < res.len * 2) {
+        num_buckets *= 2;
+    }
+    res.bucket_mask = num_buckets - 1;
+    res.buckets = mycc_alloc(sizeof *res.buckets * num_buckets);
+    memset(res.buckets, 0xff, sizeof *res.buckets * num_buckets);
+    // Inserted from the back, so each bucket is in the order of the file
+    for (uint32_t i = res.len; i != 0; --i) {
+        PrevDecl* decl = &res.decls[i - 1];
+        const uint32_t hash = hash_token_kinds(ast->toks.kinds
+                                               + decl->first_token);
+        uint32_t* bucket = &res.buckets[hash & res.bucket_mask];
+        decl->next = *bucket;
+        *bucket = i - 1;
+    }
+    return res;
+}
+
+static void PrevDecls_free(const PrevDecls* prev) {
+    mycc_free(prev->decls);
+    mycc_free(prev->buckets);
+}
+
+AST parse_ast_incremental(TokenArr* tokens,
+                          const AST* prev,
+                          ParserErrArr* errs) {
+    assert(tokens);
+    assert(prev);
+    assert(errs);
+
+    MYCC_TIMER_BEGIN();
+
+    const uint32_t num_tokens = tokens->len;
+    PrevDecls prev_decls = PrevDecls_create(prev);
+    ParserErr err = ParserErr_create();
+    ParserState s = ParserState_create(tokens, &err);
+    AST res = parse_ast_impl(&s, num_tokens, &prev_decls, errs);
+    res.toks = s._arr;
+    ParserState_free(&s);
+    PrevDecls_free(&prev_decls);
+    if (errs->len == 0) {
+        MYCC_TIMER_END("incremental parser");
+    }
+    return res;
+}
+
+// Whether the parser would create the same nodes for the tokens at the
+// current position as for decl. This is the case if the token kinds are the
+// same and each identifier is a typedef name or enum constant exactly if it
+// was one before. The copied nodes refer to the new tokens, so spellings and
+// values of the tokens do not matter.
+//
+// Declarations that define typedef names or enum constants or that contain
+// errors are always parsed again, so the state of the parser is the same as
+// if everything was parsed. Otherwise first_type_data is set to the first
+// type data index of decl, as the type data of a declaration without errors
+// is allocated in one piece.
+static bool matches_prev_decl(const ParserState* s,
+                              const AST* prev_ast,
+                              const PrevDecl* decl,
+                              uint32_t* first_type_data) {
+    const TokenArr* toks = &s->_arr;
+    if (toks->len - s->it < decl->num_tokens
+        || memcmp(toks->kinds + s->it,
+                  prev_ast->toks.kinds + decl->first_token,
+                  decl->num_tokens)
+               != 0) {
+        return false;
+    }
+    uint32_t num_bound = 0;
+    uint32_t min_type_data = UINT32_MAX;
+    const uint32_t nodes_end = decl->first_node + decl->num_nodes;
+    for (uint32_t i = decl->first_node; i != nodes_end; ++i) {
+        const uint32_t type_data_idx = prev_ast->datas[i].type_data_idx;
+        min_type_data = type_data_idx < min_type_data ? type_data_idx
+                                                      : min_type_data;
+        switch (prev_ast->kinds[i]) {
+            case AST_ERROR:
+            case AST_STORAGE_CLASS_SPEC_TYPEDEF:
+            case AST_ENUM_CONSTANT_AND_ATTRIBUTE:
+                return false;
+            case AST_TYPE_SPEC_TYPEDEF_NAME:
+            case AST_ENUM_CONSTANT: {
+                const uint32_t token_idx = prev_ast->datas[i].main_token
+                                           - decl->first_token + s->it;
+                const uint32_t id_idx = toks->val_indices[token_idx];
+                const bool is_bound = prev_ast->kinds[i] == AST_ENUM_CONSTANT
+                                          ? ParserState_is_enum_constant(s,
+                                                                         id_idx)
+                                          : ParserState_is_typedef(s, id_idx);
+                if (!is_bound) {
+                    return false;
+                }
+                ++num_bound;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    // No other identifier may be a typedef name or enum constant now
+    const uint32_t tokens_end = s->it + decl->num_tokens;
+    for (uint32_t i = s->it; i != tokens_end; ++i) {
+        if (toks->kinds[i] != TOKEN_IDENTIFIER) {
+            continue;
+        }
+        if (ParserState_is_bound(s, toks->val_indices[i])) {
+            if (num_bound == 0) {
+                return false;
+            }
+            --num_bound;
+        }
+    }
+    *first_type_data = min_type_data;
+    return num_bound == 0;
+}
+
+// Copies the nodes of decl to the end of ast, moving all indices to the
+// current position, and skips the tokens of decl
+static void copy_prev_decl(ParserState* s,
+                           AST* ast,
+                           const AST* prev_ast,
+                           const PrevDecl* decl,
+                           uint32_t first_type_data) {
+    const uint32_t num_nodes = decl->num_nodes;
+    if (ast->cap - ast->len < num_nodes) {
+        while (ast->cap - ast->len < num_nodes) {
+            ast->cap = ast->cap == 0 ? 1 : ast->cap * 2;
+        }
+        ast->kinds = mycc_realloc(ast->kinds, sizeof *ast->kinds * ast->cap);
+        ast->datas = mycc_realloc(ast->datas, sizeof *ast->datas * ast->cap);
+    }
+    memcpy(ast->kinds + ast->len,
+           prev_ast->kinds + decl->first_node,
+           sizeof *ast->kinds * num_nodes);
+
+    // Offsets may wrap around, which is fine for unsigned integers
+    const uint32_t node_offset = ast->len - decl->first_node;
+    const uint32_t token_offset = s->it - decl->first_token;
+    const uint32_t type_data_offset = ast->type_data_len - first_type_data;
+    uint32_t num_type_data = 0;
+    for (uint32_t i = 0; i != num_nodes; ++i) {
+        const ASTNodeKind kind = prev_ast->kinds[decl->first_node + i];
+        ASTNodeData data = prev_ast->datas[decl->first_node + i];
+        data.main_token += token_offset;
+        if (data.rhs != 0 && kind != AST_TYPE_QUAL_LIST
+            && kind != AST_STORAGE_CLASS_SPECS) {
+            data.rhs += node_offset;
+        }
+        if (data.type_data_idx != UINT32_MAX) {
+            data.type_data_idx += type_data_offset;
+            ++num_type_data;
+        }
+        ast->datas[ast->len + i] = data;
+    }
+    ast->len += num_nodes;
+    ast->type_data_len += num_type_data;
+    s->it += decl->num_tokens;
+}
+
+// Reuses a declaration of prev if the tokens at the current position match it
+static bool reuse_prev_decl(ParserState* s, AST* ast, PrevDecls* prev) {
+    assert(s->_stream == NULL);
+    const AST* prev_ast = prev->ast;
+    uint32_t found = UINT32_MAX;
+    uint32_t first_type_data = 0;
+    if (prev->expected < prev->len
+        && matches_prev_decl(s,
+                             prev_ast,
+                             &prev->decls[prev->expected],
+                             &first_type_data)) {
+        found = prev->expected;
+    } else if (prev->len != 0 && s->_arr.len - s->it >= PREV_DECL_KEY_LEN) {
+        const uint32_t hash = hash_token_kinds(s->_arr.kinds + s->it);
+        uint32_t idx = prev->buckets[hash & prev->bucket_mask];
+        for (uint32_t i = 0; i != PREV_DECL_MAX_CANDIDATES && idx != UINT32_MAX;
+             ++i) {
+            if (matches_prev_decl(s,
+                                  prev_ast,
+                                  &prev->decls[idx],
+                                  &first_type_data)) {
+                found = idx;
+                break;
+            }
+            idx = prev->decls[idx].next;
+        }
+    }
+    if (found == UINT32_MAX) {
+        return false;
+    }
+    copy_prev_decl(s, ast, prev_ast, &prev->decls[found], first_type_data);
+    prev->expected = found + 1;
+    return true;
+}
+
 static uint32_t parse_external_declaration(ParserState* s, AST* ast);
 
-static bool parse_translation_unit(ParserState* s, AST* ast) {
+static void parse_translation_unit(ParserState* s, AST* ast, PrevDecls* prev) {
     const uint32_t res = add_node(ast, AST_TRANSLATION_UNIT, s->it);
     assert(res == 0);
 
     while (ParserState_curr_kind(s) != TOKEN_INVALID) {
+        if (prev != NULL && reuse_prev_decl(s, ast, prev)) {
+            continue;
+        }
+        const uint32_t idx = ast->len;
+        const uint32_t start_it = s->it;
         if (!parse_external_declaration(s, ast)) {
-            return false;
+            recover_from_error(s, ast, idx, start_it, 1);
         }
     }
     ast->datas[res].rhs = ast->len;
-    return true;
 }
 
 static uint32_t parse_statement(ParserState* s, AST* ast);
@@ -579,9 +1100,14 @@ static uint32_t parse_compound_statement(ParserState* s, AST* ast) {
     ParserState_push_scope(s);
     const uint32_t res = add_node(ast, AST_COMPOUND_STATEMENT, s->it);
     ParserState_accept_it(s);
+    const uint32_t num_scopes = s->_len;
     while (ParserState_curr_kind(s) != TOKEN_RBRACE
            && ParserState_curr_kind(s) != TOKEN_INVALID) {
-        CHECK_ERR(parse_block_item(s, ast));
+        const uint32_t idx = ast->len;
+        const uint32_t start_it = s->it;
+        if (!parse_block_item(s, ast)) {
+            recover_from_error(s, ast, idx, start_it, num_scopes);
+        }
     }
     CHECK_ERR(ParserState_accept(s, TOKEN_RBRACE));
     ParserState_pop_scope(s);
@@ -1051,7 +1577,7 @@ static uint32_t parse_declaration_specs(ParserState* s,
                                           AST* ast,
                                           bool* is_typedef) {
     if (UNLIKELY(!is_declaration_spec(s))) {
-        // TODO: error
+        ParserErr_set(s->err, PARSER_ERR_EXPECTED_DECLARATION_SPECS, s->it);
         return 0;
     }
     const uint32_t res = add_node(ast, AST_DECLARATION_SPECS, s->it);
@@ -1084,7 +1610,9 @@ static uint32_t parse_attrs_and_declaration_specs(ParserState* s, AST* ast) {
         const uint32_t rhs = parse_declaration_specs(s, ast, &is_typedef);
         CHECK_ERR(rhs);
         if (UNLIKELY(is_typedef)) {
-            // TODO: err
+            ParserErr_set(s->err,
+                          PARSER_ERR_TYPEDEF_PARAM_DECL,
+                          ast->datas[rhs].main_token);
             return 0;
         }
         ast->datas[res].rhs = rhs;
@@ -1093,7 +1621,9 @@ static uint32_t parse_attrs_and_declaration_specs(ParserState* s, AST* ast) {
         bool is_typedef = false;
         const uint32_t res = parse_declaration_specs(s, ast, &is_typedef);
         if (UNLIKELY(is_typedef)) {
-            // TODO: err
+            ParserErr_set(s->err,
+                          PARSER_ERR_TYPEDEF_PARAM_DECL,
+                          ast->datas[res].main_token);
             return 0;
         }
         return res;
@@ -1134,20 +1664,21 @@ static uint32_t parse_abs_decl_or_decl(ParserState* s, AST* ast) {
             // lhs of rhs
             const uint32_t bracket_decl = parse_abs_decl_or_decl(s, ast);
             CHECK_ERR(bracket_decl);
-            uint32_t internal_rhs;
-            if (ast->kinds[bracket_decl] == AST_ABS_DECLARATOR) {
-                ast->kinds[res] = AST_ABS_DECLARATOR;
-                ast->kinds[rhs] = AST_DIRECT_ABS_DECLARATOR;
-                CHECK_ERR(ParserState_accept(s, TOKEN_RBRACKET));
-                internal_rhs = parse_abs_arr_or_func_suffix_list(s, ast);
-            } else {
-                ast->kinds[res] = AST_DECLARATOR;
-                ast->kinds[rhs] = AST_DIRECT_DECLARATOR;
-                CHECK_ERR(ParserState_accept(s, TOKEN_RBRACKET));
-                internal_rhs = parse_arr_or_func_suffix_list(s, ast);
+            const bool is_abs = ast->kinds[bracket_decl]
+                                == AST_ABS_DECLARATOR;
+            ast->kinds[res] = is_abs ? AST_ABS_DECLARATOR : AST_DECLARATOR;
+            ast->kinds[rhs] = is_abs ? AST_DIRECT_ABS_DECLARATOR
+                                     : AST_DIRECT_DECLARATOR;
+            CHECK_ERR(ParserState_accept(s, TOKEN_RBRACKET));
+            // The suffixes are optional, e.g. in int (*ptr)
+            if (ParserState_curr_kind(s) == TOKEN_LBRACKET
+                || ParserState_curr_kind(s) == TOKEN_LINDEX) {
+                const uint32_t internal_rhs =
+                    is_abs ? parse_abs_arr_or_func_suffix_list(s, ast)
+                           : parse_arr_or_func_suffix_list(s, ast);
+                CHECK_ERR(internal_rhs);
+                ast->datas[rhs].rhs = internal_rhs;
             }
-            CHECK_ERR(internal_rhs);
-            ast->datas[rhs].rhs = internal_rhs;
             assert(ast->kinds[rhs] != AST_TRANSLATION_UNIT);
             break;
         }
@@ -1384,7 +1915,8 @@ static uint32_t parse_member_declaration_list(ParserState* s, AST* ast) {
     CHECK_ERR(parse_member_declaration(s, ast));
 
     // TODO: condition may be wrong
-    while (ParserState_curr_kind(s) != TOKEN_RBRACE) {
+    while (ParserState_curr_kind(s) != TOKEN_RBRACE
+           && ParserState_curr_kind(s) != TOKEN_INVALID) {
         CHECK_ERR(parse_member_declaration(s, ast));
     }
     ast->datas[res].rhs = ast->len;
@@ -1408,7 +1940,11 @@ static uint32_t parse_struct_union_body(ParserState* s, AST* ast) {
 
     // neither lhs or rhs exists
     if (UNLIKELY(ast->len == res + 1)) {
-        // TODO: error
+        static const TokenKind ex[] = {
+            TOKEN_IDENTIFIER,
+            TOKEN_LBRACE,
+        };
+        expected_tokens_error(s, ex, ARR_LEN(ex));
         return 0;
     }
     return res;
@@ -1453,9 +1989,12 @@ static uint32_t parse_attribute_id(ParserState* s, AST* ast, bool* has_id) {
 static uint32_t parse_enum_constant_and_attribute(ParserState* s, AST* ast) {
     const uint32_t res = add_node(ast, AST_ENUM_CONSTANT_AND_ATTRIBUTE, s->it);
     const uint32_t const_idx = s->it;
-    // TODO: this might error if current token is not identifier
+    if (UNLIKELY(ParserState_curr_kind(s) != TOKEN_IDENTIFIER)) {
+        expected_token_error(s, TOKEN_IDENTIFIER);
+        return 0;
+    }
     const uint32_t identifier_idx = ParserState_curr_id_idx(s);
-    CHECK_ERR(ParserState_accept(s, TOKEN_IDENTIFIER));
+    ParserState_accept_it(s);
     add_node_with_type(ast, AST_ENUM_CONSTANT, const_idx);
     CHECK_ERR(ParserState_register_enum_constant(s, identifier_idx, const_idx));
     if (ParserState_curr_kind(s) == TOKEN_LINDEX) {
@@ -1624,8 +2163,6 @@ static uint32_t parse_align_spec(ParserState* s, AST* ast) {
 }
 
 static uint32_t parse_type_spec_qual(ParserState* s, AST* ast) {
-    assert(is_type_spec(s) || is_type_qual(ParserState_curr_kind(s))
-           || ParserState_curr_kind(s) == TOKEN_ALIGNAS);
     if (curr_is_type_qual(s)) {
         return parse_type_qual(s, ast);
     } else if (is_type_spec(s)) {
@@ -1654,11 +2191,10 @@ static uint32_t parse_type_spec_qual(ParserState* s, AST* ast) {
             TOKEN_ENUM,
             TOKEN_IDENTIFIER, // typedef name
             // TODO: typeof and typeof_unqual
-            // type_qual
+            // type_qual (_Atomic is already in the type specs)
             TOKEN_CONST,
             TOKEN_RESTRICT,
             TOKEN_VOLATILE,
-            TOKEN_ATOMIC,
             // func_spec
             TOKEN_INLINE,
             TOKEN_NORETURN,
@@ -2118,8 +2654,7 @@ static uint32_t parse_generic_sel(ParserState* s, AST* ast) {
 }
 
 static uint32_t parse_primary_expr(ParserState* s, AST* ast) {
-    // TODO: this might not need a node
-    const uint32_t res = add_node_with_type(ast, AST_PRIMARY_EXPR, s->it);
+    const uint32_t res = ast->len;
     switch (ParserState_curr_kind(s)) {
         case TOKEN_IDENTIFIER:
             // TODO: it should be fine to consider enum constants identifiers
@@ -2144,6 +2679,10 @@ static uint32_t parse_primary_expr(ParserState* s, AST* ast) {
             ParserState_accept_it(s);
             break;
         case TOKEN_LBRACKET:
+            // The node is needed to keep the brackets from being lost, as
+            // chains of operators with the same precedence are stored like
+            // right associative ones
+            add_node_with_type(ast, AST_PRIMARY_EXPR, s->it);
             ParserState_accept_it(s);
             CHECK_ERR(parse_expr(s, ast));
             CHECK_ERR(ParserState_accept(s, TOKEN_RBRACKET));
@@ -2341,14 +2880,19 @@ static bool is_postfix_op(TokenKind t) {
 }
 
 static uint32_t parse_postfix_expr(ParserState* s, AST* ast) {
-    // TODO: might not need node
-    const uint32_t res = add_node_with_type(ast, AST_POSTFIX_EXPR, s->it);
-
+    const uint32_t start_token_idx = s->it;
+    uint32_t res;
     if (ParserState_curr_kind(s) == TOKEN_LBRACKET && next_is_type_name(s)) {
-        CHECK_ERR(parse_compound_literal(s, ast));
+        res = parse_compound_literal(s, ast);
     } else {
-        CHECK_ERR(parse_primary_expr(s, ast));
+        res = parse_primary_expr(s, ast);
+    }
+    CHECK_ERR(res);
+
+    if (!is_postfix_op(ParserState_curr_kind(s))) {
+        return res;
     }
+    insert_node_with_type(ast, res, AST_POSTFIX_EXPR, start_token_idx);
 
     uint32_t curr_node_idx = res;
     while (is_postfix_op(ParserState_curr_kind(s))) {
@@ -2400,27 +2944,25 @@ static uint32_t parse_unary_expr(ParserState* s, AST* ast);
 
 // TODO: does not work with compound literals
 static uint32_t parse_cast_expr(ParserState* s, AST* ast) {
-    // TODO: might not need a node
+    if (ParserState_curr_kind(s) != TOKEN_LBRACKET || !next_is_type_name(s)) {
+        return parse_unary_expr(s, ast);
+    }
     const uint32_t start_token_idx = s->it;
     const uint32_t start_len = ast->len;
     const uint32_t res = add_node_with_type(ast, AST_CAST_EXPR, s->it);
-    if (ParserState_curr_kind(s) == TOKEN_LBRACKET && next_is_type_name(s)) {
-        ParserState_accept_it(s);
-        CHECK_ERR(parse_type_name(s, ast));
-        CHECK_ERR(ParserState_accept(s, TOKEN_RBRACKET));
-        if (ParserState_curr_kind(s) == TOKEN_LBRACE) {
-            // TODO: this is herrendous, fix this
-            s->it = start_token_idx;
-            ast->len = start_len;
-            return parse_postfix_expr(s, ast);
-        }
-
-        const uint32_t rhs = parse_cast_expr(s, ast);
-        CHECK_ERR(rhs);
-        ast->datas[res].rhs = rhs;
-    } else {
-        CHECK_ERR(parse_unary_expr(s, ast));
+    ParserState_accept_it(s);
+    CHECK_ERR(parse_type_name(s, ast));
+    CHECK_ERR(ParserState_accept(s, TOKEN_RBRACKET));
+    if (ParserState_curr_kind(s) == TOKEN_LBRACE) {
+        // TODO: this is herrendous, fix this
+        s->it = start_token_idx;
+        ast->len = start_len;
+        return parse_postfix_expr(s, ast);
     }
+
+    const uint32_t rhs = parse_cast_expr(s, ast);
+    CHECK_ERR(rhs);
+    ast->datas[res].rhs = rhs;
     return res;
 }
 
@@ -2510,194 +3052,92 @@ static uint32_t parse_unary_expr(ParserState* s, AST* ast) {
     }
 }
 
-static uint32_t parse_binary_expr_multiple_ops(
-    ParserState* s,
-    AST* ast,
-    ASTNodeKind default_kind,
-    uint32_t (*parse_child)(ParserState*, AST*),
-    ASTNodeKind (*op_to_node_kind)(TokenKind)) {
-    // TODO: might not need node
-    const uint32_t res = add_node_with_type(ast, default_kind, s->it);
-    CHECK_ERR(parse_child(s, ast));
-
-    const ASTNodeKind kind = op_to_node_kind(ParserState_curr_kind(s));
-    if (kind != AST_TRANSLATION_UNIT) {
-        ast->kinds[res] = kind;
-        ParserState_accept_it(s);
-        const uint32_t rhs = parse_binary_expr_multiple_ops(s,
-                                                            ast,
-                                                            default_kind,
-                                                            parse_child,
-                                                            op_to_node_kind);
-        CHECK_ERR(rhs);
-        ast->datas[res].rhs = rhs;
-    }
-    return res;
-}
-
-static ASTNodeKind mul_op_to_mul_expr_kind(TokenKind k) {
-    switch (k) {
-        case TOKEN_ASTERISK:
-            return AST_MUL_EXPR;
-        case TOKEN_DIV:
-            return AST_DIV_EXPR;
-        case TOKEN_MOD:
-            return AST_MOD_EXPR;
-        default:
-            return AST_TRANSLATION_UNIT;
-    }
-}
-
-static uint32_t parse_mul_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_multiple_ops(s,
-                                          ast,
-                                          AST_MUL_EXPR,
-                                          parse_cast_expr,
-                                          mul_op_to_mul_expr_kind);
-}
-
-static ASTNodeKind add_op_to_add_expr_kind(TokenKind k) {
-    switch (k) {
-        case TOKEN_ADD:
-            return AST_ADD_EXPR;
-        case TOKEN_SUB:
-            return AST_SUB_EXPR;
-        default:
-            return AST_TRANSLATION_UNIT;
-    }
-}
-
-static uint32_t parse_add_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_multiple_ops(s,
-                                          ast,
-                                          AST_ADD_EXPR,
-                                          parse_mul_expr,
-                                          add_op_to_add_expr_kind);
-}
-
-static ASTNodeKind shift_op_to_shift_expr_kind(TokenKind k) {
-    switch (k) {
-        case TOKEN_LSHIFT:
-            return AST_LSHIFT_EXPR;
-        case TOKEN_RSHIFT:
-            return AST_RSHIFT_EXPR;
-        default:
-            return AST_TRANSLATION_UNIT;
-    }
-}
-
-static uint32_t parse_shift_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_multiple_ops(s,
-                                          ast,
-                                          AST_LSHIFT_EXPR,
-                                          parse_add_expr,
-                                          shift_op_to_shift_expr_kind);
-}
-
-static ASTNodeKind rel_op_to_rel_expr_kind(TokenKind k) {
+// Precedences of the binary operators, operators with a higher precedence
+// bind more tightly
+enum {
+    PREC_NONE = 0,
+    PREC_LOG_OR,
+    PREC_LOG_AND,
+    PREC_OR,
+    PREC_XOR,
+    PREC_AND,
+    PREC_EQ,
+    PREC_REL,
+    PREC_SHIFT,
+    PREC_ADD,
+    PREC_MUL,
+};
+
+typedef struct {
+    uint8_t prec;
+    uint8_t kind;
+} BinaryOp;
+
+static BinaryOp get_binary_op(TokenKind k) {
     switch (k) {
+        case TOKEN_LOR:
+            return (BinaryOp){PREC_LOG_OR, AST_LOG_OR_EXPR};
+        case TOKEN_LAND:
+            return (BinaryOp){PREC_LOG_AND, AST_LOG_AND_EXPR};
+        case TOKEN_OR:
+            return (BinaryOp){PREC_OR, AST_OR_EXPR};
+        case TOKEN_XOR:
+            return (BinaryOp){PREC_XOR, AST_XOR_EXPR};
+        case TOKEN_AND:
+            return (BinaryOp){PREC_AND, AST_AND_EXPR};
+        case TOKEN_EQ:
+            return (BinaryOp){PREC_EQ, AST_EQ_EXPR};
+        case TOKEN_NE:
+            return (BinaryOp){PREC_EQ, AST_NE_EXPR};
         case TOKEN_LT:
-            return AST_REL_EXPR_LT;
+            return (BinaryOp){PREC_REL, AST_REL_EXPR_LT};
         case TOKEN_GT:
-            return AST_REL_EXPR_GT;
+            return (BinaryOp){PREC_REL, AST_REL_EXPR_GT};
         case TOKEN_LE:
-            return AST_REL_EXPR_LE;
+            return (BinaryOp){PREC_REL, AST_REL_EXPR_LE};
         case TOKEN_GE:
-            return AST_REL_EXPR_GE;
+            return (BinaryOp){PREC_REL, AST_REL_EXPR_GE};
+        case TOKEN_LSHIFT:
+            return (BinaryOp){PREC_SHIFT, AST_LSHIFT_EXPR};
+        case TOKEN_RSHIFT:
+            return (BinaryOp){PREC_SHIFT, AST_RSHIFT_EXPR};
+        case TOKEN_ADD:
+            return (BinaryOp){PREC_ADD, AST_ADD_EXPR};
+        case TOKEN_SUB:
+            return (BinaryOp){PREC_ADD, AST_SUB_EXPR};
+        case TOKEN_ASTERISK:
+            return (BinaryOp){PREC_MUL, AST_MUL_EXPR};
+        case TOKEN_DIV:
+            return (BinaryOp){PREC_MUL, AST_DIV_EXPR};
+        case TOKEN_MOD:
+            return (BinaryOp){PREC_MUL, AST_MOD_EXPR};
         default:
-            return AST_TRANSLATION_UNIT;
+            return (BinaryOp){PREC_NONE, AST_TRANSLATION_UNIT};
     }
 }
 
-static uint32_t parse_rel_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_multiple_ops(s,
-                                          ast,
-                                          AST_REL_EXPR_GT,
-                                          parse_shift_expr,
-                                          rel_op_to_rel_expr_kind);
-}
-
-static ASTNodeKind eq_op_to_eq_expr_kind(TokenKind k) {
-    switch (k) {
-        case TOKEN_EQ:
-            return AST_EQ_EXPR;
-        case TOKEN_NE:
-            return AST_NE_EXPR;
-        default:
-            return AST_TRANSLATION_UNIT;
-    }
-}
-
-static uint32_t parse_eq_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_multiple_ops(s,
-                                          ast,
-                                          AST_EQ_EXPR,
-                                          parse_rel_expr,
-                                          eq_op_to_eq_expr_kind);
-}
-
-static uint32_t parse_binary_expr_single_op(
-    ParserState* s,
-    AST* ast,
-    uint32_t (*parse_child)(ParserState*, AST* ast),
-    TokenKind op,
-    ASTNodeKind kind) {
-    const uint32_t res = add_node_with_type(ast, kind, s->it);
-    CHECK_ERR(parse_child(s, ast));
+// Parses binary operators with a precedence of at least min_prec using
+// precedence climbing, so nodes are only created for operators that are
+// actually present. The rhs of an operator also contains all following
+// operators with the same precedence, so "a - b - c" is stored as
+// a - (b - c), like the grammar in ast.h describes it
+static uint32_t parse_binary_expr(ParserState* s, AST* ast, uint8_t min_prec) {
+    const uint32_t start_token_idx = s->it;
+    const uint32_t res = parse_cast_expr(s, ast);
+    CHECK_ERR(res);
 
-    if (ParserState_curr_kind(s) == op) {
+    BinaryOp op = get_binary_op(ParserState_curr_kind(s));
+    while (op.prec != PREC_NONE && op.prec >= min_prec) {
+        insert_node_with_type(ast, res, op.kind, start_token_idx);
         ParserState_accept_it(s);
-        const uint32_t rhs = parse_binary_expr_single_op(s,
-                                                         ast,
-                                                         parse_child,
-                                                         op,
-                                                         kind);
+        const uint32_t rhs = parse_binary_expr(s, ast, op.prec);
         CHECK_ERR(rhs);
         ast->datas[res].rhs = rhs;
+        op = get_binary_op(ParserState_curr_kind(s));
     }
     return res;
 }
 
-static uint32_t parse_and_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_single_op(s,
-                                       ast,
-                                       parse_eq_expr,
-                                       TOKEN_AND,
-                                       AST_AND_EXPR);
-}
-
-static uint32_t parse_xor_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_single_op(s,
-                                       ast,
-                                       parse_and_expr,
-                                       TOKEN_XOR,
-                                       AST_XOR_EXPR);
-}
-
-static uint32_t parse_or_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_single_op(s,
-                                       ast,
-                                       parse_xor_expr,
-                                       TOKEN_OR,
-                                       AST_OR_EXPR);
-}
-
-static uint32_t parse_log_and_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_single_op(s,
-                                       ast,
-                                       parse_or_expr,
-                                       TOKEN_LAND,
-                                       AST_LOG_AND_EXPR);
-}
-
-static uint32_t parse_log_or_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_single_op(s,
-                                       ast,
-                                       parse_log_and_expr,
-                                       TOKEN_LOR,
-                                       AST_LOG_OR_EXPR);
-}
-
 static uint32_t parse_cond_expr(ParserState* s, AST* ast);
 
 static uint32_t parse_cond_items(ParserState* s, AST* ast) {
@@ -2713,10 +3153,12 @@ static uint32_t parse_cond_items(ParserState* s, AST* ast) {
 }
 
 static uint32_t parse_cond_expr(ParserState* s, AST* ast) {
-    const uint32_t res = add_node_with_type(ast, AST_COND_EXPR, s->it);
-    CHECK_ERR(parse_log_or_expr(s, ast));
+    const uint32_t start_token_idx = s->it;
+    const uint32_t res = parse_binary_expr(s, ast, PREC_LOG_OR);
+    CHECK_ERR(res);
 
     if (ParserState_curr_kind(s) == TOKEN_QMARK) {
+        insert_node_with_type(ast, res, AST_COND_EXPR, start_token_idx);
         ParserState_accept_it(s);
         const uint32_t rhs = parse_cond_items(s, ast);
         CHECK_ERR(rhs);
@@ -2758,19 +3200,35 @@ static ASTNodeKind assign_op_to_assign_expr_kind(TokenKind k) {
 // because differentiating is actually not that easy, leave that error to
 // contextanalysis
 static uint32_t parse_assign_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_multiple_ops(s,
-                                          ast,
-                                          AST_ASSIGN,
-                                          parse_cond_expr,
-                                          assign_op_to_assign_expr_kind);
+    const uint32_t start_token_idx = s->it;
+    const uint32_t res = parse_cond_expr(s, ast);
+    CHECK_ERR(res);
+
+    const ASTNodeKind kind = assign_op_to_assign_expr_kind(
+        ParserState_curr_kind(s));
+    if (kind != AST_TRANSLATION_UNIT) {
+        insert_node_with_type(ast, res, kind, start_token_idx);
+        ParserState_accept_it(s);
+        const uint32_t rhs = parse_assign_expr(s, ast);
+        CHECK_ERR(rhs);
+        ast->datas[res].rhs = rhs;
+    }
+    return res;
 }
 
 static uint32_t parse_expr(ParserState* s, AST* ast) {
-    return parse_binary_expr_single_op(s,
-                                       ast,
-                                       parse_assign_expr,
-                                       TOKEN_COMMA,
-                                       AST_EXPR);
+    const uint32_t start_token_idx = s->it;
+    const uint32_t res = parse_assign_expr(s, ast);
+    CHECK_ERR(res);
+
+    if (ParserState_curr_kind(s) == TOKEN_COMMA) {
+        insert_node_with_type(ast, res, AST_EXPR, start_token_idx);
+        ParserState_accept_it(s);
+        const uint32_t rhs = parse_expr(s, ast);
+        CHECK_ERR(rhs);
+        ast->datas[res].rhs = rhs;
+    }
+    return res;
 }
 
 static uint32_t parse_const_expr(ParserState* s, AST* ast) {
@@ -7,6 +7,8 @@ typedef struct {
     File f;
     StrBuf indents;
     const FileInfo* file_info;
+    // Set if the value of a literal could not be converted
+    PreprocErr* err;
 } ASTDumper;
 
 static void ASTDumper_free(ASTDumper* d) {
@@ -42,19 +44,24 @@ static uint32_t dump_ast_rec(const AST* ast,
                              ASTDumper* d,
                              SourceLoc last_loc);
 
-bool dump_ast(const AST* ast, const FileInfo* file_info, File f) {
+bool dump_ast(const AST* ast,
+              const FileInfo* file_info,
+              File f,
+              PreprocErr* err) {
     MYCC_TIMER_BEGIN();
     ASTDumper d = {
         .f = f,
         .indents = StrBuf_create_empty(),
         .file_info = file_info,
+        .err = err,
     };
     const bool res = dump_ast_rec(ast,
                                   0,
                                   STR_LIT(""),
                                   &d,
                                   (SourceLoc){UINT32_MAX, {0, 0}})
-                     == ast->len;
+                         == ast->len
+                     && err->kind == PREPROC_ERR_NONE;
     ASTDumper_free(&d);
     MYCC_TIMER_END("ast dumper");
     return res;
@@ -80,7 +87,18 @@ static ASTNodeCategory get_ast_node_category(ASTNodeKind k);
 
 static Str get_node_kind_str(ASTNodeKind k);
 
+// Only the first literal that could not be converted is reported
+static PreprocErr* literal_err(const ASTDumper* d) {
+    return d->err->kind == PREPROC_ERR_NONE ? d->err : NULL;
+}
+
+// The functions dumping values do nothing for literals that could not be
+// converted, as dump_ast() fails anyway
+
 static void dump_int_val(ASTDumper* d, const IntVal* val) {
+    if (val == NULL) {
+        return;
+    }
     ASTDumper_println(d, "int_val: {Str}", IntValKind_str(val->kind));
     if (IntValKind_is_sint(val->kind)) {
         ASTDumper_println(d, "sint_val: {i64}", val->sint_val);
@@ -90,11 +108,17 @@ static void dump_int_val(ASTDumper* d, const IntVal* val) {
 }
 
 static void dump_float_val(ASTDumper* d, const FloatVal* val) {
+    if (val == NULL) {
+        return;
+    }
     ASTDumper_println(d, "float_val: {Str}", FloatValKind_str(val->kind));
     ASTDumper_println(d, "val: {floatg}", val->val);
 }
 
 static void dump_str_lit(ASTDumper* d, const StrLit* lit) {
+    if (lit == NULL) {
+        return;
+    }
     ASTDumper_println(d, "str_lit: {Str}", StrBuf_as_str(&lit->contents));
 }
 
@@ -110,22 +134,28 @@ static void dump_balanced_token(ASTDumper* d,
     const uint32_t val_idx = ast->toks.val_indices[main_token];
     switch (kind) {
         case TOKEN_IDENTIFIER: {
-            const StrBuf* buf = &ast->toks.identifiers[val_idx];
-            ASTDumper_println(d, "identifier: {Str}", StrBuf_as_str(buf));
+            const Str spell = StringPool_get(&ast->toks.identifiers, val_idx);
+            ASTDumper_println(d, "identifier: {Str}", spell);
             break;
         }
         case TOKEN_F_CONSTANT: {
-            const FloatVal* val = &ast->toks.float_consts[val_idx];
+            const FloatVal* val = TokenArr_float_const(&ast->toks,
+                                                       main_token,
+                                                       literal_err(d));
             dump_float_val(d, val);
             break;
         }
         case TOKEN_I_CONSTANT: {
-            const IntVal* val = &ast->toks.int_consts[val_idx];
+            const IntVal* val = TokenArr_int_const(&ast->toks,
+                                                   main_token,
+                                                   literal_err(d));
             dump_int_val(d, val);
             break;
         }
         case TOKEN_STRING_LITERAL: {
-            const StrLit* lit = &ast->toks.str_lits[val_idx];
+            const StrLit* lit = TokenArr_str_lit(&ast->toks,
+                                                 main_token,
+                                                 literal_err(d));
             dump_str_lit(d, lit);
             break;
         }
@@ -168,7 +198,7 @@ static uint32_t dump_ast_rec(const AST* ast,
     const ASTNodeKind kind = ast->kinds[node_idx];
     const Str node_kind_str = get_node_kind_str(kind);
     const uint32_t main_token = ast->datas[node_idx].main_token;
-    const SourceLoc loc = ast->toks.locs[main_token];
+    const SourceLoc loc = TokenArr_loc(&ast->toks, main_token);
     // Only print source location if it is different from parent in order to not
     // clutter the output
     if (SourceLoc_eq(loc, last_loc)) {
@@ -264,7 +294,7 @@ static uint32_t dump_ast_rec(const AST* ast,
                 if (str.data == NULL) {
                     assert(token_kind == TOKEN_IDENTIFIER);
                     const uint32_t val_idx = ast->toks.val_indices[i];
-                    str = StrBuf_as_str(&ast->toks.identifiers[val_idx]);
+                    str = StringPool_get(&ast->toks.identifiers, val_idx);
                 }
                 ASTDumper_println(d, "token: {Str}", str);
             }
@@ -274,28 +304,31 @@ static uint32_t dump_ast_rec(const AST* ast,
         case AST_NODE_CATEGORY_IDENTIFIER: {
             const uint32_t token_idx = data.main_token;
             const uint32_t val_idx = ast->toks.val_indices[token_idx];
-            const Str spell = StrBuf_as_str(&ast->toks.identifiers[val_idx]);
+            const Str spell = StringPool_get(&ast->toks.identifiers, val_idx);
             ASTDumper_println(d, "spelling: {Str}", spell);
             res = node_idx + 1;
             break;
         }
         case AST_NODE_CATEGORY_STRING_LITERAL: {
-            const uint32_t token_idx = data.main_token;
-            const uint32_t val_idx = ast->toks.val_indices[token_idx];
-            const StrLit* lit = &ast->toks.str_lits[val_idx];
+            const StrLit* lit = TokenArr_str_lit(&ast->toks,
+                                                 data.main_token,
+                                                 literal_err(d));
             dump_str_lit(d, lit);
             res = node_idx + 1;
             break;
         }
         case AST_NODE_CATEGORY_CONSTANT: {
             const uint32_t token_idx = data.main_token;
-            const uint32_t val_idx = ast->toks.val_indices[token_idx];
             if (ast->toks.kinds[token_idx] == TOKEN_I_CONSTANT) {
-                const IntVal* val = &ast->toks.int_consts[val_idx];
+                const IntVal* val = TokenArr_int_const(&ast->toks,
+                                                       token_idx,
+                                                       literal_err(d));
                 dump_int_val(d, val);
             } else {
                 assert(ast->toks.kinds[token_idx] == TOKEN_F_CONSTANT);
-                const FloatVal* val = &ast->toks.float_consts[val_idx];
+                const FloatVal* val = TokenArr_float_const(&ast->toks,
+                                                           token_idx,
+                                                           literal_err(d));
                 dump_float_val(d, val);
             }
             res = node_idx + 1;
@@ -413,6 +446,7 @@ static ASTNodeCategory get_ast_node_category(ASTNodeKind k) {
         case AST_STORAGE_CLASS_SPEC_THREAD_LOCAL:
         case AST_STORAGE_CLASS_SPEC_AUTO:
         case AST_STORAGE_CLASS_SPEC_REGISTER:
+        case AST_ERROR:
             return AST_NODE_CATEGORY_NO_CHILDREN;
         case AST_UNLABELED_STATEMENT:
         case AST_ENUM_SPEC:
@@ -806,6 +840,8 @@ static Str get_node_kind_str(ASTNodeKind k) {
             return STR_LIT("storage class specifier");
         case AST_IDENTIFIER:
             return STR_LIT("identifier");
+        case AST_ERROR:
+            return STR_LIT("error");
     }
     UNREACHABLE();
 }
@@ -1,6 +1,7 @@
 #include "frontend/ast/ast_serializer.h"
 
 #include <setjmp.h>
+#include <string.h>
 
 #include "util/mem.h"
 #include "util/log.h"
@@ -214,6 +215,52 @@ static bool deserialize_str_lit(ASTDeserializer* r, StrLit* res) {
     return StrBuf_valid(&res->contents);
 }
 
+// Deserialized values are stored already converted
+static uint8_t* create_converted_states(uint32_t len) {
+    uint8_t* res = mycc_alloc_or_null(sizeof *res * len);
+    if (len != 0) {
+        memset(res, TOKEN_LITERAL_CONVERTED, sizeof *res * len);
+    }
+    return res;
+}
+
+static bool deserialize_loc_table(ASTDeserializer* r, SourceLocTable* res) {
+    uint32_t len;
+    if (!deserialize_u32(r, &len)) {
+        return false;
+    }
+    res->len = len;
+    res->cap = len;
+    res->starts = mycc_alloc_or_null(sizeof *res->starts * len);
+    res->file_indices = mycc_alloc_or_null(sizeof *res->file_indices * len);
+    res->lines = mycc_alloc_or_null(sizeof *res->lines * len);
+
+    deserializer_read(r, res->starts, sizeof *res->starts, len);
+    deserializer_read(r, res->file_indices, sizeof *res->file_indices, len);
+    deserializer_read(r, res->lines, sizeof *res->lines, len);
+    if (!deserialize_u32(r, &res->end) || !deserialize_u32(r, &len)) {
+        return false;
+    }
+
+    res->exps_len = len;
+    res->exps_cap = len;
+    res->exp_starts = mycc_alloc_or_null(sizeof *res->exp_starts * len);
+    res->exp_locs = mycc_alloc_or_null(sizeof *res->exp_locs * len);
+    res->exp_spellings = mycc_alloc_or_null(sizeof *res->exp_spellings * len);
+    deserializer_read(r, res->exp_starts, sizeof *res->exp_starts, len);
+    deserializer_read(r, res->exp_locs, sizeof *res->exp_locs, len);
+    deserializer_read(r, res->exp_spellings, sizeof *res->exp_spellings, len);
+    if (!deserialize_u32(r, &res->exp_end) || !deserialize_u32(r, &len)) {
+        return false;
+    }
+
+    res->spellings_len = len;
+    res->spellings_cap = len;
+    res->spellings = mycc_alloc_or_null(sizeof *res->spellings * len);
+    deserializer_read(r, res->spellings, sizeof *res->spellings, len);
+    return true;
+}
+
 static bool deserialize_token_arr(ASTDeserializer* r, TokenArr* res) {
     uint32_t len;
     if (!deserialize_u32(r, &len)) {
@@ -230,53 +277,54 @@ static bool deserialize_token_arr(ASTDeserializer* r, TokenArr* res) {
     deserializer_read(r, res->kinds, sizeof *res->kinds, len);
     deserializer_read(r, res->val_indices, sizeof *res->val_indices, len);
     deserializer_read(r, res->locs, sizeof *res->locs, len);
+    if (!deserialize_loc_table(r, &res->loc_table)) {
+        // TODO: free stuff
+        return false;
+    }
 
-    if (!deserialize_u32(r, &res->identifiers_len)) {
-        // TODO:
+    if (!StringPool_read(&res->identifiers, r->file)) {
+        // TODO: free stuff
         return false;
     }
     // It should not be possible to have a program without identifiers
-    assert(res->identifiers_len > 0);
-    res->identifiers = mycc_alloc(sizeof *res->identifiers * res->identifiers_len);
-    for (uint32_t i = 0; i < res->identifiers_len; ++i) {
-        res->identifiers[i] = deserialize_str_buf(r);
-        if (!StrBuf_valid(&res->identifiers[i])) {
-            // TODO: free stuff
-            return false;
-        }
-    }
-    if (!deserialize_u32(r, &res->int_consts_len)) {
+    assert(res->identifiers.len > 0);
+    TokenLiterals* lits = &res->literals;
+    *lits = TokenLiterals_create_empty();
+    if (!deserialize_u32(r, &lits->int_consts_len)) {
         // TODO:
         return false;
     }
     // Programs without int consts are possible
-    res->int_consts = mycc_alloc_or_null(sizeof *res->int_consts * res->int_consts_len);
-    for (uint32_t i = 0; i < res->int_consts_len; ++i) {
-        if (!deserialize_int_val(r, &res->int_consts[i])) {
+    lits->int_consts = mycc_alloc_or_null(sizeof *lits->int_consts * lits->int_consts_len);
+    lits->int_states = create_converted_states(lits->int_consts_len);
+    for (uint32_t i = 0; i < lits->int_consts_len; ++i) {
+        if (!deserialize_int_val(r, &lits->int_consts[i])) {
             // TODO:
             return false;
         }
     }
-    if (!deserialize_u32(r, &res->float_consts_len)) {
+    if (!deserialize_u32(r, &lits->float_consts_len)) {
         // TODO:
         return false;
     }
     // Programs without floats are definitely possible
-    res->float_consts = mycc_alloc_or_null(sizeof *res->float_consts * res->float_consts_len);
-    for (uint32_t i = 0; i < res->float_consts_len; ++i) {
-        if (!deserialize_float_val(r, &res->float_consts[i])) {
+    lits->float_consts = mycc_alloc_or_null(sizeof *lits->float_consts * lits->float_consts_len);
+    lits->float_states = create_converted_states(lits->float_consts_len);
+    for (uint32_t i = 0; i < lits->float_consts_len; ++i) {
+        if (!deserialize_float_val(r, &lits->float_consts[i])) {
             // TODO:
             return false;
         }
     }
-    if (!deserialize_u32(r, &res->str_lits_len)) {
+    if (!deserialize_u32(r, &lits->str_lits_len)) {
         // TODO:
         return false;
     }
     // Programs without string literals are possible as well
-    res->str_lits = mycc_alloc_or_null(sizeof *res->str_lits * res->str_lits_len);
-    for (uint32_t i = 0; i < res->str_lits_len; ++i) {
-        if (!deserialize_str_lit(r, &res->str_lits[i])) {
+    lits->str_lits = mycc_alloc_or_null(sizeof *lits->str_lits * lits->str_lits_len);
+    lits->str_states = create_converted_states(lits->str_lits_len);
+    for (uint32_t i = 0; i < lits->str_lits_len; ++i) {
+        if (!deserialize_str_lit(r, &lits->str_lits[i])) {
             // TODO:
             return false;
         }
@@ -289,6 +337,103 @@ typedef struct {
     File file;
 } ASTSerializer;
 
+// Only the literals referenced by a token are written, so literals that are
+// never used, like the ones in macros that are never expanded, are neither
+// converted nor reported if they are invalid
+typedef struct {
+    // Value index of every token in the file
+    uint32_t* val_indices;
+    // Indices of the written literals in the TokenArr, in the order they are
+    // written
+    uint32_t* int_consts;
+    uint32_t* float_consts;
+    uint32_t* str_lits;
+    uint32_t int_consts_len, float_consts_len, str_lits_len;
+} WrittenLiterals;
+
+static uint32_t* alloc_unwritten(uint32_t len) {
+    uint32_t* res = mycc_alloc_or_null(sizeof *res * len);
+    for (uint32_t i = 0; i < len; ++i) {
+        res[i] = UINT32_MAX;
+    }
+    return res;
+}
+
+static void WrittenLiterals_free(const WrittenLiterals* w) {
+    mycc_free(w->val_indices);
+    mycc_free(w->int_consts);
+    mycc_free(w->float_consts);
+    mycc_free(w->str_lits);
+}
+
+// Converts the literals referenced by the tokens, so invalid ones are reported
+// at the location of their token before anything is written
+static bool collect_literals(const TokenArr* tokens,
+                             WrittenLiterals* res,
+                             PreprocErr* err) {
+    const TokenLiterals* lits = &tokens->literals;
+    *res = (WrittenLiterals){
+        .val_indices = mycc_alloc_or_null(sizeof *res->val_indices
+                                          * tokens->len),
+        .int_consts = mycc_alloc_or_null(sizeof *res->int_consts
+                                         * lits->int_consts_len),
+        .float_consts = mycc_alloc_or_null(sizeof *res->float_consts
+                                           * lits->float_consts_len),
+        .str_lits = mycc_alloc_or_null(sizeof *res->str_lits
+                                       * lits->str_lits_len),
+        .int_consts_len = 0,
+        .float_consts_len = 0,
+        .str_lits_len = 0,
+    };
+    // Index in the file of each literal in the TokenArr
+    uint32_t* int_indices = alloc_unwritten(lits->int_consts_len);
+    uint32_t* float_indices = alloc_unwritten(lits->float_consts_len);
+    uint32_t* str_indices = alloc_unwritten(lits->str_lits_len);
+    bool success = true;
+    for (uint32_t i = 0; i < tokens->len && success; ++i) {
+        const uint32_t val_idx = tokens->val_indices[i];
+        uint32_t* indices;
+        uint32_t* written;
+        uint32_t* written_len;
+        switch (tokens->kinds[i]) {
+            case TOKEN_I_CONSTANT:
+                success = TokenArr_int_const(tokens, i, err) != NULL;
+                indices = int_indices;
+                written = res->int_consts;
+                written_len = &res->int_consts_len;
+                break;
+            case TOKEN_F_CONSTANT:
+                success = TokenArr_float_const(tokens, i, err) != NULL;
+                indices = float_indices;
+                written = res->float_consts;
+                written_len = &res->float_consts_len;
+                break;
+            case TOKEN_STRING_LITERAL:
+                success = TokenArr_str_lit(tokens, i, err) != NULL;
+                indices = str_indices;
+                written = res->str_lits;
+                written_len = &res->str_lits_len;
+                break;
+            default:
+                res->val_indices[i] = val_idx;
+                continue;
+        }
+        if (indices[val_idx] == UINT32_MAX) {
+            indices[val_idx] = *written_len;
+            written[*written_len] = val_idx;
+            ++*written_len;
+        }
+        res->val_indices[i] = indices[val_idx];
+    }
+    mycc_free(int_indices);
+    mycc_free(float_indices);
+    mycc_free(str_indices);
+    if (!success) {
+        WrittenLiterals_free(res);
+    }
+    return success;
+}
+
 static void serializer_write(ASTSerializer* d,
                              const void* buffer,
                              uint32_t size,
@@ -319,10 +464,19 @@ static void serialize_float(ASTSerializer* d, double f) {
 static void serialize_bool(ASTSerializer* d, bool b) {
     serializer_write(d, &b, sizeof b, 1);
 }
-static void serialize_tokens(ASTSerializer* d, const TokenArr* tokens);
-
-bool serialize_ast(const AST* ast, const FileInfo* file_info, File f) {
+static void serialize_tokens(ASTSerializer* d,
+                             const TokenArr* tokens,
+                             const WrittenLiterals* written);
+
+bool serialize_ast(const AST* ast,
+                   const FileInfo* file_info,
+                   File f,
+                   PreprocErr* err) {
     MYCC_TIMER_BEGIN();
+    WrittenLiterals written;
+    if (!collect_literals(&ast->toks, &written, err)) {
+        return false;
+    }
     ASTSerializer d = {
         .file = f,
     };
@@ -338,10 +492,12 @@ bool serialize_ast(const AST* ast, const FileInfo* file_info, File f) {
         if (has_type_data) {
             // TODO: serialize_type_data
         }
-        serialize_tokens(&d, &ast->toks);
+        serialize_tokens(&d, &ast->toks, &written);
     } else {
+        WrittenLiterals_free(&written);
         return false;
     }
+    WrittenLiterals_free(&written);
     MYCC_TIMER_END("ast serializer");
     return true;
 }
@@ -373,27 +529,66 @@ static void serialize_float_val(ASTSerializer* d, const FloatVal* val) {
     serialize_float(d, val->val);
 }
 
-static void serialize_tokens(ASTSerializer* d, const TokenArr* tokens) {
+static void serialize_loc_table(ASTSerializer* d, const SourceLocTable* t) {
+    serialize_u32(d, t->len);
+    serializer_write(d, t->starts, sizeof *t->starts, t->len);
+    serializer_write(d, t->file_indices, sizeof *t->file_indices, t->len);
+    serializer_write(d, t->lines, sizeof *t->lines, t->len);
+    serialize_u32(d, t->end);
+
+    serialize_u32(d, t->exps_len);
+    serializer_write(d, t->exp_starts, sizeof *t->exp_starts, t->exps_len);
+    serializer_write(d, t->exp_locs, sizeof *t->exp_locs, t->exps_len);
+    serializer_write(d,
+                     t->exp_spellings,
+                     sizeof *t->exp_spellings,
+                     t->exps_len);
+    serialize_u32(d, t->exp_end);
+
+    serialize_u32(d, t->spellings_len);
+    serializer_write(d, t->spellings, sizeof *t->spellings, t->spellings_len);
+}
+
+static void serialize_tokens(ASTSerializer* d,
+                             const TokenArr* tokens,
+                             const WrittenLiterals* written) {
     serialize_u32(d, tokens->len);
     serializer_write(d, tokens->kinds, sizeof *tokens->kinds, tokens->len);
-    serializer_write(d, tokens->val_indices, sizeof *tokens->val_indices, tokens->len);
+    serializer_write(d,
+                     written->val_indices,
+                     sizeof *written->val_indices,
+                     tokens->len);
     serializer_write(d, tokens->locs, sizeof *tokens->locs, tokens->len);
+    serialize_loc_table(d, &tokens->loc_table);
 
-    serialize_u32(d, tokens->identifiers_len);
-    for (uint32_t i = 0; i < tokens->identifiers_len; ++i) {
-        serialize_str_buf(d, &tokens->identifiers[i]);
-    }
-    serialize_u32(d, tokens->int_consts_len);
-    for (uint32_t i = 0; i < tokens->int_consts_len; ++i) {
-        serialize_int_val(d, &tokens->int_consts[i]);
-    }
-    serialize_u32(d, tokens->float_consts_len);
-    for (uint32_t i = 0; i < tokens->float_consts_len; ++i) {
-        serialize_float_val(d, &tokens->float_consts[i]);
+    if (!StringPool_write(&tokens->identifiers, d->file)) {
+        longjmp(d->err_buf, 0);
     }
-    serialize_u32(d, tokens->str_lits_len);
-    for (uint32_t i = 0; i < tokens->str_lits_len; ++i) {
-        serialize_str_lit(d, &tokens->str_lits[i]);
+    // The written literals were all converted by collect_literals()
+    const TokenLiterals* lits = &tokens->literals;
+    serialize_u32(d, written->int_consts_len);
+    for (uint32_t i = 0; i < written->int_consts_len; ++i) {
+        serialize_int_val(d,
+                          TokenLiterals_int_const(lits,
+                                                  written->int_consts[i],
+                                                  (SourceLoc){0},
+                                                  NULL));
+    }
+    serialize_u32(d, written->float_consts_len);
+    for (uint32_t i = 0; i < written->float_consts_len; ++i) {
+        serialize_float_val(d,
+                            TokenLiterals_float_const(lits,
+                                                      written->float_consts[i],
+                                                      (SourceLoc){0},
+                                                      NULL));
+    }
+    serialize_u32(d, written->str_lits_len);
+    for (uint32_t i = 0; i < written->str_lits_len; ++i) {
+        serialize_str_lit(d,
+                          TokenLiterals_str_lit(lits,
+                                                written->str_lits[i],
+                                                (SourceLoc){0},
+                                                NULL));
     }
 }
 
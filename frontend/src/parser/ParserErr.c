@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include "util/macro_util.h"
+#include "util/mem.h"
 
 ParserErr ParserErr_create(void) {
     return (ParserErr){
@@ -24,8 +25,13 @@ void ParserErr_print(File out,
                      const TokenArr* tokens,
                      const ParserErr* err) {
     assert(err->kind != PARSER_ERR_NONE);
+    assert(err->err_token_idx <= tokens->len);
 
-    ErrBase base = ErrBase_create(tokens->locs[err->err_token_idx]);
+    // Errors at the end of the file are reported at the last token
+    const uint32_t loc_idx = err->err_token_idx == tokens->len
+                                 ? tokens->len - 1
+                                 : err->err_token_idx;
+    ErrBase base = ErrBase_create(TokenArr_loc(tokens, loc_idx));
     ErrBase_print(out, file_info, &base);
     switch (err->kind) {
         case PARSER_ERR_NONE:
@@ -36,7 +42,7 @@ void ParserErr_print(File out,
         }
         case PARSER_ERR_REDEFINED_SYMBOL: {
             assert(err->prev_def_idx < tokens->len);
-            const SourceLoc loc = tokens->locs[err->prev_def_idx];
+            const SourceLoc loc = TokenArr_loc(tokens, err->prev_def_idx);
             const Str path = FileInfo_get(file_info, loc.file_idx);
             Str type_str = err->was_typedef_name ? STR_LIT("typedef name")
                                                  : STR_LIT("enum constant");
@@ -45,7 +51,7 @@ void ParserErr_print(File out,
                 out,
                 "Redefined symbol {Str} that was already defined as {Str} in "
                 "{Str}({u32}, {u32})",
-                StrBuf_as_str(&tokens->identifiers[val_idx]),
+                StringPool_get(&tokens->identifiers, val_idx),
                 type_str,
                 path,
                 loc.file_loc.line,
@@ -98,7 +104,7 @@ void ParserErr_print(File out,
                 out,
                 "Expected a typedef name but got identifier with "
                 "spelling {Str}",
-                StrBuf_as_str(&tokens->identifiers[val_idx]));
+                StringPool_get(&tokens->identifiers, val_idx));
             break;
         }
         case PARSER_ERR_EMPTY_DIRECT_ABS_DECL:
@@ -107,6 +113,48 @@ void ParserErr_print(File out,
         case PARSER_ERR_TYPEDEF_WITHOUT_DECLARATOR:
             File_put_str("Typedef without declarator", out);
             break;
+        case PARSER_ERR_EXPECTED_DECLARATION_SPECS:
+            File_put_str("Expected declaration specifiers", out);
+            break;
     }
     File_putc('\n', out);
+    if (TokenArr_is_expanded(tokens, loc_idx)) {
+        const SourceLoc spelling = TokenArr_spelling_loc(tokens, loc_idx);
+        File_printf(out,
+                    "Expanded from the macro definition at "
+                    "{Str}({u32}, {u32})\n",
+                    FileInfo_get(file_info, spelling.file_idx),
+                    spelling.file_loc.line,
+                    spelling.file_loc.index);
+    }
+}
+
+ParserErrArr ParserErrArr_create(void) {
+    return (ParserErrArr){
+        .len = 0,
+        .cap = 0,
+        .errs = NULL,
+    };
+}
+
+void ParserErrArr_push(ParserErrArr* arr, const ParserErr* err) {
+    assert(err->kind != PARSER_ERR_NONE);
+    if (arr->len == arr->cap) {
+        mycc_grow_alloc((void**)&arr->errs, &arr->cap, sizeof *arr->errs);
+    }
+    arr->errs[arr->len] = *err;
+    ++arr->len;
+}
+
+void ParserErrArr_print(File out,
+                        const FileInfo* file_info,
+                        const TokenArr* tokens,
+                        const ParserErrArr* arr) {
+    for (uint32_t i = 0; i != arr->len; ++i) {
+        ParserErr_print(out, file_info, tokens, &arr->errs[i]);
+    }
+}
+
+void ParserErrArr_free(const ParserErrArr* arr) {
+    mycc_free(arr->errs);
 }
@@ -8,28 +8,21 @@
 
 #include "util/mem.h"
 
+#include "frontend/preproc/preproc.h"
+
 typedef enum {
     ID_KIND_NONE,
     ID_KIND_TYPEDEF_NAME,
     ID_KIND_ENUM_CONSTANT
 } IDKind;
 
-typedef struct ParserIDData {
+typedef struct ParserBinding {
+    uint32_t identifier_idx;
     uint32_t token_idx;
+    // Binding of the same identifier this shadows + 1, or 0 if there is none
+    uint32_t prev;
     IDKind kind;
-} ParserIDData;
-
-// This maps all indices directly to their kinds, wasting a lot of memory
-typedef struct ParserIdentifierMap {
-    uint32_t _cap;
-    // TODO: we actually only need 3 bits per kind in this case
-    uint8_t* _kinds;
-    uint32_t* _token_indices;
-} ParserIdentifierMap;
-
-static ParserIdentifierMap ParserIdentifierMap_create(void) {
-    return (ParserIdentifierMap){0};
-}
+} ParserBinding;
 
 ParserState ParserState_create(TokenArr* tokens, ParserErr* err) {
     assert(tokens);
@@ -37,26 +30,67 @@ ParserState ParserState_create(TokenArr* tokens, ParserErr* err) {
     ParserState res = {
         ._arr = *tokens,
         .it = 0,
+        ._bindings = NULL,
+        ._num_bindings = 0,
+        ._bindings_cap = 0,
         ._len = 1,
         ._cap = 1,
-        ._scope_maps = mycc_alloc(sizeof *res._scope_maps),
+        ._scope_starts = mycc_alloc(sizeof *res._scope_starts),
+        ._innermost = NULL,
+        ._innermost_len = 0,
+        ._stream = NULL,
         .err = err,
+        ._errs = NULL,
     };
-    res._scope_maps[0] = ParserIdentifierMap_create();
+    res._scope_starts[0] = 0;
     *tokens = TokenArr_create_empty();
     return res;
 }
 
-static void ParserIdentifierMap_free(const ParserIdentifierMap* map) {
-    mycc_free(map->_token_indices);
-    mycc_free(map->_kinds);
+ParserState ParserState_create_stream(PreprocStream* stream, ParserErr* err) {
+    assert(stream);
+
+    ParserState res = {
+        ._arr = TokenArr_create_empty(),
+        .it = 0,
+        ._bindings = NULL,
+        ._num_bindings = 0,
+        ._bindings_cap = 0,
+        ._len = 1,
+        ._cap = 1,
+        ._scope_starts = mycc_alloc(sizeof *res._scope_starts),
+        ._innermost = NULL,
+        ._innermost_len = 0,
+        ._stream = stream,
+        .err = err,
+        ._errs = NULL,
+    };
+    res._scope_starts[0] = 0;
+    TokenArr_reserve(&res._arr, PreprocStream_estimate_num_tokens(stream));
+    ParserState_read_tokens(&res);
+    return res;
+}
+
+void ParserState_finish_stream(ParserState* s) {
+    assert(s->_stream);
+    PreprocStream_finish(s->_stream, &s->_arr);
+    s->_stream = NULL;
+}
+
+void ParserState_read_tokens(ParserState* s) {
+    assert(s->_stream);
+    // Errors are left in the error of the stream, after which it does not
+    // produce any more tokens, so the parser just sees the end of the file
+    PreprocStream_read(s->_stream,
+                       &s->_arr,
+                       s->it + PARSER_STATE_LOOKAHEAD
+                           + PARSER_STATE_STREAM_CHUNK_LEN);
 }
 
 void ParserState_free(ParserState* s) {
-    for (uint32_t i = 0; i < s->_cap; ++i) {
-        ParserIdentifierMap_free(&s->_scope_maps[i]);
-    }
-    mycc_free(s->_scope_maps);
+    mycc_free(s->_bindings);
+    mycc_free(s->_scope_starts);
+    mycc_free(s->_innermost);
 }
 
 void expected_token_error(ParserState* s, TokenKind expected) {
@@ -79,44 +113,55 @@ void expected_tokens_error(ParserState* s,
 
 void ParserState_push_scope(ParserState* s) {
     if (s->_len == s->_cap) {
-        ++s->_cap;
-        s->_scope_maps = mycc_realloc(s->_scope_maps,
-                                      sizeof *s->_scope_maps * s->_cap);
-        s->_scope_maps[s->_len] = ParserIdentifierMap_create();
+        mycc_grow_alloc((void**)&s->_scope_starts,
+                        &s->_cap,
+                        sizeof *s->_scope_starts);
     }
+    s->_scope_starts[s->_len] = s->_num_bindings;
     ++s->_len;
 }
 
-static void ParserIdentifierMap_clear(ParserIdentifierMap* map) {
-    memset(map->_kinds, 0, sizeof *map->_kinds * map->_cap);
-    // token indices don't need to be reset, because they are only accessed if
-    // kind is nonzero
-}
-
 void ParserState_pop_scope(ParserState* s) {
     assert(s->_len > 1);
     --s->_len;
-    ParserIdentifierMap_clear(&s->_scope_maps[s->_len]);
-}
-
-// returns whether this was already inside the map
-// Does not insert if there is already an entry
-static bool ParserIdentifierMap_insert(ParserIdentifierMap* map,
-                                       uint32_t identifier_idx,
-                                       uint32_t token_idx,
-                                       IDKind kind) {
-    if (identifier_idx >= map->_cap) {
-        const uint32_t new_cap = identifier_idx + 1;
-        map->_kinds = mycc_realloc(map->_kinds, sizeof *map->_kinds * new_cap);
-        map->_token_indices = mycc_realloc(map->_token_indices, sizeof *map->_token_indices * new_cap);
-        memset(map->_kinds + map->_cap, 0, sizeof *map->_kinds * (new_cap - map->_cap));
-        map->_cap = new_cap;
-    } else if (map->_kinds[identifier_idx] != ID_KIND_NONE) {
-        return false;
+    const uint32_t scope_start = s->_scope_starts[s->_len];
+    // Restore the bindings shadowed by the ones of this scope
+    for (uint32_t i = s->_num_bindings; i != scope_start; --i) {
+        const ParserBinding* binding = &s->_bindings[i - 1];
+        s->_innermost[binding->identifier_idx] = binding->prev;
     }
-    map->_kinds[identifier_idx] = kind;
-    map->_token_indices[identifier_idx] = token_idx;
-    return true;
+    s->_num_bindings = scope_start;
+}
+
+// Returns the innermost binding of the identifier, or NULL if there is none
+static const ParserBinding* get_binding(const ParserState* s,
+                                        uint32_t identifier_idx) {
+    if (identifier_idx >= s->_innermost_len
+        || s->_innermost[identifier_idx] == 0) {
+        return NULL;
+    }
+    return &s->_bindings[s->_innermost[identifier_idx] - 1];
+}
+
+static bool is_in_curr_scope(const ParserState* s,
+                             const ParserBinding* binding) {
+    const uint32_t binding_idx = (uint32_t)(binding - s->_bindings);
+    return binding_idx >= s->_scope_starts[s->_len - 1];
+}
+
+static void reserve_innermost(ParserState* s, uint32_t identifier_idx) {
+    if (identifier_idx < s->_innermost_len) {
+        return;
+    }
+    const uint32_t grown_len = s->_innermost_len + s->_innermost_len / 2;
+    const uint32_t new_len = identifier_idx < grown_len ? grown_len
+                                                        : identifier_idx + 1;
+    s->_innermost = mycc_realloc(s->_innermost,
+                                 sizeof *s->_innermost * new_len);
+    memset(s->_innermost + s->_innermost_len,
+           0,
+           sizeof *s->_innermost * (new_len - s->_innermost_len));
+    s->_innermost_len = new_len;
 }
 
 static bool register_identifier(ParserState* s,
@@ -125,13 +170,26 @@ static bool register_identifier(ParserState* s,
                                 IDKind kind) {
     assert(kind != ID_KIND_NONE);
     // TODO: shadowing warning
-    if (ParserIdentifierMap_insert(&s->_scope_maps[s->_len - 1], identifier_idx,
-                                   token_idx, kind)) {
-        return true;
-    } else {
+    const ParserBinding* prev = get_binding(s, identifier_idx);
+    if (prev != NULL && is_in_curr_scope(s, prev)) {
         ParserState_set_redefinition_err(s, identifier_idx, token_idx);
         return false;
     }
+    reserve_innermost(s, identifier_idx);
+    if (s->_num_bindings == s->_bindings_cap) {
+        mycc_grow_alloc((void**)&s->_bindings,
+                        &s->_bindings_cap,
+                        sizeof *s->_bindings);
+    }
+    s->_bindings[s->_num_bindings] = (ParserBinding){
+        .identifier_idx = identifier_idx,
+        .token_idx = token_idx,
+        .prev = s->_innermost[identifier_idx],
+        .kind = kind,
+    };
+    ++s->_num_bindings;
+    s->_innermost[identifier_idx] = s->_num_bindings;
+    return true;
 }
 
 bool ParserState_register_enum_constant(ParserState* s,
@@ -146,40 +204,21 @@ bool ParserState_register_typedef(ParserState* s,
     return register_identifier(s, identifier_idx, token_idx, ID_KIND_TYPEDEF_NAME);
 }
 
-static IDKind ParserIdentifierMap_get_kind(const ParserIdentifierMap* map, uint32_t identifier_idx) {
-    if (identifier_idx >= map->_cap) {
-        return ID_KIND_NONE;
-    }
-    return map->_kinds[identifier_idx];
-}
-
-static IDKind get_item(const ParserState* s, uint32_t identifier_idx) {
-    for (uint32_t i = 0; i < s->_len; ++i) {
-        const IDKind kind = ParserIdentifierMap_get_kind(&s->_scope_maps[i], identifier_idx);
-        if (kind != ID_KIND_NONE) {
-            return kind;
-        }
-    }
-
-    return ID_KIND_NONE;
+static IDKind get_kind(const ParserState* s, uint32_t identifier_idx) {
+    const ParserBinding* binding = get_binding(s, identifier_idx);
+    return binding == NULL ? ID_KIND_NONE : binding->kind;
 }
 
 bool ParserState_is_enum_constant(const ParserState* s, uint32_t identifier_idx) {
-    return get_item(s, identifier_idx) == ID_KIND_ENUM_CONSTANT;
+    return get_kind(s, identifier_idx) == ID_KIND_ENUM_CONSTANT;
 }
 
 bool ParserState_is_typedef(const ParserState* s, uint32_t identifier_idx) {
-    return get_item(s, identifier_idx) == ID_KIND_TYPEDEF_NAME;
+    return get_kind(s, identifier_idx) == ID_KIND_TYPEDEF_NAME;
 }
 
-static ParserIDData ParserIdentifierMap_get(const ParserIdentifierMap* map, uint32_t identifier_idx) {
-    if (identifier_idx >= map->_cap) {
-        return (ParserIDData){0};
-    }
-    return (ParserIDData){
-        .kind = map->_kinds[identifier_idx],
-        .token_idx = map->_token_indices[identifier_idx],
-    };
+bool ParserState_is_bound(const ParserState* s, uint32_t identifier_idx) {
+    return get_binding(s, identifier_idx) != NULL;
 }
 
 void ParserState_set_redefinition_err(ParserState* s,
@@ -188,10 +227,10 @@ void ParserState_set_redefinition_err(ParserState* s,
 
     ParserErr_set(s->err, PARSER_ERR_REDEFINED_SYMBOL, redef_token_idx);
 
-    ParserIDData prev_def = ParserIdentifierMap_get(&s->_scope_maps[s->_len - 1], identifier_idx);
-    assert(prev_def.kind != ID_KIND_NONE);
+    const ParserBinding* prev_def = get_binding(s, identifier_idx);
+    assert(prev_def != NULL);
 
-    s->err->was_typedef_name = prev_def.kind == ID_KIND_TYPEDEF_NAME;
-    s->err->prev_def_idx = prev_def.token_idx; 
+    s->err->was_typedef_name = prev_def->kind == ID_KIND_TYPEDEF_NAME;
+    s->err->prev_def_idx = prev_def->token_idx;
 }
 
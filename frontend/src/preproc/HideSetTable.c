@@ -0,0 +1,192 @@
+#include "frontend/preproc/HideSetTable.h"
+
+#include <string.h>
+#include <assert.h>
+
+#include "util/mem.h"
+
+enum {
+    MASK_BITS = 64,
+};
+
+static uint64_t elem_bit(uint32_t macro_id) {
+    return (uint64_t)1 << (macro_id % MASK_BITS);
+}
+
+// Elements are stored as bytes in the string set, which does not keep them
+// aligned, so they are copied out one by one
+static uint32_t num_elems(Str set) {
+    return set.len / sizeof(uint32_t);
+}
+
+static uint32_t get_elem(Str set, uint32_t i) {
+    uint32_t res;
+    memcpy(&res, set.data + sizeof res * i, sizeof res);
+    return res;
+}
+
+static Str get_set(const HideSetTable* t, uint32_t set) {
+    return IndexedStringSet_get(&t->_sets, set);
+}
+
+static void reserve_tmp(HideSetTable* t, uint32_t len) {
+    if (len > t->_tmp_cap) {
+        t->_tmp_cap = len;
+        t->_tmp = mycc_realloc(t->_tmp, sizeof *t->_tmp * t->_tmp_cap);
+    }
+}
+
+// Returns the index of the set holding the first len elements of _tmp
+static uint32_t intern_tmp(HideSetTable* t, uint32_t len) {
+    const uint32_t prev_len = IndexedStringSet_len(&t->_sets);
+    const Str elems = {
+        .len = sizeof *t->_tmp * len,
+        .data = (const char*)t->_tmp,
+    };
+    const uint32_t idx = IndexedStringSet_find_or_insert(&t->_sets, elems);
+    if (idx == prev_len) {
+        if (idx == t->_masks_cap) {
+            mycc_grow_alloc((void**)&t->_masks,
+                            &t->_masks_cap,
+                            sizeof *t->_masks);
+        }
+        uint64_t mask = 0;
+        for (uint32_t i = 0; i < len; ++i) {
+            mask |= elem_bit(t->_tmp[i]);
+        }
+        t->_masks[idx] = mask;
+    }
+    return idx;
+}
+
+HideSetTable HideSetTable_create(void) {
+    HideSetTable res = {
+        ._sets = IndexedStringSet_create(64),
+        ._masks_cap = 0,
+        ._masks = NULL,
+        ._tmp_cap = 0,
+        ._tmp = NULL,
+    };
+    reserve_tmp(&res, 16);
+    const uint32_t empty = intern_tmp(&res, 0);
+    assert(empty == HIDE_SET_EMPTY);
+    (void)empty;
+    return res;
+}
+
+void HideSetTable_free(const HideSetTable* t) {
+    IndexedStringSet_free(&t->_sets);
+    mycc_free(t->_masks);
+    mycc_free(t->_tmp);
+}
+
+bool HideSetTable_contains(const HideSetTable* t,
+                           uint32_t set,
+                           uint32_t macro_id) {
+    if ((t->_masks[set] & elem_bit(macro_id)) == 0) {
+        return false;
+    }
+    const Str elems = get_set(t, set);
+    uint32_t low = 0, high = num_elems(elems);
+    while (low != high) {
+        const uint32_t mid = low + (high - low) / 2;
+        const uint32_t elem = get_elem(elems, mid);
+        if (elem == macro_id) {
+            return true;
+        } else if (elem < macro_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+uint32_t HideSetTable_add(HideSetTable* t, uint32_t set, uint32_t macro_id) {
+    if (HideSetTable_contains(t, set, macro_id)) {
+        return set;
+    }
+    const Str elems = get_set(t, set);
+    const uint32_t len = num_elems(elems);
+    reserve_tmp(t, len + 1);
+    uint32_t res_len = 0;
+    uint32_t i = 0;
+    for (; i < len && get_elem(elems, i) < macro_id; ++i) {
+        t->_tmp[res_len++] = get_elem(elems, i);
+    }
+    t->_tmp[res_len++] = macro_id;
+    for (; i < len; ++i) {
+        t->_tmp[res_len++] = get_elem(elems, i);
+    }
+    return intern_tmp(t, res_len);
+}
+
+uint32_t HideSetTable_union(HideSetTable* t, uint32_t s1, uint32_t s2) {
+    if (s1 == s2 || s2 == HIDE_SET_EMPTY) {
+        return s1;
+    } else if (s1 == HIDE_SET_EMPTY) {
+        return s2;
+    }
+    const Str elems1 = get_set(t, s1);
+    const Str elems2 = get_set(t, s2);
+    const uint32_t len1 = num_elems(elems1);
+    const uint32_t len2 = num_elems(elems2);
+    reserve_tmp(t, len1 + len2);
+    uint32_t res_len = 0;
+    uint32_t i1 = 0, i2 = 0;
+    while (i1 < len1 && i2 < len2) {
+        const uint32_t e1 = get_elem(elems1, i1);
+        const uint32_t e2 = get_elem(elems2, i2);
+        if (e1 <= e2) {
+            t->_tmp[res_len++] = e1;
+            ++i1;
+            if (e1 == e2) {
+                ++i2;
+            }
+        } else {
+            t->_tmp[res_len++] = e2;
+            ++i2;
+        }
+    }
+    for (; i1 < len1; ++i1) {
+        t->_tmp[res_len++] = get_elem(elems1, i1);
+    }
+    for (; i2 < len2; ++i2) {
+        t->_tmp[res_len++] = get_elem(elems2, i2);
+    }
+    return intern_tmp(t, res_len);
+}
+
+uint32_t HideSetTable_intersection(HideSetTable* t, uint32_t s1, uint32_t s2) {
+    if (s1 == s2) {
+        return s1;
+    } else if (s1 == HIDE_SET_EMPTY || s2 == HIDE_SET_EMPTY
+               || (t->_masks[s1] & t->_masks[s2]) == 0) {
+        return HIDE_SET_EMPTY;
+    }
+    const Str elems1 = get_set(t, s1);
+    const Str elems2 = get_set(t, s2);
+    const uint32_t len1 = num_elems(elems1);
+    const uint32_t len2 = num_elems(elems2);
+    reserve_tmp(t, len1 < len2 ? len1 : len2);
+    uint32_t res_len = 0;
+    uint32_t i1 = 0, i2 = 0;
+    while (i1 < len1 && i2 < len2) {
+        const uint32_t e1 = get_elem(elems1, i1);
+        const uint32_t e2 = get_elem(elems2, i2);
+        if (e1 == e2) {
+            t->_tmp[res_len++] = e1;
+            ++i1;
+            ++i2;
+        } else if (e1 < e2) {
+            ++i1;
+        } else {
+            ++i2;
+        }
+    }
+    return intern_tmp(t, res_len);
+}
+
+uint32_t HideSetTable_len(const HideSetTable* t) {
+    return IndexedStringSet_len(&t->_sets);
+}
@@ -0,0 +1,135 @@
+#include "frontend/preproc/IncludeCache.h"
+
+#include "util/mem.h"
+#include "util/paths.h"
+#include "util/thread.h"
+#include "util/DirEntries.h"
+#include "util/IndexedStringSet.h"
+
+struct IncludeCache {
+    Mutex _lock;
+    // The directory and the name of every lookup, separated by '\0'
+    IndexedStringSet _lookups;
+    uint32_t _results_cap;
+    // Index into _paths for every lookup, UINT32_MAX if it was not found
+    uint32_t* _results;
+    IndexedStringSet _paths;
+    IndexedStringSet _dirs;
+    uint32_t _dir_entries_cap;
+    DirEntries* _dir_entries;
+};
+
+IncludeCache* IncludeCache_create(void) {
+    IncludeCache* res = mycc_alloc(sizeof *res);
+    *res = (IncludeCache){
+        ._lookups = IndexedStringSet_create(0),
+        ._results_cap = 0,
+        ._results = NULL,
+        ._paths = IndexedStringSet_create(0),
+        ._dirs = IndexedStringSet_create(0),
+        ._dir_entries_cap = 0,
+        ._dir_entries = NULL,
+    };
+    Mutex_init(&res->_lock);
+    return res;
+}
+
+void IncludeCache_free(IncludeCache* c) {
+    Mutex_destroy(&c->_lock);
+    IndexedStringSet_free(&c->_lookups);
+    mycc_free(c->_results);
+    IndexedStringSet_free(&c->_paths);
+    const uint32_t num_dirs = IndexedStringSet_len(&c->_dirs);
+    for (uint32_t i = 0; i < num_dirs; ++i) {
+        DirEntries_free(&c->_dir_entries[i]);
+    }
+    mycc_free(c->_dir_entries);
+    IndexedStringSet_free(&c->_dirs);
+    mycc_free(c);
+}
+
+static StrBuf create_key(Str dir, Str name) {
+    StrBuf res = StrBuf_create_empty_with_cap(dir.len + 1 + name.len);
+    StrBuf_append(&res, dir);
+    StrBuf_push_back(&res, '\0');
+    StrBuf_append(&res, name);
+    return res;
+}
+
+IncludeCacheRes IncludeCache_find(IncludeCache* c,
+                                  Str dir,
+                                  Str name,
+                                  StrBuf* path) {
+    StrBuf key = create_key(dir, name);
+    Mutex_lock(&c->_lock);
+    const uint32_t idx = IndexedStringSet_find(&c->_lookups,
+                                               StrBuf_as_str(&key));
+    IncludeCacheRes res;
+    if (idx == UINT32_MAX) {
+        res = INCLUDE_CACHE_UNKNOWN;
+    } else if (c->_results[idx] == UINT32_MAX) {
+        res = INCLUDE_CACHE_NOT_FOUND;
+    } else {
+        res = INCLUDE_CACHE_FOUND;
+        // The strings in the set may move once the lock is released
+        *path = StrBuf_create(IndexedStringSet_get(&c->_paths,
+                                                   c->_results[idx]));
+    }
+    Mutex_unlock(&c->_lock);
+    StrBuf_free(&key);
+    return res;
+}
+
+void IncludeCache_insert(IncludeCache* c,
+                         Str dir,
+                         Str name,
+                         const StrBuf* path) {
+    StrBuf key = create_key(dir, name);
+    Mutex_lock(&c->_lock);
+    const uint32_t idx = IndexedStringSet_find_or_insert(&c->_lookups,
+                                                         StrBuf_as_str(&key));
+    if (idx == c->_results_cap) {
+        mycc_grow_alloc((void**)&c->_results,
+                        &c->_results_cap,
+                        sizeof *c->_results);
+    }
+    c->_results[idx] = path == NULL
+                           ? UINT32_MAX
+                           : IndexedStringSet_find_or_insert(
+                               &c->_paths,
+                               StrBuf_as_str(path));
+    Mutex_unlock(&c->_lock);
+    StrBuf_free(&key);
+}
+
+static uint32_t get_first_file_sep(Str path) {
+    for (uint32_t i = 0; i < path.len; ++i) {
+        if (is_file_sep(Str_at(path, i))) {
+            return i;
+        }
+    }
+    return path.len;
+}
+
+bool IncludeCache_may_exist(IncludeCache* c, Str dir, Str name) {
+    // Only the first component of the name has to be in dir
+    const Str first = Str_substr(name, 0, get_first_file_sep(name));
+    if (first.len == 0) {
+        return true;
+    }
+    Mutex_lock(&c->_lock);
+    const uint32_t num_dirs = IndexedStringSet_len(&c->_dirs);
+    const uint32_t idx = IndexedStringSet_find_or_insert(&c->_dirs, dir);
+    if (idx == num_dirs) {
+        if (idx == c->_dir_entries_cap) {
+            mycc_grow_alloc((void**)&c->_dir_entries,
+                            &c->_dir_entries_cap,
+                            sizeof *c->_dir_entries);
+        }
+        c->_dir_entries[idx] = DirEntries_read(dir);
+    }
+    const bool res = DirEntries_contains(&c->_dir_entries[idx], first);
+    Mutex_unlock(&c->_lock);
+    return res;
+}
+
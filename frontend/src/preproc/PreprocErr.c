@@ -234,6 +234,12 @@ void PreprocErr_print(File out, const FileInfo* file_info,
             ErrBase_print(out, file_info, &err->base);
             File_put_str("Incomplete preprocessor constant expression", out);
             break;
+        case PREPROC_ERR_INCLUDE_STR_LIT:
+            ErrBase_print(out, file_info, &err->base);
+            File_put_str(
+                "'<' '>' literals may only be used in include directives",
+                out);
+            break;
     }
     File_putc('\n', out);
 }
@@ -307,6 +313,7 @@ void PreprocErr_free(PreprocErr* err) {
         case PREPROC_ERR_INCLUDE_NUM_ARGS:
         case PREPROC_ERR_INCLUDE_NOT_STRING_LITERAL:
         case PREPROC_ERR_INCOMPLETE_EXPR:
+        case PREPROC_ERR_INCLUDE_STR_LIT:
         case PREPROC_ERR_INT_CONST:
         case PREPROC_ERR_FLOAT_CONST:
         case PREPROC_ERR_CHAR_CONST:
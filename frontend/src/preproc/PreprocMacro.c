@@ -8,195 +8,349 @@
 
 #include "read_and_tokenize_line.h"
 
-// TODO: make this also collect macro args?
-static uint32_t find_macro_end(PreprocState* state,
-                               const PreprocTokenArr* res,
-                               uint32_t macro_start,
-                               const ArchTypeInfo* info) {
-    uint32_t i = macro_start;
-    assert(res->kinds[i] == TOKEN_IDENTIFIER);
-    ++i;
-    assert(res->kinds[i] == TOKEN_LBRACKET);
-    ++i;
-
-    const bool can_read_new_toks = res == &state->toks;
-    uint32_t open_bracket_count = 1;
-    while (i != res->len || (can_read_new_toks && !PreprocState_over(state))) {
-        if (can_read_new_toks) {
-            while (i == res->len && !PreprocState_over(state)) {
-                if (!read_and_tokenize_line(state, info)) {
-                    return UINT32_MAX;
-                }
-            }
+struct PreprocExpansionCtx {
+    // Range of the tokens in PreprocExpansionBufs.toks that are left to scan
+    uint32_t pos, end;
+};
+
+// Expands tokens through a stack of contexts, with the expansion of every
+// macro being pushed as a new context, so tokens are only written once into
+// the output instead of being shifted around in place
+//
+// Whether a macro may be expanded is decided by the hide set of each token,
+// which holds the macros the token came out of, like in Prosser's algorithm
+typedef struct {
+    PreprocState* state;
+    PreprocExpansionBufs* bufs;
+    PreprocTokenArr* out;
+    // The expansion buffer out belongs to, if the hide sets of the output are
+    // needed, which is the case for expanded macro arguments
+    PreprocExpansionTokens* hide_set_out;
+    const ArchTypeInfo* info;
+    // Index of the context holding the input of this expansion
+    uint32_t ctxs_start;
+    // Tokens below this belong to the expansions this one is nested in
+    uint32_t toks_start;
+    // Whether lines may be read when the input runs out, which is only the
+    // case for the tokens of the source file
+    bool can_read_lines;
+} MacroExpander;
+
+static void push_token(PreprocTokenArr* arr,
+                       uint8_t kind,
+                       uint32_t val_idx,
+                       SourceLoc loc) {
+    PreprocTokenArr_reserve(arr, 1);
+    arr->kinds[arr->len] = kind;
+    arr->val_indices[arr->len] = val_idx;
+    arr->locs[arr->len] = loc;
+    ++arr->len;
+}
 
-            if (PreprocState_over(state) && i == res->len) {
-                break;
-            }
-        }
+static void append_tokens(PreprocTokenArr* res,
+                          const PreprocTokenArr* arr,
+                          uint32_t start,
+                          uint32_t end) {
+    const uint32_t len = end - start;
+    PreprocTokenArr_reserve(res, len);
+    memcpy(res->kinds + res->len, arr->kinds + start, sizeof *res->kinds * len);
+    memcpy(res->val_indices + res->len,
+           arr->val_indices + start,
+           sizeof *res->val_indices * len);
+    memcpy(res->locs + res->len, arr->locs + start, sizeof *res->locs * len);
+    res->len += len;
+}
 
-        const TokenKind kind = res->kinds[i];
-        if (kind == TOKEN_LBRACKET) {
-            ++open_bracket_count;
-        } else if (kind == TOKEN_RBRACKET) {
-            --open_bracket_count;
-            if (open_bracket_count == 0) {
-                break;
-            }
-        }
-        ++i;
+// The hide sets always have the same capacity as the tokens
+static void reserve_exp_tokens(PreprocExpansionTokens* toks, uint32_t num) {
+    const uint32_t prev_cap = toks->arr.cap;
+    PreprocTokenArr_reserve(&toks->arr, num);
+    if (toks->arr.cap != prev_cap) {
+        toks->hide_sets = mycc_realloc(toks->hide_sets,
+                                       sizeof *toks->hide_sets
+                                           * toks->arr.cap);
     }
+}
 
-    if (res->kinds[i] != TOKEN_RBRACKET) {
-        PreprocErr_set(state->err,
-                       PREPROC_ERR_UNTERMINATED_MACRO,
-                       res->locs[macro_start]);
-        return UINT32_MAX;
+static void push_exp_token(PreprocExpansionTokens* toks,
+                           uint8_t kind,
+                           uint32_t val_idx,
+                           SourceLoc loc,
+                           uint32_t hide_set) {
+    reserve_exp_tokens(toks, 1);
+    toks->hide_sets[toks->arr.len] = hide_set;
+    push_token(&toks->arr, kind, val_idx, loc);
+}
+
+// Appends the tokens of arr from start to end, with hide_sets being NULL if
+// they all have an empty hide set
+static void append_exp_tokens(PreprocExpansionTokens* res,
+                              const PreprocTokenArr* arr,
+                              const uint32_t* hide_sets,
+                              uint32_t start,
+                              uint32_t end) {
+    const uint32_t len = end - start;
+    reserve_exp_tokens(res, len);
+    uint32_t* res_hide_sets = res->hide_sets + res->arr.len;
+    if (hide_sets == NULL) {
+        for (uint32_t i = 0; i < len; ++i) {
+            res_hide_sets[i] = HIDE_SET_EMPTY;
+        }
+    } else {
+        memcpy(res_hide_sets, hide_sets + start, sizeof *res_hide_sets * len);
     }
-    return i;
+    append_tokens(&res->arr, arr, start, end);
 }
 
-typedef struct {
-    uint32_t len, cap;
-    const PreprocMacro** data;
-} ExpandedMacroStack;
+static PreprocExpansionCtx* top_ctx(const MacroExpander* ex) {
+    return &ex->bufs->ctxs[ex->bufs->ctxs_len - 1];
+}
 
-static void ExpandedMacroStack_push(ExpandedMacroStack* stack,
-                                    const PreprocMacro* m) {
-    if (stack->len == stack->cap) {
-        mycc_grow_alloc((void**)&stack->data, &stack->cap, sizeof(void*));
-    }
-    stack->data[stack->len] = m;
-    ++stack->len;
+// Pushes the tokens from start to the end of the token buffer
+static void push_ctx(MacroExpander* ex, uint32_t start) {
+    PreprocExpansionBufs* bufs = ex->bufs;
+    if (bufs->ctxs_len == bufs->ctxs_cap) {
+        mycc_grow_alloc((void**)&bufs->ctxs,
+                        &bufs->ctxs_cap,
+                        sizeof *bufs->ctxs);
+    }
+    bufs->ctxs[bufs->ctxs_len] = (PreprocExpansionCtx){
+        .pos = start,
+        .end = bufs->toks.arr.len,
+    };
+    ++bufs->ctxs_len;
+}
+
+static void pop_ctx(MacroExpander* ex) {
+    PreprocExpansionBufs* bufs = ex->bufs;
+    --bufs->ctxs_len;
+    // Contexts are ordered in the buffer like on the stack, so everything
+    // after the new top context is unused
+    bufs->toks.arr.len = bufs->ctxs_len == ex->ctxs_start ? ex->toks_start
+                                                          : top_ctx(ex)->end;
 }
 
-static void ExpandedMacroStack_pop(ExpandedMacroStack* stack) {
-    --stack->len;
+// Replaces the input, which was used up, with the tokens of the next line
+static bool read_line_into_input(MacroExpander* ex) {
+    assert(ex->out == &ex->state->toks);
+    assert(ex->bufs->ctxs_len == ex->ctxs_start + 1);
+    PreprocTokenArr* toks = &ex->state->toks;
+    const uint32_t out_len = toks->len;
+    if (!read_and_tokenize_line(ex->state, ex->info)) {
+        return false;
+    }
+    PreprocExpansionBufs* bufs = ex->bufs;
+    bufs->toks.arr.len = ex->toks_start;
+    append_exp_tokens(&bufs->toks, toks, NULL, out_len, toks->len);
+    toks->len = out_len;
+    PreprocExpansionCtx* input = top_ctx(ex);
+    input->pos = ex->toks_start;
+    input->end = bufs->toks.arr.len;
+    return true;
 }
 
-static bool ExpandedMacroStack_contains(const ExpandedMacroStack* stack,
-                                        const PreprocMacro* to_check) {
-    for (uint32_t i = 0; i < stack->len; ++i) {
-        if (stack->data[i] == to_check) {
+// Pops contexts that were used up, returning false if there are no tokens
+// left or an error occurred
+static bool has_next_token(MacroExpander* ex) {
+    while (true) {
+        const PreprocExpansionCtx* ctx = top_ctx(ex);
+        if (ctx->pos != ctx->end) {
             return true;
+        } else if (ex->bufs->ctxs_len - 1 != ex->ctxs_start) {
+            pop_ctx(ex);
+        } else if (!ex->can_read_lines || PreprocState_over(ex->state)
+                   || !read_line_into_input(ex)) {
+            return false;
         }
     }
-    return false;
 }
 
-static ExpandedMacroStack ExpandedMacroStack_create(void) {
-    return (ExpandedMacroStack){
-        .len = 0,
-        .cap = 0,
-        .data = NULL,
+typedef struct {
+    uint8_t kind;
+    uint32_t val_idx;
+    SourceLoc loc;
+    uint32_t hide_set;
+} ExpansionToken;
+
+static ExpansionToken next_token(MacroExpander* ex) {
+    PreprocExpansionCtx* ctx = top_ctx(ex);
+    assert(ctx->pos != ctx->end);
+    const PreprocExpansionTokens* toks = &ex->bufs->toks;
+    const uint32_t idx = ctx->pos;
+    ++ctx->pos;
+    return (ExpansionToken){
+        .kind = toks->arr.kinds[idx],
+        .val_idx = toks->arr.val_indices[idx],
+        .loc = toks->arr.locs[idx],
+        .hide_set = toks->hide_sets[idx],
     };
 }
 
-static void ExpandedMacroStack_free(ExpandedMacroStack* stack) {
-    mycc_free(stack->data);
+static void push_output(MacroExpander* ex, const ExpansionToken* tok) {
+    if (ex->hide_set_out != NULL) {
+        push_exp_token(ex->hide_set_out,
+                       tok->kind,
+                       tok->val_idx,
+                       tok->loc,
+                       tok->hide_set);
+    } else {
+        push_token(ex->out, tok->kind, tok->val_idx, tok->loc);
+    }
 }
 
-typedef struct {
-    int32_t alloc_change;
-    uint32_t next;
-} ExpansionInfo;
-
-static ExpansionInfo expand_func_macro(PreprocState* state,
-                                       PreprocTokenArr* res,
-                                       const PreprocMacro* macro,
-                                       uint32_t macro_idx,
-                                       uint32_t macro_end,
-                                       ExpandedMacroStack* expanded,
-                                       const ArchTypeInfo* info);
-
-static ExpansionInfo expand_obj_macro(PreprocState* state,
-                                      PreprocTokenArr* res,
-                                      const PreprocMacro* macro,
-                                      uint32_t macro_idx,
-                                      ExpandedMacroStack* expanded,
-                                      const ArchTypeInfo* info);
-
-static ExpansionInfo find_and_expand_macro(PreprocState* state,
-                                           PreprocTokenArr* res,
-                                           uint32_t i,
-                                           ExpandedMacroStack* expanded,
-                                           const ArchTypeInfo* info) {
-    const TokenKind kind = res->kinds[i];
-    if (kind != TOKEN_IDENTIFIER) {
-        return (ExpansionInfo){0, i + 1};
-    }
-    const PreprocMacro* macro = find_preproc_macro(state, res->val_indices[i]);
-    if (macro == NULL || ExpandedMacroStack_contains(expanded, macro)) {
-        return (ExpansionInfo){0, i + 1};
-    }
-    uint32_t macro_end;
-    if (macro->is_func_macro) {
-        const uint32_t next_idx = i + 1;
-        if (next_idx < res->len && res->kinds[next_idx] == TOKEN_LBRACKET) {
-            macro_end = find_macro_end(state, res, i, info);
-            if (state->err->kind != PREPROC_ERR_NONE) {
-                return (ExpansionInfo){0, UINT32_MAX};
+// Tokens of an expansion refer to the expansion instead of copying the
+// location of the macro name, so their spellings can be looked up
+static SourceLoc expanded_loc(uint32_t exp_idx, uint32_t token_idx) {
+    return (SourceLoc){
+        .file_idx = SOURCE_LOC_EXPANSION_FILE_IDX,
+        .file_loc = {exp_idx, token_idx},
+    };
+}
+
+static void expand_obj_macro(MacroExpander* ex,
+                             const PreprocMacro* macro,
+                             const ExpansionToken* name) {
+    assert(macro->is_func_macro == false);
+    assert(macro->num_args == 0);
+    if (macro->expansion_len == 0) {
+        return;
+    }
+    PreprocExpansionBufs* bufs = ex->bufs;
+    const uint32_t hide_set = HideSetTable_add(&bufs->hide_sets,
+                                               name->hide_set,
+                                               name->val_idx);
+    const uint32_t exp_idx = SourceLocTable_add_expansion(
+        &ex->state->vals.loc_table,
+        name->loc,
+        macro->spellings_idx,
+        macro->expansion_len);
+    PreprocExpansionTokens* toks = &bufs->toks;
+    const uint32_t start = toks->arr.len;
+    reserve_exp_tokens(toks, macro->expansion_len);
+    for (uint32_t i = 0; i < macro->expansion_len; ++i) {
+        assert(macro->kinds[i] != TOKEN_INVALID);
+        toks->arr.kinds[start + i] = macro->kinds[i];
+        toks->arr.val_indices[start + i] = macro->vals[i].val_idx;
+        toks->arr.locs[start + i] = expanded_loc(exp_idx, i);
+        toks->hide_sets[start + i] = hide_set;
+    }
+    toks->arr.len += macro->expansion_len;
+    push_ctx(ex, start);
+}
+
+static bool expand_func_macro(MacroExpander* ex,
+                              const PreprocMacro* macro,
+                              const ExpansionToken* name);
+
+static bool expand_ctxs(MacroExpander* ex) {
+    PreprocState* state = ex->state;
+    while (has_next_token(ex)) {
+        const ExpansionToken tok = next_token(ex);
+        if (tok.kind == TOKEN_IDENTIFIER
+            && !HideSetTable_contains(&ex->bufs->hide_sets,
+                                      tok.hide_set,
+                                      tok.val_idx)) {
+            const PreprocMacro* macro = find_preproc_macro(state, tok.val_idx);
+            if (macro != NULL && !macro->is_func_macro) {
+                expand_obj_macro(ex, macro, &tok);
+                continue;
+            } else if (macro != NULL) {
+                // not considered func_macro without brackets
+                if (has_next_token(ex)) {
+                    const PreprocExpansionCtx* ctx = top_ctx(ex);
+                    if (ex->bufs->toks.arr.kinds[ctx->pos] == TOKEN_LBRACKET) {
+                        if (!expand_func_macro(ex, macro, &tok)) {
+                            return false;
+                        }
+                        continue;
+                    }
+                } else if (state->err->kind != PREPROC_ERR_NONE) {
+                    return false;
+                }
             }
-            assert(macro_end != UINT32_MAX);
-            return expand_func_macro(state,
-                                     res,
-                                     macro,
-                                     i,
-                                     macro_end,
-                                     expanded,
-                                     info);
-        } else {
-            // not considered func_macro without brackets
-            return (ExpansionInfo){0, i + 1};
         }
-    } else {
-        return expand_obj_macro(state, res, macro, i, expanded, info);
+        push_output(ex, &tok);
     }
+    return state->err->kind == PREPROC_ERR_NONE;
 }
 
-static ExpansionInfo expand_all_macros_in_range(PreprocState* state,
-                                                PreprocTokenArr* res,
-                                                uint32_t start,
-                                                uint32_t end,
-                                                ExpandedMacroStack* expanded,
-                                                const ArchTypeInfo* info) {
-    assert(end <= res->len);
-    int32_t alloc_change = 0;
-    uint32_t i = start;
-    while (i < end) {
-        const ExpansionInfo ex_info = find_and_expand_macro(state,
-                                                            res,
-                                                            i,
-                                                            expanded,
-                                                            info);
-        if (ex_info.next == UINT32_MAX) {
-            return (ExpansionInfo){0, UINT32_MAX};
-        }
-        end += ex_info.alloc_change;
-        alloc_change += ex_info.alloc_change;
-        assert(end <= res->len);
-        i = ex_info.next;
+// Expands the tokens of arr from start to end, appending them to out
+//
+// hide_sets are the hide sets of the tokens of arr, or NULL if they are all
+// empty. hide_set_out is the expansion buffer out belongs to, if the hide sets
+// of the result need to be kept.
+static bool expand_tokens(PreprocState* state,
+                          const PreprocTokenArr* arr,
+                          const uint32_t* hide_sets,
+                          uint32_t start,
+                          uint32_t end,
+                          PreprocTokenArr* out,
+                          PreprocExpansionTokens* hide_set_out,
+                          bool can_read_lines,
+                          const ArchTypeInfo* info) {
+    assert(hide_set_out == NULL || out == &hide_set_out->arr);
+    PreprocExpansionBufs* bufs = &state->_expansion;
+    MacroExpander ex = {
+        .state = state,
+        .bufs = bufs,
+        .out = out,
+        .hide_set_out = hide_set_out,
+        .info = info,
+        .ctxs_start = bufs->ctxs_len,
+        .toks_start = bufs->toks.arr.len,
+        .can_read_lines = can_read_lines,
+    };
+    append_exp_tokens(&bufs->toks, arr, hide_sets, start, end);
+    push_ctx(&ex, ex.toks_start);
+    const bool res = expand_ctxs(&ex);
+    // Contexts are left over when an error occurred
+    while (bufs->ctxs_len != ex.ctxs_start) {
+        pop_ctx(&ex);
     }
+    return res;
+}
+
+static bool may_expand(const PreprocState* state,
+                       const PreprocTokenArr* arr,
+                       uint32_t i) {
+    return arr->kinds[i] == TOKEN_IDENTIFIER
+           && find_preproc_macro(state, arr->val_indices[i]) != NULL;
+}
 
-    return (ExpansionInfo){alloc_change, end};
+// Only the tokens of a source file may continue on the lines after them
+static bool is_file_input(const PreprocState* state,
+                           const PreprocTokenArr* arr) {
+    return arr == &state->toks && state->file_manager.opened_info_len != 0;
 }
 
 bool expand_all_macros(PreprocState* state,
                        PreprocTokenArr* res,
                        uint32_t start,
                        const ArchTypeInfo* info) {
-    // TODO: Keeping this persistent would improve performance instead of
-    // reallocating all the time
-    ExpandedMacroStack expanded = ExpandedMacroStack_create();
-    const ExpansionInfo success = expand_all_macros_in_range(state,
-                                                             res,
-                                                             start,
-                                                             res->len,
-                                                             &expanded,
-                                                             info);
-    ExpandedMacroStack_free(&expanded);
-    return success.next != UINT32_MAX;
+    // Tokens before the first macro stay where they are
+    while (start != res->len && !may_expand(state, res, start)) {
+        ++start;
+    }
+    if (start == res->len) {
+        return true;
+    }
+    // The remaining tokens are copied into the expansion buffer before
+    // anything is written into res
+    const uint32_t end = res->len;
+    res->len = start;
+    const bool success = expand_tokens(state,
+                                       res,
+                                       NULL,
+                                       start,
+                                       end,
+                                       res,
+                                       NULL,
+                                       is_file_input(state, res),
+                                       info);
+    return success;
 }
 
+
 static uint32_t get_str_idx(const uint32_t* ids, uint32_t len, uint32_t to_find) {
     for (uint32_t i = 0; i < len; ++i) {
         if (ids[i] == to_find) {
@@ -222,6 +376,7 @@ static bool is_duplicate_arg(uint32_t id_idx,
 }
 
 static PreprocMacro parse_func_like_macro(PreprocTokenArr* arr,
+                                          MemArena* arena,
                                           PreprocErr* err) {
     PreprocMacro res = {
         .is_func_macro = true,
@@ -306,10 +461,12 @@ static PreprocMacro parse_func_like_macro(PreprocTokenArr* arr,
     res.expansion_len = arr->len - it - 1; // TODO: not sure about - 1
     res.kinds = res.expansion_len == 0
                     ? NULL
-                    : mycc_alloc(sizeof *res.kinds * res.expansion_len);
+                    : MemArena_alloc(arena,
+                                     sizeof *res.kinds * res.expansion_len);
     res.vals = res.expansion_len == 0
                    ? NULL
-                   : mycc_alloc(sizeof *res.vals * res.expansion_len);
+                   : MemArena_alloc(arena,
+                                    sizeof *res.vals * res.expansion_len);
 
     for (uint32_t i = it + 1; i < arr->len; ++i) {
         const uint32_t res_idx = i - it - 1;
@@ -349,15 +506,19 @@ fail:
     return (PreprocMacro){0};
 }
 
-static PreprocMacro parse_object_like_macro(PreprocTokenArr* arr) {
+static PreprocMacro parse_object_like_macro(PreprocTokenArr* arr,
+                                            MemArena* arena) {
     const uint32_t ex_len = arr->len - 3;
     PreprocMacro res = {
         .is_func_macro = false,
         .num_args = 0,
         .is_variadic = false,
         .expansion_len = ex_len,
-        .kinds = ex_len == 0 ? NULL : mycc_alloc(sizeof *res.kinds * ex_len),
-        .vals = ex_len == 0 ? NULL : mycc_alloc(sizeof *res.vals * ex_len),
+        .kinds = ex_len == 0
+                     ? NULL
+                     : MemArena_alloc(arena, sizeof *res.kinds * ex_len),
+        .vals = ex_len == 0 ? NULL
+                            : MemArena_alloc(arena, sizeof *res.vals * ex_len),
     };
 
     for (uint32_t i = 3; i < arr->len; ++i) {
@@ -382,8 +543,11 @@ static bool is_func_like_macro(const PreprocTokenArr* arr, uint32_t name_len) {
 }
 
 PreprocMacro parse_preproc_macro(PreprocTokenArr* arr,
-                                 uint32_t name_len, PreprocErr* err) {
+                                 uint32_t name_len,
+                                 MemArena* arena,
+                                 PreprocErr* err) {
     assert(arr);
+    assert(arena);
     assert(arr->len >= 2);
     assert(arr->kinds[0] == TOKEN_PP_STRINGIFY);
     assert(arr->kinds[1] == TOKEN_IDENTIFIER);
@@ -400,46 +564,26 @@ PreprocMacro parse_preproc_macro(PreprocTokenArr* arr,
     }
 
     if (is_func_like_macro(arr, name_len)) {
-        return parse_func_like_macro(arr, err);
+        return parse_func_like_macro(arr, arena, err);
     } else {
-        return parse_object_like_macro(arr);
+        return parse_object_like_macro(arr, arena);
     }
 }
 
-void PreprocMacro_free(const PreprocMacro* m) {
-    mycc_free(m->kinds);
-    mycc_free(m->vals);
-}
-
-static PreprocTokenArr collect_until(PreprocTokenArr* arr, uint32_t start, uint32_t end) {
-    const uint32_t len = end - start;
-    PreprocTokenArr res = {0};
-
-    if (len != 0) {
-        res.len = len;
-        res.cap = len;
-        res.kinds = mycc_alloc(sizeof *res.kinds * len);
-        res.val_indices = mycc_alloc(sizeof *res.val_indices * len);
-        res.locs = mycc_alloc(sizeof *res.locs * len);
-    }
-
-    for (uint32_t i = 0; i < len; ++i) {
-        const uint32_t arr_it = start + i;
-        res.kinds[i] = arr->kinds[arr_it];
-        res.val_indices[i] = arr->val_indices[arr_it];
-        res.locs[i] = arr->locs[arr_it];
-    }
-    return res;
-}
+typedef struct {
+    uint32_t start, len;
+} TokenRange;
 
 /**
  *
- * @param it Token pointer to the start of a macro argument
- * @param limit_ptr Pointer to this macros closing bracket
+ * @param it Index of the start of a macro argument
+ * @param end Index of this macros closing bracket
  *
- * @return The macro argument given at the start of this pointer
+ * @return The range of the macro argument starting at it
  */
-static PreprocTokenArr collect_macro_arg(PreprocTokenArr* arr, uint32_t it, uint32_t end) {
+static TokenRange collect_macro_arg(const PreprocTokenArr* arr,
+                                    uint32_t it,
+                                    uint32_t end) {
     uint32_t num_open_brackets = 0;
     uint32_t arg_start = it;
     while (it != end
@@ -453,59 +597,46 @@ static PreprocTokenArr collect_macro_arg(PreprocTokenArr* arr, uint32_t it, uint
         ++it;
     }
 
-    return collect_until(arr, arg_start, it);
+    return (TokenRange){arg_start, it - arg_start};
 }
 
 typedef struct {
     uint32_t len;
-    PreprocTokenArr* arrs;
+    // Ranges in PreprocExpansionBufs.args, owned by the scratch arena of the
+    // expansion
+    TokenRange* ranges;
 } MacroArgs;
 
-static void PreprocTokenArr_free_only_tokens(const PreprocTokenArr* arr) {
-    mycc_free(arr->kinds);
-    mycc_free(arr->val_indices);
-    mycc_free(arr->locs);
-}
-
-static void MacroArgs_free(MacroArgs* args) {
-    for (uint32_t i = 0; i < args->len; ++i) {
-        PreprocTokenArr_free_only_tokens(&args->arrs[i]);
-    }
-    mycc_free(args->arrs);
-}
-
 /**
- * @brief Collects arguments for the given macro, assuming the number of
- *        arguments was already checked in the course of finding the closing
- *        bracket
+ * @brief Collects arguments for the given macro
  *
- * @param args_start Pointer to start of macro arguments (opening bracket)
- * @param limit_ptr Pointer to closing bracket of this macro
+ * @param args_start Index of the start of macro arguments (opening bracket)
+ * @param end Index of the closing bracket of this macro
  * @param expected_args Number of arguments this macro expects
  *
- * @return Pointer to #expected_args token_arrs representing the arguments of
- *         this macro call
+ * @return #expected_args ranges representing the arguments of this macro call
  */
-static MacroArgs collect_macro_args(PreprocTokenArr* arr,
+static MacroArgs collect_macro_args(const PreprocTokenArr* arr,
                                     uint32_t args_start,
                                     uint32_t end,
                                     uint32_t expected_args,
                                     bool is_variadic,
+                                    MemArena* scratch,
                                     PreprocErr* err) {
     assert(arr->kinds[args_start] == TOKEN_LBRACKET);
 
     const uint32_t cap = is_variadic ? expected_args + 1 : expected_args;
     assert(!is_variadic || cap != 0);
-    assert(cap != 0 || args_start + 1 == end);
     MacroArgs res = {
         .len = 0,
-        .arrs = cap == 0 ? NULL : mycc_alloc(sizeof *res.arrs * cap),
+        .ranges = cap == 0 ? NULL
+                           : MemArena_alloc(scratch, sizeof *res.ranges * cap),
     };
 
     uint32_t it = args_start + 1;
     while (res.len < expected_args && it != end) {
-        res.arrs[res.len] = collect_macro_arg(arr, it, end);
-        it += res.arrs[res.len].len;
+        res.ranges[res.len] = collect_macro_arg(arr, it, end);
+        it += res.ranges[res.len].len;
 
         ++res.len;
         if (arr->kinds[it] == TOKEN_COMMA) {
@@ -521,14 +652,13 @@ static MacroArgs collect_macro_args(PreprocTokenArr* arr,
     if (arr->kinds[it] == TOKEN_COMMA
         && ((it + 1 == end && res.len < expected_args) || is_variadic)) {
         ++it;
-        res.arrs[res.len] = collect_until(arr, it, end);
-        it += res.arrs[res.len].len;
-        assert(it == end);
+        res.ranges[res.len] = (TokenRange){it, end - it};
+        it = end;
         ++res.len;
     } else if (is_variadic && res.len == expected_args) {
         assert(it == end || it == args_start + 1);
-        res.arrs[res.len] = collect_until(arr, it, end);
-        it += res.arrs[res.len].len;
+        res.ranges[res.len] = (TokenRange){it, end - it};
+        it = end;
         ++res.len;
     }
 
@@ -537,218 +667,157 @@ static MacroArgs collect_macro_args(PreprocTokenArr* arr,
         err->expected_arg_count = expected_args;
         err->is_variadic = is_variadic;
         err->too_few_args = true;
-        goto fail;
+        return (MacroArgs){0};
     } else if (it != end) {
         PreprocErr_set(err, PREPROC_ERR_MACRO_ARG_COUNT, arr->locs[it]);
         err->expected_arg_count = expected_args;
         err->is_variadic = is_variadic;
         err->too_few_args = false;
-        goto fail;
+        return (MacroArgs){0};
     }
 
     return res;
-fail:
-    MacroArgs_free(&res);
-    return (MacroArgs){
-        .len = 0,
-        .arrs = NULL,
-    };
 }
 
-static uint32_t get_expansion_len(const PreprocMacro* macro,
-                                  const MacroArgs* args) {
-    uint32_t len = 0;
-    for (uint32_t i = 0; i < macro->expansion_len; ++i) {
-        if (macro->kinds[i] == TOKEN_INVALID) {
-            assert(args->arrs);
-            len += args->arrs[macro->vals[i].arg_num].len;
-        } else {
-            len += 1;
+
+// Moves the tokens of the macro call starting at the opening bracket into the
+// argument buffer
+static bool collect_macro_call(MacroExpander* ex, SourceLoc loc) {
+    PreprocExpansionTokens* args = &ex->bufs->args;
+    uint32_t open_bracket_count = 0;
+    while (has_next_token(ex)) {
+        const ExpansionToken tok = next_token(ex);
+        push_exp_token(args, tok.kind, tok.val_idx, tok.loc, tok.hide_set);
+        if (tok.kind == TOKEN_LBRACKET) {
+            ++open_bracket_count;
+        } else if (tok.kind == TOKEN_RBRACKET) {
+            --open_bracket_count;
+            if (open_bracket_count == 0) {
+                return true;
+            }
         }
     }
-
-    return len;
-}
-
-static void shift_back(PreprocTokenArr* arr,
-                       uint32_t num,
-                       uint32_t from,
-                       uint32_t to) {
-    const uint32_t len = to - from;
-    memmove(arr->kinds + from + num,
-            arr->kinds + from,
-            sizeof *arr->kinds * len);
-    memmove(arr->val_indices + from + num, arr->val_indices + from, sizeof *arr->val_indices * len);
-    memmove(arr->locs + from + num, arr->locs + from, sizeof *arr->locs * len);
-}
-
-static void shift_forward(PreprocTokenArr* arr,
-                          uint32_t num,
-                          uint32_t from,
-                          uint32_t to) {
-    const uint32_t len = to - from - num;
-    memmove(arr->kinds + from,
-            arr->kinds + from + num,
-            sizeof *arr->kinds * len);
-    memmove(arr->val_indices + from, arr->val_indices + from + num, sizeof *arr->val_indices * len);
-    memmove(arr->locs + from, arr->locs + from + num, sizeof *arr->locs * len);
-}
-
-static void copy_into_tokens(PreprocTokenArr* res,
-                             uint32_t* token_idx,
-                             const PreprocTokenArr* arr,
-                             SourceLoc loc) {
-    assert(arr);
-    for (uint32_t i = 0; i < arr->len; ++i) {
-        res->kinds[*token_idx] = arr->kinds[i];
-        res->val_indices[*token_idx] = arr->val_indices[i];
-        res->locs[*token_idx] = loc;
-        ++*token_idx;
+    if (ex->state->err->kind == PREPROC_ERR_NONE) {
+        PreprocErr_set(ex->state->err, PREPROC_ERR_UNTERMINATED_MACRO, loc);
     }
+    return false;
 }
 
 // TODO: stringification and concatenation
-static ExpansionInfo expand_func_macro(PreprocState* state,
-                                       PreprocTokenArr* res,
-                                       const PreprocMacro* macro,
-                                       uint32_t macro_idx,
-                                       uint32_t macro_end,
-                                       ExpandedMacroStack* expanded,
-                                       const ArchTypeInfo* info) {
-    const SourceLoc loc = res->locs[macro_idx];
+static bool expand_func_macro(MacroExpander* ex,
+                              const PreprocMacro* macro,
+                              const ExpansionToken* name) {
     assert(macro->is_func_macro);
-    assert(macro_end < res->len);
-    assert(res->kinds[macro_idx + 1] == TOKEN_LBRACKET);
-    MacroArgs args = collect_macro_args(res,
-                                        macro_idx + 1,
-                                        macro_end,
-                                        macro->num_args,
-                                        macro->is_variadic,
-                                        state->err);
-    if (args.len == 0 && macro->num_args != 0) {
-        assert(state->err->kind != PREPROC_ERR_NONE);
-        return (ExpansionInfo){0, UINT32_MAX};
+    PreprocState* state = ex->state;
+    PreprocExpansionBufs* bufs = ex->bufs;
+    PreprocExpansionTokens* args_buf = &bufs->args;
+    const uint32_t call_start = args_buf->arr.len;
+    if (!collect_macro_call(ex, name->loc)) {
+        args_buf->arr.len = call_start;
+        return false;
     }
-
-    for (uint32_t i = 0; i < args.len; ++i) {
-        PreprocTokenArr* arg = &args.arrs[i];
-        const ExpansionInfo success = expand_all_macros_in_range(
-            state,
-            arg,
-            0, arg->len,
-            expanded,
-            info);
-        if (success.next == UINT32_MAX) {
-            MacroArgs_free(&args);
-            return success;
-        }
+    const uint32_t call_end = args_buf->arr.len - 1;
+
+    const MemArenaMark scratch_mark = MemArena_mark(&state->_scratch_arena);
+    const MacroArgs args = collect_macro_args(&args_buf->arr,
+                                              call_start,
+                                              call_end,
+                                              macro->num_args,
+                                              macro->is_variadic,
+                                              &state->_scratch_arena,
+                                              state->err);
+    if (state->err->kind != PREPROC_ERR_NONE) {
+        MemArena_reset(&state->_scratch_arena, scratch_mark);
+        args_buf->arr.len = call_start;
+        return false;
     }
-
     assert((macro->is_variadic && args.len == (uint32_t)macro->num_args + 1)
            || (!macro->is_variadic && args.len == (uint32_t)macro->num_args));
 
-    const uint32_t exp_len = get_expansion_len(macro, &args);
-    const uint32_t macro_call_len = macro_end - macro_idx + 1;
-
-    const bool alloc_grows = exp_len > macro_call_len;
-    const uint32_t alloc_change_abs = alloc_grows ? exp_len - macro_call_len
-                                                  : macro_call_len - exp_len;
-
-    const uint32_t old_len = res->len;
-
-    int32_t alloc_change = 0;
-    if (alloc_grows) {
-        alloc_change = alloc_change_abs;
-        res->len += alloc_change_abs;
-        res->cap += alloc_change_abs;
-        res->kinds = mycc_realloc(res->kinds, sizeof *res->kinds * res->cap);
-        res->val_indices = mycc_realloc(res->val_indices, sizeof *res->val_indices * res->cap);
-        res->locs = mycc_realloc(res->locs, sizeof *res->locs * res->cap);
-
-        shift_back(res, alloc_change_abs, macro_idx + macro_call_len, old_len);
-    } else if (alloc_change_abs != 0) {
-        alloc_change = -(ptrdiff_t)alloc_change_abs;
-        res->len -= alloc_change_abs;
-
-        shift_forward(res, alloc_change_abs, macro_idx + exp_len, old_len);
-    }
-
-    uint32_t token_idx = macro_idx;
+    // Arguments are fully expanded before they are substituted
+    TokenRange* expanded = args.len == 0
+                               ? NULL
+                               : MemArena_alloc(&state->_scratch_arena,
+                                                sizeof *expanded * args.len);
+    for (uint32_t i = 0; i < args.len; ++i) {
+        const uint32_t exp_start = args_buf->arr.len;
+        const bool success = expand_tokens(
+            state,
+            &args_buf->arr,
+            args_buf->hide_sets,
+            args.ranges[i].start,
+            args.ranges[i].start + args.ranges[i].len,
+            &args_buf->arr,
+            args_buf,
+            false,
+            ex->info);
+        if (!success) {
+            MemArena_reset(&state->_scratch_arena, scratch_mark);
+            args_buf->arr.len = call_start;
+            return false;
+        }
+        expanded[i] = (TokenRange){exp_start, args_buf->arr.len - exp_start};
+    }
+
+    // Only macros that hide both the name and the closing bracket stay
+    // hidden, so an invocation that is completed by tokens from outside the
+    // expansion these came from can expand them again
+    HideSetTable* hide_sets = &bufs->hide_sets;
+    const uint32_t hide_set = HideSetTable_add(
+        hide_sets,
+        HideSetTable_intersection(hide_sets,
+                                  name->hide_set,
+                                  args_buf->hide_sets[call_end]),
+        name->val_idx);
+
+    // Empty macros have no tokens that could refer to their expansion
+    const uint32_t exp_idx = macro->expansion_len == 0
+                                 ? UINT32_MAX
+                                 : SourceLocTable_add_expansion(
+                                     &state->vals.loc_table,
+                                     name->loc,
+                                     macro->spellings_idx,
+                                     macro->expansion_len);
+    PreprocExpansionTokens* toks = &bufs->toks;
+    const uint32_t start = toks->arr.len;
+    // Consecutive argument tokens usually have the same hide set, so the
+    // last union is reused
+    uint32_t last_arg_hide_set = HIDE_SET_EMPTY;
+    uint32_t last_union = hide_set;
     for (uint32_t i = 0; i < macro->expansion_len; ++i) {
         const TokenKind kind = macro->kinds[i];
         const TokenValOrArg* curr = &macro->vals[i];
         if (kind == TOKEN_INVALID) {
-            copy_into_tokens(res, &token_idx, &args.arrs[curr->arg_num], loc);
+            const TokenRange arg = expanded[curr->arg_num];
+            const uint32_t arg_start = toks->arr.len;
+            append_exp_tokens(toks,
+                              &args_buf->arr,
+                              args_buf->hide_sets,
+                              arg.start,
+                              arg.start + arg.len);
+            // Argument tokens keep their own locations, as they were
+            // spelled in the invocation and not in the macro body
+            for (uint32_t j = arg_start; j < toks->arr.len; ++j) {
+                if (toks->hide_sets[j] != last_arg_hide_set) {
+                    last_arg_hide_set = toks->hide_sets[j];
+                    last_union = HideSetTable_union(hide_sets,
+                                                    last_arg_hide_set,
+                                                    hide_set);
+                }
+                toks->hide_sets[j] = last_union;
+            }
         } else {
-            res->kinds[token_idx] = kind;
-            res->val_indices[token_idx] = curr->val_idx;
-            res->locs[token_idx] = loc;
-            ++token_idx;
+            push_exp_token(toks,
+                           kind,
+                           curr->val_idx,
+                           expanded_loc(exp_idx, i),
+                           hide_set);
         }
     }
-
-    const uint32_t last_after_macro = token_idx == 0 ? 0 : token_idx - 1;
-    ExpandedMacroStack_push(expanded, macro);
-    ExpansionInfo ex_info = expand_all_macros_in_range(state,
-                                                       res,
-                                                       macro_idx,
-                                                       last_after_macro,
-                                                       expanded,
-                                                       info);
-    ExpandedMacroStack_pop(expanded);
-
-    MacroArgs_free(&args);
-    ex_info.alloc_change += alloc_change;
-    return ex_info;
-}
-
-static ExpansionInfo expand_obj_macro(PreprocState* state,
-                                      PreprocTokenArr* res,
-                                      const PreprocMacro* macro,
-                                      uint32_t macro_idx,
-                                      ExpandedMacroStack* expanded,
-                                      const ArchTypeInfo* info) {
-    const SourceLoc loc = res->locs[macro_idx];
-    assert(macro->is_func_macro == false);
-    assert(macro->num_args == 0);
-
-    const uint32_t exp_len = macro->expansion_len;
-    const uint32_t old_len = res->len;
-
-    int32_t alloc_change;
-    if (exp_len > 0) {
-        alloc_change = exp_len - 1;
-        res->cap += exp_len - 1;
-        res->len += exp_len - 1;
-        res->kinds = mycc_realloc(res->kinds, sizeof *res->kinds * res->cap);
-        res->val_indices = mycc_realloc(res->val_indices, sizeof *res->val_indices * res->cap);
-        res->locs = mycc_realloc(res->locs, sizeof *res->locs * res->cap);
-
-        shift_back(res, exp_len - 1, macro_idx, old_len);
-    } else {
-        alloc_change = -1;
-        res->len -= 1;
-
-        shift_forward(res, 1, macro_idx, old_len);
+    MemArena_reset(&state->_scratch_arena, scratch_mark);
+    args_buf->arr.len = call_start;
+    if (toks->arr.len != start) {
+        push_ctx(ex, start);
     }
-
-    for (uint32_t i = 0; i < exp_len; ++i) {
-        assert(macro->kinds[i] != TOKEN_INVALID);
-
-        res->kinds[macro_idx + i] = macro->kinds[i];
-        res->val_indices[macro_idx + i] = macro->vals[i].val_idx;
-        res->locs[macro_idx + i] = loc;
-    }
-
-    ExpandedMacroStack_push(expanded, macro);
-    ExpansionInfo ex_info = expand_all_macros_in_range(state,
-                                                       res,
-                                                       macro_idx,
-                                                       macro_idx + exp_len,
-                                                       expanded,
-                                                       info);
-    ExpandedMacroStack_pop(expanded);
-    ex_info.alloc_change += alloc_change;
-    return ex_info;
+    return true;
 }
-
@@ -0,0 +1,514 @@
+#include "frontend/preproc/PreprocPCH.h"
+
+#include <string.h>
+
+#include "util/mem.h"
+#include "util/hash.h"
+
+#include "frontend/preproc/PreprocMacro.h"
+
+enum {
+    PCH_VERSION = 3,
+    MACRO_FLAG_FUNC = 1 << 0,
+    MACRO_FLAG_VARIADIC = 1 << 1,
+};
+
+static const char g_magic[8] = {'m', 'y', 'c', 'c', '-', 'p', 'c', 'h'};
+
+// The hash tables in the file are only usable if the hash function has not
+// changed, so a known hash is stored with the header
+static uint64_t get_hash_check(void) {
+    return mycc_hash_str(STR_LIT("mycc precompiled header"));
+}
+
+static bool write_u32(File f, uint32_t val) {
+    return File_write(&val, sizeof val, 1, f) == 1;
+}
+
+static bool read_u32(File f, uint32_t* res) {
+    return File_read(res, sizeof *res, 1, f) == 1;
+}
+
+// Empty arrays may be NULL, which must not be passed to fwrite() or fread()
+static bool write_arr(File f,
+                      const void* arr,
+                      size_t elem_bytes,
+                      uint32_t len) {
+    return len == 0 || File_write(arr, elem_bytes, len, f) == len;
+}
+
+static bool read_arr(File f, void* res, size_t elem_bytes, uint32_t len) {
+    return len == 0 || File_read(res, elem_bytes, len, f) == len;
+}
+
+static bool write_header(File f) {
+    const uint64_t hash_check = get_hash_check();
+    return File_write(g_magic, sizeof *g_magic, sizeof g_magic, f)
+               == sizeof g_magic
+           && write_u32(f, PCH_VERSION)
+           && File_write(&hash_check, sizeof hash_check, 1, f) == 1;
+}
+
+static bool read_header(File f) {
+    char magic[sizeof g_magic];
+    uint32_t version;
+    uint64_t hash_check;
+    return File_read(magic, sizeof *magic, sizeof magic, f) == sizeof magic
+           && memcmp(magic, g_magic, sizeof magic) == 0
+           && read_u32(f, &version) && version == PCH_VERSION
+           && File_read(&hash_check, sizeof hash_check, 1, f) == 1
+           && hash_check == get_hash_check();
+}
+
+static bool write_file_info(File f,
+                            const FileInfo* info,
+                            const PreprocPCHFile* files) {
+    if (!write_u32(f, info->len)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < info->len; ++i) {
+        const Str path = StrBuf_as_str(&info->paths[i]);
+        const uint8_t is_once = files[i].is_once;
+        if (!write_u32(f, path.len)
+            || !write_arr(f, path.data, sizeof *path.data, path.len)
+            || File_write(&is_once, sizeof is_once, 1, f) != 1
+            || !write_u32(f, files[i].guard_id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_file_info(File f, FileInfo* res, PreprocPCHFile** files) {
+    uint32_t len;
+    if (!read_u32(f, &len) || len == 0) {
+        return false;
+    }
+    *res = (FileInfo){
+        .len = 0,
+        .paths = mycc_alloc(sizeof *res->paths * len),
+    };
+    *files = mycc_alloc(sizeof **files * len);
+    for (uint32_t i = 0; i < len; ++i) {
+        uint32_t path_len;
+        if (!read_u32(f, &path_len)) {
+            goto fail;
+        }
+        char* data = mycc_alloc_or_null(sizeof *data * path_len);
+        if (!read_arr(f, data, sizeof *data, path_len)) {
+            mycc_free(data);
+            goto fail;
+        }
+        const StrBuf path = StrBuf_create((Str){path_len, data});
+        mycc_free(data);
+        res->paths[i] = path;
+        ++res->len;
+
+        uint8_t is_once;
+        if (File_read(&is_once, sizeof is_once, 1, f) != 1 || is_once > 1
+            || !read_u32(f, &(*files)[i].guard_id)) {
+            goto fail;
+        }
+        (*files)[i].is_once = is_once != 0;
+    }
+    return true;
+fail:
+    mycc_free(*files);
+    FileInfo_free(res);
+    return false;
+}
+
+static bool write_tokens(File f, const PreprocTokenArr* toks) {
+    const uint32_t len = toks->len;
+    return write_u32(f, len)
+           && write_arr(f, toks->kinds, sizeof *toks->kinds, len)
+           && write_arr(f, toks->val_indices, sizeof *toks->val_indices, len)
+           && write_arr(f, toks->locs, sizeof *toks->locs, len);
+}
+
+static bool read_tokens(File f, PreprocTokenArr* res) {
+    uint32_t len;
+    if (!read_u32(f, &len)) {
+        return false;
+    }
+    *res = (PreprocTokenArr){
+        .len = len,
+        .cap = len,
+        .kinds = mycc_alloc_or_null(sizeof *res->kinds * len),
+        .val_indices = mycc_alloc_or_null(sizeof *res->val_indices * len),
+        .locs = mycc_alloc_or_null(sizeof *res->locs * len),
+    };
+    if (!read_arr(f, res->kinds, sizeof *res->kinds, len)
+        || !read_arr(f, res->val_indices, sizeof *res->val_indices, len)
+        || !read_arr(f, res->locs, sizeof *res->locs, len)) {
+        PreprocTokenArr_free(res);
+        return false;
+    }
+    return true;
+}
+
+static bool write_loc_table(File f, const SourceLocTable* t) {
+    return write_u32(f, t->len)
+           && write_arr(f, t->starts, sizeof *t->starts, t->len)
+           && write_arr(f, t->file_indices, sizeof *t->file_indices, t->len)
+           && write_arr(f, t->lines, sizeof *t->lines, t->len)
+           && write_u32(f, t->end) && write_u32(f, t->exps_len)
+           && write_arr(f, t->exp_starts, sizeof *t->exp_starts, t->exps_len)
+           && write_arr(f, t->exp_locs, sizeof *t->exp_locs, t->exps_len)
+           && write_arr(f,
+                        t->exp_spellings,
+                        sizeof *t->exp_spellings,
+                        t->exps_len)
+           && write_u32(f, t->exp_end) && write_u32(f, t->spellings_len)
+           && write_arr(f,
+                        t->spellings,
+                        sizeof *t->spellings,
+                        t->spellings_len);
+}
+
+static bool read_loc_table(File f, SourceLocTable* res) {
+    *res = SourceLocTable_create();
+    uint32_t len;
+    if (!read_u32(f, &len)) {
+        return false;
+    }
+    res->len = len;
+    res->cap = len;
+    res->starts = mycc_alloc_or_null(sizeof *res->starts * len);
+    res->file_indices = mycc_alloc_or_null(sizeof *res->file_indices * len);
+    res->lines = mycc_alloc_or_null(sizeof *res->lines * len);
+    if (!read_arr(f, res->starts, sizeof *res->starts, len)
+        || !read_arr(f, res->file_indices, sizeof *res->file_indices, len)
+        || !read_arr(f, res->lines, sizeof *res->lines, len)
+        || !read_u32(f, &res->end) || !read_u32(f, &len)) {
+        SourceLocTable_free(res);
+        return false;
+    }
+    res->exps_len = len;
+    res->exps_cap = len;
+    res->exp_starts = mycc_alloc_or_null(sizeof *res->exp_starts * len);
+    res->exp_locs = mycc_alloc_or_null(sizeof *res->exp_locs * len);
+    res->exp_spellings = mycc_alloc_or_null(sizeof *res->exp_spellings * len);
+    if (!read_arr(f, res->exp_starts, sizeof *res->exp_starts, len)
+        || !read_arr(f, res->exp_locs, sizeof *res->exp_locs, len)
+        || !read_arr(f, res->exp_spellings, sizeof *res->exp_spellings, len)
+        || !read_u32(f, &res->exp_end) || !read_u32(f, &len)) {
+        SourceLocTable_free(res);
+        return false;
+    }
+    res->spellings_len = len;
+    res->spellings_cap = len;
+    res->spellings = mycc_alloc_or_null(sizeof *res->spellings * len);
+    if (!read_arr(f, res->spellings, sizeof *res->spellings, len)) {
+        SourceLocTable_free(res);
+        return false;
+    }
+    return true;
+}
+
+static bool write_vals(File f, const PreprocTokenValList* vals) {
+    return IndexedStringSet_write(&vals->identifiers, f)
+           && IndexedStringSet_write(&vals->int_consts, f)
+           && IndexedStringSet_write(&vals->float_consts, f)
+           && IndexedStringSet_write(&vals->str_lits, f)
+           && write_loc_table(f, &vals->loc_table);
+}
+
+static bool read_vals(File f, PreprocTokenValList* res) {
+    if (!IndexedStringSet_read(&res->identifiers, f)) {
+        return false;
+    }
+    if (!IndexedStringSet_read(&res->int_consts, f)) {
+        IndexedStringSet_free(&res->identifiers);
+        return false;
+    }
+    if (!IndexedStringSet_read(&res->float_consts, f)) {
+        IndexedStringSet_free(&res->identifiers);
+        IndexedStringSet_free(&res->int_consts);
+        return false;
+    }
+    if (!IndexedStringSet_read(&res->str_lits, f)) {
+        IndexedStringSet_free(&res->identifiers);
+        IndexedStringSet_free(&res->int_consts);
+        IndexedStringSet_free(&res->float_consts);
+        return false;
+    }
+    if (!read_loc_table(f, &res->loc_table)) {
+        IndexedStringSet_free(&res->identifiers);
+        IndexedStringSet_free(&res->int_consts);
+        IndexedStringSet_free(&res->float_consts);
+        IndexedStringSet_free(&res->str_lits);
+        return false;
+    }
+    return true;
+}
+
+static bool write_macro(File f, const PreprocMacro* macro) {
+    const uint8_t flags = (macro->is_func_macro ? MACRO_FLAG_FUNC : 0)
+                          | (macro->is_variadic ? MACRO_FLAG_VARIADIC : 0);
+    const uint32_t len = macro->expansion_len;
+    return File_write(&flags, sizeof flags, 1, f) == 1
+           && write_u32(f, macro->num_args) && write_u32(f, len)
+           && write_u32(f, macro->spellings_idx)
+           && write_arr(f, macro->kinds, sizeof *macro->kinds, len)
+           && write_arr(f, macro->vals, sizeof *macro->vals, len);
+}
+
+static bool read_macro(File f, PreprocMacro* res, MemArena* arena) {
+    uint8_t flags;
+    uint32_t num_args, len, spellings_idx;
+    if (File_read(&flags, sizeof flags, 1, f) != 1 || !read_u32(f, &num_args)
+        || !read_u32(f, &len) || !read_u32(f, &spellings_idx)) {
+        return false;
+    }
+    *res = (PreprocMacro){
+        .is_func_macro = (flags & MACRO_FLAG_FUNC) != 0,
+        .is_variadic = (flags & MACRO_FLAG_VARIADIC) != 0,
+        .num_args = num_args,
+        .expansion_len = len,
+        .kinds = len == 0 ? NULL
+                          : MemArena_alloc(arena, sizeof *res->kinds * len),
+        .vals = len == 0 ? NULL
+                         : MemArena_alloc(arena, sizeof *res->vals * len),
+        .spellings_idx = spellings_idx,
+    };
+    return read_arr(f, res->kinds, sizeof *res->kinds, len)
+           && read_arr(f, res->vals, sizeof *res->vals, len);
+}
+
+static bool write_macro_map(File f, const PreprocMacroMap* map) {
+    if (!write_u32(f, map->_cap)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < map->_cap; ++i) {
+        if (!write_macro(f, &map->_macros[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool read_macro_map(File f, PreprocMacroMap* res, MemArena* arena) {
+    uint32_t cap;
+    if (!read_u32(f, &cap)) {
+        return false;
+    }
+    *res = (PreprocMacroMap){
+        ._cap = cap,
+        ._macros = mycc_alloc_or_null(sizeof *res->_macros * cap),
+    };
+    for (uint32_t i = 0; i < cap; ++i) {
+        if (!read_macro(f, &res->_macros[i], arena)) {
+            mycc_free(res->_macros);
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t get_num_vals(const PreprocTokenValList* vals,
+                             TokenKind kind) {
+    switch (kind) {
+        case TOKEN_IDENTIFIER:
+            return IndexedStringSet_len(&vals->identifiers);
+        case TOKEN_I_CONSTANT:
+            return IndexedStringSet_len(&vals->int_consts);
+        case TOKEN_F_CONSTANT:
+            return IndexedStringSet_len(&vals->float_consts);
+        case TOKEN_STRING_LITERAL:
+            return IndexedStringSet_len(&vals->str_lits);
+        default:
+            // The value index of other tokens is never used
+            return UINT32_MAX;
+    }
+}
+
+static bool is_valid_val(const PreprocTokenValList* vals,
+                         uint8_t kind,
+                         uint32_t val_idx) {
+    if (kind >= TOKEN_INVALID) {
+        return false;
+    }
+    const uint32_t num_vals = get_num_vals(vals, (TokenKind)kind);
+    return num_vals == UINT32_MAX || val_idx < num_vals;
+}
+
+// Number of offsets of the expansion at idx, which is 0 if the table had
+// already run out of them
+static uint32_t get_exp_len(const SourceLocTable* t, uint32_t idx) {
+    const uint32_t start = t->exp_starts[idx];
+    if (start == SOURCE_LOC_UNKNOWN) {
+        return 0;
+    }
+    const bool is_last = idx + 1 == t->exps_len
+                         || t->exp_starts[idx + 1] == SOURCE_LOC_UNKNOWN;
+    return (is_last ? t->exp_end : t->exp_starts[idx + 1]) - start;
+}
+
+// Only expansions before max_exp may be referred to, so resolving the
+// invocation of an expansion cannot loop
+static bool is_valid_loc(const SourceLocTable* t,
+                         uint32_t num_files,
+                         uint32_t max_exp,
+                         SourceLoc loc) {
+    if (loc.file_idx != SOURCE_LOC_EXPANSION_FILE_IDX) {
+        return loc.file_idx < num_files;
+    }
+    const uint32_t exp = loc.file_loc.line;
+    return exp < max_exp
+           && (t->exp_starts[exp] == SOURCE_LOC_UNKNOWN
+               || loc.file_loc.index < get_exp_len(t, exp));
+}
+
+static bool is_valid_loc_table(const SourceLocTable* t, uint32_t num_files) {
+    if (t->end > SOURCE_LOC_UNKNOWN || t->exp_end > SOURCE_LOC_UNKNOWN) {
+        return false;
+    }
+    for (uint32_t i = 0; i < t->len; ++i) {
+        if (t->file_indices[i] >= num_files || t->starts[i] >= t->end
+            || (i != 0 && t->starts[i] <= t->starts[i - 1])) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < t->spellings_len; ++i) {
+        if (t->spellings[i].file_idx >= num_files) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < t->exps_len; ++i) {
+        const uint32_t start = t->exp_starts[i];
+        if ((start != SOURCE_LOC_UNKNOWN && start > t->exp_end)
+            || (i != 0 && start < t->exp_starts[i - 1])) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < t->exps_len; ++i) {
+        const uint32_t spellings_idx = t->exp_spellings[i];
+        if (!is_valid_loc(t, num_files, i, t->exp_locs[i])
+            || spellings_idx > t->spellings_len
+            || get_exp_len(t, i) > t->spellings_len - spellings_idx) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_valid_tokens(const PreprocPCH* pch) {
+    const PreprocTokenArr* toks = &pch->toks;
+    const SourceLocTable* t = &pch->vals.loc_table;
+    for (uint32_t i = 0; i < toks->len; ++i) {
+        const SourceLoc loc = toks->locs[i];
+        if (!is_valid_val(&pch->vals, toks->kinds[i], toks->val_indices[i])
+            || !is_valid_loc(t, pch->file_info.len, t->exps_len, loc)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_valid_macro(const PreprocPCH* pch, const PreprocMacro* macro) {
+    const uint32_t num_args = macro->num_args;
+    const uint32_t spellings_len = pch->vals.loc_table.spellings_len;
+    // Every parameter has its own identifier
+    if (num_args > IndexedStringSet_len(&pch->vals.identifiers)
+        || (!macro->is_func_macro && num_args != 0)
+        || macro->spellings_idx > spellings_len
+        || macro->expansion_len > spellings_len - macro->spellings_idx) {
+        return false;
+    }
+    const uint32_t num_params = num_args + (macro->is_variadic ? 1 : 0);
+    for (uint32_t i = 0; i < macro->expansion_len; ++i) {
+        const uint8_t kind = macro->kinds[i];
+        if (kind == TOKEN_INVALID) {
+            if (!macro->is_func_macro
+                || macro->vals[i].arg_num >= num_params) {
+                return false;
+            }
+        } else if (!is_valid_val(&pch->vals, kind, macro->vals[i].val_idx)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Makes sure all indices read from the file are in range, as they are used
+// without checks
+static bool is_valid_pch(const PreprocPCH* pch) {
+    if (!is_valid_loc_table(&pch->vals.loc_table, pch->file_info.len)
+        || !is_valid_tokens(pch)) {
+        return false;
+    }
+    const uint32_t num_ids = IndexedStringSet_len(&pch->vals.identifiers);
+    for (uint32_t i = 0; i < pch->file_info.len; ++i) {
+        const uint32_t guard_id = pch->files[i].guard_id;
+        if (guard_id != UINT32_MAX && guard_id >= num_ids) {
+            return false;
+        }
+    }
+    const PreprocMacroMap* map = &pch->macro_map;
+    // Macros are stored at the index of their name
+    if (map->_cap > num_ids) {
+        return false;
+    }
+    for (uint32_t i = 0; i < map->_cap; ++i) {
+        if (!is_valid_macro(pch, &map->_macros[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PreprocPCH_write(const PreprocPCH* pch, File f) {
+    return write_header(f)
+           && write_file_info(f, &pch->file_info, pch->files)
+           && write_tokens(f, &pch->toks) && write_vals(f, &pch->vals)
+           && write_macro_map(f, &pch->macro_map);
+}
+
+bool PreprocPCH_read(PreprocPCH* res, File f) {
+    if (!read_header(f)) {
+        return false;
+    }
+    PreprocPCH pch = {
+        ._macro_arena = MemArena_create(0),
+    };
+    if (!read_file_info(f, &pch.file_info, &pch.files)) {
+        goto fail_file_info;
+    }
+    if (!read_tokens(f, &pch.toks)) {
+        goto fail_tokens;
+    }
+    if (!read_vals(f, &pch.vals)) {
+        goto fail_vals;
+    }
+    if (!read_macro_map(f, &pch.macro_map, &pch._macro_arena)) {
+        goto fail_macro_map;
+    }
+    if (!is_valid_pch(&pch)) {
+        goto fail_valid;
+    }
+    *res = pch;
+    return true;
+fail_valid:
+    mycc_free(pch.macro_map._macros);
+fail_macro_map:
+    PreprocTokenValList_free(&pch.vals);
+fail_vals:
+    PreprocTokenArr_free(&pch.toks);
+fail_tokens:
+    mycc_free(pch.files);
+    FileInfo_free(&pch.file_info);
+fail_file_info:
+    MemArena_free(&pch._macro_arena);
+    return false;
+}
+
+void PreprocPCH_free(const PreprocPCH* pch) {
+    PreprocTokenArr_free(&pch->toks);
+    PreprocTokenValList_free(&pch->vals);
+    mycc_free(pch->macro_map._macros);
+    MemArena_free(&pch->_macro_arena);
+    FileInfo_free(&pch->file_info);
+    mycc_free(pch->files);
+}
+
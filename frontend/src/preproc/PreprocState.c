@@ -6,16 +6,57 @@
 
 #include "util/mem.h"
 #include "util/paths.h"
+#include "util/FileContents.h"
+#include "util/FileId.h"
+#include "util/scan.h"
 
+#include "frontend/preproc/IncludeCache.h"
 #include "frontend/preproc/PreprocMacro.h"
+#include "frontend/preproc/PreprocPCH.h"
+
+enum {
+    SCRATCH_ARENA_BLOCK_SIZE = 4096,
+};
+
+// Detection of the include guard of a file, which has to enclose everything
+// except whitespace, comments and pragmas
+typedef enum {
+    INCLUDE_GUARD_START,
+    INCLUDE_GUARD_IN_IFNDEF,
+    INCLUDE_GUARD_AFTER_ENDIF,
+    INCLUDE_GUARD_NONE,
+} IncludeGuardState;
+
+// Whether inactive conditional regions can be skipped directly in the file
+// buffer, which is only done for files without '\0' where every '\r' is part
+// of a "\r\n", so newlines can simply be counted
+typedef enum {
+    RAW_SKIP_UNCHECKED,
+    RAW_SKIP_SUPPORTED,
+    RAW_SKIP_UNSUPPORTED,
+} RawSkipSupport;
 
 typedef struct OpenedFileInfo {
     size_t pos;
-    char* data;
+    FileContents contents;
     uint32_t prefix_idx;
     SourceLoc loc;
+    // Index into FileManager.included_info
+    uint32_t file_idx;
+    IncludeGuardState guard_state;
+    uint32_t guard_id;
+    // conds_len inside the #ifndef of the include guard
+    uint32_t guard_conds_len;
+    RawSkipSupport raw_skip;
 } OpenedFileInfo;
 
+typedef struct IncludedFileInfo {
+    FileId id;
+    bool is_once;
+    // Identifier index of the include guard macro, UINT32_MAX if there is none
+    uint32_t guard_id;
+} IncludedFileInfo;
+
 typedef struct {
     bool is_valid;
     FileManager fm;
@@ -31,24 +72,68 @@ static StrBuf get_path_prefix(Str path) {
     }
 }
 
-static char* read_entire_file(File f) {
-    assert(File_valid(f));
-    if (!File_seek(f, 0, FILE_SEEK_END)) {
-        return NULL;
-    }
-    const long size = File_tell(f);
-    if (!File_seek(f, 0, FILE_SEEK_START)) {
-        return NULL;
+static uint32_t find_included_file(const FileManager* fm, FileId id) {
+    for (uint32_t i = 0; i < fm->included_info_len; ++i) {
+        if (FileId_eq(fm->included_info[i].id, id)) {
+            return i;
+        }
     }
+    return UINT32_MAX;
+}
 
-    char* data = mycc_alloc(size + 1);
-    const size_t read = File_read(data, 1, size, f);
-    if (read != (size_t)size) {
-        return NULL;
+// Returns the index of the file at path in included_info. A path that was not
+// seen before is compared with the known files by identity, so differently
+// spelled paths to the same file share #pragma once and include guards.
+static uint32_t add_included_path(FileManager* fm, CStr path) {
+    const Str path_str = CStr_as_str(path);
+    const uint32_t known_idx = IndexedStringSet_find(&fm->included_paths,
+                                                     path_str);
+    if (known_idx != UINT32_MAX) {
+        return fm->path_files[known_idx];
+    }
+    const uint32_t path_idx = IndexedStringSet_find_or_insert(
+        &fm->included_paths,
+        path_str);
+    if (path_idx == fm->path_files_cap) {
+        mycc_grow_alloc((void**)&fm->path_files,
+                        &fm->path_files_cap,
+                        sizeof *fm->path_files);
     }
-    data[size] = '\0';
-    File_close(f);
-    return data;
+    const FileId id = FileId_get(path);
+    uint32_t file_idx = find_included_file(fm, id);
+    if (file_idx == UINT32_MAX) {
+        if (fm->included_info_len == fm->included_info_cap) {
+            mycc_grow_alloc((void**)&fm->included_info,
+                            &fm->included_info_cap,
+                            sizeof *fm->included_info);
+        }
+        file_idx = fm->included_info_len;
+        fm->included_info[file_idx] = (IncludedFileInfo){
+            .id = id,
+            .is_once = false,
+            .guard_id = UINT32_MAX,
+        };
+        ++fm->included_info_len;
+    }
+    fm->path_files[path_idx] = file_idx;
+    return file_idx;
+}
+
+static OpenedFileInfo OpenedFileInfo_create(FileContents contents,
+                                            uint32_t prefix_idx,
+                                            SourceLoc loc,
+                                            uint32_t file_idx) {
+    return (OpenedFileInfo){
+        .pos = 0,
+        .contents = contents,
+        .prefix_idx = prefix_idx,
+        .loc = loc,
+        .file_idx = file_idx,
+        .guard_state = INCLUDE_GUARD_START,
+        .guard_id = UINT32_MAX,
+        .guard_conds_len = 0,
+        .raw_skip = RAW_SKIP_UNCHECKED,
+    };
 }
 
 static FileData create_file_data(CStr start_file, PreprocErr* err) {
@@ -68,18 +153,23 @@ static FileData create_file_data(CStr start_file, PreprocErr* err) {
         .prefixes_len = 1,
         .prefixes_cap = 1,
         .prefixes = mycc_alloc(sizeof *fm.prefixes),
+        .included_paths = IndexedStringSet_create(0),
+        .path_files_cap = 0,
+        .path_files = NULL,
+        .included_info_len = 0,
+        .included_info_cap = 0,
+        .included_info = NULL,
     };
-    char* data = read_entire_file(file);
-    if (!data) {
+    const FileContents contents = FileContents_read(file);
+    if (!contents.data) {
         // TODO: error
         return (FileData){0};
     }
-    fm.opened_info[0] = (OpenedFileInfo){
-        .pos = 0,
-        .data = data,
-        .prefix_idx = 0,
-        .loc = {0, {0, 0}},
-    };
+    const uint32_t file_idx = add_included_path(&fm, start_file);
+    fm.opened_info[0] = OpenedFileInfo_create(contents,
+                                              0,
+                                              (SourceLoc){0, {0, 0}},
+                                              file_idx);
     fm.prefixes[0] = get_path_prefix(CStr_as_str(start_file));
     FileInfo fi = FileInfo_create(&file_name);
 
@@ -94,10 +184,14 @@ static PreprocMacroMap PreprocMacroMap_create(void) {
     return (PreprocMacroMap){0};
 }
 
+static void PreprocMacroMap_free(const PreprocMacroMap* map);
+
 PreprocState PreprocState_create(CStr start_file,
                                  uint32_t num_include_dirs,
                                  const Str* include_dirs,
+                                 IncludeCache* include_cache,
                                  PreprocErr* err) {
+    assert(include_cache);
     FileData fd = create_file_data(start_file, err);
     if (!fd.is_valid) {
         PreprocState res = {0};
@@ -123,8 +217,14 @@ PreprocState PreprocState_create(CStr start_file,
         .conds = NULL,
         .err = err,
         ._macro_map = PreprocMacroMap_create(),
+        ._macro_arena = MemArena_create(0),
+        ._scratch_arena = MemArena_create(SCRATCH_ARENA_BLOCK_SIZE),
+        ._expansion = {
+            .hide_sets = HideSetTable_create(),
+        },
         .num_include_dirs = num_include_dirs,
         .include_dirs = include_dirs,
+        .include_cache = include_cache,
         .file_info = fd.fi,
     };
 }
@@ -159,12 +259,136 @@ PreprocState PreprocState_create_string(Str code,
         .conds = NULL,
         .err = err,
         ._macro_map = PreprocMacroMap_create(),
+        ._macro_arena = MemArena_create(0),
+        ._scratch_arena = MemArena_create(SCRATCH_ARENA_BLOCK_SIZE),
+        ._expansion = {
+            .hide_sets = HideSetTable_create(),
+        },
         .num_include_dirs = num_include_dirs,
         .include_dirs = include_dirs,
+        .include_cache = NULL,
         .file_info = FileInfo_create(&filename_str),
     };
 }
 
+static FileInfo prepend_file_info(const FileInfo* prefix, FileInfo* info) {
+    FileInfo res = {
+        .len = prefix->len + info->len,
+        .paths = mycc_alloc(sizeof *res.paths * (prefix->len + info->len)),
+    };
+    for (uint32_t i = 0; i < prefix->len; ++i) {
+        res.paths[i] = StrBuf_create(StrBuf_as_str(&prefix->paths[i]));
+    }
+    for (uint32_t i = 0; i < info->len; ++i) {
+        res.paths[prefix->len + i] = info->paths[i];
+    }
+    mycc_free(info->paths);
+    return res;
+}
+
+void PreprocState_apply_pch(PreprocState* state, const PreprocPCH* pch) {
+    assert(state->toks.len == 0);
+    assert(state->_macro_map._cap == 0);
+
+    PreprocTokenArr_free(&state->toks);
+    state->toks = PreprocTokenArr_copy(&pch->toks);
+    PreprocTokenValList_free(&state->vals);
+    state->vals = PreprocTokenValList_copy(&pch->vals);
+
+    const PreprocMacroMap* map = &pch->macro_map;
+    PreprocMacroMap_free(&state->_macro_map);
+    state->_macro_map = (PreprocMacroMap){
+        ._cap = map->_cap,
+        ._macros = mycc_alloc_or_null(sizeof *map->_macros * map->_cap),
+    };
+    if (map->_cap != 0) {
+        memcpy(state->_macro_map._macros,
+               map->_macros,
+               sizeof *map->_macros * map->_cap);
+    }
+
+    // The files of the header come first, so the locations of its tokens
+    // stay valid
+    const uint32_t num_pch_files = pch->file_info.len;
+    state->file_info = prepend_file_info(&pch->file_info, &state->file_info);
+    state->line_info.curr_loc.file_idx += num_pch_files;
+    FileManager* fm = &state->file_manager;
+    for (uint32_t i = 0; i < fm->opened_info_len; ++i) {
+        fm->opened_info[i].loc.file_idx += num_pch_files;
+    }
+    // States created from a string cannot include files
+    if (fm->opened_info == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < num_pch_files; ++i) {
+        const PreprocPCHFile* file = &pch->files[i];
+        const uint32_t file_idx = add_included_path(
+            fm,
+            StrBuf_c_str(&state->file_info.paths[i]));
+        IncludedFileInfo* info = &fm->included_info[file_idx];
+        info->is_once = info->is_once || file->is_once;
+        if (file->guard_id != UINT32_MAX) {
+            info->guard_id = file->guard_id;
+        }
+    }
+}
+
+// The start file is never closed, so its include guard is only known once
+// all of it has been read
+static void finish_start_file(FileManager* fm) {
+    if (fm->opened_info_len == 0) {
+        return;
+    }
+    const OpenedFileInfo* start = &fm->opened_info[0];
+    if (start->guard_state == INCLUDE_GUARD_AFTER_ENDIF) {
+        fm->included_info[start->file_idx].guard_id = start->guard_id;
+    }
+}
+
+static PreprocPCHFile* get_pch_files(FileManager* fm, const FileInfo* info) {
+    finish_start_file(fm);
+    PreprocPCHFile* res = mycc_alloc_or_null(sizeof *res * info->len);
+    for (uint32_t i = 0; i < info->len; ++i) {
+        const uint32_t path_idx = IndexedStringSet_find(
+            &fm->included_paths,
+            StrBuf_as_str(&info->paths[i]));
+        if (path_idx == UINT32_MAX) {
+            res[i] = (PreprocPCHFile){
+                .is_once = false,
+                .guard_id = UINT32_MAX,
+            };
+        } else {
+            const uint32_t file_idx = fm->path_files[path_idx];
+            const IncludedFileInfo* included = &fm->included_info[file_idx];
+            res[i] = (PreprocPCHFile){
+                .is_once = included->is_once,
+                .guard_id = included->guard_id,
+            };
+        }
+    }
+    return res;
+}
+
+PreprocPCH PreprocState_take_pch(PreprocState* state) {
+    PreprocPCH res = {
+        .toks = state->toks,
+        .vals = state->vals,
+        .macro_map = state->_macro_map,
+        ._macro_arena = state->_macro_arena,
+        .file_info = state->file_info,
+        .files = get_pch_files(&state->file_manager, &state->file_info),
+    };
+    state->toks = PreprocTokenArr_create_empty();
+    state->vals = PreprocTokenValList_create();
+    state->_macro_map = PreprocMacroMap_create();
+    state->_macro_arena = MemArena_create(0);
+    state->file_info = (FileInfo){
+        .len = 0,
+        .paths = NULL,
+    };
+    return res;
+}
+
 static bool is_escaped_newline(Str line) {
     if (line.len == 0) {
         return false;
@@ -179,19 +403,26 @@ static bool is_escaped_newline(Str line) {
 
 static bool current_file_over(const PreprocState* state) {
     const OpenedFileInfo* curr = &state->file_manager.opened_info[state->file_manager.opened_info_len - 1];
-    return (state->line_info.next.data == NULL || *state->line_info.next.data == '\0') && (state->file_manager.opened_info == NULL || curr->data[curr->pos] == '\0');
+    return state->line_info.next.len == 0 && (state->file_manager.opened_info == NULL || curr->contents.data[curr->pos] == '\0');
 }
 
 static bool is_start_file(const PreprocState* state) {
     return state->file_manager.opened_info_len <= 1;
 }
 
-static Str read_next_line(OpenedFileInfo* info, StrBuf* line) {
-    const char* data = info->data + info->pos;
-    while (*data != '\n' && *data != '\r' && *data != '\0') {
-        StrBuf_push_back(line, *data);
-        ++data;
-    }
+static uint32_t find_line_end(const OpenedFileInfo* info) {
+    const Str rest = {
+        .len = (uint32_t)(info->contents.len - info->pos),
+        .data = info->contents.data + info->pos,
+    };
+    return mycc_find_first_of3(rest, '\n', '\r', '\0');
+}
+
+// Returns the next line as a view into the file buffer and moves past it
+static Str read_next_line(OpenedFileInfo* info) {
+    const char* line_start = info->contents.data + info->pos;
+    const uint32_t len = find_line_end(info);
+    const char* data = line_start + len;
     if (*data == '\n') {
         ++data;
     }
@@ -202,38 +433,206 @@ static Str read_next_line(OpenedFileInfo* info, StrBuf* line) {
             ++data;
         }
     }
-    const size_t offset = data - info->data;
+    const size_t offset = data - info->contents.data;
     info->pos = offset;
-    return StrBuf_as_str(line);
+    return (Str){
+        .len = len,
+        .data = line_start,
+    };
 }
 
 static void preproc_state_close_file(PreprocState* s);
 
 void PreprocState_read_line(PreprocState* state) {
     assert(state);
-    StrBuf_clear(&state->line_info.line);
     while (current_file_over(state) && !is_start_file(state)) {
         preproc_state_close_file(state);
     }
-    StrBuf* line = &state->line_info.line;
     OpenedFileInfo* opened_info = &state->file_manager.opened_info[state->file_manager.opened_info_len - 1];
-    state->line_info.next = read_next_line(opened_info, line);
-    while (is_escaped_newline(state->line_info.next)) {
-        StrBuf_push_back(line, '\n');
-        state->line_info.next = read_next_line(opened_info, line);
+    Str next = read_next_line(opened_info);
+    if (is_escaped_newline(next)) {
+        // Spliced lines are joined in line, with the newlines kept, so the
+        // tokenizer can keep track of the line numbers
+        StrBuf* line = &state->line_info.line;
+        StrBuf_clear(line);
+        StrBuf_append(line, next);
+        do {
+            StrBuf_push_back(line, '\n');
+            next = read_next_line(opened_info);
+            StrBuf_append(line, next);
+        } while (is_escaped_newline(next));
+        next = StrBuf_as_str(line);
     }
+    state->line_info.next = next;
     state->line_info.curr_loc.file_loc.line += 1;
     state->line_info.curr_loc.file_loc.index = 1;
 }
 
+uint32_t PreprocState_estimate_num_tokens(const PreprocState* state) {
+    const FileManager* fm = &state->file_manager;
+    // States created from a string have no opened files
+    const size_t num_bytes = fm->opened_info_len == 0
+                                 ? state->line_info.next.len
+                                 : fm->opened_info[0].contents.len;
+    return estimate_num_tokens(num_bytes);
+}
+
 bool PreprocState_over(const PreprocState* state) {
     return current_file_over(state) && is_start_file(state);
 }
 
+// '\r' is only found right before '\n' when skipping raw lines
+static bool is_raw_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Whether the line ending at the newline at it is continued on the next one
+static bool is_spliced_line_end(const char* begin, const char* it) {
+    while (it != begin && is_raw_blank(it[-1])) {
+        --it;
+    }
+    return it != begin && it[-1] == '\\';
+}
+
+// Whether only blanks precede it on its line
+static bool is_at_line_start(const char* begin, const char* it) {
+    while (it != begin && is_raw_blank(it[-1])) {
+        --it;
+    }
+    return it == begin
+           || (it[-1] == '\n' && !is_spliced_line_end(begin, it - 1));
+}
+
+static const char* skip_raw_line_comment(const char* begin,
+                                         const char* it,
+                                         const char* end) {
+    while (true) {
+        const Str rest = {(uint32_t)(end - it), it};
+        it += mycc_find_char(rest, '\n');
+        if (it == end || !is_spliced_line_end(begin, it)) {
+            return it;
+        }
+        ++it;
+    }
+}
+
+static const char* skip_raw_literal(const char* it,
+                                    const char* end,
+                                    char quote) {
+    while (true) {
+        const Str rest = {(uint32_t)(end - it), it};
+        it += mycc_find_first_of3(rest, quote, '\\', '\n');
+        if (it == end) {
+            return it;
+        } else if (*it == quote) {
+            return it + 1;
+        } else if (*it == '\n') {
+            // Unterminated literal
+            return it;
+        }
+        // Escape sequence or spliced line
+        ++it;
+        while (it != end && is_raw_blank(*it)) {
+            ++it;
+        }
+        if (it != end) {
+            ++it;
+        }
+    }
+}
+
+static bool supports_raw_skip(Str contents) {
+    if (mycc_find_char(contents, '\0') != contents.len) {
+        return false;
+    }
+    // Lines ending in a lone '\r' or in "\n\r" are split differently when
+    // read line by line
+    uint32_t i = mycc_find_char(contents, '\r');
+    while (i != contents.len) {
+        if (i + 1 == contents.len || contents.data[i + 1] != '\n'
+            || (i != 0 && contents.data[i - 1] == '\n')) {
+            return false;
+        }
+        i += 2;
+        i += mycc_find_char(Str_advance(contents, i), '\r');
+    }
+    return true;
+}
+
+void PreprocState_skip_inactive_lines(PreprocState* state) {
+    assert(state);
+    FileManager* fm = &state->file_manager;
+    if (fm->opened_info_len == 0) {
+        return;
+    }
+    OpenedFileInfo* curr = &fm->opened_info[fm->opened_info_len - 1];
+    const Str contents = {(uint32_t)curr->contents.len, curr->contents.data};
+    if (curr->raw_skip == RAW_SKIP_UNCHECKED) {
+        curr->raw_skip = supports_raw_skip(contents) ? RAW_SKIP_SUPPORTED
+                                                     : RAW_SKIP_UNSUPPORTED;
+    }
+    if (curr->raw_skip != RAW_SKIP_SUPPORTED) {
+        return;
+    }
+
+    const char* const begin = contents.data;
+    const char* const end = begin + contents.len;
+    const char* const start = begin + curr->pos;
+    const char* it = start;
+    bool in_comment = state->line_info.is_in_comment;
+    const Str directive_relevant = STR_LIT("#/\"'");
+    while (it != end) {
+        const Str rest = {(uint32_t)(end - it), it};
+        if (in_comment) {
+            const uint32_t comment_end = mycc_find_comment_end(rest);
+            if (comment_end == rest.len) {
+                it = end;
+                break;
+            }
+            it += comment_end + 2;
+            in_comment = false;
+            continue;
+        }
+        it += mycc_find_first_of(rest, directive_relevant);
+        if (it == end) {
+            break;
+        }
+        const char c = *it;
+        if (c == '#') {
+            if (is_at_line_start(begin, it)) {
+                while (it != begin && it[-1] != '\n') {
+                    --it;
+                }
+                break;
+            }
+            ++it;
+        } else if (c == '/') {
+            ++it;
+            if (it != end && *it == '*') {
+                in_comment = true;
+                ++it;
+            } else if (it != end && *it == '/') {
+                it = skip_raw_line_comment(begin, it, end);
+            }
+        } else {
+            it = skip_raw_literal(it + 1, end, c);
+        }
+    }
+    const Str skipped = {(uint32_t)(it - start), start};
+    state->line_info.curr_loc.file_loc.line += mycc_count_char(skipped, '\n');
+    state->line_info.is_in_comment = in_comment;
+    state->line_info.next = (Str){0};
+    curr->pos = (size_t)(it - begin);
+}
+
 typedef struct {
     File file;
     StrBuf path;
+    // Index of the file in FileManager.included_info
+    uint32_t file_idx;
     uint32_t prefix_idx;
+    // The file does not need to be opened because it was already included
+    bool is_skipped;
 } FileOpenRes;
 
 static uint32_t get_current_prefix_idx(const FileManager* fm) {
@@ -251,6 +650,86 @@ static void add_prefix(FileManager* fm, const StrBuf* prefix) {
     ++fm->prefixes_len;
 }
 
+// Checks whether the file was already included and including it again would
+// not produce anything
+static bool can_skip_include(const PreprocState* s, uint32_t file_idx) {
+    const IncludedFileInfo* info = &s->file_manager.included_info[file_idx];
+    return info->is_once
+           || (info->guard_id != UINT32_MAX
+               && find_preproc_macro(s, info->guard_id) != NULL);
+}
+
+static FileOpenRes skip_include(StrBuf* full_path, const StrBuf* filename) {
+    StrBuf_free(full_path);
+    StrBuf_free(filename);
+    return (FileOpenRes){
+        .is_skipped = true,
+    };
+}
+
+static bool is_included_path(const PreprocState* s, Str path) {
+    return IndexedStringSet_find(&s->file_manager.included_paths, path)
+           != UINT32_MAX;
+}
+
+// Tries the candidate dir + filename, where a path that was included before
+// is known to exist, so it does not need to be opened here
+static bool try_include_candidate(PreprocState* s,
+                                  Str dir,
+                                  Str filename,
+                                  StrBuf* full_path,
+                                  File* file) {
+    const Str path = StrBuf_as_str(full_path);
+    if (is_included_path(s, path)) {
+        return true;
+    } else if (!IncludeCache_may_exist(s->include_cache, dir, filename)) {
+        return false;
+    }
+    *file = File_open(StrBuf_c_str(full_path), FILE_READ | FILE_BINARY);
+    if (!File_valid(*file)) {
+        errno = 0;
+        return false;
+    }
+    return true;
+}
+
+// Searches the including directory and then the include directories for
+// filename, storing the path of the first match in full_path
+static bool search_include(PreprocState* s,
+                           Str prefix,
+                           Str filename,
+                           StrBuf* full_path,
+                           File* file) {
+    *full_path = StrBuf_concat(prefix, filename);
+    if (try_include_candidate(s, prefix, filename, full_path, file)) {
+        return true;
+    }
+    StrBuf_clear(full_path);
+    for (uint32_t i = 0; i < s->num_include_dirs; ++i) {
+        const Str dir = s->include_dirs[i];
+
+        uint32_t needed_cap = dir.len + filename.len;
+        if (!is_file_sep(Str_at(dir, dir.len - 1))) {
+            needed_cap += 1;
+            StrBuf_reserve(full_path, needed_cap);
+            StrBuf_append(full_path, dir);
+            StrBuf_push_back(full_path, '/');
+        } else {
+            StrBuf_reserve(full_path, needed_cap);
+            StrBuf_append(full_path, dir);
+        }
+        StrBuf_append(full_path, filename);
+
+        if (try_include_candidate(s, dir, filename, full_path, file)) {
+            StrBuf_shrink_to_fit(full_path);
+            return true;
+        }
+        StrBuf_clear(full_path);
+    }
+    StrBuf_free(full_path);
+    return false;
+}
+
 // TODO: maybe use filename instead of creating a new string
 static FileOpenRes resolve_path_and_open(PreprocState* s,
                                          const StrBuf* filename,
@@ -263,37 +742,51 @@ static FileOpenRes resolve_path_and_open(PreprocState* s,
     const StrBuf* prefix = &s->file_manager.prefixes[current_prefix_idx];
 
     const Str prefix_str = StrBuf_as_str(prefix);
-    StrBuf full_path = StrBuf_concat(prefix_str, filename_str);
-    File file = File_open(StrBuf_c_str(&full_path), FILE_READ | FILE_BINARY);
-    if (!File_valid(file)) {
-        errno = 0;
-        StrBuf_clear(&full_path);
-        for (uint32_t i = 0; i < s->num_include_dirs; ++i) {
-            const Str dir = s->include_dirs[i];
-
-            uint32_t needed_cap = dir.len + StrBuf_len(filename);
-            if (!is_file_sep(Str_at(dir, dir.len - 1))) {
-                needed_cap += 1;
-                StrBuf_reserve(&full_path, needed_cap);
-                StrBuf_append(&full_path, dir);
-                StrBuf_push_back(&full_path, '/');
-            } else {
-                StrBuf_reserve(&full_path, needed_cap);
-                StrBuf_append(&full_path, dir);
-            }
-            StrBuf_append(&full_path, filename_str);
+    StrBuf full_path;
+    File file = {NULL};
+    bool found;
+    switch (IncludeCache_find(s->include_cache,
+                              prefix_str,
+                              filename_str,
+                              &full_path)) {
+        case INCLUDE_CACHE_FOUND:
+            found = true;
+            break;
+        case INCLUDE_CACHE_NOT_FOUND:
+            found = false;
+            break;
+        case INCLUDE_CACHE_UNKNOWN:
+            found = search_include(s,
+                                   prefix_str,
+                                   filename_str,
+                                   &full_path,
+                                   &file);
+            IncludeCache_insert(s->include_cache,
+                                prefix_str,
+                                filename_str,
+                                found ? &full_path : NULL);
+            break;
+        default:
+            UNREACHABLE();
+    }
+    if (!found) {
+        // TODO: check system dirs?
+        errno = ENOENT;
+        PreprocErr_set_file_err(s->err, filename, *include_loc);
+        return (FileOpenRes){0};
+    }
 
-            file = File_open(StrBuf_c_str(&full_path), FILE_READ | FILE_BINARY);
-            if (File_valid(file)) {
-                StrBuf_shrink_to_fit(&full_path);
-                break;
-            }
-            StrBuf_clear(&full_path);
+    const uint32_t file_idx = add_included_path(&s->file_manager,
+                                                StrBuf_c_str(&full_path));
+    if (can_skip_include(s, file_idx)) {
+        if (File_valid(file)) {
+            File_close(file);
         }
-
+        return skip_include(&full_path, filename);
+    } else if (!File_valid(file)) {
+        file = File_open(StrBuf_c_str(&full_path), FILE_READ | FILE_BINARY);
         if (!File_valid(file)) {
             StrBuf_free(&full_path);
-            // TODO: check system dirs?
             PreprocErr_set_file_err(s->err, filename, *include_loc);
             return (FileOpenRes){0};
         }
@@ -312,9 +805,11 @@ static FileOpenRes resolve_path_and_open(PreprocState* s,
     }
     StrBuf_free(filename);
     return (FileOpenRes){
-        file,
-        full_path,
-        prefix_idx,
+        .file = file,
+        .path = full_path,
+        .file_idx = file_idx,
+        .prefix_idx = prefix_idx,
+        .is_skipped = false,
     };
 }
 
@@ -324,7 +819,9 @@ bool PreprocState_open_file(PreprocState* s,
     FileManager* fm = &s->file_manager;
 
     FileOpenRes fp = resolve_path_and_open(s, filename, include_loc);
-    if (!File_valid(fp.file)) {
+    if (fp.is_skipped) {
+        return true;
+    } else if (!File_valid(fp.file)) {
         return false;
     }
     FileInfo_add(&s->file_info, &fp.path);
@@ -345,26 +842,95 @@ bool PreprocState_open_file(PreprocState* s,
     };
 
     s->line_info.curr_loc = new_loc;
-    char* data = read_entire_file(fp.file);
-    if (!data) {
+    const FileContents contents = FileContents_read(fp.file);
+    if (!contents.data) {
         // TODO: error
         return false;
     }
-    fm->opened_info[fm->opened_info_len] = (OpenedFileInfo){
-        .pos = 0,
-        .data = data,
-        .prefix_idx = fp.prefix_idx,
-        .loc = new_loc,
-    };
+    fm->opened_info[fm->opened_info_len] = OpenedFileInfo_create(
+        contents,
+        fp.prefix_idx,
+        new_loc,
+        fp.file_idx);
     ++fm->opened_info_len;
 
     return true;
 }
 
+static OpenedFileInfo* get_current_file(PreprocState* s) {
+    FileManager* fm = &s->file_manager;
+    return &fm->opened_info[fm->opened_info_len - 1];
+}
+
+void PreprocState_guard_directive(PreprocState* state,
+                                  const PreprocTokenArr* arr) {
+    assert(arr->len > 1);
+    assert(arr->kinds[1] == TOKEN_IDENTIFIER);
+    if (state->file_manager.opened_info == NULL) {
+        return;
+    }
+    OpenedFileInfo* curr = get_current_file(state);
+    const uint32_t directive_id_idx = arr->val_indices[1];
+    // Pragmas other than #pragma once are ignored, so skipping them does not
+    // change anything
+    if (directive_id_idx == PREPROC_PRAGMA_ID_IDX) {
+        return;
+    }
+    switch (curr->guard_state) {
+        case INCLUDE_GUARD_START:
+            if (directive_id_idx == PREPROC_IFNDEF_ID_IDX && arr->len == 3
+                && arr->kinds[2] == TOKEN_IDENTIFIER) {
+                curr->guard_state = INCLUDE_GUARD_IN_IFNDEF;
+                curr->guard_id = arr->val_indices[2];
+                curr->guard_conds_len = state->conds_len + 1;
+            } else {
+                curr->guard_state = INCLUDE_GUARD_NONE;
+            }
+            break;
+        case INCLUDE_GUARD_IN_IFNDEF:
+            if (state->conds_len != curr->guard_conds_len) {
+                break;
+            }
+            if (directive_id_idx == PREPROC_ENDIF_ID_IDX) {
+                curr->guard_state = INCLUDE_GUARD_AFTER_ENDIF;
+            } else if (directive_id_idx == PREPROC_ELSE_ID_IDX
+                       || directive_id_idx == PREPROC_ELIF_ID_IDX) {
+                curr->guard_state = INCLUDE_GUARD_NONE;
+            }
+            break;
+        case INCLUDE_GUARD_AFTER_ENDIF:
+            curr->guard_state = INCLUDE_GUARD_NONE;
+            break;
+        case INCLUDE_GUARD_NONE:
+            break;
+    }
+}
+
+void PreprocState_guard_tokens(PreprocState* state) {
+    if (state->file_manager.opened_info == NULL) {
+        return;
+    }
+    OpenedFileInfo* curr = get_current_file(state);
+    if (curr->guard_state != INCLUDE_GUARD_IN_IFNDEF) {
+        curr->guard_state = INCLUDE_GUARD_NONE;
+    }
+}
+
+void PreprocState_pragma_once(PreprocState* state) {
+    if (state->file_manager.opened_info == NULL) {
+        return;
+    }
+    const OpenedFileInfo* curr = get_current_file(state);
+    state->file_manager.included_info[curr->file_idx].is_once = true;
+}
+
 static void preproc_state_close_file(PreprocState* s) {
     FileManager* fm = &s->file_manager;
     const OpenedFileInfo* last_file = &fm->opened_info[fm->opened_info_len - 1];
-    mycc_free(last_file->data);
+    if (last_file->guard_state == INCLUDE_GUARD_AFTER_ENDIF) {
+        fm->included_info[last_file->file_idx].guard_id = last_file->guard_id;
+    }
+    FileContents_free(&last_file->contents);
     --fm->opened_info_len;
     const OpenedFileInfo* info = &fm->opened_info[fm->opened_info_len - 1];
     s->line_info.next = Str_null();
@@ -418,13 +984,10 @@ static bool PreprocMacroMap_register(PreprocMacroMap* map,
         }
         map->_cap = new_cap;
     }
-    // If this overwrites a macro, free the old one
+    // The expansion of an overwritten macro stays in the arena until the end
+    // of the translation unit
     PreprocMacro* old = &map->_macros[idx];
-    bool overwritten = false;
-    if (PreprocMacro_is_valid(old)) {
-        PreprocMacro_free(old);
-        overwritten = true;
-    }
+    const bool overwritten = PreprocMacro_is_valid(old);
     *old = *macro;
     return overwritten;
 }
@@ -443,11 +1006,7 @@ static void PreprocMacroMap_remove(PreprocMacroMap* map, uint32_t idx) {
     if (idx >= map->_cap) {
         return;
     }
-    PreprocMacro* macro = &map->_macros[idx];
-    if (PreprocMacro_is_valid(macro)) {
-        PreprocMacro_free(macro);
-        *macro = PreprocMacro_create_invalid();
-    }
+    map->_macros[idx] = PreprocMacro_create_invalid();
 }
 
 void PreprocState_remove_macro(PreprocState* state, uint32_t identifier_idx) {
@@ -488,22 +1047,31 @@ static void FileManager_free(FileManager* fm) {
         return;
     }
     for (uint32_t i = 0; i < fm->opened_info_len; ++i) {
-        mycc_free(fm->opened_info[i].data);
+        FileContents_free(&fm->opened_info[i].contents);
     }
     mycc_free(fm->opened_info);
     for (uint32_t i = 0; i < fm->prefixes_len; ++i) {
         StrBuf_free(&fm->prefixes[i]);
     }
     mycc_free(fm->prefixes);
+    IndexedStringSet_free(&fm->included_paths);
+    mycc_free(fm->path_files);
+    mycc_free(fm->included_info);
 }
 
 static void PreprocMacroMap_free(const PreprocMacroMap* map) {
-    for (uint32_t i = 0; i < map->_cap; ++i) {
-        PreprocMacro_free(&map->_macros[i]);
-    }
     mycc_free(map->_macros);
 }
 
+static void PreprocExpansionBufs_free(const PreprocExpansionBufs* bufs) {
+    PreprocTokenArr_free(&bufs->toks.arr);
+    mycc_free(bufs->toks.hide_sets);
+    PreprocTokenArr_free(&bufs->args.arr);
+    mycc_free(bufs->args.hide_sets);
+    mycc_free(bufs->ctxs);
+    HideSetTable_free(&bufs->hide_sets);
+}
+
 void PreprocState_free(PreprocState* state) {
     PreprocTokenArr_free(&state->toks);
     PreprocTokenValList_free(&state->vals);
@@ -512,6 +1080,9 @@ void PreprocState_free(PreprocState* state) {
     FileManager_free(&state->file_manager);
     mycc_free(state->conds);
     PreprocMacroMap_free(&state->_macro_map);
+    MemArena_free(&state->_macro_arena);
+    MemArena_free(&state->_scratch_arena);
+    PreprocExpansionBufs_free(&state->_expansion);
     FileInfo_free(&state->file_info);
 }
 
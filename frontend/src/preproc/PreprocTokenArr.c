@@ -1,8 +1,12 @@
 #include "frontend/preproc/PreprocTokenArr.h"
 
+#include <string.h>
+
 #include "util/mem.h"
 #include "util/macro_util.h"
 
+#include "keyword_hash.h"
+
 PreprocTokenArr PreprocTokenArr_create_empty(void) {
     return (PreprocTokenArr){0};
 }
@@ -14,14 +18,20 @@ PreprocTokenValList PreprocTokenValList_create(void) {
         .int_consts = IndexedStringSet_create(INIT_CAP),
         .float_consts = IndexedStringSet_create(INIT_CAP),
         .str_lits = IndexedStringSet_create(INIT_CAP),
+        .loc_table = SourceLocTable_create(),
     };
+    // These are found by find_preproc_keyword() instead of the set, but they
+    // are still inserted, so their spellings can be retrieved by index
     for (TokenKind k = TOKEN_KEYWORDS_START; k < TOKEN_KEYWORDS_END; ++k) {
-        uint32_t idx = PreprocTokenValList_add_identifier(&res, TokenKind_get_spelling(k));
+        uint32_t idx = IndexedStringSet_find_or_insert(
+            &res.identifiers,
+            TokenKind_get_spelling(k));
         UNUSED(idx);
         assert(idx == IndexedStringSet_len(&res.identifiers) - 1);
     }
     for (uint32_t i = 0; i < ARR_LEN(preproc_identifiers); ++i) {
-        uint32_t idx = PreprocTokenValList_add_identifier(&res, preproc_identifiers[i]);
+        uint32_t idx = IndexedStringSet_find_or_insert(&res.identifiers,
+                                                       preproc_identifiers[i]);
         UNUSED(idx);
         assert(idx == IndexedStringSet_len(&res.identifiers) - 1);
     }
@@ -33,6 +43,17 @@ void PreprocTokenValList_free(const PreprocTokenValList* vals) {
     IndexedStringSet_free(&vals->int_consts);
     IndexedStringSet_free(&vals->float_consts);
     IndexedStringSet_free(&vals->str_lits);
+    SourceLocTable_free(&vals->loc_table);
+}
+
+PreprocTokenValList PreprocTokenValList_copy(const PreprocTokenValList* vals) {
+    return (PreprocTokenValList){
+        .identifiers = IndexedStringSet_copy(&vals->identifiers),
+        .int_consts = IndexedStringSet_copy(&vals->int_consts),
+        .float_consts = IndexedStringSet_copy(&vals->float_consts),
+        .str_lits = IndexedStringSet_copy(&vals->str_lits),
+        .loc_table = SourceLocTable_copy(&vals->loc_table),
+    };
 }
 
 void PreprocTokenArr_free(const PreprocTokenArr* arr) {
@@ -41,7 +62,46 @@ void PreprocTokenArr_free(const PreprocTokenArr* arr) {
     mycc_free(arr->locs);
 }
 
+void PreprocTokenArr_reserve(PreprocTokenArr* arr, uint32_t num) {
+    const uint32_t needed = arr->len + num;
+    if (needed <= arr->cap) {
+        return;
+    }
+    uint32_t new_cap = arr->cap == 0 ? 64 : arr->cap;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    arr->kinds = mycc_realloc(arr->kinds, sizeof *arr->kinds * new_cap);
+    arr->val_indices = mycc_realloc(arr->val_indices,
+                                    sizeof *arr->val_indices * new_cap);
+    arr->locs = mycc_realloc(arr->locs, sizeof *arr->locs * new_cap);
+    arr->cap = new_cap;
+}
+
+PreprocTokenArr PreprocTokenArr_copy(const PreprocTokenArr* arr) {
+    if (arr->len == 0) {
+        return PreprocTokenArr_create_empty();
+    }
+    PreprocTokenArr res = {
+        .len = arr->len,
+        .cap = arr->len,
+        .kinds = mycc_alloc(sizeof *res.kinds * arr->len),
+        .val_indices = mycc_alloc(sizeof *res.val_indices * arr->len),
+        .locs = mycc_alloc(sizeof *res.locs * arr->len),
+    };
+    memcpy(res.kinds, arr->kinds, sizeof *res.kinds * arr->len);
+    memcpy(res.val_indices,
+           arr->val_indices,
+           sizeof *res.val_indices * arr->len);
+    memcpy(res.locs, arr->locs, sizeof *res.locs * arr->len);
+    return res;
+}
+
 uint32_t PreprocTokenValList_add_identifier(PreprocTokenValList* vals, Str str) {
+    const uint32_t keyword_idx = find_preproc_keyword(str);
+    if (keyword_idx != UINT32_MAX) {
+        return keyword_idx;
+    }
     return IndexedStringSet_find_or_insert(&vals->identifiers, str);
 }
 
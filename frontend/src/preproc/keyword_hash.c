@@ -0,0 +1,16 @@
+#include "keyword_hash.h"
+
+#include <string.h>
+
+// Generated from TokenKind.inc by keyword_hash_gen
+#include "keyword_hash_table.inc"
+
+uint32_t find_preproc_keyword(Str spell) {
+    const KeywordSlot* slot = &g_keyword_slots[keyword_hash(spell,
+                                                            KEYWORD_HASH_SEED)];
+    if (slot->len == spell.len
+        && memcmp(slot->spelling, spell.data, spell.len) == 0) {
+        return slot->id_idx;
+    }
+    return UINT32_MAX;
+}
@@ -0,0 +1,45 @@
+#ifndef KEYWORD_HASH_H
+#define KEYWORD_HASH_H
+
+#include "util/Str.h"
+
+enum {
+    KEYWORD_HASH_BITS = 8,
+    KEYWORD_HASH_SIZE = 1 << KEYWORD_HASH_BITS,
+};
+
+typedef struct {
+    // 0 if the slot is empty
+    uint8_t len;
+    uint8_t id_idx;
+    const char* spelling;
+} KeywordSlot;
+
+/**
+ * @brief Hash of an identifier, which is perfect for the keywords and
+ *        preprocessor identifiers with the seed of the generated table
+ *
+ * This is shared with keyword_hash_gen, which searches for the seed.
+ */
+static inline uint32_t keyword_hash(Str spell, uint32_t seed) {
+    const uint32_t last = spell.len - 1;
+    const uint32_t key = (spell.len & 0xff)
+                         | (uint32_t)(unsigned char)spell.data[0] << 8
+                         | (uint32_t)(unsigned char)spell.data[last / 2] << 16
+                         | (uint32_t)(unsigned char)spell.data[last] << 24;
+    return (key * seed) >> (32 - KEYWORD_HASH_BITS);
+}
+
+/**
+ * @brief Finds the fixed identifier index of a keyword or preprocessor
+ *        identifier, without going through the identifier set
+ *
+ * @param spell Spelling of an identifier, which must not be empty
+ *
+ * @return The index the identifier has in every PreprocTokenValList, or
+ *         UINT32_MAX if it is not a keyword or preprocessor identifier
+ */
+uint32_t find_preproc_keyword(Str spell);
+
+#endif
+
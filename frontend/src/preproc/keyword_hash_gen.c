@@ -0,0 +1,102 @@
+// Searches a seed for keyword_hash() that has no collisions between the
+// keywords and preprocessor identifiers, and writes the resulting table to the
+// file given as argument
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/File.h"
+#include "util/macro_util.h"
+
+#include "frontend/Token.h"
+#include "frontend/preproc/PreprocTokenArr.h"
+
+#include "keyword_hash.h"
+
+static const char* const g_spellings[] = {
+#define TOKEN_MACRO(name, str) [name] = str,
+#include "frontend/TokenKind.inc"
+#undef TOKEN_MACRO
+};
+
+enum {
+    NUM_IDS = PREPROC_TOKEN_ARR_INITIAL_ID_COUNT,
+    MAX_SEED_TRIES = 1 << 24,
+};
+
+static Str get_id_spelling(uint32_t id_idx) {
+    if (id_idx < TOKEN_NUM_KEYWORDS) {
+        const char* spell = g_spellings[TOKEN_KEYWORDS_START + id_idx];
+        return (Str){(uint32_t)strlen(spell), spell};
+    }
+    return preproc_identifiers[id_idx - TOKEN_NUM_KEYWORDS];
+}
+
+static bool fill_slots(uint32_t seed, uint32_t* slots) {
+    for (uint32_t i = 0; i < KEYWORD_HASH_SIZE; ++i) {
+        slots[i] = UINT32_MAX;
+    }
+    for (uint32_t i = 0; i < NUM_IDS; ++i) {
+        const uint32_t hash = keyword_hash(get_id_spelling(i), seed);
+        if (slots[hash] != UINT32_MAX) {
+            return false;
+        }
+        slots[hash] = i;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        File_put_str("Expected the output file as only argument\n",
+                     mycc_stderr);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t slots[KEYWORD_HASH_SIZE];
+    // Odd seeds, so the multiplication does not drop bits of the key
+    uint32_t seed = 0x9E3779B1;
+    uint32_t tries = 0;
+    while (!fill_slots(seed, slots)) {
+        ++tries;
+        if (tries == MAX_SEED_TRIES) {
+            File_put_str("Failed to find a perfect hash for the keywords\n",
+                         mycc_stderr);
+            return EXIT_FAILURE;
+        }
+        seed += 2;
+    }
+
+    const CStr out_path = {(uint32_t)strlen(argv[1]), argv[1]};
+    File out = File_open(out_path, FILE_WRITE);
+    if (!File_valid(out)) {
+        File_printf(mycc_stderr,
+                    "Failed to open {Str}\n",
+                    CStr_as_str(out_path));
+        return EXIT_FAILURE;
+    }
+    File_put_str("// Generated by keyword_hash_gen from TokenKind.inc\n\n", out);
+    File_printf(out, "#define KEYWORD_HASH_SEED {u32}u\n\n", seed);
+    File_put_str(
+        "static const KeywordSlot g_keyword_slots[KEYWORD_HASH_SIZE] = {\n",
+        out);
+    for (uint32_t i = 0; i < KEYWORD_HASH_SIZE; ++i) {
+        if (slots[i] != UINT32_MAX) {
+            const Str spell = get_id_spelling(slots[i]);
+            // File_printf() has no way to escape braces
+            File_printf(out, "    [{u32}] = ", i);
+            File_putc('{', out);
+            File_printf(out,
+                        "{u32}, {u32}, \"{Str}\"",
+                        spell.len,
+                        slots[i],
+                        spell);
+            File_put_str("},\n", out);
+        }
+    }
+    File_put_str("};\n", out);
+    if (!File_close(out)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
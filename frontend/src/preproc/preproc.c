@@ -7,26 +7,47 @@
 #include "util/log.h"
 
 #include "frontend/preproc/PreprocMacro.h"
+#include "frontend/preproc/PreprocPCH.h"
 #include "frontend/preproc/PreprocState.h"
-#include "frontend/preproc/num_parse.h"
 
 #include "read_and_tokenize_line.h"
 
 static bool preproc_impl(PreprocState* state, const ArchTypeInfo* info);
+static bool check_conds_terminated(PreprocState* state);
+static bool convert_token_kinds(PreprocTokenArr* tokens,
+                                uint32_t start,
+                                PreprocErr* err);
+static void shrink_tokens(PreprocTokenArr* tokens);
+static void resolve_err_loc(PreprocErr* err, const SourceLocTable* loc_table);
 
 PreprocRes preproc(CStr path,
+                   const PreprocPCH* pch,
                    uint32_t num_include_dirs,
                    const Str* include_dirs,
+                   IncludeCache* include_cache,
                    const ArchTypeInfo* info,
                    PreprocErr* err) {
     assert(info);
     assert(err);
+    if (include_cache == NULL) {
+        IncludeCache* local_cache = IncludeCache_create();
+        PreprocRes res = preproc(path,
+                                 pch,
+                                 num_include_dirs,
+                                 include_dirs,
+                                 local_cache,
+                                 info,
+                                 err);
+        IncludeCache_free(local_cache);
+        return res;
+    }
     
     MYCC_TIMER_BEGIN();
 
     PreprocState state = PreprocState_create(path,
                                              num_include_dirs,
                                              include_dirs,
+                                             include_cache,
                                              err);
     if (err->kind != PREPROC_ERR_NONE) {
         return (PreprocRes){
@@ -34,6 +55,13 @@ PreprocRes preproc(CStr path,
             .file_info = state.file_info,
         };
     }
+    if (pch) {
+        PreprocState_apply_pch(&state, pch);
+    }
+    // All tokens stay in the state until the end, so they are allocated
+    // with the estimated size right away
+    PreprocTokenArr_reserve(&state.toks,
+                            PreprocState_estimate_num_tokens(&state));
     if (!preproc_impl(&state, info)) {
         FileInfo file_info = state.file_info;
         state.file_info = (FileInfo){
@@ -63,17 +91,77 @@ PreprocRes preproc(CStr path,
     return res;
 }
 
+PreprocPCH preproc_create_pch(CStr path,
+                              const PreprocPCH* pch,
+                              uint32_t num_include_dirs,
+                              const Str* include_dirs,
+                              IncludeCache* include_cache,
+                              const ArchTypeInfo* info,
+                              PreprocErr* err) {
+    assert(info);
+    assert(err);
+    if (include_cache == NULL) {
+        IncludeCache* local_cache = IncludeCache_create();
+        PreprocPCH res = preproc_create_pch(path,
+                                            pch,
+                                            num_include_dirs,
+                                            include_dirs,
+                                            local_cache,
+                                            info,
+                                            err);
+        IncludeCache_free(local_cache);
+        return res;
+    }
+
+    PreprocState state = PreprocState_create(path,
+                                             num_include_dirs,
+                                             include_dirs,
+                                             include_cache,
+                                             err);
+    if (err->kind != PREPROC_ERR_NONE) {
+        return (PreprocPCH){
+            .file_info = state.file_info,
+        };
+    }
+    if (pch) {
+        PreprocState_apply_pch(&state, pch);
+    }
+    if (!preproc_impl(&state, info)) {
+        // vals are needed to print the error
+        PreprocPCH res = {
+            .vals = state.vals,
+            .file_info = state.file_info,
+        };
+        state.vals = PreprocTokenValList_create();
+        state.file_info = (FileInfo){
+            .len = 0,
+            .paths = NULL,
+        };
+        PreprocState_free(&state);
+        return res;
+    }
+    PreprocPCH res = PreprocState_take_pch(&state);
+    PreprocState_free(&state);
+    return res;
+}
+
 static bool preproc_impl(PreprocState* state, const ArchTypeInfo* info) {
     while (!PreprocState_over(state)) {
         const uint32_t prev_len = state->toks.len;
-        if (!read_and_tokenize_line(state, info)) {
-            return false;
-        }
-
-        if (!expand_all_macros(state, &state->toks, prev_len, info)) {
+        if (!read_and_tokenize_line(state, info)
+            || !expand_all_macros(state, &state->toks, prev_len, info)) {
+            resolve_err_loc(state->err, &state->vals.loc_table);
             return false;
         }
     }
+    if (!check_conds_terminated(state)) {
+        return false;
+    }
+    shrink_tokens(&state->toks);
+    return true;
+}
+
+static bool check_conds_terminated(PreprocState* state) {
     if (state->conds_len != 0) {
         PreprocErr_set(state->err,
                        PREPROC_ERR_UNTERMINATED_COND,
@@ -82,17 +170,163 @@ static bool preproc_impl(PreprocState* state, const ArchTypeInfo* info) {
                                                 .loc;
         return false;
     }
+    return true;
+}
+
+// The location table is not passed on when an error occurs, so errors at
+// expanded tokens are reported at the macro invocation
+static void resolve_err_loc(PreprocErr* err, const SourceLocTable* loc_table) {
+    err->base.loc = SourceLocTable_resolve(loc_table, err->base.loc);
+}
+
+static void shrink_tokens(PreprocTokenArr* tokens) {
+    tokens->cap = tokens->len;
+    tokens->kinds = mycc_realloc(tokens->kinds,
+                                 sizeof *tokens->kinds * tokens->cap);
+    tokens->val_indices = mycc_realloc(tokens->val_indices,
+                                       sizeof *tokens->val_indices * tokens->cap);
+    tokens->locs = mycc_realloc(tokens->locs,
+                                sizeof *tokens->locs * tokens->cap);
+}
+
+PreprocStream PreprocStream_create(CStr path,
+                                   const PreprocPCH* pch,
+                                   uint32_t num_include_dirs,
+                                   const Str* include_dirs,
+                                   IncludeCache* include_cache,
+                                   const ArchTypeInfo* info,
+                                   PreprocErr* err) {
+    assert(include_cache);
+    assert(info);
+    assert(err);
+    PreprocStream res = {
+        ._state = PreprocState_create(path,
+                                      num_include_dirs,
+                                      include_dirs,
+                                      include_cache,
+                                      err),
+        ._info = info,
+        ._state_valid = err->kind == PREPROC_ERR_NONE,
+    };
+    if (res._state_valid && pch) {
+        PreprocState_apply_pch(&res._state, pch);
+    }
+    return res;
+}
+
+// Appends toks to tokens, encoding their locations in loc_table, which is moved
+// into tokens when the stream is finished
+static void append_tokens(TokenArr* tokens,
+                          const PreprocTokenArr* toks,
+                          SourceLocTable* loc_table) {
+    TokenArr_reserve(tokens, toks->len);
+    memcpy(tokens->kinds + tokens->len,
+           toks->kinds,
+           sizeof *toks->kinds * toks->len);
+    memcpy(tokens->val_indices + tokens->len,
+           toks->val_indices,
+           sizeof *toks->val_indices * toks->len);
+    for (uint32_t i = 0; i < toks->len; ++i) {
+        tokens->locs[tokens->len + i] = SourceLocTable_add(loc_table,
+                                                           toks->locs[i]);
+    }
+    tokens->len += toks->len;
+}
 
-    state->toks.cap = state->toks.len;
-    state->toks.kinds = mycc_realloc(state->toks.kinds,
-                                    sizeof *state->toks.kinds * state->toks.cap);
-    state->toks.val_indices = mycc_realloc(state->toks.val_indices,
-                                          sizeof *state->toks.val_indices * state->toks.cap);
-    state->toks.locs = mycc_realloc(state->toks.locs,
-                                   sizeof *state->toks.locs * state->toks.cap);
+bool PreprocStream_read(PreprocStream* s, TokenArr* tokens, uint32_t min_len) {
+    PreprocState* state = &s->_state;
+    if (state->err->kind != PREPROC_ERR_NONE) {
+        return false;
+    }
+    // Before the first line is read, the state only contains the tokens of
+    // the precompiled header, which are already expanded
+    if (state->toks.len != 0) {
+        if (!convert_token_kinds(&state->toks, 0, state->err)) {
+            resolve_err_loc(state->err, &state->vals.loc_table);
+            return false;
+        }
+        append_tokens(tokens, &state->toks, &state->vals.loc_table);
+        state->toks.len = 0;
+    }
+    while (tokens->len < min_len && !PreprocState_over(state)) {
+        // Once a line is expanded its tokens are final, because macro
+        // invocations that continue on later lines read those lines while
+        // being expanded, so they can be moved out of the state
+        if (!read_and_tokenize_line(state, s->_info)
+            || !expand_all_macros(state, &state->toks, 0, s->_info)
+            || !convert_token_kinds(&state->toks, 0, state->err)) {
+            // The tokens of the failed line are not handed out
+            resolve_err_loc(state->err, &state->vals.loc_table);
+            return false;
+        }
+        append_tokens(tokens, &state->toks, &state->vals.loc_table);
+        state->toks.len = 0;
+        if (PreprocState_over(state) && !check_conds_terminated(state)) {
+            return false;
+        }
+    }
     return true;
 }
 
+bool PreprocStream_over(const PreprocStream* s) {
+    return s->_state.err->kind != PREPROC_ERR_NONE
+           || PreprocState_over(&s->_state);
+}
+
+uint32_t PreprocStream_estimate_num_tokens(const PreprocStream* s) {
+    if (!s->_state_valid) {
+        return 0;
+    }
+    const PreprocState* state = &s->_state;
+    return state->toks.len + PreprocState_estimate_num_tokens(state);
+}
+
+void PreprocStream_finish(PreprocStream* s, TokenArr* tokens) {
+    PreprocState* state = &s->_state;
+    if (state->err->kind == PREPROC_ERR_NONE) {
+        tokens->cap = tokens->len;
+        tokens->kinds = mycc_realloc(tokens->kinds,
+                                     sizeof *tokens->kinds * tokens->cap);
+        tokens->val_indices = mycc_realloc(
+            tokens->val_indices,
+            sizeof *tokens->val_indices * tokens->cap);
+        tokens->locs = mycc_realloc(tokens->locs,
+                                    sizeof *tokens->locs * tokens->cap);
+        SourceLocTable_free(&tokens->loc_table);
+        tokens->loc_table = state->vals.loc_table;
+        state->vals.loc_table = SourceLocTable_create();
+        tokens->identifiers = IndexedStringSet_take(&state->vals.identifiers);
+        tokens->literals = TokenLiterals_create(
+            s->_info,
+            IndexedStringSet_take(&state->vals.int_consts),
+            IndexedStringSet_take(&state->vals.float_consts),
+            IndexedStringSet_take(&state->vals.str_lits));
+    }
+}
+
+PreprocRes PreprocStream_close(PreprocStream* s) {
+    PreprocState* state = &s->_state;
+    if (!s->_state_valid) {
+        return (PreprocRes){
+            .toks = {0},
+            .file_info = state->file_info,
+        };
+    }
+    PreprocRes res = {
+        .toks = state->toks,
+        .vals = state->vals,
+        .file_info = state->file_info,
+    };
+    state->toks = PreprocTokenArr_create_empty();
+    state->vals = PreprocTokenValList_create();
+    state->file_info = (FileInfo){
+        .len = 0,
+        .paths = NULL,
+    };
+    PreprocState_free(state);
+    return res;
+}
+
 #ifdef MYCC_TEST_FUNCTIONALITY
 
 PreprocRes preproc_string(Str str,
@@ -155,31 +389,47 @@ TokenArr convert_preproc_tokens(PreprocTokenArr* tokens,
     assert(tokens);
     assert(info);
     MYCC_TIMER_BEGIN();
-    const uint32_t identifiers_len = IndexedStringSet_len(&vals->identifiers);
-    const uint32_t int_consts_len = IndexedStringSet_len(&vals->int_consts);
-    const uint32_t float_consts_len = IndexedStringSet_len(&vals->float_consts);
-    const uint32_t str_lits_len = IndexedStringSet_len(&vals->str_lits);
+    if (!convert_token_kinds(tokens, 0, err)) {
+        resolve_err_loc(err, &vals->loc_table);
+        // TODO: free
+        return (TokenArr){0};
+    }
+    // The table already holds the macro expansions the locations refer to
+    SourceLocTable loc_table = vals->loc_table;
+    uint32_t* locs = mycc_alloc_or_null(sizeof *locs * tokens->cap);
+    for (uint32_t i = 0; i < tokens->len; ++i) {
+        locs[i] = SourceLocTable_add(&loc_table, tokens->locs[i]);
+    }
+    mycc_free(tokens->locs);
+    // Literals are only converted when their values are accessed
     TokenArr res = {
         .len = tokens->len,
         .cap = tokens->cap,
         .kinds = tokens->kinds,
         .val_indices = tokens->val_indices,
-        .locs = tokens->locs,
-        // Gets initialized when done, so errors work properly
-        .identifiers = NULL,
-        .int_consts = mycc_alloc_or_null(sizeof *res.int_consts * int_consts_len),
-        .float_consts = mycc_alloc_or_null(sizeof *res.float_consts * float_consts_len),
-        .str_lits = mycc_alloc_or_null(sizeof *res.str_lits * str_lits_len),
-        .identifiers_len = identifiers_len,
-        .int_consts_len = int_consts_len,
-        .float_consts_len = float_consts_len,
-        .str_lits_len = str_lits_len,
+        .locs = locs,
+        .loc_table = loc_table,
+        .identifiers = IndexedStringSet_take(&vals->identifiers),
+        .literals = TokenLiterals_create(
+            info,
+            IndexedStringSet_take(&vals->int_consts),
+            IndexedStringSet_take(&vals->float_consts),
+            IndexedStringSet_take(&vals->str_lits)),
     };
+    *tokens = (PreprocTokenArr){0};
+    *vals = (PreprocTokenValList){0};
+    MYCC_TIMER_END("converting preproc tokens");
+    return res;
+}
+
+static bool convert_token_kinds(PreprocTokenArr* tokens,
+                                uint32_t start,
+                                PreprocErr* err) {
     // TODO: if we have identifiers in a set, we should just insert all
     // keywords in the set first 
     // that way we can just check if the token is less than the number of
     // keywords and easily map them
-    for (uint32_t i = 0; i < tokens->len; ++i) {
+    for (uint32_t i = start; i < tokens->len; ++i) {
         uint8_t* kind = &tokens->kinds[i];
         switch (*kind) {
             case TOKEN_IDENTIFIER: {
@@ -190,70 +440,10 @@ TokenArr convert_preproc_tokens(PreprocTokenArr* tokens,
             case TOKEN_PP_CONCAT:
                 PreprocErr_set(err, PREPROC_ERR_MISPLACED_PREPROC_TOKEN, tokens->locs[i]);
                 err->misplaced_preproc_tok = *kind;
-                // TODO: free
-                return (TokenArr){0};
+                return false;
         }
     }
-    for (uint32_t i = 0; i < int_consts_len; ++i) {
-        Str spelling = IndexedStringSet_get(&vals->int_consts, i);
-        if (Str_at(spelling, 0) == '\'') {
-            ParseCharConstRes char_const = parse_char_const(spelling, info);
-            if (char_const.err.kind != CHAR_CONST_ERR_NONE) {
-                // TODO: find source loc
-                PreprocErr_set(err, PREPROC_ERR_CHAR_CONST, (SourceLoc){0});
-                err->char_const_err = char_const.err;
-                err->constant_spell = spelling;
-                // TODO: free
-                return (TokenArr){0};
-            }
-            res.int_consts[i] = char_const.res;
-        } else {
-            ParseIntConstRes int_const = parse_int_const(
-                spelling,
-                info);
-            if (int_const.err.kind != INT_CONST_ERR_NONE) {
-                // TODO: find source loc
-                PreprocErr_set(err, PREPROC_ERR_INT_CONST, (SourceLoc){0});
-                err->int_const_err = int_const.err;
-                err->constant_spell = spelling;
-                // TODO: free
-                return (TokenArr){0};
-            }
-            res.int_consts[i] = int_const.res;
-        }
-    }
-    for (uint32_t i = 0; i < float_consts_len; ++i) {
-        Str spelling = IndexedStringSet_get(&vals->float_consts, i);
-        ParseFloatConstRes float_const = parse_float_const(spelling);
-        if (float_const.err.kind != FLOAT_CONST_ERR_NONE) {
-            // TODO: find source loc
-            PreprocErr_set(err, PREPROC_ERR_FLOAT_CONST, (SourceLoc){0});
-            err->float_const_err = float_const.err;
-            err->constant_spell = spelling;
-            // TODO: free
-            return (TokenArr){0};
-        }
-        res.float_consts[i] = float_const.res; 
-    }
-    for (uint32_t i = 0; i < str_lits_len; ++i) {
-        Str spelling = IndexedStringSet_get(&vals->str_lits, i);
-        StrLit* str_lit = &res.str_lits[i];
-        *str_lit = convert_to_str_lit(spelling);
-        if (str_lit->kind == STR_LIT_INCLUDE) {
-            StrLit_free(str_lit);
-            // TODO: error
-            // TODO: free
-            return (TokenArr){0};
-        }
-    }
-    res.identifiers = IndexedStringSet_take(&vals->identifiers);
-    IndexedStringSet_free(&vals->float_consts);
-    IndexedStringSet_free(&vals->int_consts);
-    IndexedStringSet_free(&vals->str_lits);
-    *tokens = (PreprocTokenArr){0};
-    *vals = (PreprocTokenValList){0};
-    MYCC_TIMER_END("converting preproc tokens");
-    return res;
+    return true;
 }
 
 static TokenKind keyword_kind(uint32_t id_idx) {
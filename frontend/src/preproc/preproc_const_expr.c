@@ -46,17 +46,27 @@ typedef struct PreprocConstExprVal {
         }                                                                      \
     } while (0)
 
+// The tokens of an expression, whose constants are converted when they are
+// evaluated
+typedef struct ConstExprTokens {
+    uint32_t len;
+    const uint8_t* kinds;
+    const uint32_t* val_indices;
+    const SourceLoc* locs;
+    TokenLiterals literals;
+} ConstExprTokens;
+
 static bool PreprocConstExprVal_is_nonzero(const PreprocConstExprVal* val) {
     assert(val->valid);
     return val->is_signed ? val->sint_val != 0 : val->uint_val != 0;
 }
 
 static PreprocConstExprVal evaluate_preproc_cond_expr(uint32_t* it,
-                                                      const TokenArr* arr,
+                                                      const ConstExprTokens* arr,
                                                       PreprocErr* err);
 
 static PreprocConstExprVal evaluate_preproc_primary_expr(uint32_t* it,
-                                                         const TokenArr* arr,
+                                                         const ConstExprTokens* arr,
                                                          PreprocErr* err) {
     if (*it >= arr->len) {
         PreprocErr_set(err,
@@ -66,15 +76,21 @@ static PreprocConstExprVal evaluate_preproc_primary_expr(uint32_t* it,
     }
     switch (arr->kinds[*it]) {
         case TOKEN_I_CONSTANT: {
+            const IntVal* val = TokenLiterals_int_const(&arr->literals,
+                                                        arr->val_indices[*it],
+                                                        arr->locs[*it],
+                                                        err);
+            if (val == NULL) {
+                return (PreprocConstExprVal){0};
+            }
             PreprocConstExprVal res;
             res.valid = true;
-            const uint32_t val_idx = arr->val_indices[*it];
-            if (IntValKind_is_sint(arr->int_consts[val_idx].kind)) {
+            if (IntValKind_is_sint(val->kind)) {
                 res.is_signed = true;
-                res.sint_val = arr->int_consts[val_idx].sint_val;
+                res.sint_val = val->sint_val;
             } else {
                 res.is_signed = false;
-                res.uint_val = arr->int_consts[val_idx].uint_val;
+                res.uint_val = val->uint_val;
             }
             ++*it;
             return res;
@@ -125,7 +141,7 @@ static bool is_preproc_unary_op(TokenKind k) {
 }
 
 static PreprocConstExprVal evaluate_preproc_unary_expr(uint32_t* it,
-                                                       const TokenArr* arr,
+                                                       const ConstExprTokens* arr,
                                                        PreprocErr* err) {
     if (is_preproc_unary_op(arr->kinds[*it])) {
         const TokenKind op = arr->kinds[*it];
@@ -176,7 +192,7 @@ static PreprocConstExprVal evaluate_preproc_unary_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_mul_expr(uint32_t* it,
-                                                     const TokenArr* arr,
+                                                     const ConstExprTokens* arr,
                                                      PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_unary_expr(it, arr, err);
     if (!res.valid) {
@@ -210,7 +226,7 @@ static PreprocConstExprVal evaluate_preproc_mul_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_add_expr(uint32_t* it,
-                                                     const TokenArr* arr,
+                                                     const ConstExprTokens* arr,
                                                      PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_mul_expr(it, arr, err);
     if (!res.valid) {
@@ -235,7 +251,7 @@ static PreprocConstExprVal evaluate_preproc_add_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_shift_expr(uint32_t* it,
-                                                       const TokenArr* arr,
+                                                       const ConstExprTokens* arr,
                                                        PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_add_expr(it, arr, err);
     if (!res.valid) {
@@ -260,7 +276,7 @@ static PreprocConstExprVal evaluate_preproc_shift_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_rel_expr(uint32_t* it,
-                                                     const TokenArr* arr,
+                                                     const ConstExprTokens* arr,
                                                      PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_shift_expr(it, arr, err);
     if (!res.valid) {
@@ -297,7 +313,7 @@ static PreprocConstExprVal evaluate_preproc_rel_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_eq_expr(uint32_t* it,
-                                                    const TokenArr* arr,
+                                                    const ConstExprTokens* arr,
                                                     PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_rel_expr(it, arr, err);
     if (!res.valid) {
@@ -324,7 +340,7 @@ static PreprocConstExprVal evaluate_preproc_eq_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_and_expr(uint32_t* it,
-                                                     const TokenArr* arr,
+                                                     const ConstExprTokens* arr,
                                                      PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_eq_expr(it, arr, err);
     if (!res.valid) {
@@ -344,7 +360,7 @@ static PreprocConstExprVal evaluate_preproc_and_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_xor_expr(uint32_t* it,
-                                                     const TokenArr* arr,
+                                                     const ConstExprTokens* arr,
                                                      PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_and_expr(it, arr, err);
     if (!res.valid) {
@@ -364,7 +380,7 @@ static PreprocConstExprVal evaluate_preproc_xor_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_or_expr(uint32_t* it,
-                                                    const TokenArr* arr,
+                                                    const ConstExprTokens* arr,
                                                     PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_xor_expr(it, arr, err);
     if (!res.valid) {
@@ -384,7 +400,7 @@ static PreprocConstExprVal evaluate_preproc_or_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_log_and_expr(uint32_t* it,
-                                                         const TokenArr* arr,
+                                                         const ConstExprTokens* arr,
                                                          PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_or_expr(it, arr, err);
     if (!res.valid) {
@@ -408,7 +424,7 @@ static PreprocConstExprVal evaluate_preproc_log_and_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_log_or_expr(uint32_t* it,
-                                                        const TokenArr* arr,
+                                                        const ConstExprTokens* arr,
                                                         PreprocErr* err) {
     PreprocConstExprVal res = evaluate_preproc_log_and_expr(it, arr, err);
     if (!res.valid) {
@@ -432,7 +448,7 @@ static PreprocConstExprVal evaluate_preproc_log_or_expr(uint32_t* it,
 }
 
 static PreprocConstExprVal evaluate_preproc_cond_expr(uint32_t* it,
-                                                      const TokenArr* arr,
+                                                      const ConstExprTokens* arr,
                                                       PreprocErr* err) {
     PreprocConstExprVal curr_res = evaluate_preproc_log_or_expr(it, arr, err);
     if (!curr_res.valid) {
@@ -545,57 +561,52 @@ PreprocConstExprRes evaluate_preproc_const_expr(PreprocState* state,
             .valid = false,
         };
     }
-    const uint32_t int_consts_len = IndexedStringSet_len(&state->vals.int_consts);
-    TokenArr tokens = {
+    // Only the constants of the expression are converted, when they are
+    // evaluated, so their spellings are copied with new indices
+    StringPool int_spellings = StringPool_create(0);
+    uint32_t* val_indices = mycc_alloc(sizeof *val_indices * arr->len);
+    for (uint32_t i = 2; i < arr->len; ++i) {
+        if (arr->kinds[i] == TOKEN_I_CONSTANT) {
+            const Str spell = IndexedStringSet_get(&state->vals.int_consts,
+                                                   arr->val_indices[i]);
+            val_indices[i] = StringPool_add(&int_spellings, spell);
+        } else {
+            val_indices[i] = arr->val_indices[i];
+        }
+    }
+    ConstExprTokens tokens = {
         .len = arr->len,
-        .cap = arr->cap,
         .kinds = arr->kinds,
-        .val_indices = arr->val_indices,
+        .val_indices = val_indices,
         .locs = arr->locs,
-        .identifiers = state->vals.identifiers._data,
-        .int_consts = mycc_alloc(sizeof *tokens.int_consts * int_consts_len),
-        .int_consts_len = int_consts_len,
+        .literals = TokenLiterals_create(info,
+                                         int_spellings,
+                                         StringPool_create(0),
+                                         StringPool_create(0)),
     };
-    for (uint32_t i = 0; i < int_consts_len; ++i) {
-        const Str spell = IndexedStringSet_get(&state->vals.int_consts, i);
-        if (Str_at(spell, 0) == '\'') {
-            ParseCharConstRes res = parse_char_const(spell, info);
-            if (res.err.kind != CHAR_CONST_ERR_NONE) {
-                PreprocErr_set(err, PREPROC_ERR_CHAR_CONST, arr->locs[i]);
-                err->char_const_err = res.err;
-                // TODO: do we need to take this
-                err->constant_spell = spell;
-                return (PreprocConstExprRes){
-                    .valid = false,
-                };
-            }
-            tokens.int_consts[i] = res.res;
-        } else {
-            ParseIntConstRes res = parse_int_const(spell, info);
-            if (res.err.kind != INT_CONST_ERR_NONE) {
-                PreprocErr_set(err, PREPROC_ERR_INT_CONST, arr->locs[i]);
-                err->int_const_err = res.err;
-                // TODO: do we need to take this
-                err->constant_spell = spell;
-                return (PreprocConstExprRes){
-                    .valid = false,
-                };
-            }
-            tokens.int_consts[i] = res.res;
-        }
-    }
     // TODO: need to check for F_CONSTANT and IDENTIFIERs
 
     uint32_t i = 2;
     PreprocConstExprVal val = evaluate_preproc_cond_expr(&i, &tokens, err);
     if (!val.valid) {
-        mycc_free(tokens.int_consts);
+        if (err->kind == PREPROC_ERR_INT_CONST
+            || err->kind == PREPROC_ERR_CHAR_CONST) {
+            // The spelling in the error has to outlive the copied spellings
+            const uint32_t idx = IndexedStringSet_find(&state->vals.int_consts,
+                                                       err->constant_spell);
+            assert(idx != UINT32_MAX);
+            err->constant_spell = IndexedStringSet_get(&state->vals.int_consts,
+                                                       idx);
+        }
+        mycc_free(val_indices);
+        TokenLiterals_free(&tokens.literals);
         return (PreprocConstExprRes){
             .valid = false,
         };
     }
     assert(i == arr->len);
-    mycc_free(tokens.int_consts);
+    mycc_free(val_indices);
+    TokenLiterals_free(&tokens.literals);
     return (PreprocConstExprRes){
         .valid = true,
         .res = PreprocConstExprVal_is_nonzero(&val),
@@ -2,10 +2,13 @@
 
 #include <ctype.h>
 
+#include "util/scan.h"
+
 #include "frontend/preproc/PreprocMacro.h"
 #include "frontend/preproc/PreprocTokenArr.h"
 #include "frontend/preproc/preproc_const_expr.h"
 
+#include "keyword_hash.h"
 #include "tokenizer.h"
 
 static bool is_preproc_directive(Str line) {
@@ -28,8 +31,7 @@ bool read_and_tokenize_line(PreprocState* state, const ArchTypeInfo* info) {
     assert(state);
 
     while (true) {
-        if (state->line_info.next.data == NULL
-            || *state->line_info.next.data == '\0') {
+        if (state->line_info.next.len == 0) {
             PreprocState_read_line(state);
         }
         if (PreprocState_over(state)) {
@@ -51,6 +53,7 @@ bool read_and_tokenize_line(PreprocState* state, const ArchTypeInfo* info) {
                 return false;
             }
         } else {
+            const uint32_t prev_len = state->toks.len;
             const bool res = tokenize_line(&state->toks,
                                            &state->vals,
                                            state->err,
@@ -58,6 +61,9 @@ bool read_and_tokenize_line(PreprocState* state, const ArchTypeInfo* info) {
             if (!res) {
                 return false;
             }
+            if (state->toks.len != prev_len) {
+                PreprocState_guard_tokens(state);
+            }
 
             break;
         }
@@ -75,11 +81,14 @@ static uint32_t skip_whitespaces(Str line) {
     return i;
 }
 
-static bool is_cond_directive(Str line) {
+// Gets the identifier index of the name of the directive in line, which is
+// UINT32_MAX if line is not a directive whose name is a keyword or
+// preprocessor identifier
+static uint32_t get_directive_idx(Str line) {
     uint32_t i = skip_whitespaces(line);
 
     if (i == line.len || Str_at(line, i) != '#') {
-        return false;
+        return UINT32_MAX;
     }
 
     ++i;
@@ -87,53 +96,36 @@ static bool is_cond_directive(Str line) {
         ++i;
     }
 
-    const Str else_dir = STR_LIT("else");
-    const Str elif_dir = STR_LIT("elif");
-    const Str endif_dir = STR_LIT("endif");
-
-    Str rest = Str_advance(line, i);
-    if (rest.len < else_dir.len) {
-        return false;
-    } else if (Str_starts_with(rest, else_dir)
-               || Str_starts_with(rest, elif_dir)
-               || Str_starts_with(rest, endif_dir)) {
-        return true;
-    } else {
-        return false;
-    }
-}
-
-static bool is_if_dir(Str line) {
-    uint32_t i = skip_whitespaces(line);
-
-    if (i == line.len || Str_at(line, i) != '#') {
-        return false;
-    }
-
-    ++i;
-    while (i != line.len && isspace(Str_at(line, i))) {
+    const uint32_t name_start = i;
+    while (i != line.len
+           && (isalnum((unsigned char)Str_at(line, i))
+               || Str_at(line, i) == '_')) {
         ++i;
     }
+    if (i == name_start) {
+        return UINT32_MAX;
+    }
+    return find_preproc_keyword(Str_substr(line, name_start, i));
+}
 
-    const Str if_dir = STR_LIT("if");
-    const Str ifdef_dir = STR_LIT("ifdef");
-    const Str ifndef_dir = STR_LIT("ifndef");
+static bool is_cond_directive(Str line) {
+    const uint32_t idx = get_directive_idx(line);
+    return idx == PREPROC_ELSE_ID_IDX || idx == PREPROC_ELIF_ID_IDX
+           || idx == PREPROC_ENDIF_ID_IDX;
+}
 
-    Str rest = Str_advance(line, i);
-    return Str_starts_with(rest, if_dir) || Str_starts_with(rest, ifdef_dir)
-           || Str_starts_with(rest, ifndef_dir);
+static bool is_if_dir(Str line) {
+    const uint32_t idx = get_directive_idx(line);
+    return idx == PREPROC_IF_ID_IDX || idx == PREPROC_IFDEF_ID_IDX
+           || idx == PREPROC_IFNDEF_ID_IDX;
 }
 
 static bool skip_until_next_cond(PreprocState* state,
                                  const ArchTypeInfo* info) {
     while (!PreprocState_over(state)) {
+        PreprocState_skip_inactive_lines(state);
         PreprocState_read_line(state);
-        if (is_if_dir(state->line_info.next)) {
-            PreprocState_push_cond(state, state->line_info.curr_loc, false);
-            if (!skip_until_next_cond(state, info)) {
-                return false;
-            }
-        } else if (is_cond_directive(state->line_info.next)) {
+        if (is_cond_directive(state->line_info.next)) {
             PreprocTokenArr arr = PreprocTokenArr_create_empty();
             const bool tokenize_res = tokenize_line(&arr,
                                                     &state->vals,
@@ -147,6 +139,18 @@ static bool skip_until_next_cond(PreprocState* state,
             PreprocTokenArr_free(&arr);
             return stat_res;
         }
+        // Lines that are not tokenized still need to count the newlines of
+        // spliced lines
+        const SourceLoc loc = state->line_info.curr_loc;
+        state->line_info.curr_loc.file_loc.line += mycc_count_char(
+            state->line_info.next,
+            '\n');
+        if (is_if_dir(state->line_info.next)) {
+            PreprocState_push_cond(state, loc, false);
+            if (!skip_until_next_cond(state, info)) {
+                return false;
+            }
+        }
     }
     PreprocErr_set(state->err,
                    PREPROC_ERR_UNTERMINATED_COND,
@@ -311,6 +315,7 @@ static bool preproc_statement(PreprocState* state,
     }
 
     const uint32_t directive_id_idx = arr->val_indices[1];
+    PreprocState_guard_directive(state, arr);
 
     if (directive_id_idx == PREPROC_IF_ID_IDX) {
         PreprocConstExprRes res = evaluate_preproc_const_expr(state,
@@ -334,10 +339,18 @@ static bool preproc_statement(PreprocState* state,
         }
         const uint32_t identifier_idx = arr->val_indices[2];
         const Str spell = IndexedStringSet_get(&state->vals.identifiers, identifier_idx);
-        PreprocMacro macro = parse_preproc_macro(arr, spell.len, state->err);
+        PreprocMacro macro = parse_preproc_macro(arr,
+                                                 spell.len,
+                                                 &state->_macro_arena,
+                                                 state->err);
         if (state->err->kind != PREPROC_ERR_NONE) {
             return false;
         }
+        // The expansion is at the end of the directive
+        macro.spellings_idx = SourceLocTable_add_macro(
+            &state->vals.loc_table,
+            arr->locs + arr->len - macro.expansion_len,
+            macro.expansion_len);
         PreprocState_register_macro(state, identifier_idx, &macro);
     } else if (directive_id_idx == PREPROC_UNDEF_ID_IDX) {
         if (arr->len < 3) {
@@ -367,7 +380,13 @@ static bool preproc_statement(PreprocState* state,
     } else if (directive_id_idx == PREPROC_INCLUDE_ID_IDX) {
         return handle_include(state, arr, info);
     } else if (directive_id_idx == PREPROC_PRAGMA_ID_IDX) {
-        // TODO:
+        if (arr->len == 3 && arr->kinds[2] == TOKEN_IDENTIFIER
+            && Str_eq(IndexedStringSet_get(&state->vals.identifiers,
+                                           arr->val_indices[2]),
+                      STR_LIT("once"))) {
+            PreprocState_pragma_once(state);
+        }
+        // TODO: other pragmas
     } else if (directive_id_idx == PREPROC_ELIF_ID_IDX) {
         return handle_else_elif(state, arr, false, info);
     } else if (directive_id_idx == PREPROC_ELSE_ID_IDX) {
@@ -189,21 +189,3 @@ static bool is_hex_float_const(Str str) {
         return true;
     }
 }
-
-static bool is_id_char(char c) {
-    return isalpha(c) || isdigit(c) || c == '_';
-}
-
-bool is_valid_identifier(Str str) {
-    if (!isalpha(Str_at(str, 0)) && Str_at(str, 0) != '_') {
-        return false;
-    }
-    for (uint32_t i = 1; i != str.len; ++i) {
-        if (!is_id_char(Str_at(str, i))) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
@@ -8,6 +8,5 @@
 
 bool is_int_const(Str str);
 bool is_float_const(Str str);
-bool is_valid_identifier(Str str);
 
 #endif
@@ -4,10 +4,15 @@
 #include <assert.h>
 
 #include "util/mem.h"
+#include "util/scan.h"
 
 #include "frontend/Token.h"
 
 #include "regex.h"
+#include "tokenizer_tables.h"
+
+// Generated from TokenKind.inc by tokenizer_tables_gen
+#include "tokenizer_tables.inc"
 
 typedef struct {
     Str it;
@@ -17,13 +22,28 @@ typedef struct {
     uint32_t current_file_idx;
 } TokenizerState;
 
-static TokenKind singlec_token_kind(char c);
-static TokenKind check_next(TokenKind kind, Str next);
-static bool is_singlec_token(const TokenizerState* s, TokenKind t);
+static uint8_t char_class(char c) {
+    return g_char_classes[(unsigned char)c];
+}
+
+// Returns the length of the longest prefix of str, in which every character
+// is in one of the given classes
+static uint32_t scan_class(Str str, uint8_t classes) {
+    uint32_t len = 0;
+    while (len != str.len && (char_class(str.data[len]) & classes)) {
+        ++len;
+    }
+    return len;
+}
+
+static TokenKind match_punctuator(Str str, uint32_t* len);
+static bool is_punctuator_start(Str str);
 
 static void advance(TokenizerState* s, uint32_t num);
 static void advance_one(TokenizerState* s);
 static void advance_newline(TokenizerState* s);
+static void advance_multiline(TokenizerState* s, uint32_t num);
+static void skip_whitespace(TokenizerState* s);
 
 static void handle_comments(TokenizerState* s, bool* comment_not_terminated);
 static void handle_ongoing_comment(TokenizerState* s,
@@ -72,10 +92,8 @@ static bool tokenize_next_token(PreprocTokenArr* arr,
         .current_file_idx = info->curr_loc.file_idx,
     };
 
-    while (isspace(*s.it.data)) {
-        advance_newline(&s);
-    }
-    if (*s.it.data == '\0') {
+    skip_whitespace(&s);
+    if (s.it.len == 0) {
         arr->kinds[idx] = TOKEN_INVALID;
         arr->val_indices[idx] = UINT32_MAX;
         arr->locs[idx] = (SourceLoc){
@@ -90,10 +108,10 @@ static bool tokenize_next_token(PreprocTokenArr* arr,
             s.file_loc,
         };
         advance_one(&s);
-        while (isblank(*s.it.data)) {
+        while (s.it.len != 0 && isblank(*s.it.data)) {
             advance_one(&s);
         }
-        if (*s.it.data != '\n') {
+        if (s.it.len == 0 || *s.it.data != '\n') {
             PreprocErr_set(err, PREPROC_ERR_INVALID_BACKSLASH, loc);
             return false;
         }
@@ -107,16 +125,15 @@ static bool tokenize_next_token(PreprocTokenArr* arr,
         return tokenize_next_token(arr, vals, idx, err, info);
     }
 
-    TokenKind kind = singlec_token_kind(Str_at(s.it, 0));
-    if (kind != TOKEN_INVALID && is_singlec_token(&s, kind)) {
-        if (kind == TOKEN_DIV
+    if (is_punctuator_start(s.it)) {
+        if (Str_at(s.it, 0) == '/'
             && (s.it.len > 1
                 && (Str_at(s.it, 1) == '/' || Str_at(s.it, 1) == '*'))) {
             handle_comments(&s, &info->is_in_comment);
             write_line_info(&s, info);
             return tokenize_next_token(arr, vals, idx, err, info);
         }
-        if (kind == TOKEN_LT) {
+        if (Str_at(s.it, 0) == '<') {
             // Assume this is a '<' '>' include
             if (prev_token_is_include(arr)) {
                 return handle_character_literal(&s, arr, vals, idx, info, err);
@@ -124,15 +141,14 @@ static bool tokenize_next_token(PreprocTokenArr* arr,
             // TODO: can use include being the last token as a shortcut, but
             // because of computed includes, we can't rely on it
         }
-        if (s.it.len != 1) {
-            kind = check_next(kind, Str_incr(s.it));
-        }
+        uint32_t len = 0;
+        const TokenKind kind = match_punctuator(s.it, &len);
+        assert(kind != TOKEN_INVALID);
 
         arr->kinds[idx] = kind;
         arr->val_indices[idx] = UINT32_MAX;
         arr->locs[idx] = (SourceLoc){s.current_file_idx, s.file_loc};
 
-        uint32_t len = TokenKind_get_spelling(kind).len;
         advance(&s, len);
 
         write_line_info(&s, info);
@@ -154,18 +170,15 @@ bool tokenize_line(PreprocTokenArr* res, PreprocTokenValList* vals,
     assert(info->next.data);
     assert(info->curr_loc.file_idx != UINT32_MAX);
 
-    while (*info->next.data != '\0') {
-        if (res->len == res->cap) {
-            mycc_grow_alloc((void**)&res->kinds, &res->cap, sizeof *res->kinds);
-            res->val_indices = mycc_realloc(res->val_indices, res->cap * sizeof *res->val_indices);
-            res->locs = mycc_realloc(res->locs, res->cap * sizeof *res->locs);
-        }
+    PreprocTokenArr_reserve(res, estimate_num_tokens(info->next.len));
+    while (info->next.len != 0) {
+        PreprocTokenArr_reserve(res, 1);
         do {
             if (!tokenize_next_token(res, vals, res->len, err, info)) {
                 return false;
             }
         // TODO: not sure about res->len
-        } while (res->kinds[res->len] == TOKEN_INVALID && *info->next.data != '\0');
+        } while (res->kinds[res->len] == TOKEN_INVALID && info->next.len != 0);
 
         if (res->kinds[res->len] != TOKEN_INVALID) {
             ++res->len;
@@ -174,189 +187,33 @@ bool tokenize_line(PreprocTokenArr* res, PreprocTokenValList* vals,
     return true;
 }
 
-static TokenKind singlec_token_kind(char c) {
-    switch (c) {
-        case ';':
-            return TOKEN_SEMICOLON;
-        case '(':
-            return TOKEN_LBRACKET;
-        case ')':
-            return TOKEN_RBRACKET;
-        case '{':
-            return TOKEN_LBRACE;
-        case '}':
-            return TOKEN_RBRACE;
-        case '[':
-            return TOKEN_LINDEX;
-        case ']':
-            return TOKEN_RINDEX;
-        case '.':
-            return TOKEN_DOT;
-        case '&':
-            return TOKEN_AND;
-        case '|':
-            return TOKEN_OR;
-        case '^':
-            return TOKEN_XOR;
-        case '!':
-            return TOKEN_NOT;
-        case '~':
-            return TOKEN_BNOT;
-        case '-':
-            return TOKEN_SUB;
-        case '+':
-            return TOKEN_ADD;
-        case '*':
-            return TOKEN_ASTERISK;
-        case '/':
-            return TOKEN_DIV;
-        case '%':
-            return TOKEN_MOD;
-        case '<':
-            return TOKEN_LT;
-        case '>':
-            return TOKEN_GT;
-        case '?':
-            return TOKEN_QMARK;
-        case ':':
-            return TOKEN_COLON;
-        case '=':
-            return TOKEN_ASSIGN;
-        case ',':
-            return TOKEN_COMMA;
-        case '#':
-            return TOKEN_PP_STRINGIFY;
-        default:
-            return TOKEN_INVALID;
-    }
-}
-
-static bool check_kind(TokenKind kind, Str next_chars) {
-    Str spell = TokenKind_get_spelling(kind);
-    assert(spell.len != 0);
-    assert(spell.len >= 2);
-    return Str_eq(Str_incr(spell), Str_substr(next_chars, 0, spell.len - 1));
-}
-
-static TokenKind check_next(TokenKind kind, Str next) {
-    assert(next.len != 0);
-    switch (kind) {
-        case TOKEN_ADD:
-            if (check_kind(TOKEN_ADD_ASSIGN, next)) {
-                return TOKEN_ADD_ASSIGN;
-            } else if (check_kind(TOKEN_INC, next)) {
-                return TOKEN_INC;
-            } else {
-                break;
-            }
-        case TOKEN_SUB:
-            if (check_kind(TOKEN_PTR_OP, next)) {
-                return TOKEN_PTR_OP;
-            } else if (check_kind(TOKEN_DEC, next)) {
-                return TOKEN_DEC;
-            } else if (check_kind(TOKEN_SUB_ASSIGN, next)) {
-                return TOKEN_SUB_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_ASTERISK:
-            if (check_kind(TOKEN_MUL_ASSIGN, next)) {
-                return TOKEN_MUL_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_DIV:
-            if (check_kind(TOKEN_DIV_ASSIGN, next)) {
-                return TOKEN_DIV_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_LT:
-            if (check_kind(TOKEN_LSHIFT_ASSIGN, next)) {
-                return TOKEN_LSHIFT_ASSIGN;
-            } else if (check_kind(TOKEN_LSHIFT, next)) {
-                return TOKEN_LSHIFT;
-            } else if (check_kind(TOKEN_LE, next)) {
-                return TOKEN_LE;
-            } else {
-                break;
-            }
-        case TOKEN_GT:
-            if (check_kind(TOKEN_RSHIFT_ASSIGN, next)) {
-                return TOKEN_RSHIFT_ASSIGN;
-            } else if (check_kind(TOKEN_RSHIFT, next)) {
-                return TOKEN_RSHIFT;
-            } else if (check_kind(TOKEN_GE, next)) {
-                return TOKEN_GE;
-            } else {
-                break;
-            }
-        case TOKEN_AND:
-            if (check_kind(TOKEN_LAND, next)) {
-                return TOKEN_LAND;
-            } else if (check_kind(TOKEN_AND_ASSIGN, next)) {
-                return TOKEN_AND_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_OR:
-            if (check_kind(TOKEN_LOR, next)) {
-                return TOKEN_LOR;
-            } else if (check_kind(TOKEN_OR_ASSIGN, next)) {
-                return TOKEN_OR_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_XOR:
-            if (check_kind(TOKEN_XOR_ASSIGN, next)) {
-                return TOKEN_XOR_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_MOD:
-            if (check_kind(TOKEN_MOD_ASSIGN, next)) {
-                return TOKEN_MOD_ASSIGN;
-            } else {
-                break;
-            }
-        case TOKEN_DOT:
-            if (check_kind(TOKEN_ELLIPSIS, next)) {
-                return TOKEN_ELLIPSIS;
-            } else {
-                break;
-            }
-        case TOKEN_ASSIGN:
-            if (check_kind(TOKEN_EQ, next)) {
-                return TOKEN_EQ;
-            } else {
-                break;
-            }
-        case TOKEN_NOT:
-            if (check_kind(TOKEN_NE, next)) {
-                return TOKEN_NE;
-            } else {
-                break;
-            }
-        case TOKEN_PP_STRINGIFY:
-            if (check_kind(TOKEN_PP_CONCAT, next)) {
-                return TOKEN_PP_CONCAT;
-            } else {
-                break;
-            }
-        default:
+static TokenKind match_punctuator(Str str, uint32_t* len) {
+    assert(str.len != 0);
+    TokenKind res = TOKEN_INVALID;
+    uint32_t state = PUNCT_START_STATE;
+    // The last accepting state is not necessarily the last state, because ".."
+    // is only a prefix of "..."
+    for (uint32_t i = 0; i != str.len; ++i) {
+        const uint8_t row = g_punct_states[state].row;
+        state = g_punct_transitions[row][(unsigned char)str.data[i]];
+        if (state == PUNCT_NO_TRANSITION) {
             break;
+        }
+        if (g_punct_states[state].kind != TOKEN_INVALID) {
+            res = g_punct_states[state].kind;
+            *len = i + 1;
+        }
     }
-
-    return kind;
+    return res;
 }
 
-static bool is_singlec_token(const TokenizerState* s, TokenKind t) {
-    switch (t) {
-        case TOKEN_DOT:
-            return s->it.len < 2 || !isdigit(s->it.data[1]);
-        default:
-            return true;
+static bool is_punctuator_start(Str str) {
+    if ((char_class(str.data[0]) & CHAR_CLASS_PUNCT) == 0) {
+        return false;
     }
+    // A '.' followed by a digit starts a floating point constant
+    return str.data[0] != '.' || str.len < 2
+           || (char_class(str.data[1]) & CHAR_CLASS_DIGIT) == 0;
 }
 
 static void advance(TokenizerState* s, uint32_t num) {
@@ -390,6 +247,43 @@ static void advance_newline(TokenizerState* s) {
     s->it = Str_incr(s->it);
 }
 
+// Like advance(), but the skipped characters may contain newlines
+static void advance_multiline(TokenizerState* s, uint32_t num) {
+    if (num == 0) {
+        return;
+    }
+    const Str span = Str_substr(s->it, 0, num);
+    uint32_t last_newline = UINT32_MAX;
+    uint32_t i = mycc_find_char(span, '\n');
+    while (i != num) {
+        ++s->file_loc.line;
+        last_newline = i;
+        i += 1 + mycc_find_char(Str_advance(span, i + 1), '\n');
+    }
+    const uint32_t index = s->file_loc.index;
+    advance(s, num);
+    if (last_newline != UINT32_MAX) {
+        s->file_loc.index = num - last_newline;
+    } else {
+        s->file_loc.index = index + num;
+    }
+}
+
+static void skip_whitespace(TokenizerState* s) {
+    // Whitespace between tokens is mostly a few characters long, which is too
+    // short to make up for the call to one of the scanning kernels
+    while (s->it.len != 0) {
+        const uint8_t cls = char_class(*s->it.data);
+        if (cls & CHAR_CLASS_NEWLINE) {
+            advance_newline(s);
+        } else if (cls & CHAR_CLASS_BLANK) {
+            advance(s, scan_class(s->it, CHAR_CLASS_BLANK));
+        } else {
+            return;
+        }
+    }
+}
+
 static void handle_comments(TokenizerState* s, bool* comment_not_terminated) {
     assert(*s->it.data == '/');
     assert(s->it.data[1] == '*' || s->it.data[1] == '/');
@@ -400,8 +294,9 @@ static void handle_comments(TokenizerState* s, bool* comment_not_terminated) {
 
         handle_ongoing_comment(s, comment_not_terminated);
     } else {
-        while (*s->it.data != '\0' && *s->it.data != '\n') {
-            advance_one(s);
+        const uint32_t len = mycc_find_char(s->it, '\n');
+        if (len != 0) {
+            advance(s, len);
         }
     }
 }
@@ -410,12 +305,9 @@ static void handle_ongoing_comment(TokenizerState* s,
                                    bool* comment_not_terminated) {
     assert(comment_not_terminated);
 
-    while (*s->it.data != '\0'
-           && (*s->it.data != '*' || s->it.data[1] != '/')) {
-        advance_newline(s);
-    }
+    advance_multiline(s, mycc_find_comment_end(s->it));
 
-    if (*s->it.data == '\0') {
+    if (s->it.len == 0) {
         *comment_not_terminated = true;
     } else {
         assert(*s->it.data == '*');
@@ -465,15 +357,28 @@ static bool handle_character_literal(TokenizerState* s,
     ++spell_view.len;
 
     advance_one(s);
-    while (*s->it.data != '\0'
+    while (s->it.len != 0
            && ((s->prev_prev != '\\' && s->prev == '\\')
                || *s->it.data != terminator)) {
+        const bool is_escaped = s->prev_prev != '\\' && s->prev == '\\';
+        if (!is_escaped) {
+            // Skip characters that cannot end the literal all at once
+            const uint32_t len = mycc_find_first_of3(s->it,
+                                                     terminator,
+                                                     '\\',
+                                                     '\n');
+            if (len != 0) {
+                spell_view.len += len;
+                advance(s, len);
+                continue;
+            }
+        }
         ++spell_view.len;
 
         advance_newline(s);
     }
 
-    if (*s->it.data == '\0') {
+    if (s->it.len == 0) {
         unterminated_literal_err(err,
                                  terminator,
                                  start_loc,
@@ -499,28 +404,25 @@ static bool handle_character_literal(TokenizerState* s,
     }
 }
 
-static bool token_is_over(const TokenizerState* s, bool is_num) {
-    if (*s->it.data == '\0' || isspace(*s->it.data)) {
-        return true;
-    }
-    TokenKind kind = singlec_token_kind(*s->it.data);
-    if (kind == TOKEN_INVALID) {
-        return false;
-    } else if (is_num) {
-        switch (kind) {
-            case TOKEN_SUB:
-            case TOKEN_ADD: {
-                char prev = (char)tolower((unsigned char)s->prev);
-                return (prev != 'e' && prev != 'p');
+// Returns the length of the number at the start of str
+static uint32_t scan_number(Str str) {
+    uint32_t len = 1;
+    while (len != str.len) {
+        const char c = str.data[len];
+        if (char_class(c) & CHAR_CLASS_TOKEN_END) {
+            if (c == '+' || c == '-') {
+                // Only part of the number if it is the sign of an exponent
+                const char prev = str.data[len - 1];
+                if (prev != 'e' && prev != 'E' && prev != 'p' && prev != 'P') {
+                    break;
+                }
+            } else if (c != '.') {
+                break;
             }
-            case TOKEN_DOT:
-                return false;
-            default:
-                return true;
         }
-    } else {
-        return true;
+        ++len;
     }
+    return len;
 }
 
 static bool handle_other(TokenizerState* s,
@@ -529,17 +431,31 @@ static bool handle_other(TokenizerState* s,
                          uint32_t res_idx,
                          LineInfo* info,
                          PreprocErr* err) {
-    const bool is_num = isdigit(*s->it.data) || *s->it.data == '.';
+    const uint8_t first_class = char_class(*s->it.data);
+    const bool is_num = (first_class & CHAR_CLASS_DIGIT) || *s->it.data == '.';
     Str spell_view = {
         .len = 0,
         .data = s->it.data,
     };
-    const FileLoc start_loc = s->file_loc;
-    while (!token_is_over(s, is_num)) {
-        ++spell_view.len;
-
-        advance_one(s);
+    bool is_valid_id = false;
+    if (is_num) {
+        spell_view.len = scan_number(s->it);
+    } else {
+        if (first_class & CHAR_CLASS_ID_START) {
+            spell_view.len = scan_class(s->it, CHAR_CLASS_ID);
+        }
+        const uint32_t valid_len = spell_view.len;
+        // Other characters are still part of the token, which is then invalid
+        while (spell_view.len != s->it.len
+               && (char_class(s->it.data[spell_view.len])
+                   & CHAR_CLASS_TOKEN_END) == 0) {
+            ++spell_view.len;
+        }
+        is_valid_id = valid_len != 0 && valid_len == spell_view.len;
     }
+    assert(spell_view.len != 0);
+    const FileLoc start_loc = s->file_loc;
+    advance(s, spell_view.len);
 
     TokenKind kind;
     if (is_num) {
@@ -558,7 +474,7 @@ static bool handle_other(TokenizerState* s,
             err->invalid_num = StrBuf_create(spell_view);
             return false;
         }
-    } else if (is_valid_identifier(spell_view)) {
+    } else if (is_valid_id) {
         arr->val_indices[res_idx] = PreprocTokenValList_add_identifier(vals, spell_view);
         kind = TOKEN_IDENTIFIER;
     } else {
@@ -0,0 +1,44 @@
+#ifndef TOKENIZER_TABLES_H
+#define TOKENIZER_TABLES_H
+
+#include <stdint.h>
+
+// Flags in g_char_classes
+enum {
+    // Whitespace except '\n'
+    CHAR_CLASS_BLANK = 1 << 0,
+    CHAR_CLASS_NEWLINE = 1 << 1,
+    // Letters and '_'
+    CHAR_CLASS_ID_START = 1 << 2,
+    CHAR_CLASS_DIGIT = 1 << 3,
+    // First character of a punctuator
+    CHAR_CLASS_PUNCT = 1 << 4,
+
+    CHAR_CLASS_SPACE = CHAR_CLASS_BLANK | CHAR_CLASS_NEWLINE,
+    CHAR_CLASS_ID = CHAR_CLASS_ID_START | CHAR_CLASS_DIGIT,
+    // Characters that end an identifier or a number
+    CHAR_CLASS_TOKEN_END = CHAR_CLASS_SPACE | CHAR_CLASS_PUNCT,
+};
+
+enum {
+    PUNCT_START_STATE = 0,
+    // Used in g_punct_transitions, because no transition leads to the start
+    PUNCT_NO_TRANSITION = PUNCT_START_STATE,
+    // Row of g_punct_transitions without any transitions
+    PUNCT_EMPTY_ROW = 0,
+};
+
+/**
+ * @brief State of the DFA matching punctuators, after reading a prefix of at
+ *        least one of them
+ */
+typedef struct {
+    // TokenKind of the punctuator spelled by the prefix, or TOKEN_INVALID if
+    // it is only the start of longer punctuators, like ".."
+    uint8_t kind;
+    // Row in g_punct_transitions, indexed by the next character
+    uint8_t row;
+} PunctState;
+
+#endif
+
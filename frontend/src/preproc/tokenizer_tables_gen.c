@@ -0,0 +1,193 @@
+// Builds the character classes and the DFA matching punctuators from the
+// spellings in TokenKind.inc, and writes them to the file given as argument
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/File.h"
+
+#include "frontend/Token.h"
+
+#include "tokenizer_tables.h"
+
+static const char* const g_names[] = {
+#define TOKEN_MACRO(name, str) [name] = #name,
+#include "frontend/TokenKind.inc"
+#undef TOKEN_MACRO
+};
+
+static const char* const g_spellings[] = {
+#define TOKEN_MACRO(name, str) [name] = str,
+#include "frontend/TokenKind.inc"
+#undef TOKEN_MACRO
+};
+
+enum {
+    NUM_CHARS = 256,
+    // Limited by the uint8_t fields of PunctState
+    MAX_STATES = 256,
+};
+
+typedef struct {
+    TokenKind kind;
+    uint8_t next[NUM_CHARS];
+} TrieState;
+
+static uint32_t g_num_states = 1;
+static TrieState g_states[MAX_STATES];
+
+static bool add_punctuator(TokenKind kind, const char* spell) {
+    uint32_t state = PUNCT_START_STATE;
+    for (const char* it = spell; *it != '\0'; ++it) {
+        const unsigned char c = (unsigned char)*it;
+        if (g_states[state].next[c] == PUNCT_NO_TRANSITION) {
+            if (g_num_states == MAX_STATES) {
+                return false;
+            }
+            g_states[g_num_states].kind = TOKEN_INVALID;
+            g_states[state].next[c] = (uint8_t)g_num_states;
+            ++g_num_states;
+        }
+        state = g_states[state].next[c];
+    }
+    g_states[state].kind = kind;
+    return true;
+}
+
+static bool has_transitions(const TrieState* state) {
+    for (uint32_t c = 0; c != NUM_CHARS; ++c) {
+        if (state->next[c] != PUNCT_NO_TRANSITION) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint8_t get_char_class(uint32_t c) {
+    switch (c) {
+        case ' ':
+        case '\t':
+        case '\v':
+        case '\f':
+        case '\r':
+            return CHAR_CLASS_BLANK;
+        case '\n':
+            return CHAR_CLASS_NEWLINE;
+        case '_':
+            return CHAR_CLASS_ID_START;
+        default:
+            break;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+        return CHAR_CLASS_ID_START;
+    } else if (c >= '0' && c <= '9') {
+        return CHAR_CLASS_DIGIT;
+    } else if (g_states[PUNCT_START_STATE].next[c] != PUNCT_NO_TRANSITION) {
+        return CHAR_CLASS_PUNCT;
+    }
+    return 0;
+}
+
+static void write_char_classes(File out) {
+    File_put_str("static const uint8_t g_char_classes[256] = {\n", out);
+    for (uint32_t c = 0; c != NUM_CHARS; c += 16) {
+        File_put_str("   ", out);
+        for (uint32_t i = c; i != c + 16; ++i) {
+            File_printf(out, " {u32},", (uint32_t)get_char_class(i));
+        }
+        File_putc('\n', out);
+    }
+    File_put_str("};\n\n", out);
+}
+
+static void write_punct_tables(File out) {
+    uint8_t rows[MAX_STATES];
+    uint32_t num_rows = PUNCT_EMPTY_ROW + 1;
+    for (uint32_t i = 0; i != g_num_states; ++i) {
+        if (has_transitions(&g_states[i])) {
+            rows[i] = (uint8_t)num_rows;
+            ++num_rows;
+        } else {
+            rows[i] = PUNCT_EMPTY_ROW;
+        }
+    }
+
+    File_printf(out, "#define PUNCT_NUM_STATES {u32}\n", g_num_states);
+    File_printf(out, "#define PUNCT_NUM_ROWS {u32}\n\n", num_rows);
+
+    File_put_str(
+        "static const PunctState g_punct_states[PUNCT_NUM_STATES] = {\n",
+        out);
+    for (uint32_t i = 0; i != g_num_states; ++i) {
+        // File_printf() has no way to escape braces
+        File_put_str("    {", out);
+        File_printf(out,
+                    "{c_str}, {u32}",
+                    g_names[g_states[i].kind],
+                    (uint32_t)rows[i]);
+        File_put_str("},\n", out);
+    }
+    File_put_str("};\n\n", out);
+
+    File_put_str("static const uint8_t "
+                 "g_punct_transitions[PUNCT_NUM_ROWS][256] = {\n",
+                 out);
+    // PUNCT_EMPTY_ROW
+    File_put_str("    {0},\n", out);
+    for (uint32_t i = 0; i != g_num_states; ++i) {
+        if (rows[i] == PUNCT_EMPTY_ROW) {
+            continue;
+        }
+        File_put_str("    {", out);
+        for (uint32_t c = 0; c != NUM_CHARS; ++c) {
+            const uint8_t next = g_states[i].next[c];
+            if (next != PUNCT_NO_TRANSITION) {
+                // Punctuators contain no characters that need escaping
+                File_printf(out,
+                            "['{char}'] = {u32}, ",
+                            (char)c,
+                            (uint32_t)next);
+            }
+        }
+        File_put_str("},\n", out);
+    }
+    File_put_str("};\n", out);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        File_put_str("Expected the output file as only argument\n",
+                     mycc_stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (TOKEN_INVALID > UINT8_MAX) {
+        File_put_str("TokenKind does not fit into PunctState\n", mycc_stderr);
+        return EXIT_FAILURE;
+    }
+    g_states[PUNCT_START_STATE].kind = TOKEN_INVALID;
+    for (uint32_t kind = TOKEN_KEYWORDS_END; kind != TOKEN_INVALID; ++kind) {
+        if (!add_punctuator(kind, g_spellings[kind])) {
+            File_put_str("Too many states for the punctuator table\n",
+                         mycc_stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const CStr out_path = {(uint32_t)strlen(argv[1]), argv[1]};
+    File out = File_open(out_path, FILE_WRITE);
+    if (!File_valid(out)) {
+        File_printf(mycc_stderr,
+                    "Failed to open {Str}\n",
+                    CStr_as_str(out_path));
+        return EXIT_FAILURE;
+    }
+    File_put_str("// Generated by tokenizer_tables_gen from TokenKind.inc\n\n",
+                 out);
+    write_char_classes(out);
+    write_punct_tables(out);
+    if (!File_close(out)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
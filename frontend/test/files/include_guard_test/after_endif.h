@@ -0,0 +1,5 @@
+#ifndef AFTER_ENDIF_H
+#define AFTER_ENDIF_H
+#endif
+
+int after_endif;
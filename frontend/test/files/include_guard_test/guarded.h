@@ -0,0 +1,13 @@
+// Comments are allowed outside of the guard
+
+#ifndef GUARDED_H
+#define GUARDED_H
+
+#ifdef SOMETHING
+int something;
+#endif
+
+int guarded;
+
+#endif
+
@@ -0,0 +1,5 @@
+// Different paths to the same file must not include it again
+#include "once.h"
+#include "../include_guard_test/once.h"
+#include "./guarded.h"
+#include "../include_guard_test/guarded.h"
@@ -0,0 +1,10 @@
+#include "guarded.h"
+#include "once.h"
+#include "after_endif.h"
+#include "guarded.h"
+#include "once.h"
+#include "after_endif.h"
+
+#undef GUARDED_H
+// The guard macro is not defined anymore, so this is included again
+#include "guarded.h"
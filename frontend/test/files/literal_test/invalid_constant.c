@@ -0,0 +1,3 @@
+#define UNUSED 1uu
+
+int n = 1lul;
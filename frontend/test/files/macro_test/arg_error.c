@@ -0,0 +1,2 @@
+#define ID(x) x
+int a = ID(1 2);
@@ -0,0 +1,14 @@
+#define NIL(x) x
+#define G_0(arg) NIL(G_1)(arg)
+#define G_1(arg) NIL(arg)
+#define f(a) a * g
+#define g(a) f(a)
+#define obj fn
+#define fn(x) x obj
+
+a = G_0(42);
+b = f(2)(9);
+c = obj(1)(2);
+#define self self
+#define id(x) x
+d = id(id(self));
@@ -0,0 +1,8 @@
+#define ID(x) x
+#define ADD(a, b) a + b
+#define SELF(x) x SELF
+#define ONE 1
+x = ID(ADD
+)(ONE,
+  2) + ONE;
+y = SELF(1)(2);
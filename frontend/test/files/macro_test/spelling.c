@@ -0,0 +1,3 @@
+#define TWO 2
+#define SUM(a, b) (a + b + TWO)
+int n = SUM(1, n);
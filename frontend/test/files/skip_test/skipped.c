@@ -0,0 +1,23 @@
+#if 0
+/*
+#endif
+*/
+// #endif \
+#endif
+const char* s = "#endif";
+char c = '"';
+#define X 1 \
+  #endif
+#if 1
+#endif
+#elif 0
+not code
+#else
+int a;
+#endif
+#ifdef UNDEFINED
+"unterminated
+x \
+y
+#endif
+int b;
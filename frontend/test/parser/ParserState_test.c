@@ -11,19 +11,17 @@ TEST(ParserState) {
     uint32_t val_indices[] = {
         0,
     };
-    SourceLoc locs[] = {
-        {0, {0, 0}},
-    };
-    StrBuf identifiers[] = {
-        STR_BUF_NON_HEAP("Test"),
+    uint32_t locs[] = {
+        0,
     };
+    StringPool identifiers = StringPool_create(1);
+    StringPool_add(&identifiers, STR_LIT("Test"));
     TokenArr dummy_arr = {
         .len = 1,
         .cap = 1,
         .kinds = kinds,
         .val_indices = val_indices,
         .locs = locs,
-        .identifiers_len = 1,
         .identifiers = identifiers,
     };
     ParserErr err = ParserErr_create();
@@ -115,8 +113,56 @@ TEST(ParserState) {
         StrBuf_free(&dummy_strings[i]);
     }
     ParserState_free(&s);
+    StringPool_free(&identifiers);
+}
+
+TEST(shadowing) {
+    TokenArr arr = TokenArr_create_empty();
+    ParserErr err = ParserErr_create();
+    ParserState s = ParserState_create(&arr, &err);
+
+    enum {
+        NUM_SCOPES = 50,
+        ID_IDX = 1000,
+    };
+    ASSERT(ParserState_register_typedef(&s, ID_IDX, 0));
+    for (uint32_t i = 1; i != NUM_SCOPES; ++i) {
+        ParserState_push_scope(&s);
+        if (i % 2 == 0) {
+            ASSERT(ParserState_register_typedef(&s, ID_IDX, i));
+        } else {
+            ASSERT(ParserState_register_enum_constant(&s, ID_IDX, i));
+        }
+        ASSERT(ParserState_is_typedef(&s, ID_IDX) == (i % 2 == 0));
+        ASSERT(ParserState_is_enum_constant(&s, ID_IDX) == (i % 2 != 0));
+    }
+    ASSERT(err.kind == PARSER_ERR_NONE);
+
+    // Redefinition in the innermost scope reports the innermost binding
+    ASSERT(!ParserState_register_typedef(&s, ID_IDX, NUM_SCOPES));
+    ASSERT(err.kind == PARSER_ERR_REDEFINED_SYMBOL);
+    ASSERT_UINT(err.err_token_idx, NUM_SCOPES);
+    ASSERT_UINT(err.prev_def_idx, NUM_SCOPES - 1);
+    ASSERT(!err.was_typedef_name);
+    err = ParserErr_create();
+
+    for (uint32_t i = NUM_SCOPES - 1; i != 0; --i) {
+        ParserState_pop_scope(&s);
+        const uint32_t outer = i - 1;
+        ASSERT(ParserState_is_typedef(&s, ID_IDX) == (outer % 2 == 0));
+        ASSERT(ParserState_is_enum_constant(&s, ID_IDX) == (outer % 2 != 0));
+    }
+    ASSERT(s._len == 1);
+    ASSERT(!ParserState_is_typedef(&s, ID_IDX - 1));
+    ASSERT(!ParserState_is_typedef(&s, ID_IDX + 1));
+    ASSERT(err.kind == PARSER_ERR_NONE);
+
+    TokenArr_free(&s._arr);
+    ParserState_free(&s);
+    TokenArr_free(&arr);
 }
 
 TEST_SUITE_BEGIN(ParserState){
     REGISTER_TEST(ParserState),
+    REGISTER_TEST(shadowing),
 } TEST_SUITE_END()
@@ -9,21 +9,120 @@ TEST(redefine_typedef_error) {
                                                      "typedef char MyInt;\n"),
                                              STR_LIT("a file"), &(PreprocInitialStrings){0});
 
-    ParserErr err = ParserErr_create();
-
-    AST ast = parse_ast(&preproc_res.toks, &err);
-    ASSERT_UINT(ast.len, 0);
-    ASSERT(err.kind == PARSER_ERR_REDEFINED_SYMBOL);
-    ASSERT(err.was_typedef_name);
-    const uint32_t val_idx = ast.toks.val_indices[err.err_token_idx];
-    const Str got_spell = StrBuf_as_str(
-        &ast.toks.identifiers[val_idx]);
+    ParserErrArr errs = ParserErrArr_create();
+
+    AST ast = parse_ast(&preproc_res.toks, &errs);
+    ASSERT_UINT(errs.len, 1);
+    const ParserErr* err = &errs.errs[0];
+    ASSERT(err->kind == PARSER_ERR_REDEFINED_SYMBOL);
+    ASSERT(err->was_typedef_name);
+    const uint32_t val_idx = ast.toks.val_indices[err->err_token_idx];
+    const Str got_spell = StringPool_get(&ast.toks.identifiers, val_idx);
     ASSERT_STR(got_spell, STR_LIT("MyInt"));
+    ASSERT(ast.kinds[ast.len - 1] == AST_ERROR);
+
+    ParserErrArr_free(&errs);
+    AST_free(&ast);
+    TestPreprocRes_free(&preproc_res);
+}
+
+static uint32_t count_nodes(const AST* ast, ASTNodeKind kind) {
+    uint32_t res = 0;
+    for (uint32_t i = 0; i != ast->len; ++i) {
+        if (ast->kinds[i] == kind) {
+            ++res;
+        }
+    }
+    return res;
+}
+
+TEST(recover_multiple_errors) {
+    TestPreprocRes preproc_res = tokenize_string(
+        STR_LIT("int f(void) {\n"
+                "    int a = ;\n"
+                "    a = 1 + ;\n"
+                "    if (a) {\n"
+                "        a = (1 + 2;\n"
+                "    }\n"
+                "    return a;\n"
+                "}\n"
+                "struct S { int x +; } s;\n"
+                "int g(void) {\n"
+                "    return 0;\n"
+                "}\n"),
+        STR_LIT("a file"),
+        &(PreprocInitialStrings){0});
+
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&preproc_res.toks, &errs);
+    ASSERT_UINT(errs.len, 4);
+    static const TokenKind got[] = {
+        TOKEN_SEMICOLON,
+        TOKEN_SEMICOLON,
+        TOKEN_SEMICOLON,
+        TOKEN_ADD,
+    };
+    for (uint32_t i = 0; i != errs.len; ++i) {
+        const ParserErr* err = &errs.errs[i];
+        ASSERT(err->kind == PARSER_ERR_EXPECTED_TOKENS);
+        ASSERT_TOKEN_KIND(ast.toks.kinds[err->err_token_idx], got[i]);
+    }
+    ASSERT_UINT(count_nodes(&ast, AST_ERROR), 4);
+    // Both function definitions remain, only the items with errors are
+    // replaced
+    ASSERT_UINT(count_nodes(&ast, AST_FUNC_DEF), 2);
+    ASSERT_UINT(count_nodes(&ast, AST_RETURN_STATEMENT), 2);
+
+    ParserErrArr_free(&errs);
+    AST_free(&ast);
+    TestPreprocRes_free(&preproc_res);
+}
+
+TEST(unclosed_block_error) {
+    TestPreprocRes preproc_res = tokenize_string(
+        STR_LIT("int f(void) {\n"
+                "    {\n"
+                "        int a;\n"),
+        STR_LIT("a file"),
+        &(PreprocInitialStrings){0});
+
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&preproc_res.toks, &errs);
+    // The end of the file is only reported once, not for every open block
+    ASSERT_UINT(errs.len, 1);
+    ASSERT(errs.errs[0].kind == PARSER_ERR_EXPECTED_TOKENS);
+    ASSERT_UINT(errs.errs[0].err_token_idx, ast.toks.len);
+
+    ParserErrArr_free(&errs);
+    AST_free(&ast);
+    TestPreprocRes_free(&preproc_res);
+}
+
+// Errors at macro arguments are reported where the argument was written, not
+// at the parameter in the macro definition
+TEST(macro_arg_error) {
+    TestPreprocRes preproc_res = tokenize(
+        CSTR_LIT("../frontend/test/files/macro_test/arg_error.c"));
+
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&preproc_res.toks, &errs);
+    ASSERT_UINT(errs.len, 1);
+    const ParserErr* err = &errs.errs[0];
+    ASSERT(err->kind == PARSER_ERR_EXPECTED_TOKENS);
+    ASSERT_TOKEN_KIND(ast.toks.kinds[err->err_token_idx], TOKEN_I_CONSTANT);
+    ASSERT(!TokenArr_is_expanded(&ast.toks, err->err_token_idx));
+    const SourceLoc loc = TokenArr_loc(&ast.toks, err->err_token_idx);
+    ASSERT_UINT(loc.file_loc.line, (uint32_t)2);
+    ASSERT_UINT(loc.file_loc.index, (uint32_t)14);
 
+    ParserErrArr_free(&errs);
     AST_free(&ast);
     TestPreprocRes_free(&preproc_res);
 }
 
 TEST_SUITE_BEGIN(parser_error){
     REGISTER_TEST(redefine_typedef_error),
+    REGISTER_TEST(recover_multiple_errors),
+    REGISTER_TEST(unclosed_block_error),
+    REGISTER_TEST(macro_arg_error),
 } TEST_SUITE_END()
@@ -2,6 +2,8 @@
 
 #include "frontend/ast/ast_serializer.h"
 
+#include "frontend/preproc/preproc.h"
+
 #include "util/StrBuf.h"
 
 #include "../test_helpers.h"
@@ -36,20 +38,20 @@ static void compare_tokens(const TokenArr* got, const TokenArr* ex) {
         const uint32_t ex_val_idx = ex->val_indices[i];
         switch (got->kinds[i]) {
             case TOKEN_IDENTIFIER:
-                ASSERT_STR(StrBuf_as_str(&got->identifiers[got_val_idx]),
-                           StrBuf_as_str(&ex->identifiers[ex_val_idx]));
+                ASSERT_STR(StringPool_get(&got->identifiers, got_val_idx),
+                           StringPool_get(&ex->identifiers, ex_val_idx));
                 break;
             case TOKEN_I_CONSTANT:
-                compare_int_vals(&got->int_consts[got_val_idx],
-                                 &ex->int_consts[ex_val_idx]);
+                compare_int_vals(TokenArr_int_const(got, i, NULL),
+                                 TokenArr_int_const(ex, i, NULL));
                 break;
             case TOKEN_F_CONSTANT:
-                compare_float_vals(&got->float_consts[got_val_idx],
-                                   &ex->float_consts[ex_val_idx]);
+                compare_float_vals(TokenArr_float_const(got, i, NULL),
+                                   TokenArr_float_const(ex, i, NULL));
                 break;
             case TOKEN_STRING_LITERAL:
-                compare_str_lits(&got->str_lits[got_val_idx],
-                                 &ex->str_lits[ex_val_idx]);
+                compare_str_lits(TokenArr_str_lit(got, i, NULL),
+                                 TokenArr_str_lit(ex, i, NULL));
                 break;
             default:
                 break;
@@ -88,9 +90,9 @@ TEST(no_preproc) {
     const CStr file = CSTR_LIT("../frontend/test/files/no_preproc.c");
     TestPreprocRes res = tokenize(file);
 
-    ParserErr err = ParserErr_create();
-    AST ast = parse_ast(&res.toks, &err);
-    ASSERT(err.kind == PARSER_ERR_NONE);
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&res.toks, &errs);
+    ASSERT_UINT(errs.len, 0);
 
     compare_with_ex_file(
         &ast,
@@ -104,9 +106,9 @@ TEST(parser_testfile) {
     const CStr file = CSTR_LIT("../frontend/test/files/parser_testfile.c");
     TestPreprocRes res = tokenize(file);
 
-    ParserErr err = ParserErr_create();
-    AST ast = parse_ast(&res.toks, &err);
-    ASSERT(err.kind == PARSER_ERR_NONE);
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&res.toks, &errs);
+    ASSERT_UINT(errs.len, 0);
 
     compare_with_ex_file(
         &ast,
@@ -120,14 +122,157 @@ TEST(large_testfile) {
     const CStr file = CSTR_LIT("../frontend/test/files/large_testfile.c");
     TestPreprocRes res = tokenize(file);
 
-    ParserErr err = ParserErr_create();
-    AST ast = parse_ast(&res.toks, &err);
-    ASSERT(err.kind == PARSER_ERR_NONE);
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&res.toks, &errs);
+    ASSERT_UINT(errs.len, 0);
+
+    compare_with_ex_file(
+        &ast,
+        &res.file_info,
+        CSTR_LIT("../frontend/test/files/large_testfile.c.binast"));
+    TestPreprocRes_free(&res);
+    AST_free(&ast);
+}
+
+TEST(large_testfile_stream) {
+    const CStr file = CSTR_LIT("../frontend/test/files/large_testfile.c");
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    IncludeCache* include_cache = IncludeCache_create();
+    PreprocErr preproc_err = PreprocErr_create();
+    PreprocStream stream = PreprocStream_create(file,
+                                                NULL,
+                                                0,
+                                                NULL,
+                                                include_cache,
+                                                &info,
+                                                &preproc_err);
+    ASSERT(preproc_err.kind == PREPROC_ERR_NONE);
+
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast_stream(&stream, &errs);
+    ASSERT(PreprocStream_over(&stream));
+    PreprocRes res = PreprocStream_close(&stream);
+    ASSERT(preproc_err.kind == PREPROC_ERR_NONE);
+    ASSERT_UINT(errs.len, 0);
 
     compare_with_ex_file(
         &ast,
         &res.file_info,
         CSTR_LIT("../frontend/test/files/large_testfile.c.binast"));
+    PreprocRes_free(&res);
+    IncludeCache_free(include_cache);
+    AST_free(&ast);
+}
+
+TEST(large_testfile_incremental) {
+    const CStr file = CSTR_LIT("../frontend/test/files/large_testfile.c");
+    const CStr prev_file = CSTR_LIT(
+        "../frontend/test/files/large_testfile.c.binast");
+    TestPreprocRes res = tokenize(file);
+
+    File f = File_open(prev_file, FILE_READ | FILE_BINARY);
+    DeserializeASTRes prev = deserialize_ast(f);
+    File_close(f);
+
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast_incremental(&res.toks, &prev.ast, &errs);
+    ASSERT_UINT(errs.len, 0);
+
+    compare_with_ex_file(&ast, &res.file_info, prev_file);
+    TestPreprocRes_free(&res);
+    FileInfo_free(&prev.file_info);
+    AST_free(&prev.ast);
+    AST_free(&ast);
+}
+
+static void compare_asts(const AST* got, const AST* ex) {
+    ASSERT_UINT(got->len, ex->len);
+    ASSERT(memcmp(got->kinds, ex->kinds, sizeof *got->kinds * got->len) == 0);
+    ASSERT(memcmp(got->datas, ex->datas, sizeof *got->datas * got->len) == 0);
+    ASSERT_UINT(got->type_data_len, ex->type_data_len);
+}
+
+TEST(incremental_changed_decls) {
+    TestPreprocRes prev_res = tokenize_string(
+        STR_LIT("int T;\n"
+                "int f(int a, int b) {\n"
+                "    T * a;\n"
+                "    return a + b * 2;\n"
+                "}\n"
+                "int g(int a, int b) {\n"
+                "    return a * b + f(a, b);\n"
+                "}\n"
+                "int h(int a, int b) {\n"
+                "    int c = a * b;\n"
+                "    return c + f(a, b);\n"
+                "}\n"),
+        STR_LIT("a file"),
+        &(PreprocInitialStrings){0});
+    ParserErrArr errs = ParserErrArr_create();
+    AST prev = parse_ast(&prev_res.toks, &errs);
+    ASSERT_UINT(errs.len, 0);
+
+    // T becomes a typedef name, so f has to be parsed again even though its
+    // tokens did not change
+    const Str code = STR_LIT("typedef int T;\n"
+                             "int f(int a, int b) {\n"
+                             "    T * a;\n"
+                             "    return a + b * 2;\n"
+                             "}\n"
+                             "int inserted(int a, int b) {\n"
+                             "    return a - b;\n"
+                             "}\n"
+                             "int h(int x, int y) {\n"
+                             "    int c = x * y;\n"
+                             "    return c + f(x, y);\n"
+                             "}\n"
+                             "int g(int a, int b) {\n"
+                             "    return a * b - f(a, b);\n"
+                             "}\n");
+    TestPreprocRes res = tokenize_string(code,
+                                         STR_LIT("a file"),
+                                         &(PreprocInitialStrings){0});
+    AST ast = parse_ast_incremental(&res.toks, &prev, &errs);
+    ASSERT_UINT(errs.len, 0);
+
+    TestPreprocRes ex_res = tokenize_string(code,
+                                            STR_LIT("a file"),
+                                            &(PreprocInitialStrings){0});
+    AST ex = parse_ast(&ex_res.toks, &errs);
+    ASSERT_UINT(errs.len, 0);
+    compare_asts(&ast, &ex);
+
+    TestPreprocRes_free(&prev_res);
+    TestPreprocRes_free(&res);
+    TestPreprocRes_free(&ex_res);
+    AST_free(&prev);
+    AST_free(&ast);
+    AST_free(&ex);
+}
+
+TEST(serialize_invalid_constant) {
+    const CStr file = CSTR_LIT(
+        "../frontend/test/files/literal_test/invalid_constant.c");
+    TestPreprocRes res = tokenize(file);
+
+    ParserErrArr errs = ParserErrArr_create();
+    AST ast = parse_ast(&res.toks, &errs);
+    ASSERT_UINT(errs.len, 0);
+
+    // The constant in the unused macro is not written, so only the one in the
+    // declaration is reported, at the location of its token
+    File f = File_open_tmp();
+    ASSERT(File_valid(f));
+    PreprocErr err = PreprocErr_create();
+    ASSERT(!serialize_ast(&ast, &res.file_info, f, &err));
+    ASSERT(err.kind == PREPROC_ERR_INT_CONST);
+    ASSERT_STR(err.constant_spell, STR_LIT("1lul"));
+    ASSERT_UINT(err.base.loc.file_idx, (uint32_t)0);
+    ASSERT_UINT(err.base.loc.file_loc.line, (uint32_t)3);
+    ASSERT_UINT(err.base.loc.file_loc.index, (uint32_t)9);
+
+    File_close(f);
+    PreprocErr_free(&err);
     TestPreprocRes_free(&res);
     AST_free(&ast);
 }
@@ -136,4 +281,8 @@ TEST_SUITE_BEGIN(parser_file){
     REGISTER_TEST(no_preproc),
     REGISTER_TEST(parser_testfile),
     REGISTER_TEST(large_testfile),
+    REGISTER_TEST(large_testfile_stream),
+    REGISTER_TEST(large_testfile_incremental),
+    REGISTER_TEST(incremental_changed_decls),
+    REGISTER_TEST(serialize_invalid_constant),
 } TEST_SUITE_END()
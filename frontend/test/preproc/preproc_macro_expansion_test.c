@@ -2,6 +2,8 @@
 #include "frontend/preproc/preproc.h"
 #include "frontend/preproc/PreprocMacro.h"
 
+#include "util/mem.h"
+
 #include "testing/asserts.h"
 
 #include "../test_helpers.h"
@@ -33,7 +35,19 @@ static void test_preproc_macro(const PreprocMacro* macro,
     // Creation initializes with a size so we need to free this before replacing it
     PreprocTokenValList_free(&state.vals);
     state.vals = res.vals;
-    PreprocState_register_macro(&state, macro_id_idx, macro);
+    // The macro was not defined in the input, so it has no locations of its
+    // own
+    PreprocMacro defined = *macro;
+    SourceLoc* def_locs = mycc_alloc_or_null(sizeof *def_locs
+                                             * macro->expansion_len);
+    for (uint32_t i = 0; i < macro->expansion_len; ++i) {
+        def_locs[i] = (SourceLoc){0, {0, 0}};
+    }
+    defined.spellings_idx = SourceLocTable_add_macro(&state.vals.loc_table,
+                                                     def_locs,
+                                                     macro->expansion_len);
+    mycc_free(def_locs);
+    PreprocState_register_macro(&state, macro_id_idx, &defined);
 
     ASSERT(expand_all_macros(&state, &state.toks, 0, &info));
     ASSERT(err.kind == PREPROC_ERR_NONE);
@@ -71,9 +85,6 @@ static void test_preproc_macro(const PreprocMacro* macro,
     }
     FileInfo_free(&res.file_info);
     PreprocRes_free_preproc_tokens(&expected);
-    // Zero macros so the stack allocated macros are not freed
-    memset(state._macro_map._macros, 0,
-           sizeof *state._macro_map._macros * state._macro_map._cap);
     PreprocState_free(&state);
 }
 
@@ -580,10 +591,68 @@ TEST(expand_func_like_variadic) {
                        STR_LIT("m = 1, 2, 3, 4;"));
 }
 
+TEST(loc_table_overflow) {
+    SourceLocTable t = SourceLocTable_create();
+    const SourceLoc loc = {0, {1, 5}};
+    const uint32_t first = SourceLocTable_add(&t, loc);
+    const SourceLoc far = {0, {2, SOURCE_LOC_UNKNOWN - 1}};
+    ASSERT_UINT(SourceLocTable_add(&t, far), SOURCE_LOC_UNKNOWN);
+    const SourceLoc unknown = SourceLocTable_get(&t, SOURCE_LOC_UNKNOWN);
+    ASSERT_UINT(unknown.file_idx, (uint32_t)0);
+    ASSERT_UINT(unknown.file_loc.line, (uint32_t)0);
+    ASSERT_UINT(unknown.file_loc.index, (uint32_t)0);
+    // Locations that still fit are unaffected
+    const SourceLoc got = SourceLocTable_get(&t, first);
+    ASSERT_UINT(got.file_loc.line, (uint32_t)1);
+    ASSERT_UINT(got.file_loc.index, (uint32_t)5);
+    ASSERT_UINT(SourceLocTable_get(&t, SourceLocTable_add(&t, loc))
+                    .file_loc.index,
+                (uint32_t)5);
+
+    const SourceLoc def_loc = {0, {1, 0}};
+    const uint32_t spellings_idx = SourceLocTable_add_macro(&t, &def_loc, 1);
+    const uint32_t exp = SourceLocTable_add_expansion(&t,
+                                                      loc,
+                                                      spellings_idx,
+                                                      1);
+    const uint32_t exp_loc = SourceLocTable_add(
+        &t,
+        (SourceLoc){SOURCE_LOC_EXPANSION_FILE_IDX, {exp, 0}});
+    ASSERT(exp_loc != SOURCE_LOC_UNKNOWN);
+
+    // Expansions that do not fit are still resolved to their invocation
+    t.exp_end = SOURCE_LOC_UNKNOWN - 1;
+    const uint32_t full_exp = SourceLocTable_add_expansion(&t,
+                                                           loc,
+                                                           spellings_idx,
+                                                           1);
+    const SourceLoc full_exp_loc = {SOURCE_LOC_EXPANSION_FILE_IDX,
+                                    {full_exp, 0}};
+    ASSERT_UINT(SourceLocTable_add(&t, full_exp_loc), SOURCE_LOC_UNKNOWN);
+    ASSERT_UINT(SourceLocTable_resolve(&t, full_exp_loc).file_loc.index,
+                (uint32_t)5);
+    ASSERT_UINT(SourceLocTable_get(&t, exp_loc).file_loc.index, (uint32_t)5);
+    ASSERT_UINT(t.exp_end, SOURCE_LOC_UNKNOWN - 1);
+
+    // Later expansions do not get offsets either, so the starts stay
+    // ascending
+    t.exp_end = 1;
+    const uint32_t later_exp = SourceLocTable_add_expansion(&t,
+                                                            loc,
+                                                            spellings_idx,
+                                                            1);
+    const SourceLoc later_exp_loc = {SOURCE_LOC_EXPANSION_FILE_IDX,
+                                     {later_exp, 0}};
+    ASSERT_UINT(SourceLocTable_add(&t, later_exp_loc), SOURCE_LOC_UNKNOWN);
+
+    SourceLocTable_free(&t);
+}
+
 TEST_SUITE_BEGIN(preproc_macro_expansion){
     REGISTER_TEST(expand_obj_like),
     REGISTER_TEST(expand_obj_like_empty),
     REGISTER_TEST(expand_recursive),
     REGISTER_TEST(expand_func_like),
     REGISTER_TEST(expand_func_like_variadic),
+    REGISTER_TEST(loc_table_overflow),
 } TEST_SUITE_END()
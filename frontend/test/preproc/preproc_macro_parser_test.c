@@ -1,8 +1,6 @@
 #include "frontend/Token.h"
 #include "frontend/preproc/PreprocMacro.h"
 
-#include "util/mem.h"
-
 #include "testing/asserts.h"
 
 #include "../test_helpers.h"
@@ -109,7 +107,8 @@ TEST(parse_obj_like) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 10, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 10, &arena, &err);
         ASSERT(err.kind == PREPROC_ERR_NONE);
 
         PreprocMacro ex = {
@@ -123,8 +122,7 @@ TEST(parse_obj_like) {
         };
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -228,7 +226,8 @@ TEST(parse_obj_like) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 13, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 13, &arena, &err);
 
         PreprocMacro ex = {
             .is_func_macro = false,
@@ -241,8 +240,7 @@ TEST(parse_obj_like) {
         };
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -398,12 +396,12 @@ TEST(parse_func_like) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         ASSERT(err.kind == PREPROC_ERR_NONE);
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -501,12 +499,12 @@ TEST(parse_func_like) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         ASSERT(err.kind == PREPROC_ERR_NONE);
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -572,12 +570,12 @@ TEST(parse_func_like) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 15, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 15, &arena, &err);
         ASSERT(err.kind == PREPROC_ERR_NONE);
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -740,12 +738,12 @@ TEST(parse_variadic) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         ASSERT(err.kind == PREPROC_ERR_NONE);
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -921,12 +919,12 @@ TEST(parse_variadic) {
         PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
 
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         ASSERT(err.kind == PREPROC_ERR_NONE);
 
         compare_preproc_macros(&got, &ex, &vals);
-        mycc_free(got.kinds);
-        mycc_free(got.vals);
+        MemArena_free(&arena);
 
         PreprocTokenValList_free(&vals);
     }
@@ -1069,9 +1067,11 @@ TEST(parse_duplicate_arg_name) {
     val_indices[8] = ID_IDX(1);
     {
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         is_zeroed_macro(&got);
         ASSERT(err.kind == PREPROC_ERR_DUPLICATE_MACRO_PARAM);
+        MemArena_free(&arena);
         const Str duplicate = IndexedStringSet_get(&vals.identifiers, err.duplicate_macro_arg_id_idx);
         ASSERT_STR(duplicate, STR_LIT("a"));
         ASSERT_UINT(err.base.loc.file_idx, 0);
@@ -1085,9 +1085,11 @@ TEST(parse_duplicate_arg_name) {
     val_indices[6] = ID_IDX(3);
     {
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         is_zeroed_macro(&got);
         ASSERT(err.kind == PREPROC_ERR_DUPLICATE_MACRO_PARAM);
+        MemArena_free(&arena);
         const Str duplicate = IndexedStringSet_get(&vals.identifiers, err.duplicate_macro_arg_id_idx);
         ASSERT_STR(duplicate, STR_LIT("c"));
         ASSERT_UINT(err.base.loc.file_idx, 0);
@@ -1098,9 +1100,11 @@ TEST(parse_duplicate_arg_name) {
     val_indices[6] = ID_IDX(1);
     {
         PreprocErr err = PreprocErr_create();
-        PreprocMacro got = parse_preproc_macro(&arr, 9, &err);
+        MemArena arena = MemArena_create(0);
+        PreprocMacro got = parse_preproc_macro(&arr, 9, &arena, &err);
         is_zeroed_macro(&got);
         ASSERT(err.kind == PREPROC_ERR_DUPLICATE_MACRO_PARAM);
+        MemArena_free(&arena);
         const Str duplicate = IndexedStringSet_get(&vals.identifiers, err.duplicate_macro_arg_id_idx);
         ASSERT_STR(duplicate, STR_LIT("a"));
         ASSERT_UINT(err.base.loc.file_idx, 0);
@@ -1192,7 +1196,8 @@ TEST(parse_obj_like_starting_with_bracket) {
     PreprocTokenValList_insert_initial_strings(&vals, &initial_strs);
     
     PreprocErr err = PreprocErr_create();
-    PreprocMacro got = parse_preproc_macro(&arr, 4, &err);
+    MemArena arena = MemArena_create(0);
+    PreprocMacro got = parse_preproc_macro(&arr, 4, &arena, &err);
 
     PreprocMacro ex = {
         .is_func_macro = false,
@@ -1205,8 +1210,7 @@ TEST(parse_obj_like_starting_with_bracket) {
     };
 
     compare_preproc_macros(&got, &ex, &vals);
-    mycc_free(got.kinds);
-    mycc_free(got.vals);
+    MemArena_free(&arena);
 
     PreprocTokenValList_free(&vals);
 }
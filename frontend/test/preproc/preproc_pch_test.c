@@ -0,0 +1,337 @@
+#include "testing/asserts.h"
+
+#include "frontend/preproc/preproc.h"
+#include "frontend/preproc/PreprocMacro.h"
+
+#include "../test_helpers.h"
+
+static PreprocPCH create_pch(CStr header, const ArchTypeInfo* info) {
+    PreprocErr err = PreprocErr_create();
+    PreprocPCH pch = preproc_create_pch(header,
+                                        NULL,
+                                        0,
+                                        NULL,
+                                        NULL,
+                                        info,
+                                        &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+    ASSERT(pch.toks.len != 0);
+    return pch;
+}
+
+static Str get_identifier(const PreprocTokenArr* toks,
+                          const PreprocTokenValList* vals,
+                          uint32_t idx) {
+    return IndexedStringSet_get(&vals->identifiers, toks->val_indices[idx]);
+}
+
+TEST(write_read) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    PreprocPCH pch = create_pch(
+        CSTR_LIT("../frontend/test/files/include_test/i1.h"),
+        &info);
+
+    File tmp = File_open_tmp();
+    ASSERT(File_valid(tmp));
+    ASSERT(PreprocPCH_write(&pch, tmp));
+    ASSERT(File_seek(tmp, 0, FILE_SEEK_START));
+    PreprocPCH read;
+    ASSERT(PreprocPCH_read(&read, tmp));
+    File_close(tmp);
+
+    ASSERT_UINT(read.file_info.len, pch.file_info.len);
+    for (uint32_t i = 0; i < pch.file_info.len; ++i) {
+        ASSERT_STR(FileInfo_get(&read.file_info, i),
+                   FileInfo_get(&pch.file_info, i));
+    }
+    ASSERT_UINT(read.toks.len, pch.toks.len);
+    for (uint32_t i = 0; i < pch.toks.len; ++i) {
+        ASSERT_UINT(read.toks.kinds[i], pch.toks.kinds[i]);
+        ASSERT_UINT(read.toks.val_indices[i], pch.toks.val_indices[i]);
+        ASSERT_UINT(read.toks.locs[i].file_idx, pch.toks.locs[i].file_idx);
+        ASSERT_UINT(read.toks.locs[i].file_loc.line,
+                    pch.toks.locs[i].file_loc.line);
+        ASSERT_UINT(read.toks.locs[i].file_loc.index,
+                    pch.toks.locs[i].file_loc.index);
+    }
+    const uint32_t num_ids = IndexedStringSet_len(&pch.vals.identifiers);
+    ASSERT_UINT(IndexedStringSet_len(&read.vals.identifiers), num_ids);
+    for (uint32_t i = 0; i < num_ids; ++i) {
+        ASSERT_STR(IndexedStringSet_get(&read.vals.identifiers, i),
+                   IndexedStringSet_get(&pch.vals.identifiers, i));
+    }
+    ASSERT_UINT(read.macro_map._cap, pch.macro_map._cap);
+
+    PreprocPCH_free(&read);
+    PreprocPCH_free(&pch);
+}
+
+// The PCH of i1.h must behave like the header was included before the first
+// line of start.c. Because of its include guard, the includes of i1.h in
+// start.c are then skipped, so the only difference to preprocessing start.c
+// on its own is that the header comes before "extern int n;"
+TEST(apply) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    PreprocPCH pch = create_pch(
+        CSTR_LIT("../frontend/test/files/include_test/i1.h"),
+        &info);
+
+    const CStr start_file = CSTR_LIT(
+        "../frontend/test/files/include_test/start.c");
+    PreprocErr err = PreprocErr_create();
+    PreprocRes with_pch = preproc(start_file,
+                                  &pch,
+                                  0,
+                                  NULL,
+                                  NULL,
+                                  &info,
+                                  &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+    PreprocRes without_pch = preproc(start_file,
+                                     NULL,
+                                     0,
+                                     NULL,
+                                     NULL,
+                                     &info,
+                                     &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+
+    // the files of the PCH come first
+    ASSERT(with_pch.file_info.len > pch.file_info.len);
+    for (uint32_t i = 0; i < pch.file_info.len; ++i) {
+        ASSERT_STR(FileInfo_get(&with_pch.file_info, i),
+                   FileInfo_get(&pch.file_info, i));
+    }
+    ASSERT_STR(FileInfo_get(&with_pch.file_info, pch.file_info.len),
+               CStr_as_str(start_file));
+
+    ASSERT_UINT(with_pch.toks.len, without_pch.toks.len);
+    enum {
+        // extern int n;
+        PREFIX_LEN = 4,
+    };
+    const uint32_t header_len = pch.toks.len;
+    for (uint32_t i = 0; i < with_pch.toks.len; ++i) {
+        uint32_t other_idx;
+        if (i < header_len) {
+            other_idx = i + PREFIX_LEN;
+        } else if (i < header_len + PREFIX_LEN) {
+            other_idx = i - header_len;
+        } else {
+            other_idx = i;
+        }
+        const uint8_t kind = with_pch.toks.kinds[i];
+        ASSERT_TOKEN_KIND(kind, without_pch.toks.kinds[other_idx]);
+        if (kind == TOKEN_IDENTIFIER) {
+            ASSERT_STR(get_identifier(&with_pch.toks, &with_pch.vals, i),
+                       get_identifier(&without_pch.toks,
+                                      &without_pch.vals,
+                                      other_idx));
+        }
+    }
+
+    PreprocRes_free(&with_pch);
+    PreprocRes_free(&without_pch);
+    PreprocPCH_free(&pch);
+}
+
+// Headers with #pragma once or an include guard that were included by the PCH
+// must not be included again, no matter which path leads to them
+static void check_apply_skips(CStr header, Str first_id, Str second_id) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    PreprocPCH pch = create_pch(header, &info);
+
+    PreprocErr err = PreprocErr_create();
+    PreprocRes res = preproc(
+        CSTR_LIT("../frontend/test/files/include_guard_test/other_paths.c"),
+        &pch,
+        0,
+        NULL,
+        NULL,
+        &info,
+        &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+
+    const Str ex_ids[] = {first_id, second_id};
+    // int <id>;
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_ids) * 3);
+    for (uint32_t i = 0; i < ARR_LEN(ex_ids); ++i) {
+        ASSERT_STR(get_identifier(&res.toks, &res.vals, i * 3 + 1), ex_ids[i]);
+    }
+
+    PreprocRes_free(&res);
+    PreprocPCH_free(&pch);
+}
+
+TEST(apply_skips_included) {
+    check_apply_skips(
+        CSTR_LIT("../frontend/test/files/include_guard_test/once.h"),
+        STR_LIT("once"),
+        STR_LIT("guarded"));
+    check_apply_skips(
+        CSTR_LIT("../frontend/test/files/include_guard_test/guarded.h"),
+        STR_LIT("guarded"),
+        STR_LIT("once"));
+}
+
+TEST(apply_stream) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    PreprocPCH pch = create_pch(
+        CSTR_LIT("../frontend/test/files/include_test/i1.h"),
+        &info);
+
+    const CStr start_file = CSTR_LIT(
+        "../frontend/test/files/include_test/start.c");
+    PreprocErr err = PreprocErr_create();
+    PreprocRes expected = preproc(start_file,
+                                  &pch,
+                                  0,
+                                  NULL,
+                                  NULL,
+                                  &info,
+                                  &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+
+    IncludeCache* include_cache = IncludeCache_create();
+    PreprocStream stream = PreprocStream_create(start_file,
+                                                &pch,
+                                                0,
+                                                NULL,
+                                                include_cache,
+                                                &info,
+                                                &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+    TokenArr tokens = TokenArr_create_empty();
+    while (!PreprocStream_over(&stream)) {
+        ASSERT(PreprocStream_read(&stream, &tokens, tokens.len + 1));
+    }
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+    PreprocStream_finish(&stream, &tokens);
+
+    // the tokens of the PCH must not be dropped and are converted like the
+    // tokens of the file
+    TokenArr ex_tokens = convert_preproc_tokens(&expected.toks,
+                                                &expected.vals,
+                                                &info,
+                                                &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+    ASSERT_UINT(tokens.len, ex_tokens.len);
+    for (uint32_t i = 0; i < tokens.len; ++i) {
+        ASSERT_TOKEN_KIND(tokens.kinds[i], ex_tokens.kinds[i]);
+        if (tokens.kinds[i] == TOKEN_IDENTIFIER) {
+            ASSERT_STR(StringPool_get(&tokens.identifiers,
+                                      tokens.val_indices[i]),
+                       StringPool_get(&ex_tokens.identifiers,
+                                      ex_tokens.val_indices[i]));
+        }
+    }
+
+    TokenArr_free(&tokens);
+    TokenArr_free(&ex_tokens);
+    PreprocRes stream_res = PreprocStream_close(&stream);
+    PreprocRes_free(&stream_res);
+    IncludeCache_free(include_cache);
+    PreprocRes_free(&expected);
+    PreprocPCH_free(&pch);
+}
+
+TEST(invalid_file) {
+    File tmp = File_open_tmp();
+    ASSERT(File_valid(tmp));
+    File_put_str_val(STR_LIT("not a precompiled header"), tmp);
+    ASSERT(File_seek(tmp, 0, FILE_SEEK_START));
+    PreprocPCH pch;
+    ASSERT(!PreprocPCH_read(&pch, tmp));
+    File_close(tmp);
+}
+
+static bool write_and_read(const PreprocPCH* pch) {
+    File tmp = File_open_tmp();
+    ASSERT(File_valid(tmp));
+    ASSERT(PreprocPCH_write(pch, tmp));
+    ASSERT(File_seek(tmp, 0, FILE_SEEK_START));
+    PreprocPCH read;
+    const bool res = PreprocPCH_read(&read, tmp);
+    File_close(tmp);
+    if (res) {
+        PreprocPCH_free(&read);
+    }
+    return res;
+}
+
+static PreprocMacro* find_func_macro(PreprocPCH* pch) {
+    for (uint32_t i = 0; i < pch->macro_map._cap; ++i) {
+        PreprocMacro* macro = &pch->macro_map._macros[i];
+        if (macro->is_func_macro) {
+            return macro;
+        }
+    }
+    ASSERT(false);
+    return NULL;
+}
+
+// Indices in the file are used without further checks, so out of range ones
+// must be rejected when reading it
+TEST(invalid_indices) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    PreprocPCH pch = create_pch(
+        CSTR_LIT("../frontend/test/files/macro_test/spelling.c"),
+        &info);
+    ASSERT(write_and_read(&pch));
+
+    uint32_t id_tok = 0;
+    while (pch.toks.kinds[id_tok] != TOKEN_IDENTIFIER) {
+        ++id_tok;
+    }
+    const uint32_t val_idx = pch.toks.val_indices[id_tok];
+    pch.toks.val_indices[id_tok] = IndexedStringSet_len(
+        &pch.vals.identifiers);
+    ASSERT(!write_and_read(&pch));
+    pch.toks.val_indices[id_tok] = val_idx;
+
+    pch.toks.locs[0].file_idx = pch.file_info.len;
+    ASSERT(!write_and_read(&pch));
+    pch.toks.locs[0].file_idx = 0;
+
+    pch.files[0].guard_id = IndexedStringSet_len(&pch.vals.identifiers);
+    ASSERT(!write_and_read(&pch));
+    pch.files[0].guard_id = UINT32_MAX;
+
+    // The expanded tokens refer to expansions that do not exist
+    SourceLocTable* t = &pch.vals.loc_table;
+    ASSERT(t->exps_len != 0);
+    const uint32_t exps_len = t->exps_len;
+    t->exps_len = 0;
+    ASSERT(!write_and_read(&pch));
+    t->exps_len = exps_len;
+
+    const uint32_t exp_spellings = t->exp_spellings[0];
+    t->exp_spellings[0] = t->spellings_len;
+    ASSERT(!write_and_read(&pch));
+    t->exp_spellings[0] = exp_spellings;
+
+    PreprocMacro* macro = find_func_macro(&pch);
+    const uint32_t spellings_idx = macro->spellings_idx;
+    macro->spellings_idx = UINT32_MAX;
+    ASSERT(!write_and_read(&pch));
+    macro->spellings_idx = spellings_idx;
+
+    const uint32_t num_args = macro->num_args;
+    macro->num_args = IndexedStringSet_len(&pch.vals.identifiers) + 1;
+    ASSERT(!write_and_read(&pch));
+    macro->num_args = 0;
+    ASSERT(!write_and_read(&pch));
+    macro->num_args = num_args;
+
+    ASSERT(write_and_read(&pch));
+    PreprocPCH_free(&pch);
+}
+
+TEST_SUITE_BEGIN(preproc_pch){
+    REGISTER_TEST(write_read),
+    REGISTER_TEST(apply),
+    REGISTER_TEST(apply_skips_included),
+    REGISTER_TEST(apply_stream),
+    REGISTER_TEST(invalid_file),
+    REGISTER_TEST(invalid_indices),
+} TEST_SUITE_END()
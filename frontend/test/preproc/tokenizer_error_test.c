@@ -124,9 +124,70 @@ TEST(preproc_token) {
     PreprocErr_free(&err);
 }
 
+TEST(invalid_constant) {
+    PreprocErr err = PreprocErr_create();
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    PreprocRes res = preproc(
+        CSTR_LIT("../frontend/test/files/literal_test/invalid_constant.c"),
+        NULL,
+        0,
+        NULL,
+        NULL,
+        &info,
+        &err);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+    // Constants are only converted when their value is needed, so the one in
+    // the unused macro is never looked at
+    TokenArr tokens = convert_preproc_tokens(&res.toks, &res.vals, &info, &err);
+    ASSERT_UINT(tokens.len, (uint32_t)5);
+    ASSERT(err.kind == PREPROC_ERR_NONE);
+
+    ASSERT_NULL(TokenArr_int_const(&tokens, 3, &err));
+    ASSERT(err.kind == PREPROC_ERR_INT_CONST);
+    ASSERT(err.int_const_err.kind == INT_CONST_ERR_U_BETWEEN_LS);
+    ASSERT_STR(err.constant_spell, STR_LIT("1lul"));
+    ASSERT_UINT(err.base.loc.file_idx, (uint32_t)0);
+    ASSERT_UINT(err.base.loc.file_loc.line, (uint32_t)3);
+    ASSERT_UINT(err.base.loc.file_loc.index, (uint32_t)9);
+
+    TokenArr_free(&tokens);
+    PreprocRes_free(&res);
+    PreprocErr_free(&err);
+}
+
+TEST(include_str_lit) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    StringPool str_spellings = StringPool_create(0);
+    const uint32_t idx = StringPool_add(&str_spellings, STR_LIT("<file.h>"));
+    TokenLiterals lits = TokenLiterals_create(&info,
+                                              StringPool_create(0),
+                                              StringPool_create(0),
+                                              str_spellings);
+    const SourceLoc loc = {
+        .file_idx = 0,
+        .file_loc = {2, 7},
+    };
+    PreprocErr err = PreprocErr_create();
+    ASSERT_NULL(TokenLiterals_str_lit(&lits, idx, loc, &err));
+    ASSERT(err.kind == PREPROC_ERR_INCLUDE_STR_LIT);
+    ASSERT_UINT(err.base.loc.file_loc.line, (uint32_t)2);
+    ASSERT_UINT(err.base.loc.file_loc.index, (uint32_t)7);
+    PreprocErr_free(&err);
+
+    // The error is reported again when the literal is already known invalid
+    err = PreprocErr_create();
+    ASSERT_NULL(TokenLiterals_str_lit(&lits, idx, loc, &err));
+    ASSERT(err.kind == PREPROC_ERR_INCLUDE_STR_LIT);
+    PreprocErr_free(&err);
+
+    TokenLiterals_free(&lits);
+}
+
 TEST_SUITE_BEGIN(tokenizer_error){
     REGISTER_TEST(unterminated_literal),
     REGISTER_TEST(invalid_identifier),
     REGISTER_TEST(invalid_number),
     REGISTER_TEST(preproc_token),
+    REGISTER_TEST(invalid_constant),
+    REGISTER_TEST(include_str_lit),
 } TEST_SUITE_END()
@@ -4,41 +4,27 @@
 
 #include "../test_helpers.h"
 
-static void check_token_arr_file(CStr filename, const TokenArr* expected);
-static void check_token_arr_str(CStr code, const TokenArr* expected);
+static void check_token_arr_file(CStr filename,
+                                 const TokenArr* expected,
+                                 const SourceLoc* ex_locs);
+static void check_token_arr_str(CStr code,
+                                const TokenArr* expected,
+                                const SourceLoc* ex_locs);
 
 static uint32_t TokenArr_add_identifier(TokenArr* arr, StrBuf id) {
-    const uint32_t idx = arr->identifiers_len;
-    ++arr->identifiers_len;
-    arr->identifiers = mycc_realloc(arr->identifiers, arr->identifiers_len * sizeof *arr->identifiers);
-    arr->identifiers[idx] = id;
-    return idx;
+    return StringPool_add(&arr->identifiers, StrBuf_as_str(&id));
 }
 
 static uint32_t TokenArr_add_str_lit(TokenArr* arr, StrLitKind kind, StrBuf buf) {
-    const uint32_t idx = arr->str_lits_len;
-    ++arr->str_lits_len;
-    arr->str_lits = mycc_realloc(arr->str_lits, arr->str_lits_len * sizeof *arr->str_lits);
-    arr->str_lits[idx] = (StrLit){
-        kind, buf,
-    };
-    return idx;
+    return TokenLiterals_add_str_lit(&arr->literals, (StrLit){kind, buf});
 }
 
 static uint32_t TokenArr_add_int_const(TokenArr* arr, IntVal val) {
-    const uint32_t idx = arr->int_consts_len;
-    ++arr->int_consts_len;
-    arr->int_consts = mycc_realloc(arr->int_consts, arr->int_consts_len * sizeof *arr->int_consts);
-    arr->int_consts[idx] = val;
-    return idx;
+    return TokenLiterals_add_int_const(&arr->literals, val);
 }
 
 static uint32_t TokenArr_add_float_const(TokenArr* arr, FloatVal val) {
-    const uint32_t idx = arr->float_consts_len;
-    ++arr->float_consts_len;
-    arr->float_consts = mycc_realloc(arr->float_consts, arr->float_consts_len * sizeof *arr->float_consts);
-    arr->float_consts[idx] = val;
-    return idx;
+    return TokenLiterals_add_float_const(&arr->literals, val);
 }
 
 TEST(simple) {
@@ -102,7 +88,7 @@ TEST(simple) {
     static_assert(EX_LEN == ARR_LEN(val_indices), "");
     static_assert(EX_LEN == ARR_LEN(locs), "");
     expected.len = expected.cap = EX_LEN;
-    check_token_arr_str(code, &expected);
+    check_token_arr_str(code, &expected, locs);
 }
 
 TEST(file) {
@@ -152,7 +138,6 @@ TEST(file) {
 #undef TOKEN_MACRO_INT_VAL
 #undef TOKEN_MACRO_FLOAT_VAL
     };
-    expected.locs = locs;
 
     enum {
         EX_LEN = ARR_LEN(kinds),
@@ -160,7 +145,7 @@ TEST(file) {
     static_assert(EX_LEN == ARR_LEN(val_indices), "");
     static_assert(EX_LEN == ARR_LEN(locs), "");
     expected.len = expected.cap = EX_LEN;
-    check_token_arr_file(filename, &expected);
+    check_token_arr_file(filename, &expected, locs);
 }
 
 TEST(include) {
@@ -192,7 +177,6 @@ TEST(include) {
 #undef TOKEN_MACRO
 #undef TOKEN_MACRO_IDENTIFIER
     };
-    expected.locs = locs;
 
     enum {
         EX_LEN = ARR_LEN(kinds),
@@ -201,7 +185,7 @@ TEST(include) {
     static_assert(EX_LEN == ARR_LEN(locs), "");
     expected.len = expected.cap = EX_LEN;
 
-    check_token_arr_file(filename, &expected);
+    check_token_arr_file(filename, &expected, locs);
 }
 
 TEST(preproc_if) {
@@ -245,7 +229,6 @@ TEST(preproc_if) {
 #undef TOKEN_MACRO_STR_LIT
 #undef TOKEN_MACRO_INT_VAL
     };
-    expected.locs = locs;
 
     enum {
         EX_LEN = ARR_LEN(kinds),
@@ -253,7 +236,316 @@ TEST(preproc_if) {
     static_assert(EX_LEN == ARR_LEN(val_indices), "");
     static_assert(EX_LEN == ARR_LEN(locs), "");
     expected.len = expected.cap = EX_LEN;
-    check_token_arr_file(filename, &expected);
+    check_token_arr_file(filename, &expected, locs);
+}
+
+TEST(include_guard) {
+    TestPreprocRes res = tokenize(
+        CSTR_LIT("../frontend/test/files/include_guard_test/start.c"));
+
+    // Files that are skipped are not opened, so they are not in file_info
+    const Str ex_files[] = {
+        STR_LIT("../frontend/test/files/include_guard_test/start.c"),
+        STR_LIT("../frontend/test/files/include_guard_test/guarded.h"),
+        STR_LIT("../frontend/test/files/include_guard_test/once.h"),
+        STR_LIT("../frontend/test/files/include_guard_test/after_endif.h"),
+        STR_LIT("../frontend/test/files/include_guard_test/after_endif.h"),
+        STR_LIT("../frontend/test/files/include_guard_test/guarded.h"),
+    };
+    ASSERT_UINT(res.file_info.len, ARR_LEN(ex_files));
+    for (uint32_t i = 0; i < ARR_LEN(ex_files); ++i) {
+        ASSERT_STR(FileInfo_get(&res.file_info, i), ex_files[i]);
+    }
+
+    const Str ex_ids[] = {
+        STR_LIT("guarded"),
+        STR_LIT("once"),
+        STR_LIT("after_endif"),
+        STR_LIT("after_endif"),
+        STR_LIT("guarded"),
+    };
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_ids) * 3);
+    for (uint32_t i = 0; i < ARR_LEN(ex_ids); ++i) {
+        const uint32_t idx = i * 3;
+        ASSERT_TOKEN_KIND(res.toks.kinds[idx], TOKEN_INT);
+        ASSERT_TOKEN_KIND(res.toks.kinds[idx + 1], TOKEN_IDENTIFIER);
+        ASSERT_STR(StringPool_get(&res.toks.identifiers,
+                                  res.toks.val_indices[idx + 1]),
+                   ex_ids[i]);
+        ASSERT_TOKEN_KIND(res.toks.kinds[idx + 2], TOKEN_SEMICOLON);
+    }
+    TestPreprocRes_free(&res);
+}
+
+TEST(include_guard_other_paths) {
+    TestPreprocRes res = tokenize(
+        CSTR_LIT("../frontend/test/files/include_guard_test/other_paths.c"));
+
+    const Str ex_files[] = {
+        STR_LIT("../frontend/test/files/include_guard_test/other_paths.c"),
+        STR_LIT("../frontend/test/files/include_guard_test/once.h"),
+        STR_LIT("../frontend/test/files/include_guard_test/./guarded.h"),
+    };
+    ASSERT_UINT(res.file_info.len, ARR_LEN(ex_files));
+    for (uint32_t i = 0; i < ARR_LEN(ex_files); ++i) {
+        ASSERT_STR(FileInfo_get(&res.file_info, i), ex_files[i]);
+    }
+
+    const Str ex_ids[] = {
+        STR_LIT("once"),
+        STR_LIT("guarded"),
+    };
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_ids) * 3);
+    for (uint32_t i = 0; i < ARR_LEN(ex_ids); ++i) {
+        ASSERT_STR(StringPool_get(&res.toks.identifiers,
+                                  res.toks.val_indices[i * 3 + 1]),
+                   ex_ids[i]);
+    }
+    TestPreprocRes_free(&res);
+}
+
+static void check_skip_inactive(CStr path) {
+    TestPreprocRes res = tokenize(path);
+
+    const Str ex_ids[] = {
+        STR_LIT("a"),
+        STR_LIT("b"),
+    };
+    const uint32_t ex_lines[] = {16, 23};
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_ids) * 3);
+    for (uint32_t i = 0; i < ARR_LEN(ex_ids); ++i) {
+        const uint32_t idx = i * 3;
+        ASSERT_TOKEN_KIND(res.toks.kinds[idx], TOKEN_INT);
+        ASSERT_TOKEN_KIND(res.toks.kinds[idx + 1], TOKEN_IDENTIFIER);
+        ASSERT_STR(StringPool_get(&res.toks.identifiers,
+                                  res.toks.val_indices[idx + 1]),
+                   ex_ids[i]);
+        ASSERT_TOKEN_KIND(res.toks.kinds[idx + 2], TOKEN_SEMICOLON);
+        ASSERT_UINT(TokenArr_loc(&res.toks, idx).file_loc.line, ex_lines[i]);
+    }
+    TestPreprocRes_free(&res);
+}
+
+// Directives in comments, literals and spliced lines of inactive regions must
+// not end them, and skipped lines must still be counted
+TEST(skip_inactive) {
+    check_skip_inactive(CSTR_LIT("../frontend/test/files/skip_test/skipped.c"));
+    // Same file with "\r\n" line endings
+    check_skip_inactive(
+        CSTR_LIT("../frontend/test/files/skip_test/skipped_crlf.c"));
+}
+
+// Macro names produced by an expansion take their arguments from the tokens
+// after it, which may be on the following lines
+TEST(macro_rescan) {
+    TestPreprocRes res = tokenize(
+        CSTR_LIT("../frontend/test/files/macro_test/rescan.c"));
+
+    const TokenKind ex_kinds[] = {
+        TOKEN_IDENTIFIER,
+        TOKEN_ASSIGN,
+        TOKEN_I_CONSTANT,
+        TOKEN_ADD,
+        TOKEN_I_CONSTANT,
+        TOKEN_ADD,
+        TOKEN_I_CONSTANT,
+        TOKEN_SEMICOLON,
+        TOKEN_IDENTIFIER,
+        TOKEN_ASSIGN,
+        TOKEN_I_CONSTANT,
+        TOKEN_IDENTIFIER,
+        TOKEN_LBRACKET,
+        TOKEN_I_CONSTANT,
+        TOKEN_RBRACKET,
+        TOKEN_SEMICOLON,
+    };
+    const uint32_t ex_lines[] = {5, 5, 6, 5, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8};
+    static_assert(ARR_LEN(ex_kinds) == ARR_LEN(ex_lines), "");
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_kinds));
+    for (uint32_t i = 0; i < ARR_LEN(ex_kinds); ++i) {
+        ASSERT_TOKEN_KIND(res.toks.kinds[i], ex_kinds[i]);
+        ASSERT_UINT(TokenArr_loc(&res.toks, i).file_loc.line, ex_lines[i]);
+    }
+    // The macro is still being expanded when its own name is reached
+    ASSERT_STR(StringPool_get(&res.toks.identifiers, res.toks.val_indices[11]),
+               STR_LIT("SELF"));
+    TestPreprocRes_free(&res);
+}
+
+TEST(macro_hide_set) {
+    TestPreprocRes res = tokenize(
+        CSTR_LIT("../frontend/test/files/macro_test/hide_set.c"));
+
+    const TokenKind ex_kinds[] = {
+        TOKEN_IDENTIFIER,
+        TOKEN_ASSIGN,
+        TOKEN_I_CONSTANT,
+        TOKEN_SEMICOLON,
+        TOKEN_IDENTIFIER,
+        TOKEN_ASSIGN,
+        TOKEN_I_CONSTANT,
+        TOKEN_ASTERISK,
+        TOKEN_I_CONSTANT,
+        TOKEN_ASTERISK,
+        TOKEN_IDENTIFIER,
+        TOKEN_SEMICOLON,
+        TOKEN_IDENTIFIER,
+        TOKEN_ASSIGN,
+        TOKEN_I_CONSTANT,
+        TOKEN_IDENTIFIER,
+        TOKEN_LBRACKET,
+        TOKEN_I_CONSTANT,
+        TOKEN_RBRACKET,
+        TOKEN_SEMICOLON,
+        TOKEN_IDENTIFIER,
+        TOKEN_ASSIGN,
+        TOKEN_IDENTIFIER,
+        TOKEN_SEMICOLON,
+    };
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_kinds));
+    for (uint32_t i = 0; i < ARR_LEN(ex_kinds); ++i) {
+        ASSERT_TOKEN_KIND(res.toks.kinds[i], ex_kinds[i]);
+    }
+    // Names that are only hidden for some of the tokens of a call are not
+    // expanded by those tokens
+    const struct {
+        uint32_t idx;
+        Str name;
+    } ex_names[] = {
+        {10, STR_LIT("g")},
+        {15, STR_LIT("fn")},
+        {22, STR_LIT("self")},
+    };
+    for (uint32_t i = 0; i < ARR_LEN(ex_names); ++i) {
+        const uint32_t val_idx = res.toks.val_indices[ex_names[i].idx];
+        ASSERT_STR(StringPool_get(&res.toks.identifiers, val_idx),
+                   ex_names[i].name);
+    }
+    TestPreprocRes_free(&res);
+}
+
+// Expanded tokens are located at the outermost macro invocation, but still
+// know where they were spelled in the macro definitions, while argument tokens
+// keep their own locations
+TEST(macro_spelling_locs) {
+    TestPreprocRes res = tokenize(
+        CSTR_LIT("../frontend/test/files/macro_test/spelling.c"));
+
+    // int n = (1 + n + 2);
+    const struct {
+        uint32_t line, index;
+    } ex_locs[] = {
+        {3, 1},
+        {3, 5},
+        {3, 7},
+        {3, 9},
+        {3, 13},
+        {3, 9},
+        {3, 16},
+        {3, 9},
+        {3, 9},
+        {3, 9},
+        {3, 18},
+    }, ex_spellings[] = {
+        {3, 1},
+        {3, 5},
+        {3, 7},
+        {2, 19},
+        {3, 13},
+        {2, 22},
+        {3, 16},
+        {2, 26},
+        {1, 13},
+        {2, 31},
+        {3, 18},
+    };
+    static_assert(ARR_LEN(ex_locs) == ARR_LEN(ex_spellings), "");
+    ASSERT_UINT(res.toks.len, ARR_LEN(ex_locs));
+    for (uint32_t i = 0; i < ARR_LEN(ex_locs); ++i) {
+        const SourceLoc loc = TokenArr_loc(&res.toks, i);
+        ASSERT_UINT(loc.file_idx, (uint32_t)0);
+        ASSERT_UINT(loc.file_loc.line, ex_locs[i].line);
+        ASSERT_UINT(loc.file_loc.index, ex_locs[i].index);
+
+        const SourceLoc spelling = TokenArr_spelling_loc(&res.toks, i);
+        ASSERT_UINT(spelling.file_idx, (uint32_t)0);
+        ASSERT_UINT(spelling.file_loc.line, ex_spellings[i].line);
+        ASSERT_UINT(spelling.file_loc.index, ex_spellings[i].index);
+
+        const bool is_expanded = i >= 3 && i < 10 && i != 4 && i != 6;
+        ASSERT(TokenArr_is_expanded(&res.toks, i) == is_expanded);
+    }
+    TestPreprocRes_free(&res);
+}
+
+// The second file uses the results of the include path resolution of the
+// first one, including the missing file
+TEST(include_shared_cache) {
+    const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
+    IncludeCache* cache = IncludeCache_create();
+    const CStr start_file = CSTR_LIT(
+        "../frontend/test/files/include_test/start.c");
+    PreprocRes results[2];
+    for (uint32_t i = 0; i < ARR_LEN(results); ++i) {
+        PreprocErr err = PreprocErr_create();
+        results[i] = preproc(start_file, NULL, 0, NULL, cache, &info, &err);
+        ASSERT(err.kind == PREPROC_ERR_NONE);
+    }
+    ASSERT_UINT(results[1].file_info.len, results[0].file_info.len);
+    for (uint32_t i = 0; i < results[0].file_info.len; ++i) {
+        ASSERT_STR(FileInfo_get(&results[1].file_info, i),
+                   FileInfo_get(&results[0].file_info, i));
+    }
+    ASSERT_UINT(results[1].toks.len, results[0].toks.len);
+    for (uint32_t i = 0; i < results[0].toks.len; ++i) {
+        ASSERT_TOKEN_KIND(results[1].toks.kinds[i], results[0].toks.kinds[i]);
+    }
+    for (uint32_t i = 0; i < ARR_LEN(results); ++i) {
+        PreprocRes_free(&results[i]);
+    }
+
+    const CStr missing_file = CSTR_LIT(
+        "../frontend/test/files/include_test/include_missing.c");
+    for (uint32_t i = 0; i < 2; ++i) {
+        PreprocErr err = PreprocErr_create();
+        PreprocRes res = preproc(missing_file,
+                                 NULL,
+                                 0,
+                                 NULL,
+                                 cache,
+                                 &info,
+                                 &err);
+        ASSERT(err.kind == PREPROC_ERR_OPEN_FILE);
+        ASSERT_STR(StrBuf_as_str(&err.fail_filename),
+                   STR_LIT("does_not_exist.h"));
+        PreprocErr_free(&err);
+        PreprocRes_free(&res);
+    }
+    IncludeCache_free(cache);
+}
+
+// Keywords and preprocessor identifiers are found without the identifier set,
+// but must get the same indices they have in the set
+TEST(keyword_indices) {
+    PreprocTokenValList vals = PreprocTokenValList_create();
+    for (uint32_t i = 0; i < PREPROC_TOKEN_ARR_INITIAL_ID_COUNT; ++i) {
+        const Str spell = IndexedStringSet_get(&vals.identifiers, i);
+        ASSERT_UINT(PreprocTokenValList_add_identifier(&vals, spell), i);
+    }
+    const Str others[] = {
+        STR_LIT("iff"),
+        STR_LIT("i"),
+        STR_LIT("define_"),
+        STR_LIT("_Alignass"),
+        STR_LIT("While"),
+    };
+    for (uint32_t i = 0; i < ARR_LEN(others); ++i) {
+        const uint32_t idx = PreprocTokenValList_add_identifier(&vals,
+                                                                others[i]);
+        ASSERT_UINT(idx, PREPROC_TOKEN_ARR_INITIAL_ID_COUNT + i);
+        ASSERT_STR(IndexedStringSet_get(&vals.identifiers, idx), others[i]);
+    }
+    PreprocTokenValList_free(&vals);
 }
 
 TEST(hex_literal_or_var) {
@@ -279,7 +571,6 @@ TEST(hex_literal_or_var) {
             {0, {1, 5}},
             {0, {1, 6}},
         };
-        expected.locs = locs;
 
         enum {
             EX_LEN = ARR_LEN(kinds)
@@ -287,7 +578,7 @@ TEST(hex_literal_or_var) {
         static_assert(EX_LEN == ARR_LEN(val_indices), "");
         static_assert(EX_LEN == ARR_LEN(locs), "");
         expected.len = expected.cap = EX_LEN;
-        check_token_arr_str(code, &expected);
+        check_token_arr_str(code, &expected, locs);
     }
     {
         CStr code = CSTR_LIT("var2e-10");
@@ -312,14 +603,13 @@ TEST(hex_literal_or_var) {
             {0, {1, 6}},
             {0, {1, 7}},
         };
-        expected.locs = locs;
         enum {
             EX_LEN = ARR_LEN(kinds)
         };
         static_assert(EX_LEN == ARR_LEN(val_indices), "");
         static_assert(EX_LEN == ARR_LEN(locs), "");
         expected.len = expected.cap = EX_LEN;
-        check_token_arr_str(code, &expected);
+        check_token_arr_str(code, &expected, locs);
     }
     {
         CStr code = CSTR_LIT("var2p-10");
@@ -344,14 +634,13 @@ TEST(hex_literal_or_var) {
             {0, {1, 6}},
             {0, {1, 7}},
         };
-        expected.locs = locs;
         enum {
             EX_LEN = ARR_LEN(kinds)
         };
         static_assert(EX_LEN == ARR_LEN(val_indices), "");
         static_assert(EX_LEN == ARR_LEN(locs), "");
         expected.len = expected.cap = EX_LEN;
-        check_token_arr_str(code, &expected);
+        check_token_arr_str(code, &expected, locs);
     }
 }
 
@@ -382,7 +671,6 @@ TEST(dot_float_literal_or_op) {
             {0, {1, 7}},
             {0, {1, 9}},
         };
-        expected.locs = locs;
 
         enum {
             EX_LEN = ARR_LEN(kinds),
@@ -390,19 +678,110 @@ TEST(dot_float_literal_or_op) {
         static_assert(EX_LEN == ARR_LEN(val_indices), "");
         static_assert(EX_LEN == ARR_LEN(locs), "");
         expected.len = expected.cap = EX_LEN;
-        check_token_arr_str(code, &expected);
+        check_token_arr_str(code, &expected, locs);
     }
 }
 
+TEST(punctuator_longest_match) {
+    CStr code = CSTR_LIT("a..b<<=c--->d...");
+
+    TokenArr expected = TokenArr_create_empty();
+    uint8_t kinds[] = {
+        TOKEN_IDENTIFIER,
+        TOKEN_DOT,
+        TOKEN_DOT,
+        TOKEN_IDENTIFIER,
+        TOKEN_LSHIFT_ASSIGN,
+        TOKEN_IDENTIFIER,
+        TOKEN_DEC,
+        TOKEN_PTR_OP,
+        TOKEN_IDENTIFIER,
+        TOKEN_ELLIPSIS,
+    };
+    expected.kinds = kinds;
+
+    uint32_t val_indices[] = {
+        TokenArr_add_identifier(&expected, STR_BUF_NON_HEAP("a")),
+        UINT32_MAX,
+        UINT32_MAX,
+        TokenArr_add_identifier(&expected, STR_BUF_NON_HEAP("b")),
+        UINT32_MAX,
+        TokenArr_add_identifier(&expected, STR_BUF_NON_HEAP("c")),
+        UINT32_MAX,
+        UINT32_MAX,
+        TokenArr_add_identifier(&expected, STR_BUF_NON_HEAP("d")),
+        UINT32_MAX,
+    };
+    expected.val_indices = val_indices;
+
+    SourceLoc locs[] = {
+        {0, {1, 1}},
+        {0, {1, 2}},
+        {0, {1, 3}},
+        {0, {1, 4}},
+        {0, {1, 5}},
+        {0, {1, 8}},
+        {0, {1, 9}},
+        {0, {1, 11}},
+        {0, {1, 13}},
+        {0, {1, 14}},
+    };
+
+    enum {
+        EX_LEN = ARR_LEN(kinds),
+    };
+    static_assert(EX_LEN == ARR_LEN(val_indices), "");
+    static_assert(EX_LEN == ARR_LEN(locs), "");
+    expected.len = expected.cap = EX_LEN;
+    check_token_arr_str(code, &expected, locs);
+}
+
 TEST_SUITE_BEGIN(tokenizer){
     REGISTER_TEST(simple),
     REGISTER_TEST(file),
     REGISTER_TEST(include),
     REGISTER_TEST(preproc_if),
+    REGISTER_TEST(include_guard),
+    REGISTER_TEST(include_guard_other_paths),
+    REGISTER_TEST(skip_inactive),
+    REGISTER_TEST(macro_rescan),
+    REGISTER_TEST(macro_hide_set),
+    REGISTER_TEST(macro_spelling_locs),
+    REGISTER_TEST(include_shared_cache),
+    REGISTER_TEST(keyword_indices),
     REGISTER_TEST(hex_literal_or_var),
     REGISTER_TEST(dot_float_literal_or_op),
+    REGISTER_TEST(punctuator_longest_match),
 } TEST_SUITE_END()
 
+// The expected arrays have no locations, so values are accessed by index
+static const IntVal* get_int_const(const TokenArr* arr, uint32_t val_idx) {
+    const IntVal* res = TokenLiterals_int_const(&arr->literals,
+                                                val_idx,
+                                                (SourceLoc){0},
+                                                NULL);
+    ASSERT_NOT_NULL(res);
+    return res;
+}
+
+static const FloatVal* get_float_const(const TokenArr* arr, uint32_t val_idx) {
+    const FloatVal* res = TokenLiterals_float_const(&arr->literals,
+                                                    val_idx,
+                                                    (SourceLoc){0},
+                                                    NULL);
+    ASSERT_NOT_NULL(res);
+    return res;
+}
+
+static const StrLit* get_str_lit(const TokenArr* arr, uint32_t val_idx) {
+    const StrLit* res = TokenLiterals_str_lit(&arr->literals,
+                                              val_idx,
+                                              (SourceLoc){0},
+                                              NULL);
+    ASSERT_NOT_NULL(res);
+    return res;
+}
+
 static void check_token(const TokenArr* got, const TokenArr* ex, uint32_t i) {
     assert(i < got->len);
     ASSERT_TOKEN_KIND(got->kinds[i], ex->kinds[i]);
@@ -410,8 +789,8 @@ static void check_token(const TokenArr* got, const TokenArr* ex, uint32_t i) {
     const uint32_t ex_val_idx = ex->val_indices[i];
     switch (got->kinds[i]) {
         case TOKEN_I_CONSTANT: {
-            const IntVal got_val = got->int_consts[got_val_idx];
-            const IntVal ex_val = ex->int_consts[ex_val_idx];
+            const IntVal got_val = *get_int_const(got, got_val_idx);
+            const IntVal ex_val = *get_int_const(ex, ex_val_idx);
             ASSERT_INT_VAL_KIND(got_val.kind, ex_val.kind);
             if (IntValKind_is_sint(got_val.kind)) {
                 ASSERT_INT(got_val.sint_val, ex_val.sint_val);
@@ -421,24 +800,25 @@ static void check_token(const TokenArr* got, const TokenArr* ex, uint32_t i) {
             break;
         }
         case TOKEN_F_CONSTANT: {
-            const FloatVal got_val = got->float_consts[got_val_idx];
-            const FloatVal ex_val = ex->float_consts[ex_val_idx];
+            const FloatVal got_val = *get_float_const(got, got_val_idx);
+            const FloatVal ex_val = *get_float_const(ex, ex_val_idx);
             ASSERT_FLOAT_VAL_KIND(got_val.kind, ex_val.kind);
             ASSERT_DOUBLE(got_val.val, ex_val.val, 0.0001);
             break;
         }
         case TOKEN_STRING_LITERAL: {
-            const StrLit got_lit = got->str_lits[got_val_idx];
-            const StrLit ex_lit = got->str_lits[ex_val_idx];
+            const StrLit got_lit = *get_str_lit(got, got_val_idx);
+            const StrLit ex_lit = *get_str_lit(ex, ex_val_idx);
             ASSERT_STR_LIT_KIND(got_lit.kind, ex_lit.kind);
             ASSERT_STR(StrBuf_as_str(&got_lit.contents),
                        StrBuf_as_str(&ex_lit.contents));
             break;
         }
         case TOKEN_IDENTIFIER: {
-            const StrBuf got_spell = got->identifiers[got_val_idx];
-            const StrBuf ex_spell = ex->identifiers[ex_val_idx];
-            ASSERT_STR(StrBuf_as_str(&got_spell), StrBuf_as_str(&ex_spell));
+            const Str got_spell = StringPool_get(&got->identifiers,
+                                                 got_val_idx);
+            const Str ex_spell = StringPool_get(&ex->identifiers, ex_val_idx);
+            ASSERT_STR(got_spell, ex_spell);
             break;
         }
         default:
@@ -471,35 +851,51 @@ static void check_token(const TokenArr* got, const TokenArr* ex, uint32_t i) {
     */
 }
 
-static void compare_tokens(const TokenArr* got, const TokenArr* expected) {
+static void compare_tokens(const TokenArr* got,
+                           const TokenArr* expected,
+                           const SourceLoc* ex_locs) {
     ASSERT_UINT(got->len, expected->len);
     for (uint32_t i = 0; i < got->len; ++i) {
         check_token(got, expected, i);
+        const SourceLoc loc = TokenArr_loc(got, i);
+        ASSERT_UINT(loc.file_idx, ex_locs[i].file_idx);
+        ASSERT_UINT(loc.file_loc.line, ex_locs[i].file_loc.line);
+        ASSERT_UINT(loc.file_loc.index, ex_locs[i].file_loc.index);
     }
 }
 
 static void TokenArr_free_identifiers_only(const TokenArr* arr) {
-    mycc_free(arr->identifiers);
-    mycc_free(arr->int_consts);
-    mycc_free(arr->float_consts);
-    mycc_free(arr->str_lits);
+    StringPool_free(&arr->identifiers);
+    const TokenLiterals* lits = &arr->literals;
+    StringPool_free(&lits->int_spellings);
+    StringPool_free(&lits->float_spellings);
+    StringPool_free(&lits->str_spellings);
+    mycc_free(lits->int_states);
+    mycc_free(lits->float_states);
+    mycc_free(lits->str_states);
+    mycc_free(lits->int_consts);
+    mycc_free(lits->float_consts);
+    mycc_free(lits->str_lits);
 }
 
 static void check_token_arr_helper(CStr file_or_code,
                                    const TokenArr* expected,
+                                   const SourceLoc* ex_locs,
                                    TestPreprocRes (*func)(CStr)) {
     TestPreprocRes preproc_res = func(file_or_code);
     ASSERT(preproc_res.toks.len != 0);
     ASSERT_UINT(preproc_res.toks.len, expected->len);
 
-    compare_tokens(&preproc_res.toks, expected);
+    compare_tokens(&preproc_res.toks, expected, ex_locs);
 
     TestPreprocRes_free(&preproc_res);
     TokenArr_free_identifiers_only(expected);
 }
 
-static void check_token_arr_file(CStr filename, const TokenArr* expected) {
-    check_token_arr_helper(filename, expected, tokenize);
+static void check_token_arr_file(CStr filename,
+                                 const TokenArr* expected,
+                                 const SourceLoc* ex_locs) {
+    check_token_arr_helper(filename, expected, ex_locs, tokenize);
 }
 
 static TestPreprocRes tokenize_string_wrapper(CStr code) {
@@ -507,6 +903,8 @@ static TestPreprocRes tokenize_string_wrapper(CStr code) {
                            &(PreprocInitialStrings){0});
 }
 
-static void check_token_arr_str(CStr code, const TokenArr* expected) {
-    check_token_arr_helper(code, expected, tokenize_string_wrapper);
+static void check_token_arr_str(CStr code,
+                                const TokenArr* expected,
+                                const SourceLoc* ex_locs) {
+    check_token_arr_helper(code, expected, ex_locs, tokenize_string_wrapper);
 }
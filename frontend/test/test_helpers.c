@@ -7,7 +7,7 @@
 TestPreprocRes tokenize(CStr file) {
     PreprocErr err = PreprocErr_create();
     const ArchTypeInfo info = get_arch_type_info(ARCH_X86_64, false);
-    PreprocRes res = preproc(file, 0, NULL, &info, &err);
+    PreprocRes res = preproc(file, NULL, 0, NULL, NULL, &info, &err);
     ASSERT(res.toks.len != 0);
     ASSERT_NOT_NULL(res.file_info.paths);
     ASSERT(err.kind == PREPROC_ERR_NONE);
@@ -10,12 +10,40 @@
 #include "util/StrBuf.h"
 #include "util/paths.h"
 #include "util/log.h"
+#include "util/mem.h"
+#include "util/ThreadPool.h"
 
-static bool convert_bin_to_text(const CmdArgs* args, CStr filename);
+static bool convert_bin_to_text(const CmdArgs* args,
+                                CStr filename,
+                                File err_out);
 
 static bool output_ast(const CmdArgs* args,
                        const ArchTypeInfo* type_info,
-                       CStr filename);
+                       const PreprocPCH* pch,
+                       IncludeCache* include_cache,
+                       CStr filename,
+                       File err_out);
+
+static bool output_pch(const CmdArgs* args,
+                       const ArchTypeInfo* type_info,
+                       const PreprocPCH* pch,
+                       IncludeCache* include_cache,
+                       CStr filename,
+                       File err_out);
+
+static bool process_file(const CmdArgs* args,
+                         const ArchTypeInfo* type_info,
+                         const PreprocPCH* pch,
+                         IncludeCache* include_cache,
+                         CStr filename,
+                         File err_out);
+
+static bool process_files_parallel(const CmdArgs* args,
+                                   const ArchTypeInfo* type_info,
+                                   const PreprocPCH* pch,
+                                   IncludeCache* include_cache);
+
+static bool read_pch(CStr filename, PreprocPCH* res);
 
 int main(int argc, char** argv) {
     const CmdArgs args = parse_cmd_args(argc, argv);
@@ -27,42 +55,193 @@ int main(int argc, char** argv) {
 #endif
     const ArchTypeInfo type_info = get_arch_type_info(ARCH_X86_64, is_windows);
 
-    if (args.action == ARG_ACTION_CONVERT_BIN_TO_TEXT) {
-        for (uint32_t i = 0; i < args.num_files; ++i) {
-            if (!convert_bin_to_text(&args, args.files[i])) {
-                goto fail;
-            }
+    // The precompiled header is only read once and shared by all files
+    PreprocPCH pch_storage;
+    const PreprocPCH* pch = NULL;
+    if (args.pch_file.data != NULL) {
+        if (!read_pch(args.pch_file, &pch_storage)) {
+            goto fail_pch;
+        }
+        pch = &pch_storage;
+    }
+
+    // Files are compiled with the same include directories, so includes
+    // resolve the same way for all of them
+    IncludeCache* include_cache = IncludeCache_create();
+    if (args.num_threads > 1 && args.num_files > 1) {
+        if (!process_files_parallel(&args, &type_info, pch, include_cache)) {
+            goto fail;
         }
     } else {
         for (uint32_t i = 0; i < args.num_files; ++i) {
-            if (!output_ast(&args, &type_info, args.files[i])) {
+            if (!process_file(&args,
+                              &type_info,
+                              pch,
+                              include_cache,
+                              args.files[i],
+                              mycc_stderr)) {
                 goto fail;
             }
         }
     }
+    IncludeCache_free(include_cache);
+    if (pch) {
+        PreprocPCH_free(pch);
+    }
     CmdArgs_free(&args);
     return EXIT_SUCCESS;
 fail:
+    IncludeCache_free(include_cache);
+    if (pch) {
+        PreprocPCH_free(pch);
+    }
+fail_pch:
     CmdArgs_free(&args);
     return EXIT_FAILURE;
 }
 
+static bool read_pch(CStr filename, PreprocPCH* res) {
+    File file = File_open(filename, FILE_READ | FILE_BINARY);
+    if (!File_valid(file)) {
+        File_printf(mycc_stderr, "Failed to open file {Str}\n", filename);
+        return false;
+    }
+    const bool success = PreprocPCH_read(res, file);
+    File_close(file);
+    if (!success) {
+        File_printf(mycc_stderr,
+                    "Failed to read precompiled header from file {Str}\n",
+                    filename);
+    }
+    return success;
+}
+
+static bool process_file(const CmdArgs* args,
+                         const ArchTypeInfo* type_info,
+                         const PreprocPCH* pch,
+                         IncludeCache* include_cache,
+                         CStr filename,
+                         File err_out) {
+    switch (args->action) {
+        case ARG_ACTION_CONVERT_BIN_TO_TEXT:
+            return convert_bin_to_text(args, filename, err_out);
+        case ARG_ACTION_OUTPUT_PCH:
+            return output_pch(args,
+                              type_info,
+                              pch,
+                              include_cache,
+                              filename,
+                              err_out);
+        case ARG_ACTION_OUTPUT_TEXT:
+        case ARG_ACTION_OUTPUT_BIN:
+            return output_ast(args,
+                              type_info,
+                              pch,
+                              include_cache,
+                              filename,
+                              err_out);
+    }
+    UNREACHABLE();
+}
+
 static StrBuf get_out_filename(Str origin_file, Str suffix) {
     uint32_t last_sep_idx = get_last_file_sep(origin_file);
     Str filename_only = Str_advance(origin_file, last_sep_idx + 1);
     return StrBuf_concat(filename_only, suffix);
 }
 
-static bool convert_bin_to_text(const CmdArgs* args, CStr filename) {
+typedef struct {
+    const CmdArgs* args;
+    const ArchTypeInfo* type_info;
+    const PreprocPCH* pch;
+    IncludeCache* include_cache;
+    bool* results;
+    // Errors of each file are buffered, so they can be printed in order
+    File* err_outs;
+} ParallelCtx;
+
+static void process_file_task(void* ctx_ptr,
+                              uint32_t task_idx,
+                              uint32_t worker_idx) {
+    UNUSED(worker_idx);
+    ParallelCtx* ctx = ctx_ptr;
+    const CStr filename = ctx->args->files[task_idx];
+    // Print errors directly if the buffer could not be created
+    const File err_out = File_valid(ctx->err_outs[task_idx])
+                             ? ctx->err_outs[task_idx]
+                             : mycc_stderr;
+    ctx->results[task_idx] = process_file(ctx->args,
+                                          ctx->type_info,
+                                          ctx->pch,
+                                          ctx->include_cache,
+                                          filename,
+                                          err_out);
+}
+
+static void copy_file_contents(File from, File to) {
+    File_seek(from, 0, FILE_SEEK_START);
+    char buf[4096];
+    size_t read;
+    while ((read = File_read(buf, 1, sizeof buf, from)) != 0) {
+        File_write(buf, 1, read, to);
+    }
+}
+
+/**
+ * @brief Processes all files given in args on args->num_threads threads
+ *
+ * Unlike the sequential driver, this does not stop at the first failing file.
+ * Errors are printed in the order the files were given, regardless of the
+ * order in which they were processed.
+ */
+static bool process_files_parallel(const CmdArgs* args,
+                                   const ArchTypeInfo* type_info,
+                                   const PreprocPCH* pch,
+                                   IncludeCache* include_cache) {
+    ParallelCtx ctx = {
+        .args = args,
+        .type_info = type_info,
+        .pch = pch,
+        .include_cache = include_cache,
+        .results = mycc_alloc(sizeof *ctx.results * args->num_files),
+        .err_outs = mycc_alloc(sizeof *ctx.err_outs * args->num_files),
+    };
+    for (uint32_t i = 0; i < args->num_files; ++i) {
+        ctx.err_outs[i] = File_open_tmp();
+    }
+
+    mycc_run_tasks(args->num_files,
+                   args->num_threads,
+                   process_file_task,
+                   &ctx);
+
+    bool success = true;
+    for (uint32_t i = 0; i < args->num_files; ++i) {
+        if (!ctx.results[i]) {
+            success = false;
+        }
+        if (File_valid(ctx.err_outs[i])) {
+            copy_file_contents(ctx.err_outs[i], mycc_stderr);
+            File_close(ctx.err_outs[i]);
+        }
+    }
+    mycc_free(ctx.results);
+    mycc_free(ctx.err_outs);
+    return success;
+}
+
+static bool convert_bin_to_text(const CmdArgs* args,
+                                CStr filename,
+                                File err_out) {
     MYCC_LOG("Converting {Str} to human readable file:\n", filename);
     File in_file = File_open(filename, FILE_READ | FILE_BINARY);
     if (!File_valid(in_file)) {
-        File_printf(mycc_stderr, "Failed to open file {Str}\n", filename);
+        File_printf(err_out, "Failed to open file {Str}\n", filename);
         return false;
     }
     DeserializeASTRes res = deserialize_ast(in_file);
     if (res.ast.len == 0) {
-        File_printf(mycc_stderr,
+        File_printf(err_out,
                     "Failed to read ast from file {Str}\n",
                     filename);
         File_close(in_file);
@@ -82,17 +261,19 @@ static bool convert_bin_to_text(const CmdArgs* args, CStr filename) {
     }
     File out_file = File_open(out_filename, FILE_WRITE);
     if (!File_valid(out_file)) {
-        File_printf(mycc_stderr, "Failed to open file {Str}\n", out_filename);
+        File_printf(err_out, "Failed to open file {Str}\n", out_filename);
         goto fail_with_out_file_closed;
     }
-    if (!dump_ast(&res.ast, &res.file_info, out_file)) {
-        File_printf(mycc_stderr,
+    // The values of deserialized literals are already converted
+    PreprocErr err = PreprocErr_create();
+    if (!dump_ast(&res.ast, &res.file_info, out_file, &err)) {
+        File_printf(err_out,
                     "Failed to write ast to textfile {Str}\n",
                     out_filename);
         goto fail_with_out_file_open;
     }
     if (!File_flush(out_file)) {
-        File_printf(mycc_stderr,
+        File_printf(err_out,
                     "Failed to flush output file {Str}\n",
                     out_filename);
         goto fail_with_out_file_open;
@@ -105,6 +286,7 @@ static bool convert_bin_to_text(const CmdArgs* args, CStr filename) {
     return true;
 fail_with_out_file_open:
     File_close(out_file);
+    File_remove(out_filename);
 fail_with_out_file_closed:
     StrBuf_free(&out_filename_str);
     AST_free(&res.ast);
@@ -113,38 +295,157 @@ fail_with_out_file_closed:
     return false;
 }
 
-static bool output_ast(const CmdArgs* args,
+// Preprocesses and parses filename at the same time. If this fails, the
+// errors are printed and nothing needs to be freed.
+static bool parse_file(const CmdArgs* args,
                        const ArchTypeInfo* type_info,
-                       CStr filename) {
-    MYCC_LOG("Generating AST for {Str}:\n", filename);
+                       const PreprocPCH* pch,
+                       IncludeCache* include_cache,
+                       CStr filename,
+                       File err_out,
+                       AST* ast,
+                       PreprocRes* preproc_res) {
     PreprocErr preproc_err = PreprocErr_create();
-    PreprocRes preproc_res = preproc(filename,
-                                     args->num_include_dirs,
-                                     args->include_dirs,
-                                     type_info,
-                                     &preproc_err);
+    PreprocStream stream = PreprocStream_create(filename,
+                                                pch,
+                                                args->num_include_dirs,
+                                                args->include_dirs,
+                                                include_cache,
+                                                type_info,
+                                                &preproc_err);
     if (preproc_err.kind != PREPROC_ERR_NONE) {
-        PreprocErr_print(mycc_stderr, &preproc_res.file_info, &preproc_res.vals, &preproc_err);
+        *preproc_res = PreprocStream_close(&stream);
+        PreprocErr_print(err_out, &preproc_res->file_info, &preproc_res->vals, &preproc_err);
         PreprocErr_free(&preproc_err);
-        goto fail_preproc;
+        PreprocRes_free(preproc_res);
+        return false;
     }
-    TokenArr tokens = convert_preproc_tokens(&preproc_res.toks, &preproc_res.vals, type_info, &preproc_err);
-    if (tokens.len == 0) {
-        PreprocErr_print(mycc_stderr, &preproc_res.file_info, &preproc_res.vals, &preproc_err);
+
+    ParserErrArr parser_errs = ParserErrArr_create();
+    *ast = parse_ast_stream(&stream, &parser_errs);
+    *preproc_res = PreprocStream_close(&stream);
+    if (preproc_err.kind != PREPROC_ERR_NONE) {
+        PreprocErr_print(err_out, &preproc_res->file_info, &preproc_res->vals, &preproc_err);
         PreprocErr_free(&preproc_err);
+        ParserErrArr_free(&parser_errs);
+        goto fail;
+    }
+    if (parser_errs.len != 0) {
+        ParserErrArr_print(err_out,
+                           &preproc_res->file_info,
+                           &ast->toks,
+                           &parser_errs);
+        ParserErrArr_free(&parser_errs);
+        goto fail;
+    }
+    return true;
+fail:
+    AST_free(ast);
+    PreprocRes_free(preproc_res);
+    return false;
+}
+
+// Parses filename like parse_file(), but reuses the unchanged declarations of
+// the AST in args->prev_ast_file. The whole file has to be preprocessed
+// first for this.
+static bool parse_file_incremental(const CmdArgs* args,
+                                   const ArchTypeInfo* type_info,
+                                   const PreprocPCH* pch,
+                                   IncludeCache* include_cache,
+                                   CStr filename,
+                                   File err_out,
+                                   AST* ast,
+                                   PreprocRes* preproc_res) {
+    File prev_file = File_open(args->prev_ast_file, FILE_READ | FILE_BINARY);
+    if (!File_valid(prev_file)) {
+        File_printf(err_out,
+                    "Failed to open file {Str}\n",
+                    args->prev_ast_file);
+        return false;
+    }
+    DeserializeASTRes prev = deserialize_ast(prev_file);
+    File_close(prev_file);
+    if (prev.ast.len == 0) {
+        File_printf(err_out,
+                    "Failed to read ast from file {Str}\n",
+                    args->prev_ast_file);
+        return false;
+    }
+
+    PreprocErr preproc_err = PreprocErr_create();
+    *preproc_res = preproc(filename,
+                           pch,
+                           args->num_include_dirs,
+                           args->include_dirs,
+                           include_cache,
+                           type_info,
+                           &preproc_err);
+    if (preproc_err.kind != PREPROC_ERR_NONE) {
         goto fail_preproc;
     }
+    TokenArr toks = convert_preproc_tokens(&preproc_res->toks,
+                                           &preproc_res->vals,
+                                           type_info,
+                                           &preproc_err);
+    if (preproc_err.kind != PREPROC_ERR_NONE) {
+        goto fail_preproc;
+    }
+
+    ParserErrArr parser_errs = ParserErrArr_create();
+    *ast = parse_ast_incremental(&toks, &prev.ast, &parser_errs);
+    AST_free(&prev.ast);
+    FileInfo_free(&prev.file_info);
+    if (parser_errs.len != 0) {
+        ParserErrArr_print(err_out,
+                           &preproc_res->file_info,
+                           &ast->toks,
+                           &parser_errs);
+        ParserErrArr_free(&parser_errs);
+        AST_free(ast);
+        PreprocRes_free(preproc_res);
+        return false;
+    }
+    return true;
+fail_preproc:
+    PreprocErr_print(err_out, &preproc_res->file_info, &preproc_res->vals, &preproc_err);
+    PreprocErr_free(&preproc_err);
+    PreprocRes_free_preproc_tokens(preproc_res);
+    AST_free(&prev.ast);
+    FileInfo_free(&prev.file_info);
+    return false;
+}
 
-    ParserErr parser_err = ParserErr_create();
-    AST ast = parse_ast(&tokens, &parser_err);
-    if (parser_err.kind != PARSER_ERR_NONE) {
-        // TODO: tokens are now in tl and need to be freed
-        ParserErr_print(mycc_stderr,
-                        &preproc_res.file_info,
-                        &ast.toks,
-                        &parser_err);
-        goto fail_parse;
+static bool output_ast(const CmdArgs* args,
+                       const ArchTypeInfo* type_info,
+                       const PreprocPCH* pch,
+                       IncludeCache* include_cache,
+                       CStr filename,
+                       File err_out) {
+    MYCC_LOG("Generating AST for {Str}:\n", filename);
+    AST ast;
+    PreprocRes preproc_res;
+    const bool parsed = args->prev_ast_file.data == NULL
+                            ? parse_file(args,
+                                         type_info,
+                                         pch,
+                                         include_cache,
+                                         filename,
+                                         err_out,
+                                         &ast,
+                                         &preproc_res)
+                            : parse_file_incremental(args,
+                                                     type_info,
+                                                     pch,
+                                                     include_cache,
+                                                     filename,
+                                                     err_out,
+                                                     &ast,
+                                                     &preproc_res);
+    if (!parsed) {
+        MYCC_LOG_STR("\n");
+        return false;
     }
+    PreprocErr preproc_err = PreprocErr_create();
 
     Str suffix = args->action == ARG_ACTION_OUTPUT_BIN ? STR_LIT(".binast")
                                                        : STR_LIT(".ast");
@@ -159,7 +460,7 @@ static bool output_ast(const CmdArgs* args,
     }
     File out_file = File_open(out_filename, FILE_WRITE | FILE_BINARY);
     if (!File_valid(out_file)) {
-        File_printf(mycc_stderr,
+        File_printf(err_out,
                     "Failed to open output file {Str}\n",
                     out_filename);
         goto fail_out_file_closed;
@@ -168,16 +469,25 @@ static bool output_ast(const CmdArgs* args,
     const bool success = args->action == ARG_ACTION_OUTPUT_BIN
                              ? serialize_ast(&ast,
                                                &preproc_res.file_info,
-                                               out_file)
+                                               out_file,
+                                               &preproc_err)
                              : dump_ast(&ast,
                                           &preproc_res.file_info,
-                                          out_file);
-    if (!success) {
-        File_printf(mycc_stderr,
+                                          out_file,
+                                          &preproc_err);
+    if (!success && preproc_err.kind != PREPROC_ERR_NONE) {
+        PreprocErr_print(err_out,
+                         &preproc_res.file_info,
+                         &preproc_res.vals,
+                         &preproc_err);
+        PreprocErr_free(&preproc_err);
+        goto fail_out_file_open;
+    } else if (!success) {
+        File_printf(err_out,
                     "Failed to write ast to file {Str}\n",
                     out_filename);
         if (!File_flush(out_file)) {
-            File_printf(mycc_stderr,
+            File_printf(err_out,
                         "Failed to flush output file {Str}\n",
                         out_filename);
         }
@@ -185,7 +495,7 @@ static bool output_ast(const CmdArgs* args,
     }
 
     if (!File_flush(out_file)) {
-        File_printf(mycc_stderr,
+        File_printf(err_out,
                     "Failed to flush output file {Str}\n",
                     out_filename);
         goto fail_out_file_open;
@@ -198,13 +508,80 @@ static bool output_ast(const CmdArgs* args,
     return true;
 fail_out_file_open:
     File_close(out_file);
+    // A partially written file must not be mistaken for a valid output
+    File_remove(out_filename);
 fail_out_file_closed:
     StrBuf_free(&out_filename_str);
-fail_parse:
     AST_free(&ast);
-fail_preproc:
     PreprocRes_free(&preproc_res);
     MYCC_LOG_STR("\n");
     return false;
 }
 
+
+static bool output_pch(const CmdArgs* args,
+                       const ArchTypeInfo* type_info,
+                       const PreprocPCH* pch,
+                       IncludeCache* include_cache,
+                       CStr filename,
+                       File err_out) {
+    MYCC_LOG("Generating precompiled header for {Str}:\n", filename);
+    PreprocErr preproc_err = PreprocErr_create();
+    PreprocPCH res = preproc_create_pch(filename,
+                                        pch,
+                                        args->num_include_dirs,
+                                        args->include_dirs,
+                                        include_cache,
+                                        type_info,
+                                        &preproc_err);
+    if (preproc_err.kind != PREPROC_ERR_NONE) {
+        PreprocErr_print(err_out, &res.file_info, &res.vals, &preproc_err);
+        PreprocErr_free(&preproc_err);
+        goto fail_preproc;
+    }
+
+    StrBuf out_filename_str;
+    CStr out_filename;
+    if (args->output_file.data == NULL) {
+        out_filename_str = get_out_filename(CStr_as_str(filename),
+                                            STR_LIT(".pch"));
+        out_filename = StrBuf_c_str(&out_filename_str);
+    } else {
+        out_filename_str = StrBuf_null();
+        out_filename = args->output_file;
+    }
+    File out_file = File_open(out_filename, FILE_WRITE | FILE_BINARY);
+    if (!File_valid(out_file)) {
+        File_printf(err_out,
+                    "Failed to open output file {Str}\n",
+                    out_filename);
+        goto fail_out_file_closed;
+    }
+    if (!PreprocPCH_write(&res, out_file)) {
+        File_printf(err_out,
+                    "Failed to write precompiled header to file {Str}\n",
+                    out_filename);
+        goto fail_out_file_open;
+    }
+    if (!File_flush(out_file)) {
+        File_printf(err_out,
+                    "Failed to flush output file {Str}\n",
+                    out_filename);
+        goto fail_out_file_open;
+    }
+    File_close(out_file);
+    StrBuf_free(&out_filename_str);
+    PreprocPCH_free(&res);
+    MYCC_LOG_STR("\n");
+    return true;
+fail_out_file_open:
+    File_close(out_file);
+    // A partially written file must not be mistaken for a valid output
+    File_remove(out_filename);
+fail_out_file_closed:
+    StrBuf_free(&out_filename_str);
+fail_preproc:
+    PreprocPCH_free(&res);
+    MYCC_LOG_STR("\n");
+    return false;
+}
@@ -0,0 +1,35 @@
+#ifndef MYCC_UTIL_DIR_ENTRIES_H
+#define MYCC_UTIL_DIR_ENTRIES_H
+
+#include <stdbool.h>
+
+#include "util/IndexedStringSet.h"
+
+/**
+ * @brief Names of all entries of a directory
+ */
+typedef struct DirEntries {
+    // false if the directory could not be listed, e.g. because listing is
+    // not supported on this platform or its file systems are usually
+    // case-insensitive
+    bool is_valid;
+    IndexedStringSet _names;
+} DirEntries;
+
+/**
+ * @param dir Path of the directory, where an empty path is the current
+ *        working directory
+ */
+DirEntries DirEntries_read(Str dir);
+
+/**
+ * @brief Checks whether dir has an entry with the given name
+ *
+ * If the directory could not be listed, every name is assumed to exist.
+ */
+bool DirEntries_contains(const DirEntries* entries, Str name);
+
+void DirEntries_free(const DirEntries* entries);
+
+#endif
+
@@ -23,8 +23,19 @@ typedef enum {
 
 File File_open(CStr filename, OpenMode mode);
 
+/**
+ * @brief Opens an anonymous temporary file for reading and writing, which is
+ *        removed when it is closed
+ */
+File File_open_tmp(void);
+
 bool File_valid(File f);
 
+/**
+ * @brief Deletes the file at the given path, which must not be open
+ */
+bool File_remove(CStr filename);
+
 bool File_close(File f);
 
 bool File_flush(File f);
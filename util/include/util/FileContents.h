@@ -0,0 +1,32 @@
+#ifndef MYCC_UTIL_FILE_CONTENTS_H
+#define MYCC_UTIL_FILE_CONTENTS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util/File.h"
+
+/**
+ * @brief Read-only contents of an entire file, followed by a null terminator
+ */
+typedef struct FileContents {
+    const char* data;
+    size_t len;
+    bool _is_mapped;
+} FileContents;
+
+/**
+ * @brief Gets the contents of f and closes it
+ *
+ * Large files are memory-mapped where the platform supports it, so they are
+ * paged in lazily and shared through the page cache. Otherwise the file is
+ * read into a buffer.
+ *
+ * @return The contents of the file, with data set to NULL on failure
+ */
+FileContents FileContents_read(File f);
+
+void FileContents_free(const FileContents* contents);
+
+#endif
+
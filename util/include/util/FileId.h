@@ -0,0 +1,26 @@
+#ifndef MYCC_UTIL_FILE_ID_H
+#define MYCC_UTIL_FILE_ID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Str.h"
+
+/**
+ * @brief Identifies a file independently of the path it is reached by
+ */
+typedef struct FileId {
+    // false if the file does not exist or identities are not supported on
+    // this platform
+    bool is_valid;
+    uint64_t dev, ino;
+} FileId;
+
+FileId FileId_get(CStr path);
+
+/**
+ * @brief Checks whether both ids are valid and belong to the same file
+ */
+bool FileId_eq(FileId id1, FileId id2);
+
+#endif
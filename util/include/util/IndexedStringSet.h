@@ -1,12 +1,27 @@
 #ifndef MYCC_UTIL_INDEXED_STRING_SET
 #define MYCC_UTIL_INDEXED_STRING_SET
 
-#include "util/StrBuf.h"
+#include "util/StringPool.h"
 
+/**
+ * @brief Set of strings that assigns each string the index it was inserted at
+ *
+ * The table is open addressed with a power of two capacity and is probed in
+ * groups of slots, like in SwissTable. Every slot has a control byte holding
+ * 7 bits of the hash of its string, so a whole group can be checked for
+ * candidates at once and strings are only compared when these bits match.
+ */
 typedef struct IndexedStringSet {
+    // _cap is the number of slots in the table
     uint32_t _len, _cap;
+    // One byte per slot, followed by a copy of the first group, so a group
+    // can be loaded at any slot without wrapping around
+    uint8_t* _ctrl;
+    // Index into _strings for every used slot
     uint32_t* _indices;
-    StrBuf* _data;
+    StringPool _strings;
+    // Hash of every string in _strings, so growing does not need to rehash
+    uint64_t* _hashes;
 } IndexedStringSet;
 
 IndexedStringSet IndexedStringSet_create(uint32_t init_cap);
@@ -15,10 +30,38 @@ void IndexedStringSet_free(const IndexedStringSet* s);
 
 uint32_t IndexedStringSet_find_or_insert(IndexedStringSet* s, Str str);
 
+/**
+ * @brief Returns the index of str, or UINT32_MAX if it is not in the set
+ */
+uint32_t IndexedStringSet_find(const IndexedStringSet* s, Str str);
+
 Str IndexedStringSet_get(const IndexedStringSet* s, uint32_t idx);
 
-StrBuf* IndexedStringSet_take(IndexedStringSet* s);
+/**
+ * @brief Frees the set, except for the pool containing the strings, which is
+ *        returned
+ */
+StringPool IndexedStringSet_take(IndexedStringSet* s);
 
 uint32_t IndexedStringSet_len(const IndexedStringSet* s);
 
+IndexedStringSet IndexedStringSet_copy(const IndexedStringSet* s);
+
+/**
+ * @brief Writes s to f, including the hash table, so it can be restored by
+ *        IndexedStringSet_read() without rehashing
+ *
+ * The hash table depends on mycc_hash_str(), so the result can only be read
+ * by a build using the same hash function.
+ */
+bool IndexedStringSet_write(const IndexedStringSet* s, File f);
+
+/**
+ * @brief Reads a set written by IndexedStringSet_write() from f into res
+ *
+ * @return false if reading failed or the data is invalid, in which case res
+ *         does not need to be freed
+ */
+bool IndexedStringSet_read(IndexedStringSet* res, File f);
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef MYCC_UTIL_MEM_ARENA_H
+#define MYCC_UTIL_MEM_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/Str.h"
+
+typedef struct MemArenaBlock {
+    char* data;
+    size_t size;
+} MemArenaBlock;
+
+/**
+ * @brief Bump allocator for objects that share a lifetime
+ *
+ * Memory is taken from a list of blocks and is only released all at once,
+ * either by MemArena_free() or by resetting to a previously taken mark.
+ * Blocks are kept after a reset, so an arena that is reset regularly does not
+ * allocate again once it has reached its peak size.
+ */
+typedef struct MemArena {
+    uint32_t _block_size;
+    // _curr is the index of the block allocations are currently taken from
+    uint32_t _curr, _len, _cap;
+    MemArenaBlock* _blocks;
+    size_t _pos;
+} MemArena;
+
+/**
+ * @brief Position in an arena that it can be reset to
+ */
+typedef struct MemArenaMark {
+    uint32_t _block_idx;
+    size_t _pos;
+} MemArenaMark;
+
+/**
+ * @brief Creates an empty arena, without allocating any blocks
+ *
+ * @param block_size Minimum size of the blocks allocated by this arena
+ */
+MemArena MemArena_create(uint32_t block_size);
+
+/**
+ * @brief Allocates bytes with the alignment of max_align_t
+ */
+void* MemArena_alloc(MemArena* a, size_t bytes);
+
+/**
+ * @brief Allocates bytes with the given alignment, which must be a power of 2
+ */
+void* MemArena_alloc_aligned(MemArena* a, size_t bytes, size_t alignment);
+
+void* MemArena_alloc_zeroed(MemArena* a, size_t len, size_t elem_size);
+
+/**
+ * @brief Copies the contents of str into the arena, adding a null terminator
+ */
+Str MemArena_copy_str(MemArena* a, Str str);
+
+MemArenaMark MemArena_mark(const MemArena* a);
+
+/**
+ * @brief Releases everything allocated after mark was taken
+ */
+void MemArena_reset(MemArena* a, MemArenaMark mark);
+
+/**
+ * @brief Releases all allocations, keeping the blocks for reuse
+ */
+void MemArena_clear(MemArena* a);
+
+void MemArena_free(const MemArena* a);
+
+#endif
+
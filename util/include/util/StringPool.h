@@ -0,0 +1,58 @@
+#ifndef MYCC_UTIL_STRING_POOL_H
+#define MYCC_UTIL_STRING_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util/Str.h"
+#include "util/File.h"
+
+typedef struct StringPoolEntry {
+    uint32_t offset, len;
+} StringPoolEntry;
+
+/**
+ * @brief List of strings whose contents are stored back to back in one buffer
+ *
+ * Strings are referred to by their index and each one is followed by a null
+ * terminator. Because the contents are in a single buffer, a pool can be
+ * freed or written out in one piece. Views returned by StringPool_get() are
+ * invalidated by StringPool_add().
+ */
+typedef struct StringPool {
+    uint32_t len, cap;
+    StringPoolEntry* entries;
+    uint32_t data_len, data_cap;
+    char* data;
+} StringPool;
+
+StringPool StringPool_create(uint32_t init_cap);
+
+void StringPool_free(const StringPool* p);
+
+/**
+ * @brief Appends a copy of str to p, which may point into p itself
+ *
+ * @return The index of the added string
+ */
+uint32_t StringPool_add(StringPool* p, Str str);
+
+Str StringPool_get(const StringPool* p, uint32_t idx);
+
+StringPool StringPool_copy(const StringPool* p);
+
+/**
+ * @brief Writes p to f in a format that can be read by StringPool_read()
+ */
+bool StringPool_write(const StringPool* p, File f);
+
+/**
+ * @brief Reads a pool written by StringPool_write() from f into res
+ *
+ * @return false if reading failed or the data is invalid, in which case res
+ *         does not need to be freed
+ */
+bool StringPool_read(StringPool* res, File f);
+
+#endif
+
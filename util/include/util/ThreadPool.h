@@ -0,0 +1,31 @@
+#ifndef MYCC_UTIL_THREAD_POOL_H
+#define MYCC_UTIL_THREAD_POOL_H
+
+#include <stdint.h>
+
+/**
+ * @brief Function executed for each task
+ *
+ * @param ctx Context pointer given to mycc_run_tasks()
+ * @param task_idx Index of the task in [0, num_tasks)
+ * @param worker_idx Index of the worker executing the task in [0, num_workers)
+ */
+typedef void (*TaskFunc)(void* ctx, uint32_t task_idx, uint32_t worker_idx);
+
+/**
+ * @brief Runs num_tasks independent tasks on num_workers threads
+ *
+ * Each worker starts with a contiguous range of tasks, which it works on from
+ * the front. When a worker runs out of tasks it steals from the back of the
+ * range of another worker, so long running tasks do not leave threads idle.
+ * The calling thread acts as worker 0. If a thread cannot be started, its
+ * tasks are stolen by the remaining workers. Returns once all tasks are
+ * finished.
+ */
+void mycc_run_tasks(uint32_t num_tasks,
+                    uint32_t num_workers,
+                    TaskFunc func,
+                    void* ctx);
+
+#endif
+
@@ -0,0 +1,17 @@
+#ifndef MYCC_UTIL_HASH_H
+#define MYCC_UTIL_HASH_H
+
+#include <stdint.h>
+
+#include "util/Str.h"
+
+/**
+ * @brief Hashes the contents of str
+ *
+ * This is a variant of wyhash, so all bits of the result are well mixed and
+ * can be used for both the bucket and a fingerprint.
+ */
+uint64_t mycc_hash_str(Str str);
+
+#endif
+
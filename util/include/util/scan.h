@@ -0,0 +1,65 @@
+#ifndef MYCC_UTIL_SCAN_H
+#define MYCC_UTIL_SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "util/Str.h"
+
+// Scanning kernels for the tokenizer. Vectorized versions are selected at
+// runtime depending on what the CPU supports, with a scalar fallback.
+
+/**
+ * @brief Returns the index of the first occurrence of c in s, or s.len if
+ *        there is none
+ */
+uint32_t mycc_find_char(Str s, char c);
+
+/**
+ * @brief Returns the index of the first character in s that is c1, c2 or c3,
+ *        or s.len if there is none
+ */
+uint32_t mycc_find_first_of3(Str s, char c1, char c2, char c3);
+
+/**
+ * @brief Returns the index of the first "*" followed by "/" in s, or s.len if
+ *        there is none
+ */
+uint32_t mycc_find_comment_end(Str s);
+
+enum {
+    MYCC_FIND_FIRST_OF_MAX = 8,
+};
+
+/**
+ * @brief Returns the index of the first character in s that is contained in
+ *        chars, or s.len if there is none
+ *
+ * @param chars At most MYCC_FIND_FIRST_OF_MAX characters
+ */
+uint32_t mycc_find_first_of(Str s, Str chars);
+
+/**
+ * @brief Returns the number of occurrences of c in s
+ */
+uint32_t mycc_count_char(Str s, char c);
+
+#ifdef MYCC_TEST_FUNCTIONALITY
+
+typedef enum {
+    SCAN_IMPL_SCALAR,
+    SCAN_IMPL_SSE2,
+    SCAN_IMPL_AVX2,
+} ScanImpl;
+
+/**
+ * @brief Forces the use of the given implementation
+ *
+ * @return false if the implementation is not supported on this machine
+ */
+bool mycc_scan_set_impl(ScanImpl impl);
+
+#endif
+
+#endif
+
@@ -0,0 +1,64 @@
+#ifndef MYCC_UTIL_THREAD_H
+#define MYCC_UTIL_THREAD_H
+
+#include <stdbool.h>
+
+// C11 threads are used where they are available, otherwise pthreads
+#ifdef MYCC_HAS_THREADS_H
+#include <threads.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef struct Mutex {
+#ifdef MYCC_HAS_THREADS_H
+    mtx_t _mtx;
+#else
+    pthread_mutex_t _mtx;
+#endif
+} Mutex;
+
+void Mutex_init(Mutex* m);
+void Mutex_destroy(Mutex* m);
+
+void Mutex_lock(Mutex* m);
+void Mutex_unlock(Mutex* m);
+
+typedef int (*ThreadFunc)(void* arg);
+
+typedef struct Thread {
+#ifdef MYCC_HAS_THREADS_H
+    thrd_t _thrd;
+#else
+    pthread_t _thrd;
+    ThreadFunc _func;
+    void* _arg;
+#endif
+} Thread;
+
+/**
+ * @brief Starts a thread executing func(arg)
+ *
+ * t must not be moved until the thread is joined.
+ *
+ * @return false if the thread could not be started
+ */
+bool Thread_create(Thread* t, ThreadFunc func, void* arg);
+
+void Thread_join(Thread* t);
+
+#ifdef MYCC_HAS_THREADS_H
+typedef once_flag OnceFlag;
+#define MYCC_ONCE_FLAG_INIT ONCE_FLAG_INIT
+#else
+typedef pthread_once_t OnceFlag;
+#define MYCC_ONCE_FLAG_INIT PTHREAD_ONCE_INIT
+#endif
+
+/**
+ * @brief Calls func exactly once for each flag, even if multiple threads call
+ *        this at the same time
+ */
+void mycc_call_once(OnceFlag* flag, void (*func)(void));
+
+#endif
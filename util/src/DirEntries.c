@@ -0,0 +1,74 @@
+// Names are compared exactly, so directories are only listed where file
+// systems are case-sensitive by default. On macOS and Windows a name with
+// different case may still exist, so no listing is available there.
+#if defined(__unix__) && !defined(__APPLE__)
+// Needed for opendir() with CMAKE_C_EXTENSIONS turned off
+#define _POSIX_C_SOURCE 200809L
+#define MYCC_HAS_DIRENT
+#endif
+
+#include "util/DirEntries.h"
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef MYCC_HAS_DIRENT
+#include <dirent.h>
+#endif
+
+#include "util/StrBuf.h"
+#include "util/macro_util.h"
+
+#ifdef MYCC_HAS_DIRENT
+
+DirEntries DirEntries_read(Str dir) {
+    StrBuf dir_str = dir.len == 0 ? StrBuf_create(STR_LIT("."))
+                                  : StrBuf_create(dir);
+    DIR* d = opendir(StrBuf_c_str(&dir_str).data);
+    StrBuf_free(&dir_str);
+    if (d == NULL) {
+        errno = 0;
+        return (DirEntries){
+            .is_valid = false,
+            ._names = {0},
+        };
+    }
+    DirEntries res = {
+        .is_valid = true,
+        ._names = IndexedStringSet_create(0),
+    };
+    const struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        const size_t len = strlen(entry->d_name);
+        IndexedStringSet_find_or_insert(&res._names,
+                                        (Str){(uint32_t)len, entry->d_name});
+    }
+    closedir(d);
+    return res;
+}
+
+#else
+
+DirEntries DirEntries_read(Str dir) {
+    UNUSED(dir);
+    return (DirEntries){
+        .is_valid = false,
+        ._names = {0},
+    };
+}
+
+#endif
+
+bool DirEntries_contains(const DirEntries* entries, Str name) {
+    if (!entries->is_valid) {
+        return true;
+    }
+    return IndexedStringSet_find(&entries->_names, name) != UINT32_MAX;
+}
+
+void DirEntries_free(const DirEntries* entries) {
+    if (entries->is_valid) {
+        IndexedStringSet_free(&entries->_names);
+    }
+}
+
@@ -45,10 +45,20 @@ File File_open(CStr filename, OpenMode mode) {
     };
 }
 
+File File_open_tmp(void) {
+    return (File){
+        ._file = tmpfile(),
+    };
+}
+
 bool File_valid(File f) {
     return f._file != NULL;
 }
 
+bool File_remove(CStr filename) {
+    return remove(filename.data) == 0;
+}
+
 bool File_close(File f) {
     const int res = fclose(f._file);
     return res == 0;
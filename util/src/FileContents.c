@@ -0,0 +1,108 @@
+#if defined(__unix__) || defined(__APPLE__)
+// Needed for fileno() and mmap() with CMAKE_C_EXTENSIONS turned off
+#define _POSIX_C_SOURCE 200809L
+#define MYCC_HAS_MMAP
+#endif
+
+#include "util/FileContents.h"
+
+#include <assert.h>
+
+#ifdef MYCC_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "util/mem.h"
+
+static FileContents read_into_buffer(File f, size_t size) {
+    char* data = mycc_alloc(size + 1);
+    const size_t read = File_read(data, 1, size, f);
+    if (read != size) {
+        mycc_free(data);
+        return (FileContents){0};
+    }
+    data[size] = '\0';
+    return (FileContents){
+        .data = data,
+        .len = size,
+        ._is_mapped = false,
+    };
+}
+
+#ifdef MYCC_HAS_MMAP
+
+enum {
+    // Below this, a single read is cheaper than setting up a mapping
+    MIN_MAPPED_SIZE = 16 * 1024,
+};
+
+static FileContents map_file(int fd, size_t size) {
+    const long page_size = sysconf(_SC_PAGESIZE);
+    // The null terminator is the zero fill of the last page, so a file that
+    // ends exactly on a page boundary cannot be mapped
+    if (size < MIN_MAPPED_SIZE || page_size <= 0
+        || size % (size_t)page_size == 0) {
+        return (FileContents){0};
+    }
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return (FileContents){0};
+    }
+    return (FileContents){
+        .data = data,
+        .len = size,
+        ._is_mapped = true,
+    };
+}
+
+FileContents FileContents_read(File f) {
+    assert(File_valid(f));
+    const int fd = fileno(f._file);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        File_close(f);
+        return (FileContents){0};
+    }
+    const size_t size = (size_t)st.st_size;
+    FileContents res = map_file(fd, size);
+    if (res.data == NULL) {
+        res = read_into_buffer(f, size);
+    }
+    File_close(f);
+    return res;
+}
+
+#else
+
+FileContents FileContents_read(File f) {
+    assert(File_valid(f));
+    if (!File_seek(f, 0, FILE_SEEK_END)) {
+        File_close(f);
+        return (FileContents){0};
+    }
+    const long size = File_tell(f);
+    if (size < 0 || !File_seek(f, 0, FILE_SEEK_START)) {
+        File_close(f);
+        return (FileContents){0};
+    }
+    FileContents res = read_into_buffer(f, (size_t)size);
+    File_close(f);
+    return res;
+}
+
+#endif
+
+void FileContents_free(const FileContents* contents) {
+#ifdef MYCC_HAS_MMAP
+    if (contents->_is_mapped) {
+        munmap((void*)contents->data, contents->len);
+        return;
+    }
+#endif
+    assert(!contents->_is_mapped);
+    // cast to make msvc happy
+    mycc_free((void*)contents->data);
+}
+
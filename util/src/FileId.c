@@ -0,0 +1,48 @@
+#if defined(__unix__) || defined(__APPLE__)
+// Needed for stat() with CMAKE_C_EXTENSIONS turned off
+#define _POSIX_C_SOURCE 200809L
+#define MYCC_HAS_STAT
+#endif
+
+#include "util/FileId.h"
+
+#include <errno.h>
+
+#ifdef MYCC_HAS_STAT
+#include <sys/stat.h>
+#endif
+
+#include "util/macro_util.h"
+
+#ifdef MYCC_HAS_STAT
+
+FileId FileId_get(CStr path) {
+    struct stat st;
+    if (stat(path.data, &st) != 0) {
+        errno = 0;
+        return (FileId){
+            .is_valid = false,
+        };
+    }
+    return (FileId){
+        .is_valid = true,
+        .dev = (uint64_t)st.st_dev,
+        .ino = (uint64_t)st.st_ino,
+    };
+}
+
+#else
+
+FileId FileId_get(CStr path) {
+    UNUSED(path);
+    return (FileId){
+        .is_valid = false,
+    };
+}
+
+#endif
+
+bool FileId_eq(FileId id1, FileId id2) {
+    return id1.is_valid && id2.is_valid && id1.dev == id2.dev
+           && id1.ino == id2.ino;
+}
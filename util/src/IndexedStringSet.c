@@ -3,120 +3,308 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define MYCC_SET_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 #include "util/macro_util.h"
 #include "util/mem.h"
+#include "util/hash.h"
+
+enum {
+    GROUP_WIDTH = 16,
+    CTRL_EMPTY = 0x80,
+};
+
+typedef uint32_t GroupMask;
+
+static uint32_t first_set_bit(GroupMask mask) {
+    assert(mask != 0);
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long res;
+    _BitScanForward(&res, mask);
+    return (uint32_t)res;
+#elif defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctz(mask);
+#else
+    uint32_t res = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++res;
+    }
+    return res;
+#endif
+}
+
+// Mask of all slots in the group starting at ctrl whose control byte is b
+static GroupMask group_match(const uint8_t* ctrl, uint8_t b) {
+#ifdef MYCC_SET_SSE2
+    const __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    const __m128i eq = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)b));
+    return (GroupMask)_mm_movemask_epi8(eq);
+#else
+    GroupMask res = 0;
+    for (uint32_t i = 0; i < GROUP_WIDTH; ++i) {
+        if (ctrl[i] == b) {
+            res |= (GroupMask)1 << i;
+        }
+    }
+    return res;
+#endif
+}
+
+static GroupMask group_match_empty(const uint8_t* ctrl) {
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+// Upper bits select the first slot, the lowest 7 are stored in the control
+// byte
+static uint32_t hash_pos(uint64_t hash, uint32_t cap) {
+    return (uint32_t)(hash >> 7) & (cap - 1);
+}
+
+static uint8_t hash_ctrl(uint64_t hash) {
+    return (uint8_t)(hash & 0x7f);
+}
+
+// At most 7/8 of the slots are used
+static uint32_t max_len(uint32_t cap) {
+    return cap - cap / 8;
+}
+
+static uint32_t cap_for_len(uint32_t len) {
+    uint32_t cap = GROUP_WIDTH;
+    while (max_len(cap) < len) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+static uint32_t* alloc_indices(uint32_t cap) {
+    uint32_t* res = mycc_alloc(sizeof *res * cap);
+    // Unused slots are never read, this only keeps written sets deterministic
+    memset(res, 0xff, sizeof *res * cap);
+    return res;
+}
+
+static uint8_t* alloc_ctrl(uint32_t cap) {
+    uint8_t* res = mycc_alloc(sizeof *res * (cap + GROUP_WIDTH));
+    memset(res, CTRL_EMPTY, sizeof *res * (cap + GROUP_WIDTH));
+    return res;
+}
 
 IndexedStringSet IndexedStringSet_create(uint32_t init_cap) {
+    const uint32_t cap = cap_for_len(init_cap);
+    const uint32_t strings_cap = max_len(cap);
     IndexedStringSet res = {
         ._len = 0,
-        ._cap = init_cap,
-        ._indices = mycc_alloc(sizeof *res._indices * init_cap),
-        ._data = mycc_alloc(sizeof *res._data * init_cap),
+        ._cap = cap,
+        ._ctrl = alloc_ctrl(cap),
+        ._indices = alloc_indices(cap),
+        ._strings = StringPool_create(strings_cap),
+        ._hashes = mycc_alloc(sizeof *res._hashes * strings_cap),
     };
-    memset(res._indices, 0xff, sizeof *res._indices * init_cap);
     return res;
 }
 
 void IndexedStringSet_free(const IndexedStringSet* s) {
+    mycc_free(s->_ctrl);
     mycc_free(s->_indices);
-    for (uint32_t i = 0; i < s->_len; ++i) {
-        StrBuf_free(&s->_data[i]);
-    }
-    mycc_free(s->_data);
+    StringPool_free(&s->_strings);
+    mycc_free(s->_hashes);
 }
 
-static uint32_t insert(IndexedStringSet* s, const StrBuf* buf, uint32_t idx_idx) {
-    assert(s->_len < s->_cap);
-
-    const uint32_t res_idx = s->_len;
-    s->_indices[idx_idx] = res_idx;
-    s->_data[res_idx] = *buf;
-    ++s->_len;
-    return res_idx;
+static void set_ctrl(IndexedStringSet* s, uint32_t slot, uint8_t ctrl) {
+    s->_ctrl[slot] = ctrl;
+    // Keep the copy of the first group after the end in sync
+    s->_ctrl[((slot - GROUP_WIDTH) & (s->_cap - 1)) + GROUP_WIDTH] = ctrl;
 }
 
-// Hash function taken from K&R version 2 (page 144)
-static uint32_t hash_string(Str str) {
-    uint32_t hash = 0;
+// Finds the first empty slot in the probe sequence of hash
+static uint32_t find_empty_slot(const IndexedStringSet* s, uint64_t hash) {
+    const uint32_t mask = s->_cap - 1;
+    uint32_t pos = hash_pos(hash, s->_cap);
+    uint32_t stride = 0;
+    while (true) {
+        const GroupMask empty = group_match_empty(s->_ctrl + pos);
+        if (empty != 0) {
+            return (pos + first_set_bit(empty)) & mask;
+        }
+        stride += GROUP_WIDTH;
+        pos = (pos + stride) & mask;
+    }
+    UNREACHABLE();
+}
 
-    uint32_t i = 0;
-    while (i != str.len) {
-        hash = Str_at(str, i) + 32 * hash;
-        ++i;
+static void grow(IndexedStringSet* s) {
+    s->_cap *= 2;
+    mycc_free(s->_ctrl);
+    s->_ctrl = alloc_ctrl(s->_cap);
+    mycc_free(s->_indices);
+    s->_indices = alloc_indices(s->_cap);
+    s->_hashes = mycc_realloc(s->_hashes,
+                              sizeof *s->_hashes * max_len(s->_cap));
+    for (uint32_t i = 0; i < s->_len; ++i) {
+        const uint64_t hash = s->_hashes[i];
+        const uint32_t slot = find_empty_slot(s, hash);
+        set_ctrl(s, slot, hash_ctrl(hash));
+        s->_indices[slot] = i;
     }
-    return hash;
 }
 
-// Assumes key is not already in set
-static uint32_t insert_str_buf(IndexedStringSet* s, const StrBuf* buf) {
-    const uint32_t hash = hash_string(StrBuf_as_str(buf));
-    uint32_t i = hash % s->_cap;
+static uint32_t find(const IndexedStringSet* s, Str str, uint64_t hash) {
+    const uint8_t ctrl = hash_ctrl(hash);
+    const uint32_t mask = s->_cap - 1;
+    uint32_t pos = hash_pos(hash, s->_cap);
+    uint32_t stride = 0;
     while (true) {
-        const uint32_t str_idx = s->_indices[i];
-        if (str_idx == UINT32_MAX) {
-            return insert(s, buf, i);
-        } else {
-            i = (i + 1) % s->_cap;
+        const uint8_t* group = s->_ctrl + pos;
+        GroupMask candidates = group_match(group, ctrl);
+        while (candidates != 0) {
+            const uint32_t slot = (pos + first_set_bit(candidates)) & mask;
+            const uint32_t str_idx = s->_indices[slot];
+            if (s->_hashes[str_idx] == hash
+                && Str_eq(str, StringPool_get(&s->_strings, str_idx))) {
+                return str_idx;
+            }
+            candidates &= candidates - 1;
+        }
+        const GroupMask empty = group_match_empty(group);
+        if (empty != 0) {
+            return UINT32_MAX;
         }
+        stride += GROUP_WIDTH;
+        pos = (pos + stride) & mask;
     }
     UNREACHABLE();
 }
 
-static void rehash(IndexedStringSet* s) {
-    const uint32_t prev_len = s->_len;
-    StrBuf* old_data = s->_data;
-    s->_len = 0;
-    s->_cap += s->_cap / 2 + 1;
-    s->_indices = mycc_realloc(s->_indices, sizeof *s->_indices * s->_cap);
-    memset(s->_indices, 0xff, sizeof *s->_indices * s->_cap);
-    s->_data = mycc_alloc(sizeof *s->_data * s->_cap);
-    for (uint32_t i = 0; i < prev_len; ++i) {
-        insert_str_buf(s, &old_data[i]);
-    }
-    assert(s->_len == prev_len);
-    mycc_free(old_data);
+uint32_t IndexedStringSet_find(const IndexedStringSet* s, Str str) {
+    return find(s, str, mycc_hash_str(str));
 }
 
-static void rehash_if_necessary(IndexedStringSet* s) {
-    if (s->_len == s->_cap - 1) {
-        rehash(s);
+uint32_t IndexedStringSet_find_or_insert(IndexedStringSet* s, Str str) {
+    const uint64_t hash = mycc_hash_str(str);
+    const uint32_t found = find(s, str, hash);
+    if (found != UINT32_MAX) {
+        return found;
     }
-}
 
-uint32_t IndexedStringSet_find_or_insert(IndexedStringSet* s, Str str) {
-    rehash_if_necessary(s);
-    const uint32_t hash = hash_string(str);
-    uint32_t i = hash % s->_cap;
-    while (true) {
-        const uint32_t str_idx = s->_indices[i];
-        if (str_idx == UINT32_MAX) {
-            StrBuf buf = StrBuf_create(str);
-            return insert(s, &buf, i);
-        } else if (Str_eq(str, StrBuf_as_str(&s->_data[str_idx]))) {
-            return str_idx;
-        } else {
-            i = (i + 1) % s->_cap;
-        }
+    // Nothing is ever removed, so the string is not in the set
+    if (s->_len == max_len(s->_cap)) {
+        grow(s);
     }
-    UNREACHABLE(); 
+    const uint32_t slot = find_empty_slot(s, hash);
+    const uint32_t res_idx = StringPool_add(&s->_strings, str);
+    assert(res_idx == s->_len);
+    set_ctrl(s, slot, hash_ctrl(hash));
+    s->_indices[slot] = res_idx;
+    s->_hashes[res_idx] = hash;
+    ++s->_len;
+    return res_idx;
 }
 
 Str IndexedStringSet_get(const IndexedStringSet* s, uint32_t idx) {
     assert(idx < s->_len);
-    return StrBuf_as_str(&s->_data[idx]);
+    return StringPool_get(&s->_strings, idx);
 }
 
-StrBuf* IndexedStringSet_take(IndexedStringSet* s) {
-    StrBuf* data = s->_data;
-    s->_data = NULL;
-    s->_len = 0;
-    s->_cap = 0;
-    mycc_free(s->_indices);
-    s->_indices = NULL;
-    return data;
+StringPool IndexedStringSet_take(IndexedStringSet* s) {
+    const StringPool res = s->_strings;
+    s->_strings = (StringPool){0};
+    IndexedStringSet_free(s);
+    *s = (IndexedStringSet){0};
+    return res;
 }
 
 uint32_t IndexedStringSet_len(const IndexedStringSet* s) {
     return s->_len;
 }
 
+static void* copy_array(const void* arr, size_t elem_size, uint32_t len) {
+    void* res = mycc_alloc_or_null(elem_size * len);
+    if (len != 0) {
+        memcpy(res, arr, elem_size * len);
+    }
+    return res;
+}
+
+IndexedStringSet IndexedStringSet_copy(const IndexedStringSet* s) {
+    IndexedStringSet res = {
+        ._len = s->_len,
+        ._cap = s->_cap,
+        ._ctrl = copy_array(s->_ctrl,
+                            sizeof *s->_ctrl,
+                            s->_cap + GROUP_WIDTH),
+        ._indices = copy_array(s->_indices, sizeof *s->_indices, s->_cap),
+        ._strings = StringPool_copy(&s->_strings),
+        ._hashes = mycc_alloc(sizeof *res._hashes * max_len(s->_cap)),
+    };
+    memcpy(res._hashes, s->_hashes, sizeof *res._hashes * s->_len);
+    return res;
+}
+
+bool IndexedStringSet_write(const IndexedStringSet* s, File f) {
+    const uint32_t ctrl_len = s->_cap + GROUP_WIDTH;
+    return File_write(&s->_len, sizeof s->_len, 1, f) == 1
+           && File_write(&s->_cap, sizeof s->_cap, 1, f) == 1
+           && File_write(s->_ctrl, sizeof *s->_ctrl, ctrl_len, f) == ctrl_len
+           && File_write(s->_indices, sizeof *s->_indices, s->_cap, f)
+                  == s->_cap
+           && File_write(s->_hashes, sizeof *s->_hashes, s->_len, f)
+                  == s->_len
+           && StringPool_write(&s->_strings, f);
+}
+
+// Checks that the table read from a file cannot lead out of bounds
+static bool is_valid_table(const IndexedStringSet* s) {
+    if (s->_strings.len != s->_len) {
+        return false;
+    }
+    uint32_t num_used = 0;
+    for (uint32_t i = 0; i < s->_cap; ++i) {
+        if (s->_ctrl[i] == CTRL_EMPTY) {
+            continue;
+        }
+        if (s->_ctrl[i] > 0x7f || s->_indices[i] >= s->_len) {
+            return false;
+        }
+        ++num_used;
+    }
+    // The table needs empty slots for probing to terminate
+    return num_used == s->_len
+           && memcmp(s->_ctrl, s->_ctrl + s->_cap, GROUP_WIDTH) == 0;
+}
+
+bool IndexedStringSet_read(IndexedStringSet* res, File f) {
+    uint32_t len, cap;
+    if (File_read(&len, sizeof len, 1, f) != 1
+        || File_read(&cap, sizeof cap, 1, f) != 1 || cap < GROUP_WIDTH
+        || (cap & (cap - 1)) != 0 || len > max_len(cap)) {
+        return false;
+    }
+    const uint32_t ctrl_len = cap + GROUP_WIDTH;
+    IndexedStringSet s = {
+        ._len = len,
+        ._cap = cap,
+        ._ctrl = mycc_alloc(sizeof *s._ctrl * ctrl_len),
+        ._indices = mycc_alloc(sizeof *s._indices * cap),
+        ._strings = {0},
+        ._hashes = mycc_alloc(sizeof *s._hashes * max_len(cap)),
+    };
+    if (File_read(s._ctrl, sizeof *s._ctrl, ctrl_len, f) != ctrl_len
+        || File_read(s._indices, sizeof *s._indices, cap, f) != cap
+        || File_read(s._hashes, sizeof *s._hashes, len, f) != len
+        || !StringPool_read(&s._strings, f) || !is_valid_table(&s)) {
+        IndexedStringSet_free(&s);
+        return false;
+    }
+    *res = s;
+    return true;
+}
+
@@ -0,0 +1,136 @@
+#include "util/MemArena.h"
+
+#include <string.h>
+#include <assert.h>
+#include <stdalign.h>
+
+#include "util/mem.h"
+
+enum {
+    DEFAULT_BLOCK_SIZE = 64 * 1024,
+};
+
+MemArena MemArena_create(uint32_t block_size) {
+    return (MemArena){
+        ._block_size = block_size == 0 ? DEFAULT_BLOCK_SIZE : block_size,
+        ._curr = 0,
+        ._len = 0,
+        ._cap = 0,
+        ._blocks = NULL,
+        ._pos = 0,
+    };
+}
+
+// Offset of the first address at or after pos with the given alignment
+static size_t aligned_start(const MemArenaBlock* block,
+                            size_t pos,
+                            size_t alignment) {
+    const uintptr_t addr = (uintptr_t)block->data + pos;
+    const uintptr_t aligned = (addr + alignment - 1) & ~(alignment - 1);
+    return pos + (aligned - addr);
+}
+
+static bool fits_in_block(const MemArenaBlock* block,
+                          size_t pos,
+                          size_t bytes,
+                          size_t alignment) {
+    const size_t start = aligned_start(block, pos, alignment);
+    return start <= block->size && bytes <= block->size - start;
+}
+
+static MemArenaBlock MemArenaBlock_create(size_t size) {
+    return (MemArenaBlock){
+        .data = mycc_alloc(size),
+        .size = size,
+    };
+}
+
+// Moves to the next block that can hold bytes, allocating it if necessary
+static void next_block(MemArena* a, size_t bytes, size_t alignment) {
+    // block data is aligned to max_align_t, so bigger alignments need padding
+    const size_t needed = alignment > alignof(max_align_t)
+                              ? bytes + alignment
+                              : bytes;
+    const size_t size = needed > a->_block_size ? needed : a->_block_size;
+    const uint32_t next = a->_len == 0 ? 0 : a->_curr + 1;
+    if (next == a->_len) {
+        if (a->_len == a->_cap) {
+            mycc_grow_alloc((void**)&a->_blocks,
+                            &a->_cap,
+                            sizeof *a->_blocks);
+        }
+        a->_blocks[a->_len] = MemArenaBlock_create(size);
+        ++a->_len;
+    } else if (!fits_in_block(&a->_blocks[next], 0, bytes, alignment)) {
+        // Only retained blocks after the current one are replaced, so
+        // allocations before the current position stay valid
+        mycc_free(a->_blocks[next].data);
+        a->_blocks[next] = MemArenaBlock_create(size);
+    }
+    a->_curr = next;
+    a->_pos = 0;
+}
+
+void* MemArena_alloc_aligned(MemArena* a, size_t bytes, size_t alignment) {
+    assert(a);
+    assert(bytes != 0);
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (a->_len == 0
+        || !fits_in_block(&a->_blocks[a->_curr], a->_pos, bytes, alignment)) {
+        next_block(a, bytes, alignment);
+    }
+    MemArenaBlock* block = &a->_blocks[a->_curr];
+    const size_t start = aligned_start(block, a->_pos, alignment);
+    assert(start + bytes <= block->size);
+    a->_pos = start + bytes;
+    return block->data + start;
+}
+
+void* MemArena_alloc(MemArena* a, size_t bytes) {
+    return MemArena_alloc_aligned(a, bytes, alignof(max_align_t));
+}
+
+void* MemArena_alloc_zeroed(MemArena* a, size_t len, size_t elem_size) {
+    const size_t bytes = len * elem_size;
+    void* res = MemArena_alloc(a, bytes);
+    memset(res, 0, bytes);
+    return res;
+}
+
+Str MemArena_copy_str(MemArena* a, Str str) {
+    char* data = MemArena_alloc_aligned(a, str.len + 1, 1);
+    memcpy(data, str.data, str.len);
+    data[str.len] = '\0';
+    return (Str){
+        .len = str.len,
+        .data = data,
+    };
+}
+
+MemArenaMark MemArena_mark(const MemArena* a) {
+    return (MemArenaMark){
+        ._block_idx = a->_curr,
+        ._pos = a->_pos,
+    };
+}
+
+void MemArena_reset(MemArena* a, MemArenaMark mark) {
+    assert(mark._block_idx < a->_len || (a->_len == 0 && mark._pos == 0));
+    assert(mark._block_idx < a->_curr
+           || (mark._block_idx == a->_curr && mark._pos <= a->_pos));
+    a->_curr = mark._block_idx;
+    a->_pos = mark._pos;
+}
+
+void MemArena_clear(MemArena* a) {
+    a->_curr = 0;
+    a->_pos = 0;
+}
+
+void MemArena_free(const MemArena* a) {
+    for (uint32_t i = 0; i < a->_len; ++i) {
+        mycc_free(a->_blocks[i].data);
+    }
+    mycc_free(a->_blocks);
+}
+
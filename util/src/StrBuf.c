@@ -218,7 +218,7 @@ void StrBuf_reserve(StrBuf* str, uint32_t new_cap) {
         if (new_cap >= STR_BUF_STATIC_LEN) {
             StrBuf_move_to_dyn_buf(str, new_cap);
         }
-    } else if (str->_cap < new_cap) {
+    } else if (str->_cap <= new_cap) {
         str->_cap = new_cap + 1;
         str->_data = mycc_realloc(str->_data, sizeof *str->_data * str->_cap);
     }
@@ -0,0 +1,151 @@
+#include "util/StringPool.h"
+
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "util/mem.h"
+
+enum {
+    // Average length assumed when sizing the initial data buffer
+    INIT_BYTES_PER_STRING = 8,
+    MIN_DATA_CAP = 64,
+};
+
+StringPool StringPool_create(uint32_t init_cap) {
+    const uint32_t data_cap = init_cap * INIT_BYTES_PER_STRING;
+    return (StringPool){
+        .len = 0,
+        .cap = init_cap,
+        .entries = mycc_alloc_or_null(sizeof(StringPoolEntry) * init_cap),
+        .data_len = 0,
+        .data_cap = data_cap,
+        .data = mycc_alloc_or_null(sizeof(char) * data_cap),
+    };
+}
+
+void StringPool_free(const StringPool* p) {
+    mycc_free(p->entries);
+    mycc_free(p->data);
+}
+
+uint32_t StringPool_add(StringPool* p, Str str) {
+    if (p->len == p->cap) {
+        mycc_grow_alloc((void**)&p->entries, &p->cap, sizeof *p->entries);
+    }
+    // Each string is followed by a null terminator
+    const uint32_t bytes = str.len + 1;
+    assert(bytes <= UINT32_MAX - p->data_len);
+    if (p->data_cap - p->data_len < bytes) {
+        // str may point into the pool itself
+        const bool is_in_pool = p->data != NULL && str.data >= p->data
+                                && str.data < p->data + p->data_len;
+        const size_t offset = is_in_pool ? (size_t)(str.data - p->data) : 0;
+        // Computed in 64 bits, so doubling cannot wrap around
+        const uint64_t needed = (uint64_t)p->data_len + bytes;
+        uint64_t new_cap = p->data_cap == 0 ? MIN_DATA_CAP : p->data_cap;
+        while (new_cap < needed) {
+            new_cap *= 2;
+        }
+        if (new_cap > UINT32_MAX) {
+            new_cap = UINT32_MAX;
+        }
+        p->data = mycc_realloc(p->data, sizeof *p->data * (size_t)new_cap);
+        p->data_cap = (uint32_t)new_cap;
+        if (is_in_pool) {
+            str.data = p->data + offset;
+        }
+    }
+    if (str.len != 0) {
+        memcpy(p->data + p->data_len, str.data, sizeof *p->data * str.len);
+    }
+    p->data[p->data_len + str.len] = '\0';
+    const uint32_t idx = p->len;
+    p->entries[idx] = (StringPoolEntry){
+        .offset = p->data_len,
+        .len = str.len,
+    };
+    p->data_len += bytes;
+    ++p->len;
+    return idx;
+}
+
+StringPool StringPool_copy(const StringPool* p) {
+    StringPool res = {
+        .len = p->len,
+        .cap = p->len,
+        .entries = mycc_alloc_or_null(sizeof *res.entries * p->len),
+        .data_len = p->data_len,
+        .data_cap = p->data_len,
+        .data = mycc_alloc_or_null(sizeof *res.data * p->data_len),
+    };
+    if (p->len != 0) {
+        memcpy(res.entries, p->entries, sizeof *res.entries * p->len);
+    }
+    if (p->data_len != 0) {
+        memcpy(res.data, p->data, sizeof *res.data * p->data_len);
+    }
+    return res;
+}
+
+// The arrays of an empty pool may be NULL, which must not be passed to
+// fwrite() or fread()
+bool StringPool_write(const StringPool* p, File f) {
+    return File_write(&p->len, sizeof p->len, 1, f) == 1
+           && (p->len == 0
+               || File_write(p->entries, sizeof *p->entries, p->len, f)
+                      == p->len)
+           && File_write(&p->data_len, sizeof p->data_len, 1, f) == 1
+           && (p->data_len == 0
+               || File_write(p->data, sizeof *p->data, p->data_len, f)
+                      == p->data_len);
+}
+
+bool StringPool_read(StringPool* res, File f) {
+    uint32_t len, data_len;
+    if (File_read(&len, sizeof len, 1, f) != 1) {
+        return false;
+    }
+    StringPoolEntry* entries = mycc_alloc_or_null(sizeof *entries * len);
+    if ((len != 0 && File_read(entries, sizeof *entries, len, f) != len)
+        || File_read(&data_len, sizeof data_len, 1, f) != 1) {
+        mycc_free(entries);
+        return false;
+    }
+    char* data = mycc_alloc_or_null(sizeof *data * data_len);
+    if (data_len != 0
+        && File_read(data, sizeof *data, data_len, f) != data_len) {
+        mycc_free(entries);
+        mycc_free(data);
+        return false;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+        const StringPoolEntry entry = entries[i];
+        // The null terminator has to be inside the data as well
+        if (entry.offset >= data_len || entry.len >= data_len - entry.offset
+            || data[entry.offset + entry.len] != '\0') {
+            mycc_free(entries);
+            mycc_free(data);
+            return false;
+        }
+    }
+    *res = (StringPool){
+        .len = len,
+        .cap = len,
+        .entries = entries,
+        .data_len = data_len,
+        .data_cap = data_len,
+        .data = data,
+    };
+    return true;
+}
+
+Str StringPool_get(const StringPool* p, uint32_t idx) {
+    assert(idx < p->len);
+    const StringPoolEntry entry = p->entries[idx];
+    return (Str){
+        .len = entry.len,
+        .data = p->data + entry.offset,
+    };
+}
+
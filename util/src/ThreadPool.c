@@ -0,0 +1,142 @@
+#include "util/ThreadPool.h"
+
+#include <stdbool.h>
+#include <assert.h>
+
+#include "util/mem.h"
+#include "util/thread.h"
+
+// Tasks that have not been started yet, the owner takes tasks from begin,
+// while other workers steal from end
+typedef struct {
+    Mutex lock;
+    uint32_t begin, end;
+} TaskRange;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct {
+    ThreadPool* pool;
+    uint32_t idx;
+} Worker;
+
+struct ThreadPool {
+    uint32_t num_workers;
+    TaskRange* ranges;
+    Worker* workers;
+    TaskFunc func;
+    void* ctx;
+};
+
+static bool take_own_task(TaskRange* range, uint32_t* task_idx) {
+    Mutex_lock(&range->lock);
+    const bool res = range->begin != range->end;
+    if (res) {
+        *task_idx = range->begin;
+        ++range->begin;
+    }
+    Mutex_unlock(&range->lock);
+    return res;
+}
+
+static bool steal_task(TaskRange* range, uint32_t* task_idx) {
+    Mutex_lock(&range->lock);
+    const bool res = range->begin != range->end;
+    if (res) {
+        --range->end;
+        *task_idx = range->end;
+    }
+    Mutex_unlock(&range->lock);
+    return res;
+}
+
+// Tries every other worker, starting with the next one, so thieves do not all
+// contend for the same range
+static bool find_task_to_steal(ThreadPool* pool,
+                               uint32_t worker_idx,
+                               uint32_t* task_idx) {
+    for (uint32_t i = 1; i < pool->num_workers; ++i) {
+        const uint32_t victim = (worker_idx + i) % pool->num_workers;
+        if (steal_task(&pool->ranges[victim], task_idx)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int worker_func(void* arg) {
+    Worker* worker = arg;
+    ThreadPool* pool = worker->pool;
+    TaskRange* own_range = &pool->ranges[worker->idx];
+
+    uint32_t task_idx;
+    while (take_own_task(own_range, &task_idx)
+           || find_task_to_steal(pool, worker->idx, &task_idx)) {
+        pool->func(pool->ctx, task_idx, worker->idx);
+    }
+    return 0;
+}
+
+void mycc_run_tasks(uint32_t num_tasks,
+                    uint32_t num_workers,
+                    TaskFunc func,
+                    void* ctx) {
+    assert(func);
+    if (num_workers > num_tasks) {
+        num_workers = num_tasks;
+    }
+    if (num_workers <= 1) {
+        for (uint32_t i = 0; i < num_tasks; ++i) {
+            func(ctx, i, 0);
+        }
+        return;
+    }
+
+    ThreadPool pool = {
+        .num_workers = num_workers,
+        .ranges = mycc_alloc(sizeof *pool.ranges * num_workers),
+        .workers = mycc_alloc(sizeof *pool.workers * num_workers),
+        .func = func,
+        .ctx = ctx,
+    };
+    const uint32_t tasks_per_worker = num_tasks / num_workers;
+    const uint32_t remainder = num_tasks % num_workers;
+    uint32_t next_begin = 0;
+    for (uint32_t i = 0; i < num_workers; ++i) {
+        const uint32_t len = tasks_per_worker + (i < remainder ? 1 : 0);
+        TaskRange* range = &pool.ranges[i];
+        Mutex_init(&range->lock);
+        range->begin = next_begin;
+        range->end = next_begin + len;
+        next_begin += len;
+        pool.workers[i] = (Worker){
+            .pool = &pool,
+            .idx = i,
+        };
+    }
+    assert(next_begin == num_tasks);
+
+    Thread* threads = mycc_alloc(sizeof *threads * (num_workers - 1));
+    bool* started = mycc_alloc(sizeof *started * (num_workers - 1));
+    for (uint32_t i = 1; i < num_workers; ++i) {
+        started[i - 1] = Thread_create(&threads[i - 1],
+                                       worker_func,
+                                       &pool.workers[i]);
+    }
+    worker_func(&pool.workers[0]);
+    for (uint32_t i = 1; i < num_workers; ++i) {
+        if (started[i - 1]) {
+            Thread_join(&threads[i - 1]);
+        }
+    }
+
+    // Worker 0 exits once nothing is left to steal, so all ranges must be empty
+    for (uint32_t i = 0; i < num_workers; ++i) {
+        assert(pool.ranges[i].begin == pool.ranges[i].end);
+        Mutex_destroy(&pool.ranges[i].lock);
+    }
+    mycc_free(started);
+    mycc_free(threads);
+    mycc_free(pool.workers);
+    mycc_free(pool.ranges);
+}
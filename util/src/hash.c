@@ -0,0 +1,99 @@
+#include "util/hash.h"
+
+#include <string.h>
+
+static const uint64_t g_secret[] = {
+    0xa0761d6478bd642full,
+    0xe7037ed1a0b428dbull,
+    0x8ebc6af09c88c6e3ull,
+};
+
+// 64x64 bit multiplication, returning the low half in a and the high half in b
+static void mum(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 u128;
+    const u128 r = (u128)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32;
+    const uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    const uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static uint64_t mix(uint64_t a, uint64_t b) {
+    mum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t read64(const char* p) {
+    uint64_t res;
+    memcpy(&res, p, sizeof res);
+    return res;
+}
+
+static uint64_t read32(const char* p) {
+    uint32_t res;
+    memcpy(&res, p, sizeof res);
+    return res;
+}
+
+// Reads 1 to 3 bytes
+static uint64_t read_small(const char* p, uint32_t len) {
+    return ((uint64_t)(unsigned char)p[0] << 16)
+           | ((uint64_t)(unsigned char)p[len >> 1] << 8)
+           | (uint64_t)(unsigned char)p[len - 1];
+}
+
+uint64_t mycc_hash_str(Str str) {
+    const char* p = str.data;
+    const uint32_t len = str.len;
+    uint64_t seed = mix(g_secret[0], g_secret[1]);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            const uint32_t mid = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + mid);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+        } else if (len > 0) {
+            a = read_small(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        uint32_t i = len;
+        if (i > 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ g_secret[0], read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ g_secret[1],
+                            read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ g_secret[2],
+                            read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ g_secret[0], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= g_secret[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ g_secret[0] ^ len, b ^ g_secret[1]);
+}
+
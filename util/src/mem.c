@@ -7,8 +7,13 @@
 
 #include "util/File.h"
 
+#ifdef MYCC_ENABLE_MEMDEBUG
+#include "util/thread.h"
+#endif
+
 #ifdef MYCC_ENABLE_MEMDEBUG
 #undef mycc_alloc
+#undef mycc_alloc_or_null
 #undef mycc_alloc_zeroed
 #undef mycc_realloc
 #undef mycc_free
@@ -342,30 +347,30 @@ static void check_if_freed(const AllocStats* stats, uint32_t alloc_idx) {
     }
 }
 
-void* mycc_memdebug_alloc_wrapper(size_t bytes,
-                                  Str func,
-                                  Str file,
-                                  uint32_t line) {
+static void* mycc_memdebug_alloc_impl(size_t bytes,
+                                      Str func,
+                                      Str file,
+                                      uint32_t line) {
     void* alloc = mycc_alloc(bytes);
     insert_alloc(&g_alloc_stats, alloc, bytes, func, file, line);
     return alloc;
 }
 
-void* mycc_memdebug_alloc_zeroed_wrapper(size_t len,
-                                         size_t elem_size,
-                                         Str func,
-                                         Str file,
-                                         uint32_t line) {
+static void* mycc_memdebug_alloc_zeroed_impl(size_t len,
+                                             size_t elem_size,
+                                             Str func,
+                                             Str file,
+                                             uint32_t line) {
     void* alloc = mycc_alloc_zeroed(len, elem_size);
     insert_alloc(&g_alloc_stats, alloc, len * elem_size, func, file, line);
     return alloc;
 }
 
-void* mycc_memdebug_realloc_wrapper(void* alloc,
-                                    size_t bytes,
-                                    Str func,
-                                    Str file,
-                                    uint32_t line) {
+static void* mycc_memdebug_realloc_impl(void* alloc,
+                                        size_t bytes,
+                                        Str func,
+                                        Str file,
+                                        uint32_t line) {
     g_alloc_stats.num_reallocs += 1;
     if (alloc == NULL) {
         void* new_alloc = mycc_realloc(alloc, bytes);
@@ -395,10 +400,10 @@ void* mycc_memdebug_realloc_wrapper(void* alloc,
     }
 }
 
-void mycc_memdebug_free_wrapper(void* alloc,
-                                Str func,
-                                Str file,
-                                uint32_t line) {
+static void mycc_memdebug_free_impl(void* alloc,
+                                    Str func,
+                                    Str file,
+                                    uint32_t line) {
     if (alloc != NULL) {
         const uint32_t alloc_idx = find_alloc_idx(&g_alloc_stats, alloc);
         assert(g_alloc_stats.data[alloc_idx].alloc == alloc
@@ -411,12 +416,12 @@ void mycc_memdebug_free_wrapper(void* alloc,
     }
 }
 
-void mycc_memdebug_grow_alloc_wrapper(void** alloc,
-                                      uint32_t* alloc_len,
-                                      size_t elem_size,
-                                      Str func,
-                                      Str file,
-                                      uint32_t line) {
+static void mycc_memdebug_grow_alloc_impl(void** alloc,
+                                          uint32_t* alloc_len,
+                                          size_t elem_size,
+                                          Str func,
+                                          Str file,
+                                          uint32_t line) {
     g_alloc_stats.num_reallocs += 1;
     if (*alloc == NULL) {
         mycc_grow_alloc(alloc, alloc_len, elem_size);
@@ -442,4 +447,93 @@ void mycc_memdebug_grow_alloc_wrapper(void** alloc,
     }
 }
 
+// Allocations may happen from multiple threads when compiling in parallel, so
+// all accesses to the allocation stats are serialized
+static OnceFlag g_lock_once = MYCC_ONCE_FLAG_INIT;
+static Mutex g_lock;
+
+static void init_lock(void) {
+    Mutex_init(&g_lock);
+}
+
+static void lock_alloc_stats(void) {
+    mycc_call_once(&g_lock_once, init_lock);
+    Mutex_lock(&g_lock);
+}
+
+static void unlock_alloc_stats(void) {
+    Mutex_unlock(&g_lock);
+}
+
+void* mycc_memdebug_alloc_wrapper(size_t bytes,
+                                  Str func,
+                                  Str file,
+                                  uint32_t line) {
+    lock_alloc_stats();
+    void* res = mycc_memdebug_alloc_impl(bytes, func, file, line);
+    unlock_alloc_stats();
+    return res;
+}
+
+void* mycc_memdebug_alloc_or_null_wrapper(size_t bytes,
+                                          Str func,
+                                          Str file,
+                                          uint32_t line) {
+    if (bytes == 0) {
+        return NULL;
+    }
+    return mycc_memdebug_alloc_wrapper(bytes, func, file, line);
+}
+
+void* mycc_memdebug_alloc_zeroed_wrapper(size_t len,
+                                         size_t elem_size,
+                                         Str func,
+                                         Str file,
+                                         uint32_t line) {
+    lock_alloc_stats();
+    void* res = mycc_memdebug_alloc_zeroed_impl(len,
+                                                elem_size,
+                                                func,
+                                                file,
+                                                line);
+    unlock_alloc_stats();
+    return res;
+}
+
+void* mycc_memdebug_realloc_wrapper(void* alloc,
+                                    size_t bytes,
+                                    Str func,
+                                    Str file,
+                                    uint32_t line) {
+    lock_alloc_stats();
+    void* res = mycc_memdebug_realloc_impl(alloc, bytes, func, file, line);
+    unlock_alloc_stats();
+    return res;
+}
+
+void mycc_memdebug_free_wrapper(void* alloc,
+                                Str func,
+                                Str file,
+                                uint32_t line) {
+    lock_alloc_stats();
+    mycc_memdebug_free_impl(alloc, func, file, line);
+    unlock_alloc_stats();
+}
+
+void mycc_memdebug_grow_alloc_wrapper(void** alloc,
+                                      uint32_t* alloc_len,
+                                      size_t elem_size,
+                                      Str func,
+                                      Str file,
+                                      uint32_t line) {
+    lock_alloc_stats();
+    mycc_memdebug_grow_alloc_impl(alloc,
+                                  alloc_len,
+                                  elem_size,
+                                  func,
+                                  file,
+                                  line);
+    unlock_alloc_stats();
+}
+
 #endif
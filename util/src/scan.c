@@ -0,0 +1,384 @@
+#include "util/scan.h"
+
+#include <assert.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MYCC_SCAN_SSE2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define MYCC_SCAN_AVX2
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+typedef struct {
+    uint32_t (*find_char)(Str s, char c);
+    uint32_t (*find_first_of3)(Str s, char c1, char c2, char c3);
+    uint32_t (*find_comment_end)(Str s);
+    uint32_t (*find_first_of)(Str s, Str chars);
+    uint32_t (*count_char)(Str s, char c);
+} ScanFuncs;
+
+static uint32_t find_char_scalar(Str s, char c) {
+    uint32_t i = 0;
+    while (i != s.len && s.data[i] != c) {
+        ++i;
+    }
+    return i;
+}
+
+static uint32_t find_first_of3_scalar(Str s, char c1, char c2, char c3) {
+    uint32_t i = 0;
+    while (i != s.len && s.data[i] != c1 && s.data[i] != c2
+           && s.data[i] != c3) {
+        ++i;
+    }
+    return i;
+}
+
+static uint32_t find_comment_end_scalar(Str s) {
+    if (s.len < 2) {
+        return s.len;
+    }
+    for (uint32_t i = 0; i != s.len - 1; ++i) {
+        if (s.data[i] == '*' && s.data[i + 1] == '/') {
+            return i;
+        }
+    }
+    return s.len;
+}
+
+static bool is_one_of(char c, Str chars) {
+    for (uint32_t i = 0; i != chars.len; ++i) {
+        if (c == chars.data[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t find_first_of_scalar(Str s, Str chars) {
+    uint32_t i = 0;
+    while (i != s.len && !is_one_of(s.data[i], chars)) {
+        ++i;
+    }
+    return i;
+}
+
+static uint32_t count_char_scalar(Str s, char c) {
+    uint32_t res = 0;
+    for (uint32_t i = 0; i != s.len; ++i) {
+        res += s.data[i] == c;
+    }
+    return res;
+}
+
+// With SSE2 the scalar versions are only used for the tails of the vectorized
+// ones, unless a test selects them
+#if !defined(MYCC_SCAN_SSE2) || defined(MYCC_TEST_FUNCTIONALITY)
+static const ScanFuncs g_scalar_funcs = {
+    .find_char = find_char_scalar,
+    .find_first_of3 = find_first_of3_scalar,
+    .find_comment_end = find_comment_end_scalar,
+    .find_first_of = find_first_of_scalar,
+    .count_char = count_char_scalar,
+};
+#endif
+
+#ifdef MYCC_SCAN_SSE2
+
+static uint32_t first_set_bit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long res;
+    _BitScanForward(&res, mask);
+    return (uint32_t)res;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+static uint32_t count_set_bits(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    uint32_t res = 0;
+    for (; mask != 0; mask &= mask - 1) {
+        ++res;
+    }
+    return res;
+#else
+    return (uint32_t)__builtin_popcount(mask);
+#endif
+}
+
+enum {
+    SSE2_WIDTH = 16,
+    AVX2_WIDTH = 32,
+};
+
+static uint32_t find_char_sse2(Str s, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    uint32_t i = 0;
+    for (; i + SSE2_WIDTH <= s.len; i += SSE2_WIDTH) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(s.data + i));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, needle));
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_char_scalar(Str_advance(s, i), c);
+}
+
+static uint32_t find_first_of3_sse2(Str s, char c1, char c2, char c3) {
+    const __m128i n1 = _mm_set1_epi8(c1);
+    const __m128i n2 = _mm_set1_epi8(c2);
+    const __m128i n3 = _mm_set1_epi8(c3);
+    uint32_t i = 0;
+    for (; i + SSE2_WIDTH <= s.len; i += SSE2_WIDTH) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(s.data + i));
+        const __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, n1), _mm_cmpeq_epi8(v, n2)),
+            _mm_cmpeq_epi8(v, n3));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_first_of3_scalar(Str_advance(s, i), c1, c2, c3);
+}
+
+static uint32_t find_comment_end_sse2(Str s) {
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+    uint32_t i = 0;
+    // The second load reads one character further, so it needs one extra
+    for (; i + SSE2_WIDTH + 1 <= s.len; i += SSE2_WIDTH) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(s.data + i));
+        const __m128i next = _mm_loadu_si128(
+            (const __m128i*)(s.data + i + 1));
+        const __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(v, star),
+                                         _mm_cmpeq_epi8(next, slash));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_comment_end_scalar(Str_advance(s, i));
+}
+
+static uint32_t find_first_of_sse2(Str s, Str chars) {
+    __m128i needles[MYCC_FIND_FIRST_OF_MAX];
+    for (uint32_t i = 0; i != chars.len; ++i) {
+        needles[i] = _mm_set1_epi8(chars.data[i]);
+    }
+    uint32_t i = 0;
+    for (; i + SSE2_WIDTH <= s.len; i += SSE2_WIDTH) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(s.data + i));
+        __m128i eq = _mm_setzero_si128();
+        for (uint32_t j = 0; j != chars.len; ++j) {
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, needles[j]));
+        }
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_first_of_scalar(Str_advance(s, i), chars);
+}
+
+static uint32_t count_char_sse2(Str s, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    uint32_t res = 0;
+    uint32_t i = 0;
+    for (; i + SSE2_WIDTH <= s.len; i += SSE2_WIDTH) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(s.data + i));
+        res += count_set_bits(
+            (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+    }
+    return res + count_char_scalar(Str_advance(s, i), c);
+}
+
+static const ScanFuncs g_sse2_funcs = {
+    .find_char = find_char_sse2,
+    .find_first_of3 = find_first_of3_sse2,
+    .find_comment_end = find_comment_end_sse2,
+    .find_first_of = find_first_of_sse2,
+    .count_char = count_char_sse2,
+};
+
+#endif // MYCC_SCAN_SSE2
+
+#ifdef MYCC_SCAN_AVX2
+
+AVX2_FUNC static uint32_t find_char_avx2(Str s, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    uint32_t i = 0;
+    for (; i + AVX2_WIDTH <= s.len; i += AVX2_WIDTH) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(s.data + i));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, needle));
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_char_sse2(Str_advance(s, i), c);
+}
+
+AVX2_FUNC static uint32_t find_first_of3_avx2(Str s,
+                                              char c1,
+                                              char c2,
+                                              char c3) {
+    const __m256i n1 = _mm256_set1_epi8(c1);
+    const __m256i n2 = _mm256_set1_epi8(c2);
+    const __m256i n3 = _mm256_set1_epi8(c3);
+    uint32_t i = 0;
+    for (; i + AVX2_WIDTH <= s.len; i += AVX2_WIDTH) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(s.data + i));
+        const __m256i eq = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, n1),
+                            _mm256_cmpeq_epi8(v, n2)),
+            _mm256_cmpeq_epi8(v, n3));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_first_of3_sse2(Str_advance(s, i), c1, c2, c3);
+}
+
+AVX2_FUNC static uint32_t find_comment_end_avx2(Str s) {
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+    uint32_t i = 0;
+    for (; i + AVX2_WIDTH + 1 <= s.len; i += AVX2_WIDTH) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(s.data + i));
+        const __m256i next = _mm256_loadu_si256(
+            (const __m256i*)(s.data + i + 1));
+        const __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(v, star),
+                                            _mm256_cmpeq_epi8(next, slash));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_comment_end_sse2(Str_advance(s, i));
+}
+
+AVX2_FUNC static uint32_t find_first_of_avx2(Str s, Str chars) {
+    __m256i needles[MYCC_FIND_FIRST_OF_MAX];
+    for (uint32_t i = 0; i != chars.len; ++i) {
+        needles[i] = _mm256_set1_epi8(chars.data[i]);
+    }
+    uint32_t i = 0;
+    for (; i + AVX2_WIDTH <= s.len; i += AVX2_WIDTH) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(s.data + i));
+        __m256i eq = _mm256_setzero_si256();
+        for (uint32_t j = 0; j != chars.len; ++j) {
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(v, needles[j]));
+        }
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + first_set_bit(mask);
+        }
+    }
+    return i + find_first_of_sse2(Str_advance(s, i), chars);
+}
+
+AVX2_FUNC static uint32_t count_char_avx2(Str s, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    uint32_t res = 0;
+    uint32_t i = 0;
+    for (; i + AVX2_WIDTH <= s.len; i += AVX2_WIDTH) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(s.data + i));
+        res += count_set_bits(
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+    }
+    return res + count_char_sse2(Str_advance(s, i), c);
+}
+
+static const ScanFuncs g_avx2_funcs = {
+    .find_char = find_char_avx2,
+    .find_first_of3 = find_first_of3_avx2,
+    .find_comment_end = find_comment_end_avx2,
+    .find_first_of = find_first_of_avx2,
+    .count_char = count_char_avx2,
+};
+
+static bool cpu_has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif // MYCC_SCAN_AVX2
+
+// The implementation is resolved once, so every call only costs one indirect
+// call. Only the AVX2 check depends on the CPU, and it runs before main(), so
+// no thread can see g_funcs change.
+#if defined(MYCC_SCAN_AVX2)
+static const ScanFuncs* g_funcs = &g_sse2_funcs;
+
+__attribute__((constructor)) static void select_funcs(void) {
+    if (cpu_has_avx2()) {
+        g_funcs = &g_avx2_funcs;
+    }
+}
+#elif defined(MYCC_SCAN_SSE2)
+static const ScanFuncs* g_funcs = &g_sse2_funcs;
+#else
+static const ScanFuncs* g_funcs = &g_scalar_funcs;
+#endif
+
+uint32_t mycc_find_char(Str s, char c) {
+    return g_funcs->find_char(s, c);
+}
+
+uint32_t mycc_find_first_of3(Str s, char c1, char c2, char c3) {
+    return g_funcs->find_first_of3(s, c1, c2, c3);
+}
+
+uint32_t mycc_find_comment_end(Str s) {
+    return g_funcs->find_comment_end(s);
+}
+
+uint32_t mycc_find_first_of(Str s, Str chars) {
+    assert(chars.len <= MYCC_FIND_FIRST_OF_MAX);
+    return g_funcs->find_first_of(s, chars);
+}
+
+uint32_t mycc_count_char(Str s, char c) {
+    return g_funcs->count_char(s, c);
+}
+
+#ifdef MYCC_TEST_FUNCTIONALITY
+
+bool mycc_scan_set_impl(ScanImpl impl) {
+    switch (impl) {
+        case SCAN_IMPL_SCALAR:
+            g_funcs = &g_scalar_funcs;
+            return true;
+        case SCAN_IMPL_SSE2:
+#ifdef MYCC_SCAN_SSE2
+            g_funcs = &g_sse2_funcs;
+            return true;
+#else
+            return false;
+#endif
+        case SCAN_IMPL_AVX2:
+#ifdef MYCC_SCAN_AVX2
+            if (!cpu_has_avx2()) {
+                return false;
+            }
+            g_funcs = &g_avx2_funcs;
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+#endif
+
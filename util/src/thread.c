@@ -0,0 +1,89 @@
+#include "util/thread.h"
+
+#include <assert.h>
+
+#include "util/macro_util.h"
+
+#ifdef MYCC_HAS_THREADS_H
+
+void Mutex_init(Mutex* m) {
+    const int res = mtx_init(&m->_mtx, mtx_plain);
+    UNUSED(res);
+    assert(res == thrd_success);
+}
+
+void Mutex_destroy(Mutex* m) {
+    mtx_destroy(&m->_mtx);
+}
+
+void Mutex_lock(Mutex* m) {
+    const int res = mtx_lock(&m->_mtx);
+    UNUSED(res);
+    assert(res == thrd_success);
+}
+
+void Mutex_unlock(Mutex* m) {
+    const int res = mtx_unlock(&m->_mtx);
+    UNUSED(res);
+    assert(res == thrd_success);
+}
+
+bool Thread_create(Thread* t, ThreadFunc func, void* arg) {
+    return thrd_create(&t->_thrd, func, arg) == thrd_success;
+}
+
+void Thread_join(Thread* t) {
+    thrd_join(t->_thrd, NULL);
+}
+
+void mycc_call_once(OnceFlag* flag, void (*func)(void)) {
+    call_once(flag, func);
+}
+
+#else
+
+void Mutex_init(Mutex* m) {
+    const int res = pthread_mutex_init(&m->_mtx, NULL);
+    UNUSED(res);
+    assert(res == 0);
+}
+
+void Mutex_destroy(Mutex* m) {
+    pthread_mutex_destroy(&m->_mtx);
+}
+
+void Mutex_lock(Mutex* m) {
+    const int res = pthread_mutex_lock(&m->_mtx);
+    UNUSED(res);
+    assert(res == 0);
+}
+
+void Mutex_unlock(Mutex* m) {
+    const int res = pthread_mutex_unlock(&m->_mtx);
+    UNUSED(res);
+    assert(res == 0);
+}
+
+// pthreads expects a function returning void*, so the thread calls the
+// function given to Thread_create() through this
+static void* thread_start(void* arg) {
+    const Thread* t = arg;
+    t->_func(t->_arg);
+    return NULL;
+}
+
+bool Thread_create(Thread* t, ThreadFunc func, void* arg) {
+    t->_func = func;
+    t->_arg = arg;
+    return pthread_create(&t->_thrd, NULL, thread_start, t) == 0;
+}
+
+void Thread_join(Thread* t) {
+    pthread_join(t->_thrd, NULL);
+}
+
+void mycc_call_once(OnceFlag* flag, void (*func)(void)) {
+    pthread_once(flag, func);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#include "util/DirEntries.h"
+
+#include "testing/testing.h"
+#include "testing/asserts.h"
+
+TEST(read) {
+    const DirEntries entries = DirEntries_read(STR_LIT("../util/test"));
+    ASSERT(DirEntries_contains(&entries, STR_LIT("DirEntries_test.c")));
+    ASSERT(DirEntries_contains(&entries, STR_LIT("CMakeLists.txt")));
+    ASSERT(DirEntries_contains(&entries, STR_LIT("..")));
+#if defined(__unix__) && !defined(__APPLE__)
+    ASSERT(entries.is_valid);
+    ASSERT(!DirEntries_contains(&entries, STR_LIT("does_not_exist.c")));
+#else
+    // Names that only differ in case may refer to the same file here
+    ASSERT(!entries.is_valid);
+    ASSERT(DirEntries_contains(&entries, STR_LIT("direntries_test.c")));
+#endif
+    DirEntries_free(&entries);
+}
+
+TEST(read_invalid) {
+    const DirEntries entries = DirEntries_read(
+        STR_LIT("../util/test/does_not_exist"));
+    ASSERT(!entries.is_valid);
+    // Without a listing, everything has to be assumed to exist
+    ASSERT(DirEntries_contains(&entries, STR_LIT("does_not_exist.c")));
+    DirEntries_free(&entries);
+}
+
+TEST_SUITE_BEGIN(DirEntries){
+    REGISTER_TEST(read),
+    REGISTER_TEST(read_invalid),
+} TEST_SUITE_END()
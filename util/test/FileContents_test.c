@@ -0,0 +1,51 @@
+#include "util/FileContents.h"
+
+#include <stdio.h>
+
+#include "testing/testing.h"
+#include "testing/asserts.h"
+
+static void test_read_file_of_size(size_t size) {
+    const CStr filename = CSTR_LIT("file_contents_test.txt");
+    File out = File_open(filename, FILE_WRITE | FILE_BINARY);
+    ASSERT(File_valid(out));
+    for (size_t i = 0; i < size; ++i) {
+        ASSERT(File_putc((char)('a' + i % 26), out));
+    }
+    ASSERT(File_close(out));
+
+    File in = File_open(filename, FILE_READ | FILE_BINARY);
+    ASSERT(File_valid(in));
+    const FileContents contents = FileContents_read(in);
+    ASSERT_NOT_NULL(contents.data);
+    ASSERT_UINT(contents.len, size);
+    for (size_t i = 0; i < size; ++i) {
+        ASSERT_CHAR(contents.data[i], (char)('a' + i % 26));
+    }
+    ASSERT_CHAR(contents.data[size], '\0');
+    FileContents_free(&contents);
+    remove(filename.data);
+}
+
+TEST(read_empty) {
+    test_read_file_of_size(0);
+}
+
+TEST(read_small) {
+    test_read_file_of_size(100);
+}
+
+TEST(read_large) {
+    test_read_file_of_size(100 * 1000);
+}
+
+TEST(read_page_multiple) {
+    test_read_file_of_size(16 * 4096);
+}
+
+TEST_SUITE_BEGIN(FileContents) {
+    REGISTER_TEST(read_empty),
+    REGISTER_TEST(read_small),
+    REGISTER_TEST(read_large),
+    REGISTER_TEST(read_page_multiple),
+} TEST_SUITE_END()
@@ -1,5 +1,7 @@
 #include "util/IndexedStringSet.h"
 
+#include <stdio.h>
+
 #include "testing/testing.h"
 #include "testing/asserts.h"
 
@@ -10,6 +12,9 @@ TEST(insert) {
     // same index returned when we attempt to insert again
     ASSERT_UINT(idx, IndexedStringSet_find_or_insert(&set, to_insert));
     ASSERT_STR(IndexedStringSet_get(&set, idx), to_insert);
+    ASSERT_UINT(IndexedStringSet_find(&set, to_insert), idx);
+    ASSERT_UINT(IndexedStringSet_find(&set, STR_LIT("not_inserted")),
+                UINT32_MAX);
     IndexedStringSet_free(&set);
 }
 
@@ -54,7 +59,33 @@ TEST(correct_rehashing) {
     IndexedStringSet_free(&set);
 }
 
+TEST(many_strings) {
+    enum { NUM_STRINGS = 5000 };
+    IndexedStringSet set = IndexedStringSet_create(0);
+    char buf[32];
+    for (uint32_t i = 0; i < NUM_STRINGS; ++i) {
+        const int len = snprintf(buf, sizeof buf, "id_%u", i);
+        const Str str = {(uint32_t)len, buf};
+        ASSERT_UINT(IndexedStringSet_find_or_insert(&set, str), i);
+    }
+    ASSERT_UINT(IndexedStringSet_len(&set), NUM_STRINGS);
+    for (uint32_t i = 0; i < NUM_STRINGS; ++i) {
+        const int len = snprintf(buf, sizeof buf, "id_%u", i);
+        const Str str = {(uint32_t)len, buf};
+        ASSERT_UINT(IndexedStringSet_find_or_insert(&set, str), i);
+        ASSERT_STR(IndexedStringSet_get(&set, i), str);
+    }
+    ASSERT_UINT(IndexedStringSet_len(&set), NUM_STRINGS);
+    // The empty string is a valid key as well
+    const uint32_t empty_idx = IndexedStringSet_find_or_insert(&set,
+                                                               STR_LIT(""));
+    ASSERT_UINT(empty_idx, NUM_STRINGS);
+    ASSERT_UINT(IndexedStringSet_find_or_insert(&set, STR_LIT("")), empty_idx);
+    IndexedStringSet_free(&set);
+}
+
 TEST_SUITE_BEGIN(IndexedStringsSet) {
     REGISTER_TEST(insert),
     REGISTER_TEST(correct_rehashing),
+    REGISTER_TEST(many_strings),
 } TEST_SUITE_END()
@@ -0,0 +1,102 @@
+#include "util/MemArena.h"
+
+#include <string.h>
+#include <stdalign.h>
+
+#include "testing/testing.h"
+#include "testing/asserts.h"
+
+TEST(alloc) {
+    MemArena arena = MemArena_create(64);
+    uint32_t* ptrs[32];
+    for (uint32_t i = 0; i < ARR_LEN(ptrs); ++i) {
+        ptrs[i] = MemArena_alloc(&arena, sizeof *ptrs[i] * 4);
+        ASSERT_UINT((uintptr_t)ptrs[i] % alignof(max_align_t), 0);
+        for (uint32_t j = 0; j < 4; ++j) {
+            ptrs[i][j] = i * 4 + j;
+        }
+    }
+    // allocations must not overlap
+    for (uint32_t i = 0; i < ARR_LEN(ptrs); ++i) {
+        for (uint32_t j = 0; j < 4; ++j) {
+            ASSERT_UINT(ptrs[i][j], i * 4 + j);
+        }
+    }
+
+    // bigger than a single block
+    char* big = MemArena_alloc(&arena, 1000);
+    memset(big, 'a', 1000);
+    ASSERT_UINT(ptrs[ARR_LEN(ptrs) - 1][3], ARR_LEN(ptrs) * 4 - 1);
+    MemArena_free(&arena);
+}
+
+TEST(alloc_aligned) {
+    MemArena arena = MemArena_create(128);
+    for (uint32_t i = 0; i < 20; ++i) {
+        char* unaligned = MemArena_alloc_aligned(&arena, 3, 1);
+        unaligned[0] = 'a';
+        void* aligned = MemArena_alloc_aligned(&arena, 8, 64);
+        ASSERT_UINT((uintptr_t)aligned % 64, 0);
+    }
+    MemArena_free(&arena);
+}
+
+TEST(copy_str) {
+    MemArena arena = MemArena_create(0);
+    const Str str = STR_LIT("some_identifier");
+    const Str copy = MemArena_copy_str(&arena, str);
+    ASSERT(copy.data != str.data);
+    ASSERT_STR(copy, str);
+    ASSERT_CHAR(copy.data[copy.len], '\0');
+    MemArena_free(&arena);
+}
+
+TEST(reset) {
+    MemArena arena = MemArena_create(64);
+    char* first = MemArena_alloc(&arena, 16);
+    memset(first, 'x', 16);
+
+    const MemArenaMark mark = MemArena_mark(&arena);
+    char* scoped = MemArena_alloc(&arena, 16);
+    for (uint32_t i = 0; i < 10; ++i) {
+        MemArena_alloc(&arena, 48);
+    }
+    const uint32_t num_blocks = arena._len;
+    MemArena_reset(&arena, mark);
+
+    // the same memory is handed out again after a reset
+    ASSERT(MemArena_alloc(&arena, 16) == scoped);
+    for (uint32_t i = 0; i < 10; ++i) {
+        MemArena_alloc(&arena, 48);
+    }
+    ASSERT_UINT(arena._len, num_blocks);
+    for (uint32_t i = 0; i < 16; ++i) {
+        ASSERT_CHAR(first[i], 'x');
+    }
+
+    MemArena_clear(&arena);
+    ASSERT(MemArena_alloc(&arena, 16) == first);
+    MemArena_free(&arena);
+}
+
+TEST(reset_with_bigger_alloc) {
+    MemArena arena = MemArena_create(32);
+    const MemArenaMark mark = MemArena_mark(&arena);
+    MemArena_alloc(&arena, 32);
+    MemArena_alloc(&arena, 32);
+    MemArena_reset(&arena, mark);
+
+    // retained block is too small for this, so it has to be replaced
+    MemArena_alloc(&arena, 32);
+    char* big = MemArena_alloc(&arena, 256);
+    memset(big, 0, 256);
+    MemArena_free(&arena);
+}
+
+TEST_SUITE_BEGIN(MemArena) {
+    REGISTER_TEST(alloc),
+    REGISTER_TEST(alloc_aligned),
+    REGISTER_TEST(copy_str),
+    REGISTER_TEST(reset),
+    REGISTER_TEST(reset_with_bigger_alloc),
+} TEST_SUITE_END()
@@ -0,0 +1,75 @@
+#include "util/ThreadPool.h"
+
+#include <stdatomic.h>
+
+#include "testing/testing.h"
+#include "testing/asserts.h"
+
+typedef struct {
+    atomic_uint num_runs[100];
+    atomic_uint total;
+} CountCtx;
+
+static void count_task(void* ctx, uint32_t task_idx, uint32_t worker_idx) {
+    UNUSED(worker_idx);
+    CountCtx* counts = ctx;
+    atomic_fetch_add(&counts->num_runs[task_idx], 1);
+    atomic_fetch_add(&counts->total, 1);
+}
+
+static void check_all_run_once(uint32_t num_tasks, uint32_t num_workers) {
+    CountCtx ctx = {0};
+    mycc_run_tasks(num_tasks, num_workers, count_task, &ctx);
+    ASSERT_UINT(atomic_load(&ctx.total), num_tasks);
+    for (uint32_t i = 0; i < num_tasks; ++i) {
+        ASSERT_UINT(atomic_load(&ctx.num_runs[i]), 1);
+    }
+}
+
+TEST(single_worker) {
+    check_all_run_once(100, 1);
+}
+
+TEST(multiple_workers) {
+    check_all_run_once(100, 4);
+    check_all_run_once(7, 3);
+}
+
+TEST(more_workers_than_tasks) {
+    check_all_run_once(3, 8);
+    check_all_run_once(0, 8);
+}
+
+typedef struct {
+    uint32_t results[64];
+} UnevenCtx;
+
+// The first tasks take far longer than the others, so the rest of worker 0's
+// range ends up being stolen
+static void uneven_task(void* ctx, uint32_t task_idx, uint32_t worker_idx) {
+    UNUSED(worker_idx);
+    UnevenCtx* uneven = ctx;
+    uint32_t val = task_idx;
+    const uint32_t num_iters = task_idx < 8 ? 100000 : 10;
+    for (uint32_t i = 0; i < num_iters; ++i) {
+        val = val * 1664525u + 1013904223u;
+    }
+    uneven->results[task_idx] = val;
+}
+
+TEST(uneven_tasks) {
+    UnevenCtx parallel = {0};
+    mycc_run_tasks(64, 4, uneven_task, &parallel);
+    UnevenCtx serial = {0};
+    mycc_run_tasks(64, 1, uneven_task, &serial);
+    for (uint32_t i = 0; i < 64; ++i) {
+        ASSERT_UINT(parallel.results[i], serial.results[i]);
+    }
+}
+
+TEST_SUITE_BEGIN(ThreadPool) {
+    REGISTER_TEST(single_worker),
+    REGISTER_TEST(multiple_workers),
+    REGISTER_TEST(more_workers_than_tasks),
+    REGISTER_TEST(uneven_tasks),
+} TEST_SUITE_END()
@@ -0,0 +1,122 @@
+#include "util/scan.h"
+
+#include "util/macro_util.h"
+#include "util/mem.h"
+
+#include "testing/testing.h"
+#include "testing/asserts.h"
+
+enum {
+    MAX_TEST_LEN = 200,
+};
+
+static const ScanImpl g_vector_impls[] = {
+    SCAN_IMPL_SSE2,
+    SCAN_IMPL_AVX2,
+};
+
+typedef struct {
+    uint32_t find_char;
+    uint32_t find_first_of3;
+    uint32_t find_comment_end;
+    uint32_t find_first_of;
+    uint32_t count_char;
+} ScanResults;
+
+static ScanResults run_all(Str s) {
+    return (ScanResults){
+        .find_char = mycc_find_char(s, '\n'),
+        .find_first_of3 = mycc_find_first_of3(s, '"', '\\', '\n'),
+        .find_comment_end = mycc_find_comment_end(s),
+        .find_first_of = mycc_find_first_of(s, STR_LIT("#/\"'\\")),
+        .count_char = mycc_count_char(s, '\n'),
+    };
+}
+
+// Places c at every position of a string of filler characters and checks
+// that all implementations agree with the scalar one
+static void compare_impls(char filler, char c) {
+    char* buf = mycc_alloc(MAX_TEST_LEN + 1);
+    for (uint32_t len = 0; len <= MAX_TEST_LEN; len += len < 70 ? 1 : 13) {
+        for (uint32_t pos = 0; pos <= len; ++pos) {
+            for (uint32_t i = 0; i < len; ++i) {
+                buf[i] = filler;
+            }
+            if (pos < len) {
+                buf[pos] = c;
+                if (c == '*' && pos + 1 < len) {
+                    buf[pos + 1] = '/';
+                }
+            }
+            const Str s = {len, buf};
+            ASSERT(mycc_scan_set_impl(SCAN_IMPL_SCALAR));
+            const ScanResults expected = run_all(s);
+            for (size_t i = 0; i < ARR_LEN(g_vector_impls); ++i) {
+                if (!mycc_scan_set_impl(g_vector_impls[i])) {
+                    continue;
+                }
+                const ScanResults got = run_all(s);
+                ASSERT_UINT(got.find_char, expected.find_char);
+                ASSERT_UINT(got.find_first_of3, expected.find_first_of3);
+                ASSERT_UINT(got.find_comment_end, expected.find_comment_end);
+                ASSERT_UINT(got.find_first_of, expected.find_first_of);
+                ASSERT_UINT(got.count_char, expected.count_char);
+            }
+        }
+    }
+    mycc_free(buf);
+}
+
+TEST(find_char) {
+    ASSERT(mycc_scan_set_impl(SCAN_IMPL_SCALAR));
+    ASSERT_UINT(mycc_find_char(STR_LIT("abc\ndef\n"), '\n'), 3);
+    ASSERT_UINT(mycc_find_char(STR_LIT("abc"), '\n'), 3);
+    compare_impls('a', '\n');
+    compare_impls('\n', 'a');
+}
+
+TEST(find_first_of3) {
+    ASSERT(mycc_scan_set_impl(SCAN_IMPL_SCALAR));
+    ASSERT_UINT(mycc_find_first_of3(STR_LIT("abc\\\""), '"', '\\', '\n'), 3);
+    ASSERT_UINT(mycc_find_first_of3(STR_LIT("abc\""), '"', '\\', '\n'), 3);
+    ASSERT_UINT(mycc_find_first_of3(STR_LIT("abc"), '"', '\\', '\n'), 3);
+    compare_impls('x', '"');
+    compare_impls('x', '\\');
+    compare_impls('y', '\n');
+}
+
+TEST(find_comment_end) {
+    ASSERT(mycc_scan_set_impl(SCAN_IMPL_SCALAR));
+    ASSERT_UINT(mycc_find_comment_end(STR_LIT("abc */")), 4);
+    ASSERT_UINT(mycc_find_comment_end(STR_LIT("a*b/ * /*")), 9);
+    ASSERT_UINT(mycc_find_comment_end(STR_LIT("**/")), 1);
+    compare_impls('x', '*');
+    compare_impls('*', 'x');
+    compare_impls('/', '*');
+}
+
+TEST(find_first_of) {
+    ASSERT(mycc_scan_set_impl(SCAN_IMPL_SCALAR));
+    ASSERT_UINT(mycc_find_first_of(STR_LIT("abc/'#"), STR_LIT("#/\"'\\")), 3);
+    ASSERT_UINT(mycc_find_first_of(STR_LIT("abc"), STR_LIT("#/\"'\\")), 3);
+    ASSERT_UINT(mycc_find_first_of(STR_LIT("abc"), STR_LIT("")), 3);
+    compare_impls('x', '#');
+    compare_impls('x', '\'');
+    compare_impls('\n', '/');
+}
+
+TEST(count_char) {
+    ASSERT(mycc_scan_set_impl(SCAN_IMPL_SCALAR));
+    ASSERT_UINT(mycc_count_char(STR_LIT("a\nb\n\nc"), '\n'), 3);
+    ASSERT_UINT(mycc_count_char(STR_LIT("abc"), '\n'), 0);
+    compare_impls('\n', 'x');
+    compare_impls('x', '\n');
+}
+
+TEST_SUITE_BEGIN(scan) {
+    REGISTER_TEST(find_char),
+    REGISTER_TEST(find_first_of3),
+    REGISTER_TEST(find_comment_end),
+    REGISTER_TEST(find_first_of),
+    REGISTER_TEST(count_char),
+} TEST_SUITE_END()